@@ -95,12 +95,33 @@ void SocketItem::socketRxData()
 
 void SocketItem::socketTxData(QByteArray data)
 {
-    this->socket->write(data);
-    this->socket->waitForBytesWritten(100);
+    this->txQueue->send(data);
     return;
 
 }
 
+/**
+ * @brief txFlush
+ *
+ * The frames are sent to the clients through non blocking queues (see socketTxQueue).
+ * This is the only method blocking the caller, waiting for the pending data of
+ * all the connected clients to be written.
+ *
+ * @param timeout the maximum waiting time in ms for every client
+ *
+ * @return
+ * - True: all the pending data have been written;
+ * - false: some data are still pending.
+ */
+bool applicationInterface::txFlush(long timeout)
+{
+    bool result = true;
+    for(int i=0; i< socketList.size(); i++){
+        if(!socketList[i]->txQueue->flush(timeout)) result = false;
+    }
+    return result;
+}
+
 
 /**
  * @brief Start
@@ -171,6 +192,7 @@ void applicationInterface::incomingConnection(qintptr socketDescriptor)
 
     // Add the Client socket to the list of the Connected socket
     item->socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+    item->txQueue = new socketTxQueue(item->socket);
     socketList.append(item);
 
 
@@ -184,6 +206,9 @@ void applicationInterface::incomingConnection(qintptr socketDescriptor)
     connect(item,SIGNAL(itemDisconnected(ushort )),this, SLOT(disconnected(ushort )),Qt::UniqueConnection);
     connect(item->socket,SIGNAL(errorOccurred(QAbstractSocket::SocketError)),item,SLOT(socketError(QAbstractSocket::SocketError)),Qt::UniqueConnection);
 
+    connect(item->txQueue,SIGNAL(backpressure(bool)),item, SLOT(txBackpressure(bool)),Qt::UniqueConnection);
+    connect(item,SIGNAL(itemBackpressure(ushort, bool)),this, SIGNAL(clientBackpressure(ushort, bool)),Qt::UniqueConnection);
+
     // The client is assigned to an unique ID identifier
     item->id = this->idseq++;
 
@@ -246,8 +271,7 @@ void applicationInterface::sendAck(ushort id,   ushort seq,  QString command, ui
     // Sends only to the socket Id requesting the command
     for(int i=0; i< socketList.size(); i++){
         if(socketList[i]->id == id){
-            socketList[i]->socket->write(buffer);
-            socketList[i]->socket->waitForBytesWritten(100);
+            socketList[i]->txQueue->send(buffer);
             return;
         }
     }
@@ -290,8 +314,7 @@ void applicationInterface::sendEvent(QString Event, QList<QString>* params){
 
     // Sends broadcast to ALL clients
     for(int i=0; i< socketList.size(); i++){
-        socketList[i]->socket->write(buffer);
-        socketList[i]->socket->waitForBytesWritten(100);
+        socketList[i]->txQueue->send(buffer);
     }
 }
 
@@ -57,6 +57,7 @@
 #include <QTcpSocket>
 #include <QHostAddress>
 #include <QNetworkInterface>
+#include "sockettxqueue.h"
 
 
 /**
@@ -78,6 +79,7 @@ public:
 signals:
     void itemDisconnected(ushort id); //!< Signal to inform the system about the communication status.
     void receivedCommandSgn(ushort id, QByteArray data); //!< For every decoded command received the server sends this signal to the Application.
+    void itemBackpressure(ushort id, bool congested); //!< Signal to inform the system about the tx queue congestion.
 
 
 public slots:
@@ -85,9 +87,11 @@ public slots:
     void socketError(QAbstractSocket::SocketError error); //!< Error callback received from the Library
     void socketRxData(); //!< Data received callback received from the Socket Library
     void socketTxData(QByteArray);//!< Data to be sent to the Socket, received from the Application thread.
+    void txBackpressure(bool congested){emit itemBackpressure(this->id, congested);} //!< Tx queue backpressure callback
 
 public:
     QTcpSocket* socket; //!< Socket pointer
+    socketTxQueue* txQueue; //!< Non blocking transmission queue of the socket
     ushort id;  //!< Unique ID of the Connected Client
 };
 
@@ -118,12 +122,14 @@ public:
 
     static const long _DEFAULT_TX_TIMEOUT = 5000;    //!< Default timeout in ms for tx data
     bool Start(void); /// Starts the Server thread
+    bool txFlush(long timeout = applicationInterface::_DEFAULT_TX_TIMEOUT); //!< Synchronous flush of the pending tx data of all the clients
 
 
     virtual uint handleReceivedCommand(QList<QString>* frame, QList<QString>* answer); //!< The Subclass shall implement its own handler for the received commands
 
 signals:
     void txFrame(QByteArray data); /// This signal is Queued connected with the transmitting thread
+    void clientBackpressure(ushort id, bool congested); //!< Emitted when the tx queue of a client crosses the high-water mark
 
 public slots:
     void receivedCommandSlot(ushort id, QByteArray data); /// This is the slot handling the EVENTs from Gantry
@@ -21,6 +21,7 @@ masterInterface::masterInterface(QString debugName, QString program, QString pro
     serverport = PORT;
     connectionStatus=false;
     socket=0;
+    txQueue=0;
     boardInitialized = false;
     board_revision_is_valid = false;;
     revision_is_received = false;
@@ -88,10 +89,29 @@ void masterInterface::Start(void)
     connect(socket,SIGNAL(readyRead()), this,SLOT(socketRxData()),Qt::UniqueConnection);
     connect(socket,SIGNAL(disconnected()),this,SLOT(socketDisconnected()),Qt::UniqueConnection);
 
+    // Non blocking transmission queue
+    txQueue = new socketTxQueue(socket);
+
     socket->connectToHost(serverip, serverport);
     return ;
 }
 
+/**
+ * This function waits for all the pending commands to be written.
+ *
+ * The masterInterface::txCommand() never blocks: this is the
+ * only blocking transmission method.
+ *
+ * @param timeout the maximum waiting time in ms
+ * @return true if all the pending data have been written
+ */
+bool masterInterface::txFlush(int timeout)
+{
+    if(!socket) return false;
+    if(!connectionStatus) return false;
+    return txQueue->flush(timeout);
+}
+
 /**
  * This is the TcpIp socket callback when the Ethernet connection has been established.
  *
@@ -106,6 +126,7 @@ void masterInterface::socketConnected()
     revision_is_received = false;
     revision_is_valid = false;
     socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+    txQueue->clear();
     handleServerConnections(connectionStatus);
 
 }
@@ -295,8 +316,7 @@ void masterInterface::txCommand(QString command, QList<QString>* params)
     rxack = false;
 
 
-    socket->write(buffer);
-    socket->waitForBytesWritten(100);
+    txQueue->send(buffer);
 
 
 }
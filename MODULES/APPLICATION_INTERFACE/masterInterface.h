@@ -10,6 +10,7 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QProcess>
+#include "sockettxqueue.h"
 
 /**
  * @brief The masterInterface class definition
@@ -54,6 +55,7 @@ public:
 
 
     void Start(void); //!< Starts the ethernet connection with the target process
+    bool txFlush(int timeout); //!< Synchronous flush of the pending tx commands
     bool startDriver(void); //!< Starts the target process
     void stopDriver(void); //!< Stops the target process
 
@@ -157,6 +159,7 @@ private:
     QHostAddress serverip;      // Addrees of the remote server
     quint16      serverport;    // Port of the remote server
     QTcpSocket*  socket;
+    socketTxQueue* txQueue;     //!< Non blocking transmission queue
     bool connectionStatus;
     bool connectionAttempt;     // E' in corso un tentativo di connessione
 
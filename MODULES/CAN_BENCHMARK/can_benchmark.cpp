@@ -0,0 +1,551 @@
+#include "application.h"
+#include "can_benchmark.h"
+#include "can_simulator.h"
+#include "can_simulator_device.h"
+#include <QFile>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <algorithm>
+
+
+/**
+ * This is the class constructor.
+ *
+ * @param
+ * - devid: this is the simulated Device ID;
+ * - ip_driver: this is the simulator address;
+ * - port_driver: this is the simulator port;
+ */
+canBenchmarkDevice::canBenchmarkDevice(uchar devid, QString ip_driver, uint port_driver):canDeviceProtocol(devid, ip_driver, port_driver)
+{
+    this->devid = devid;
+    mode = BENCHMARK_SINGLE;
+    running = false;
+    transactions = 0;
+    window = 1;
+    issued = 0;
+    completed = 0;
+    failures = 0;
+    single_time = -1;
+    setDeviceRegisterMap<canBenchmarkRegisterMap>();
+
+    connect(this, SIGNAL(deviceAccessCompleted(uchar, uchar, bool)), this, SLOT(singleCompleted(uchar, uchar, bool)), Qt::UniqueConnection);
+    connect(this, SIGNAL(deviceRequestCompleted(uint, uchar, uchar, bool)), this, SLOT(pipelinedCompleted(uint, uchar, uchar, bool)), Qt::UniqueConnection);
+}
+
+/**
+ * This function starts the benchmark of the Device.
+ *
+ * @param
+ * - mode: this is the register access mode;
+ * - transactions: this is the number of transactions to be executed;
+ * - window: this is the number of pipelined transactions waiting for the answer;
+ *
+ * @return true if the benchmark is started
+ */
+bool canBenchmarkDevice::start(BENCHMARK_MODE_t mode, int transactions, int window)
+{
+    if(running) return false;
+    if(transactions < 1) return false;
+
+    if(window < 1) window = 1;
+    if(window > CAN_PIPELINE_MAX_WINDOW) window = CAN_PIPELINE_MAX_WINDOW;
+
+    this->mode = mode;
+    this->transactions = transactions;
+    this->window = (mode == BENCHMARK_PIPELINED) ? window : 1;
+    issued = 0;
+    completed = 0;
+    failures = 0;
+    single_time = -1;
+    pipelinedTimes.clear();
+    latencies.clear();
+    latencies.reserve(transactions);
+
+    if(mode == BENCHMARK_PIPELINED) setDevicePipelineWindow(this->window);
+
+    running = true;
+    clock.start();
+    issue();
+    return true;
+}
+
+/**
+ * This function stops the benchmark:
+ * the answers of the pending transactions are ignored.
+ */
+void canBenchmarkDevice::stop(void)
+{
+    running = false;
+    pipelinedTimes.clear();
+}
+
+/**
+ * This function sends the transactions allowed by the access mode.
+ */
+void canBenchmarkDevice::issue(void)
+{
+    if(mode == BENCHMARK_SINGLE){
+        if(issued >= transactions) return;
+
+        single_time = clock.nsecsElapsed();
+        if(!deviceAccessRegister(canDeviceProtocolFrame::READ_STATUS, canBenchmarkRegisterMap::LOOP::idx)){
+            // A previous transaction is still pending: retry at its completion
+            single_time = -1;
+            return;
+        }
+        issued++;
+        return;
+    }
+
+    while((issued < transactions) && (pipelinedTimes.size() < window)){
+        qint64 sent = clock.nsecsElapsed();
+        uint request = deviceQueueRegister(canDeviceProtocolFrame::READ_STATUS, canBenchmarkRegisterMap::LOOP::idx);
+        if(!request) return;
+
+        pipelinedTimes.insert(request, sent);
+        issued++;
+    }
+}
+
+/**
+ * This function records the completion of a transaction
+ * and sends the next transactions.
+ *
+ * @param
+ * - sent: this is the sending time of the transaction in ns;
+ * - ok: the transaction is successfully completed;
+ */
+void canBenchmarkDevice::complete(qint64 sent, bool ok)
+{
+    if(ok) latencies.append(clock.nsecsElapsed() - sent);
+    else failures++;
+    completed++;
+
+    if(completed >= transactions){
+        running = false;
+        emit benchmarkCompleted(devid);
+        return;
+    }
+
+    issue();
+}
+
+/**
+ * This is the completion handler of the deviceAccessRegister() transactions.
+ */
+void canBenchmarkDevice::singleCompleted(uchar frame_type, uchar idx, bool ok)
+{
+    Q_UNUSED(frame_type);
+    Q_UNUSED(idx);
+
+    if((!running) || (mode != BENCHMARK_SINGLE)) return;
+
+    // Completion of a transaction of a previous benchmark
+    if(single_time < 0){
+        issue();
+        return;
+    }
+
+    qint64 sent = single_time;
+    single_time = -1;
+    complete(sent, ok);
+}
+
+/**
+ * This is the completion handler of the pipelined transactions.
+ */
+void canBenchmarkDevice::pipelinedCompleted(uint request, uchar frame_type, uchar idx, bool ok)
+{
+    Q_UNUSED(frame_type);
+    Q_UNUSED(idx);
+
+    if((!running) || (mode != BENCHMARK_PIPELINED)) return;
+    if(!pipelinedTimes.contains(request)) return;
+
+    complete(pipelinedTimes.take(request), ok);
+}
+
+
+/**
+ * This is the class constructor.
+ *
+ * @param parent the parent object
+ */
+canBenchmark::canBenchmark(QObject* parent):QObject(parent)
+{
+    transactions = CAN_BENCHMARK_DEFAULT_TRANSACTIONS;
+    window = CAN_BENCHMARK_DEFAULT_WINDOW;
+    deviceCounts << 1 << 2 << 4 << 8 << 16 << 32 << CAN_BENCHMARK_MAX_DEVICES;
+    ascii_enabled = true;
+    binary_enabled = true;
+    latency_min = 0;
+    latency_max = 0;
+
+    asciiServer = nullptr;
+    binaryServer = nullptr;
+    running = false;
+    failed = false;
+    current = -1;
+    pending_devices = 0;
+
+    scenarioTmo.setSingleShot(true);
+    connect(&connectionTmo, SIGNAL(timeout()), this, SLOT(connectionEvent()), Qt::UniqueConnection);
+    connect(&scenarioTmo, SIGNAL(timeout()), this, SLOT(scenarioTmoEvent()), Qt::UniqueConnection);
+}
+
+/**
+ * @brief This function sets the number of transactions executed by every Device of a scenario
+ */
+void canBenchmark::setTransactions(int transactions)
+{
+    if(transactions < 1) transactions = 1;
+    this->transactions = transactions;
+}
+
+/**
+ * @brief This function sets the number of pipelined transactions waiting for the answer
+ *
+ * The window is limited to canDeviceProtocol::CAN_PIPELINE_MAX_WINDOW.
+ */
+void canBenchmark::setWindow(int window)
+{
+    if(window < 1) window = 1;
+    if(window > canDeviceProtocol::CAN_PIPELINE_MAX_WINDOW) window = canDeviceProtocol::CAN_PIPELINE_MAX_WINDOW;
+    this->window = window;
+}
+
+/**
+ * @brief This function sets the numbers of simulated Devices of the scenarios
+ *
+ * Every count is limited from 1 to canBenchmark::CAN_BENCHMARK_MAX_DEVICES.
+ */
+void canBenchmark::setDeviceCounts(QList<int> counts)
+{
+    deviceCounts.clear();
+    for(int i=0; i<counts.size(); i++){
+        int count = counts.at(i);
+        if(count < 1) count = 1;
+        if(count > CAN_BENCHMARK_MAX_DEVICES) count = CAN_BENCHMARK_MAX_DEVICES;
+        deviceCounts.append(count);
+    }
+}
+
+/**
+ * @brief This function selects the tested framings
+ */
+void canBenchmark::setFraming(bool ascii, bool binary)
+{
+    ascii_enabled = ascii;
+    binary_enabled = binary;
+}
+
+/**
+ * @brief This function sets the latency added by the simulators (0 by default)
+ */
+void canBenchmark::setSimulatorLatency(int min_ms, int max_ms)
+{
+    latency_min = min_ms;
+    latency_max = max_ms;
+    if(asciiServer) asciiServer->setLatency(min_ms, max_ms);
+    if(binaryServer) binaryServer->setLatency(min_ms, max_ms);
+}
+
+/**
+ * @brief This function starts the benchmark
+ *
+ * The simulators and the Device clients are created the first time,
+ * then all the scenarios are executed in sequence.
+ *
+ * The canBenchmark::benchmarkCompleted() signal is emitted at the end.
+ *
+ * @return true if the benchmark is started
+ */
+bool canBenchmark::start(void)
+{
+    if(running) return false;
+    if(!deviceCounts.size()) return false;
+    if((!ascii_enabled) && (!binary_enabled)) return false;
+
+    // Scenarios
+    int max_devices = 0;
+    scenarios.clear();
+    for(int framing=0; framing<2; framing++){
+        if((framing == 0) && (!ascii_enabled)) continue;
+        if((framing == 1) && (!binary_enabled)) continue;
+
+        for(int pipelined=0; pipelined<2; pipelined++){
+            for(int i=0; i<deviceCounts.size(); i++){
+                SCENARIO_t scenario;
+                scenario.binary = (framing == 1);
+                scenario.pipelined = (pipelined == 1);
+                scenario.devices = deviceCounts.at(i);
+                scenarios.append(scenario);
+                if(scenario.devices > max_devices) max_devices = scenario.devices;
+            }
+        }
+    }
+
+    // Simulators
+    if(!asciiServer){
+        asciiServer = new canSimulatorServer(QHostAddress(QHostAddress::LocalHost), CAN_BENCHMARK_BASE_PORT);
+        asciiServer->setParent(this);
+        asciiServer->setBinaryFraming(false);
+        asciiServer->setLatency(latency_min, latency_max);
+        if(!asciiServer->Start()) return false;
+    }
+
+    if(!binaryServer){
+        binaryServer = new canSimulatorServer(QHostAddress(QHostAddress::LocalHost), CAN_BENCHMARK_BASE_PORT + 1);
+        binaryServer->setParent(this);
+        binaryServer->setLatency(latency_min, latency_max);
+        if(!binaryServer->Start()) return false;
+    }
+
+    // Simulated Devices and the related clients
+    while(asciiDevices.size() < max_devices){
+        uchar devid = asciiDevices.size() + 1;
+        asciiServer->addDevice(new canSimulatorDevice(devid, 1, 0, 0));
+        binaryServer->addDevice(new canSimulatorDevice(devid, 1, 0, 0));
+
+        canBenchmarkDevice* device = new canBenchmarkDevice(devid, "127.0.0.1", CAN_BENCHMARK_BASE_PORT);
+        device->setParent(this);
+        connect(device, SIGNAL(benchmarkCompleted(uchar)), this, SLOT(deviceCompleted(uchar)), Qt::UniqueConnection);
+        asciiDevices.append(device);
+
+        device = new canBenchmarkDevice(devid, "127.0.0.1", CAN_BENCHMARK_BASE_PORT + 1);
+        device->setParent(this);
+        connect(device, SIGNAL(benchmarkCompleted(uchar)), this, SLOT(deviceCompleted(uchar)), Qt::UniqueConnection);
+        binaryDevices.append(device);
+    }
+
+    running = true;
+    failed = false;
+    current = -1;
+    results.clear();
+
+    // Waits for all the Device channels
+    clock.start();
+    connectionTmo.start(50);
+    return true;
+}
+
+/**
+ * This is the polling event of the Device channels.
+ *
+ * When all the channels are open, the scenarios start after the
+ * framing negotiation time.
+ */
+void canBenchmark::connectionEvent(void)
+{
+    bool ready = true;
+    for(int i=0; i<asciiDevices.size(); i++){
+        if(!asciiDevices.at(i)->isReady()) ready = false;
+        if(!binaryDevices.at(i)->isReady()) ready = false;
+    }
+
+    if(!ready){
+        if(clock.elapsed() > CAN_BENCHMARK_CONNECTION_TMO){
+            connectionTmo.stop();
+            finish(false);
+        }
+        return;
+    }
+
+    connectionTmo.stop();
+    QTimer::singleShot(CAN_BENCHMARK_SETTLE_TIME, this, SLOT(nextScenario()));
+}
+
+/**
+ * This function returns the Device clients of the executing scenario framing.
+ */
+QList<canBenchmarkDevice*>* canBenchmark::scenarioDevices(void)
+{
+    if(scenarios.at(current).binary) return &binaryDevices;
+    return &asciiDevices;
+}
+
+/**
+ * This function starts the next scenario.
+ */
+void canBenchmark::nextScenario(void)
+{
+    if(!running) return;
+
+    current++;
+    if(current >= scenarios.size()){
+        finish(!failed);
+        return;
+    }
+
+    const SCENARIO_t* scenario = &scenarios.at(current);
+    QList<canBenchmarkDevice*>* devices = scenarioDevices();
+    canBenchmarkDevice::BENCHMARK_MODE_t mode = (scenario->pipelined) ? canBenchmarkDevice::BENCHMARK_PIPELINED : canBenchmarkDevice::BENCHMARK_SINGLE;
+
+    pending_devices = scenario->devices;
+    scenarioTmo.start(CAN_BENCHMARK_SCENARIO_TMO);
+    clock.start();
+
+    for(int i=0; i<scenario->devices; i++){
+        devices->at(i)->start(mode, transactions, window);
+    }
+}
+
+/**
+ * This is the completion handler of the Device clients.
+ */
+void canBenchmark::deviceCompleted(uchar devid)
+{
+    if(!running) return;
+    if(pending_devices <= 0) return;
+
+    pending_devices--;
+    if(!pending_devices) closeScenario(true);
+}
+
+/**
+ * This is the scenario deadline event:
+ * the running Devices are stopped and the scenario is closed with error.
+ */
+void canBenchmark::scenarioTmoEvent(void)
+{
+    if(!running) return;
+
+    QList<canBenchmarkDevice*>* devices = scenarioDevices();
+    for(int i=0; i<devices->size(); i++){
+        if(devices->at(i)->isRunning()) devices->at(i)->stop();
+    }
+
+    pending_devices = 0;
+    closeScenario(false);
+}
+
+/**
+ * This function returns a percentile of the sorted latencies in us.
+ *
+ * @param
+ * - sorted: this is the list of the latencies in ns, sorted in ascending order;
+ * - p: this is the percentile, from 0 to 1;
+ */
+double canBenchmark::percentile(const QVector<qint64>& sorted, double p)
+{
+    if(!sorted.size()) return 0;
+
+    int i = (int) (p * sorted.size() + 0.999999) - 1;
+    if(i < 0) i = 0;
+    if(i >= sorted.size()) i = sorted.size() - 1;
+    return (double) sorted.at(i) / 1000.0;
+}
+
+/**
+ * This function collects the results of the executing scenario
+ * and schedules the next one.
+ *
+ * @param ok false if the scenario is expired
+ */
+void canBenchmark::closeScenario(bool ok)
+{
+    scenarioTmo.stop();
+
+    const SCENARIO_t* scenario = &scenarios.at(current);
+    QList<canBenchmarkDevice*>* devices = scenarioDevices();
+    QVector<qint64> latencies;
+    BENCHMARK_RESULT_t result;
+
+    result.binary = scenario->binary;
+    result.pipelined = scenario->pipelined;
+    result.devices = scenario->devices;
+    result.window = (scenario->pipelined) ? window : 1;
+    result.failures = 0;
+    result.elapsed = (double) clock.nsecsElapsed() / 1000000.0;
+
+    for(int i=0; i<scenario->devices; i++){
+        latencies.append(devices->at(i)->getLatencies());
+        result.failures += devices->at(i)->getFailures();
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    result.transactions = latencies.size();
+    result.fps = (result.elapsed > 0) ? (result.transactions * 1000.0 / result.elapsed) : 0;
+    result.p50 = percentile(latencies, 0.5);
+    result.p99 = percentile(latencies, 0.99);
+    result.p999 = percentile(latencies, 0.999);
+    result.max = percentile(latencies, 1);
+    results.append(result);
+
+    if((!ok) || (result.failures)) failed = true;
+    QTimer::singleShot(0, this, SLOT(nextScenario()));
+}
+
+/**
+ * This function terminates the benchmark
+ * and emits the canBenchmark::benchmarkCompleted() signal.
+ */
+void canBenchmark::finish(bool ok)
+{
+    running = false;
+    scenarioTmo.stop();
+    emit benchmarkCompleted(ok, getJson());
+}
+
+/**
+ * @brief This function returns the results in JSON format
+ *
+ * See the canBenchmarkModule for the format description.
+ *
+ * @return the JSON document
+ */
+QByteArray canBenchmark::getJson(void)
+{
+    QJsonObject document;
+    QJsonArray items;
+
+    document.insert("benchmark", "can_roundtrip");
+    document.insert("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    document.insert("transactions", transactions);
+    document.insert("window", window);
+
+    for(int i=0; i<results.size(); i++){
+        const BENCHMARK_RESULT_t* result = &results.at(i);
+        QJsonObject item;
+        QJsonObject latency;
+
+        latency.insert("p50", result->p50);
+        latency.insert("p99", result->p99);
+        latency.insert("p999", result->p999);
+        latency.insert("max", result->max);
+
+        item.insert("framing", (result->binary) ? "binary" : "ascii");
+        item.insert("mode", (result->pipelined) ? "pipelined" : "single");
+        item.insert("devices", result->devices);
+        item.insert("window", result->window);
+        item.insert("transactions", result->transactions);
+        item.insert("failures", result->failures);
+        item.insert("elapsed_ms", result->elapsed);
+        item.insert("fps", result->fps);
+        item.insert("latency_us", latency);
+        items.append(item);
+    }
+
+    document.insert("results", items);
+    return QJsonDocument(document).toJson(QJsonDocument::Indented);
+}
+
+/**
+ * @brief This function writes the results to a JSON file
+ *
+ * @param filename this is the destination file
+ * @return true if the file has been written
+ */
+bool canBenchmark::writeJson(QString filename)
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    QByteArray json = getJson();
+    bool ok = (file.write(json) == json.size());
+    file.close();
+    return ok;
+}
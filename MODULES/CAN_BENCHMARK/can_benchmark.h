@@ -0,0 +1,284 @@
+#ifndef CAN_BENCHMARK_H
+#define CAN_BENCHMARK_H
+
+/*!
+ * \defgroup  canBenchmarkModule Can Round-Trip Benchmark Library Module.
+ *
+ * This Library Module implements the end-to-end benchmark of the CAN client path.
+ *
+ * # MODULE OVERVIEW
+ *
+ * The benchmark measures the round-trip latency of the
+ * canDeviceProtocol register access, from the request to the completion,
+ * through the whole client path:
+ * canDeviceProtocol -> canClient -> TcpIp -> Can Application Driver -> Device and back.
+ *
+ * The Can Application Driver and the Devices are replaced by two local
+ * simulators (see canSimulatorModule) listening on the loopback interface:
+ * - the first simulator (canBenchmark::CAN_BENCHMARK_BASE_PORT) refuses the binary framing,
+ *   so the clients keep the ascii format;
+ * - the second simulator (canBenchmark::CAN_BENCHMARK_BASE_PORT + 1) accepts the binary framing.
+ *
+ * Every simulated Device is driven by a canBenchmarkDevice, a canDeviceProtocol subclass
+ * reading a STATUS register in a closed loop.
+ *
+ * # SCENARIOS
+ *
+ * The benchmark runs all the combinations of:
+ * - framing: ascii and binary;
+ * - access mode:
+ *   - single: canDeviceProtocol::deviceAccessRegister(), one transaction at a time;
+ *   - pipelined: canDeviceProtocol::deviceQueueRegister(), with a given number
+ *     of transactions waiting for the answer (see canBenchmark::setWindow());
+ * - number of simulated Devices: by default 1, 2, 4, 8, 16, 32 and 63
+ *   (the Device ID is a 6 bit code: 63 is the maximum number of Devices).
+ *
+ * All the Devices of a scenario run at the same time, sharing the client connection.
+ *
+ * For every scenario the benchmark reports:
+ * - the number of completed and failed transactions;
+ * - the throughput in frames (transactions) per second;
+ * - the p50, p99, p999 and max round-trip latency in us.
+ *
+ * # RESULTS
+ *
+ * The results are provided in JSON format, to be stored and compared between releases:
+ *
+ * \verbatim
+    {
+        "benchmark": "can_roundtrip",
+        "date": "2026-10-16T10:00:00",
+        "transactions": 1000,
+        "window": 8,
+        "results": [
+            {
+                "framing": "binary",
+                "mode": "pipelined",
+                "devices": 4,
+                "window": 8,
+                "transactions": 4000,
+                "failures": 0,
+                "elapsed_ms": 412.5,
+                "fps": 9696.9,
+                "latency_us": { "p50": 310.2, "p99": 902.7, "p999": 1510.0, "max": 1822.3 }
+            }
+        ]
+    }
+   \endverbatim
+ *
+ * # USAGE
+ *
+ * \verbatim
+    int main(int argc, char *argv[])
+    {
+        QCoreApplication a(argc, argv);
+
+        canBenchmark* benchmark = new canBenchmark();
+        benchmark->setTransactions(2000);
+        QObject::connect(benchmark, &canBenchmark::benchmarkCompleted, [&](bool ok, QByteArray json){
+            benchmark->writeJson("can_benchmark.json");
+            a.exit((ok) ? 0 : 1);
+        });
+        benchmark->start();
+
+        return a.exec();
+    }
+   \endverbatim
+ *
+ * # FRAME CODEC MICROBENCHMARK
+ *
+ * The canCodecBenchmark measures the encoding and decoding throughput of the
+ * protocol frames (see canDeviceProtocolFrame::CAN_FRAME_t) without any connection:
+ *
+ * \verbatim
+    QList<canCodecBenchmark::CODEC_RESULT_t> results = canCodecBenchmark::run(10000000);
+    qDebug().noquote() << canCodecBenchmark::getJson(10000000, results);
+   \endverbatim
+ *
+ * # DEPENDENCES
+ *
+ * This module requires the use of the:
+ *
+ * + canSimulatorModule
+ * + canDeviceModule
+ * + canClientModule
+ *
+ * \ingroup libraryModules
+ */
+
+#include <QtCore>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "can_device_protocol.h"
+#include "can_device_register_map.h"
+
+class canSimulatorServer;
+
+/**
+ * @brief This is the register map of the simulated benchmark Device
+ *
+ * \ingroup canBenchmarkModule
+ */
+struct canBenchmarkRegisterMap: public canDeviceRegisterMap<1, 0, 0>
+{
+    typedef status<0> LOOP; //!< STATUS register read in the closed loop
+};
+
+/**
+ * @brief This class implements a benchmark client of a simulated Device
+ *
+ * The class reads the STATUS register 0 of the Device in a closed loop
+ * and collects the round-trip latency of every transaction.
+ *
+ * \ingroup canBenchmarkModule
+ */
+class canBenchmarkDevice: public canDeviceProtocol
+{
+    Q_OBJECT
+
+public:
+    explicit canBenchmarkDevice(uchar devid, QString ip_driver, uint port_driver);
+    ~canBenchmarkDevice(){};
+
+    /**
+     *  This is the register access mode
+     */
+    typedef enum{
+        BENCHMARK_SINGLE = 0,   //!< One deviceAccessRegister() transaction at a time
+        BENCHMARK_PIPELINED,    //!< deviceQueueRegister() transactions, up to the window
+    }BENCHMARK_MODE_t;
+
+    bool start(BENCHMARK_MODE_t mode, int transactions, int window);
+    void stop(void);
+
+    _inline bool isReady(void) {return isCanConnected();}       //!< Test if the Device channel is open
+    _inline bool isRunning(void) {return running;}               //!< Test if the benchmark is running
+    _inline const QVector<qint64>& getLatencies(void) {return latencies;} //!< Returns the latency of the completed transactions in ns
+    _inline int getFailures(void) {return failures;}             //!< Returns the number of failed transactions
+
+signals:
+    void benchmarkCompleted(uchar devid); //!< Emitted when all the transactions are completed
+
+private slots:
+    void singleCompleted(uchar frame_type, uchar idx, bool ok);
+    void pipelinedCompleted(uint request, uchar frame_type, uchar idx, bool ok);
+
+private:
+    uchar   devid;          //!< Device ID
+    BENCHMARK_MODE_t mode;  //!< Access mode
+    bool    running;        //!< The benchmark is running
+    int     transactions;   //!< Number of transactions to be executed
+    int     window;         //!< Number of pipelined transactions waiting for the answer
+    int     issued;         //!< Number of sent transactions
+    int     completed;      //!< Number of completed transactions
+    int     failures;       //!< Number of failed transactions
+    QElapsedTimer clock;    //!< Latency time base
+    qint64  single_time;    //!< Sending time of the single transaction
+    QMap<uint, qint64> pipelinedTimes; //!< Sending time of the pipelined transactions
+    QVector<qint64> latencies; //!< Latency of the completed transactions in ns
+
+    void issue(void);
+    void complete(qint64 sent, bool ok);
+};
+
+/**
+ * @brief This class implements the round-trip latency benchmark
+ *
+ * \ingroup canBenchmarkModule
+ */
+class canBenchmark: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit canBenchmark(QObject* parent = nullptr);
+    ~canBenchmark(){};
+
+    static const int CAN_BENCHMARK_BASE_PORT = 10101;           //!< Port of the ascii simulator (binary simulator = +1)
+    static const int CAN_BENCHMARK_MAX_DEVICES = 63;            //!< Maximum number of simulated Devices
+    static const int CAN_BENCHMARK_DEFAULT_TRANSACTIONS = 1000; //!< Default number of transactions per Device
+    static const int CAN_BENCHMARK_DEFAULT_WINDOW = 8;          //!< Default pipelined window
+    static const int CAN_BENCHMARK_CONNECTION_TMO = 5000;       //!< Maximum time to open all the Device channels in ms
+    static const int CAN_BENCHMARK_SETTLE_TIME = 500;           //!< Time for the framing negotiation in ms
+    static const int CAN_BENCHMARK_SCENARIO_TMO = 60000;        //!< Maximum duration of a scenario in ms
+
+    /**
+     *  This is the result of a scenario
+     */
+    typedef struct{
+        bool    binary;         //!< Binary framing
+        bool    pipelined;      //!< Pipelined access mode
+        int     devices;        //!< Number of simulated Devices
+        int     window;         //!< Pipelined window (1 for the single mode)
+        int     transactions;   //!< Number of completed transactions
+        int     failures;       //!< Number of failed transactions
+        double  elapsed;        //!< Scenario duration in ms
+        double  fps;            //!< Completed transactions per second
+        double  p50;            //!< 50th percentile latency in us
+        double  p99;            //!< 99th percentile latency in us
+        double  p999;           //!< 99.9th percentile latency in us
+        double  max;            //!< Maximum latency in us
+    }BENCHMARK_RESULT_t;
+
+    void setTransactions(int transactions);     //!< Sets the number of transactions per Device
+    void setWindow(int window);                 //!< Sets the pipelined window
+    void setDeviceCounts(QList<int> counts);    //!< Sets the numbers of simulated Devices of the scenarios
+    void setFraming(bool ascii, bool binary);   //!< Selects the tested framings
+    void setSimulatorLatency(int min_ms, int max_ms); //!< Sets the simulator latency
+
+    bool start(void);
+    _inline bool isRunning(void) {return running;} //!< Test if the benchmark is running
+    _inline QList<BENCHMARK_RESULT_t> getResults(void) {return results;} //!< Returns the results of the completed scenarios
+    QByteArray getJson(void);
+    bool writeJson(QString filename);
+
+signals:
+    void benchmarkCompleted(bool ok, QByteArray json); //!< Emitted when all the scenarios are completed
+
+private slots:
+    void connectionEvent(void);
+    void nextScenario(void);
+    void deviceCompleted(uchar devid);
+    void scenarioTmoEvent(void);
+
+private:
+
+    /**
+     *  This is a benchmark scenario
+     */
+    typedef struct{
+        bool    binary;     //!< Binary framing
+        bool    pipelined;  //!< Pipelined access mode
+        int     devices;    //!< Number of simulated Devices
+    }SCENARIO_t;
+
+    int     transactions;           //!< Number of transactions per Device
+    int     window;                 //!< Pipelined window
+    QList<int> deviceCounts;        //!< Numbers of simulated Devices
+    bool    ascii_enabled;          //!< Ascii framing scenarios enabled
+    bool    binary_enabled;         //!< Binary framing scenarios enabled
+    int     latency_min;            //!< Simulator minimum latency in ms
+    int     latency_max;            //!< Simulator maximum latency in ms
+
+    canSimulatorServer* asciiServer;    //!< Simulator refusing the binary framing
+    canSimulatorServer* binaryServer;   //!< Simulator accepting the binary framing
+    QList<canBenchmarkDevice*> asciiDevices;  //!< Device clients of the ascii simulator
+    QList<canBenchmarkDevice*> binaryDevices; //!< Device clients of the binary simulator
+
+    bool    running;                //!< The benchmark is running
+    bool    failed;                 //!< A scenario failed
+    QList<SCENARIO_t> scenarios;    //!< Scenarios to be executed
+    int     current;                //!< Executing scenario
+    int     pending_devices;        //!< Devices of the executing scenario not yet completed
+    QList<BENCHMARK_RESULT_t> results; //!< Results of the completed scenarios
+    QTimer  connectionTmo;          //!< Polling timer of the Device channels
+    QTimer  scenarioTmo;            //!< Scenario deadline
+    QElapsedTimer clock;            //!< Scenario time base
+
+    QList<canBenchmarkDevice*>* scenarioDevices(void);
+    void closeScenario(bool ok);
+    void finish(bool ok);
+    static double percentile(const QVector<qint64>& sorted, double p);
+};
+
+#endif // CAN_BENCHMARK_H
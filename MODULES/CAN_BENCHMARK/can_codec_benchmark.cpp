@@ -0,0 +1,214 @@
+#include "can_codec_benchmark.h"
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+
+/**
+ * This is the previous encoding implementation, kept as reference.
+ */
+QByteArray canCodecBenchmark::legacyToCanData(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* content)
+{
+    QByteArray data;
+    data.append(content->seq);
+    data.append(content->frame_type);
+    data.append(content->idx);
+    data.append(content->d[0]);
+    data.append(content->d[1]);
+    data.append(content->d[2]);
+    data.append(content->d[3]);
+    uchar crc = 0;
+    for(int i=0; i<7; i++) crc ^= data.at(i);
+    data.append(crc);
+    return data;
+}
+
+/**
+ * This is the previous decoding implementation, kept as reference.
+ */
+canDeviceProtocolFrame::CAN_FRAME_CONTENT_t canCodecBenchmark::legacyToContent(QByteArray* data)
+{
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t content;
+    content.seq = 0;
+
+    uchar crc = 0;
+    if(data->size() != 8) return content;
+
+    for(int i=0; i<7; i++) crc ^= (uchar) data->at(i);
+    if(crc != (uchar) data->at(7)) return content;
+
+    content.seq = data->at(0);
+    content.frame_type = data->at(1);
+    content.idx = data->at(2);
+    for(int i=0; i< 4; i++) content.d[i] = data->at(3+i);
+    return content;
+}
+
+/**
+ * This function returns the sequence number of the decoded frame i:
+ * the sequence 0 is never used, because it marks a frame not decoded.
+ */
+uchar canCodecBenchmark::sequence(int i)
+{
+    return (uchar) ((i % 255) + 1);
+}
+
+/**
+ * This function assignes the sequence number of an encoded frame,
+ * updating the CRC with the previous sequence number.
+ */
+void canCodecBenchmark::setSequence(uchar* b, uchar seq)
+{
+    b[7] ^= (uchar) (b[0] ^ seq);
+    b[0] = seq;
+}
+
+/**
+ * This function returns the throughput in millions of frames per second.
+ */
+double canCodecBenchmark::rate(int iterations, qint64 ns)
+{
+    if(ns <= 0) ns = 1;
+    return (double) iterations * 1000.0 / (double) ns;
+}
+
+/**
+ * @brief This function runs the microbenchmark
+ *
+ * Every implementation encodes the given number of frames with a changing content
+ * and then decodes the same number of frames: the decoded contents are
+ * accumulated in a checksum, so the compiler cannot remove the loops.
+ *
+ * Every decoded frame has a new sequence number with the CRC updated:
+ * the frames not decoded (wrong CRC) are counted in CODEC_RESULT_t::errors
+ * and the result is not valid if any frame is not decoded.
+ *
+ * @param iterations this is the number of encoded and decoded frames per implementation
+ * @return the results of the implementations
+ */
+QList<canCodecBenchmark::CODEC_RESULT_t> canCodecBenchmark::run(int iterations)
+{
+    QList<CODEC_RESULT_t> results;
+    CODEC_RESULT_t result;
+    QElapsedTimer clock;
+    volatile uint sink = 0;
+    uint checksum;
+
+    if(iterations < 1) iterations = 1;
+
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t content;
+    content.seq = 1;
+    content.frame_type = canDeviceProtocolFrame::READ_STATUS;
+    content.idx = 0;
+    memset(content.d, 0, 4);
+
+    // Previous implementation
+    QByteArray data;
+    checksum = 0;
+    clock.start();
+    for(int i=0; i<iterations; i++){
+        content.seq = (uchar) i;
+        content.d[0] = (uchar) (i >> 8);
+        data = legacyToCanData(&content);
+        checksum += (uchar) data.at(7);
+    }
+    result.encode = rate(iterations, clock.nsecsElapsed());
+
+    result.errors = 0;
+    clock.start();
+    for(int i=0; i<iterations; i++){
+        setSequence((uchar*) data.data(), sequence(i));
+        uchar seq = legacyToContent(&data).seq;
+        if(!seq) result.errors++;
+        checksum += seq;
+    }
+    result.decode = rate(iterations, clock.nsecsElapsed());
+    result.codec = "qbytearray_append";
+    if(result.errors) qDebug() << "CODEC BENCHMARK" << result.codec << "FRAMES NOT DECODED:" << result.errors;
+    results.append(result);
+    sink = sink + checksum;
+
+    // QByteArray interface
+    checksum = 0;
+    clock.start();
+    for(int i=0; i<iterations; i++){
+        content.seq = (uchar) i;
+        content.d[0] = (uchar) (i >> 8);
+        data = canDeviceProtocolFrame::toCanData(&content);
+        checksum += (uchar) data.at(7);
+    }
+    result.encode = rate(iterations, clock.nsecsElapsed());
+
+    result.errors = 0;
+    clock.start();
+    for(int i=0; i<iterations; i++){
+        setSequence((uchar*) data.data(), sequence(i));
+        uchar seq = canDeviceProtocolFrame::toContent(&data).seq;
+        if(!seq) result.errors++;
+        checksum += seq;
+    }
+    result.decode = rate(iterations, clock.nsecsElapsed());
+    result.codec = "qbytearray";
+    if(result.errors) qDebug() << "CODEC BENCHMARK" << result.codec << "FRAMES NOT DECODED:" << result.errors;
+    results.append(result);
+    sink = sink + checksum;
+
+    // Value type
+    canDeviceProtocolFrame::CAN_FRAME_t frame = canDeviceProtocolFrame::toFrame(content);
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t decoded;
+    checksum = 0;
+    clock.start();
+    for(int i=0; i<iterations; i++){
+        content.seq = (uchar) i;
+        content.d[0] = (uchar) (i >> 8);
+        frame = canDeviceProtocolFrame::toFrame(content);
+        checksum += frame.b[7];
+    }
+    result.encode = rate(iterations, clock.nsecsElapsed());
+
+    result.errors = 0;
+    clock.start();
+    for(int i=0; i<iterations; i++){
+        setSequence(frame.b, sequence(i));
+        if(canDeviceProtocolFrame::fromFrame(frame, &decoded)) checksum += decoded.seq;
+        else result.errors++;
+    }
+    result.decode = rate(iterations, clock.nsecsElapsed());
+    result.codec = "value";
+    if(result.errors) qDebug() << "CODEC BENCHMARK" << result.codec << "FRAMES NOT DECODED:" << result.errors;
+    results.append(result);
+    sink = sink + checksum;
+
+    return results;
+}
+
+/**
+ * @brief This function returns the results in JSON format
+ *
+ * @param iterations this is the number of frames of the run
+ * @param results these are the results of canCodecBenchmark::run()
+ * @return the JSON document
+ */
+QByteArray canCodecBenchmark::getJson(int iterations, const QList<CODEC_RESULT_t>& results)
+{
+    QJsonObject document;
+    QJsonArray items;
+
+    document.insert("benchmark", "can_frame_codec");
+    document.insert("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    document.insert("iterations", iterations);
+
+    for(int i=0; i<results.size(); i++){
+        QJsonObject item;
+        item.insert("codec", results.at(i).codec);
+        item.insert("encode_mfps", results.at(i).encode);
+        item.insert("decode_mfps", results.at(i).decode);
+        item.insert("decode_errors", (double) results.at(i).errors);
+        items.append(item);
+    }
+
+    document.insert("results", items);
+    return QJsonDocument(document).toJson(QJsonDocument::Indented);
+}
@@ -0,0 +1,67 @@
+#ifndef CAN_CODEC_BENCHMARK_H
+#define CAN_CODEC_BENCHMARK_H
+
+#include <QtCore>
+#include "can_device_protocol.h"
+
+/**
+ * @brief This class implements the microbenchmark of the protocol frame encoding and decoding
+ *
+ * The benchmark measures the throughput of three implementations
+ * of the canDeviceProtocolFrame encoding and decoding, in the same process:
+ * - "qbytearray_append": the previous implementation, building the frame
+ *   with a QByteArray::append() per byte and decoding it with a bounds checked
+ *   access per byte (kept here as reference);
+ * - "qbytearray": canDeviceProtocolFrame::toCanData() and canDeviceProtocolFrame::toContent(),
+ *   the QByteArray interface of the canClient signals;
+ * - "value": canDeviceProtocolFrame::toFrame() and canDeviceProtocolFrame::fromFrame(),
+ *   the 8 byte value type without heap allocations.
+ *
+ * The results are provided in JSON format:
+ *
+ * \verbatim
+    {
+        "benchmark": "can_frame_codec",
+        "date": "2026-10-16T10:00:00",
+        "iterations": 10000000,
+        "results": [
+            { "codec": "qbytearray_append", "encode_mfps": 9.8, "decode_mfps": 45.1, "decode_errors": 0 },
+            { "codec": "qbytearray", "encode_mfps": 31.5, "decode_mfps": 160.3, "decode_errors": 0 },
+            { "codec": "value", "encode_mfps": 1210.4, "decode_mfps": 980.7, "decode_errors": 0 }
+        ]
+    }
+   \endverbatim
+ *
+ * Where the throughput is in millions of frames per second (the values above are only
+ * an example of the format) and decode_errors is the number of frames not decoded:
+ * a run with decode errors is not valid.
+ *
+ * \ingroup canBenchmarkModule
+ */
+class canCodecBenchmark
+{
+public:
+    static const int CAN_CODEC_DEFAULT_ITERATIONS = 10000000; //!< Default number of encoded and decoded frames
+
+    /**
+     *  This is the result of an implementation
+     */
+    typedef struct{
+        QString codec;      //!< Implementation name
+        double  encode;     //!< Encoded frames per second (millions)
+        double  decode;     //!< Decoded frames per second (millions)
+        ulong   errors;     //!< Frames not decoded: the decode rate is not valid if not 0
+    }CODEC_RESULT_t;
+
+    static QList<CODEC_RESULT_t> run(int iterations = CAN_CODEC_DEFAULT_ITERATIONS);
+    static QByteArray getJson(int iterations, const QList<CODEC_RESULT_t>& results);
+
+private:
+    static QByteArray legacyToCanData(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* content);
+    static canDeviceProtocolFrame::CAN_FRAME_CONTENT_t legacyToContent(QByteArray* data);
+    static double rate(int iterations, qint64 ns);
+    static uchar sequence(int i);
+    static void setSequence(uchar* b, uchar seq);
+};
+
+#endif // CAN_CODEC_BENCHMARK_H
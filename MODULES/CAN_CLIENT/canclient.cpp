@@ -1,26 +1,353 @@
 #include "canclient.h"
 #include <QTimer>
+#include <QCoreApplication>
 
 /**
  * This is the class constructor.
  *
- * The Constructor only initializes some internal variable.
+ * The Constructor only initializes some internal variable
+ * and registers the acceptance filter.
  *
  * @param
- * - can_mask: this is the 16 bit Acceptance Mask;
- * - can_address: this is the 16 bit acceptance filter;
+ * - can_rx_address: this is the canId of the acceptance filter (11 or 29 bit);
  * - IP: this is the IP address of the Can Application Driver;
  * - PORT: this is the port of the Can Application Driver;
  */
-canClient::canClient(ushort can_rx_address, QString IP, int PORT):QTcpServer()
+canClient::canClient(uint can_rx_address, QString IP, int PORT):canClient(IP, PORT)
+{
+    addAcceptanceFilter(CAN_FILTER_EXACT_MASK, can_rx_address);
+}
+
+/**
+ * This is the class constructor of a multiplexed connection.
+ *
+ * The acceptance filters are registered with the canClient::registerChannel() method.
+ *
+ * @param
+ * - IP: this is the IP address of the Can Application Driver;
+ * - PORT: this is the port of the Can Application Driver;
+ */
+canClient::canClient(QString IP, int PORT):QTcpServer()
 {
     serverip = QHostAddress(IP);
     serverport = PORT;
-    rxCanId = can_rx_address;
-    rx_filter_open = false;
+    rx_filter_open.storeRelaxed(0);
+    binary_version = 0;
+    binary_offers = 0;
     connectionStatus=false;
     socket=0;
+    txQueue=0;
+    ioThread=nullptr;
+    frameTap.storeRelaxed(nullptr);
+
+    filterTimer.setSingleShot(true);
+    connect(&filterTimer, SIGNAL(timeout()), this, SLOT(setAcceptanceFilter()), Qt::UniqueConnection);
+    filterRetryTmo = CAN_FILTER_RETRY_MIN_TMO;
+
+    // Connection state machine
+    connectionState.storeRelaxed(STATE_DISCONNECTED);
+    reconnections.storeRelaxed(0);
+    reconnectDelay = CAN_RECONNECT_MIN_DELAY;
+    reconnectTimer.setSingleShot(true);
+    connect(&reconnectTimer, SIGNAL(timeout()), this, SLOT(reconnectEvent()), Qt::UniqueConnection);
+
+    statisticsBitrate = canTrafficStatistics::CAN_STAT_DEFAULT_BITRATE;
+    statisticsPrevious = trafficStatistics.snapshot(0);
+    connect(&statisticsTimer, SIGNAL(timeout()), this, SLOT(dumpStatistics()), Qt::UniqueConnection);
+}
+
+/**
+ * This function returns the process-wide connection with the Can Application Driver.
+ *
+ * The first call creates the connection and starts it:
+ * all the next calls with the same IP and PORT return the same connection,
+ * so the whole process uses a single socket, a single reconnection loop
+ * and a single frame parser.
+ *
+ * The connection is shared with the canClient::registerChannel() method.
+ *
+ * The first shared connection hooks the QCoreApplication::aboutToQuit() signal
+ * to canClient::releaseSharedClients(): all the shared connections
+ * are released before the application exits.
+ *
+ * @param
+ * - IP: this is the IP address of the Can Application Driver;
+ * - PORT: this is the port of the Can Application Driver;
+ *
+ * @return the shared connection
+ */
+canClient* canClient::getSharedClient(QString IP, int PORT)
+{
+    QString key = QString("%1:%2").arg(IP).arg(PORT);
+
+    canClient* client = sharedClients.value(key, nullptr);
+    if(client) return client;
+
+    if((!releaseHooked) && (QCoreApplication::instance())){
+        releaseHooked = true;
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &canClient::releaseSharedClients);
+    }
+
+    client = new canClient(IP, PORT);
+    sharedClients.insert(key, client);
+
+    if(ioThreadMode){
+        client->startIoThread();
+        return client;
+    }
+
+    client->ConnectToCanServer();
+    return client;
+}
+
+/**
+ * This function moves the connection to a dedicated I/O thread
+ * and starts the connection from that thread.
+ *
+ * See the I/O THREAD section of the canClientModule.
+ */
+void canClient::startIoThread(void)
+{
+    // The monotonic time base is started before the I/O thread uses it
+    timestamp();
+
+    ioThread = new QThread();
+    ioThread->setObjectName(QString("canClient %1:%2").arg(serverip.toString()).arg(serverport));
+    moveToThread(ioThread);
+    filterTimer.moveToThread(ioThread);
+    reconnectTimer.moveToThread(ioThread);
+    statisticsTimer.moveToThread(ioThread);
+    ioThread->start();
+
+    QMetaObject::invokeMethod(this, "ConnectToCanServer", Qt::QueuedConnection);
+}
+
+/**
+ * This function closes the connection from its dedicated I/O thread
+ * and waits for the thread termination.
+ *
+ * After the call the connection belongs to the calling thread.
+ */
+void canClient::stopIoThread(void)
+{
+    if(!ioThread) return;
+
+    QMetaObject::invokeMethod(this, "DisconnectFromCanServer", Qt::BlockingQueuedConnection);
+    ioThread->quit();
+    ioThread->wait();
+    delete ioThread;
+    ioThread = nullptr;
+}
+
+/**
+ * This function closes and deletes a process-wide connection
+ * created with canClient::getSharedClient().
+ *
+ * The connection is closed and the I/O thread, if used, is stopped and deleted.
+ * The channels registered on the connection are deleted with the connection:
+ * the function shall be called when the protocol objects
+ * don't use the channels anymore.
+ *
+ * @param
+ * - IP: this is the IP address of the Can Application Driver;
+ * - PORT: this is the port of the Can Application Driver;
+ */
+void canClient::releaseSharedClient(QString IP, int PORT)
+{
+    canClient* client = sharedClients.take(QString("%1:%2").arg(IP).arg(PORT));
+    if(!client) return;
+
+    if(client->ioThread){
+        client->stopIoThread();
+
+        // The channels of the I/O thread mode have no parent
+        for(int i=0; i<client->channels.size(); i++) client->channels[i]->deleteLater();
+    }else client->DisconnectFromCanServer();
+
+    client->channels.clear();
+    delete client;
+}
+
+/**
+ * This function closes and deletes all the process-wide connections.
+ *
+ * See canClient::releaseSharedClient(): the function is called
+ * at the QCoreApplication::aboutToQuit() signal.
+ */
+void canClient::releaseSharedClients(void)
+{
+    while(!sharedClients.isEmpty()){
+        canClient* client = sharedClients.first();
+        releaseSharedClient(client->serverip.toString(), client->serverport);
+    }
+}
+
+/**
+ * This function registers a reception channel for a given canId.
+ *
+ * See canClient::registerMaskChannel(): the channel receives only the canId.
+ *
+ * @param canId this is the 11 or 29 bit canId to be received
+ * @return the channel or nullptr if the canId is out of range
+ */
+canClientChannel* canClient::registerChannel(uint canId)
+{
+    if(canId > CAN_MAX_EXTENDED_ID) return nullptr;
+    return registerMaskChannel(CAN_FILTER_EXACT_MASK, canId);
+}
+
+/**
+ * This function registers a reception channel for a family of canId.
+ *
+ * The channel receives all the frames with:
+ *
+ *      (canId & mask) == address
+ *
+ * The acceptance filter is added to the connection
+ * and, if the connection is already established, immediatelly registered
+ * on the Can Application Driver. All the filters are registered again
+ * after every reconnection.
+ *
+ * The received frames are dispatched to the channels through
+ * a lookup table indexed by the canId, precomputed at the channel registration:
+ * a frame is dispatched to all the channels accepting its canId.
+ * The channels of an extended canId are computed at the first reception
+ * of that canId and then kept in a lookup cache.
+ *
+ * Registering twice the same mask and address returns the same channel.
+ *
+ * With the I/O thread, the channel lives in the thread of the caller
+ * and the lookup table and the acceptance filter are updated by the I/O thread.
+ *
+ * @param
+ * - mask: this is the acceptance filter mask (canClient::CAN_FILTER_EXACT_MASK for a single canId);
+ * - address: this is the acceptance filter address;
+ *
+ * @return the channel
+ */
+canClientChannel* canClient::registerMaskChannel(uint mask, uint address)
+{
+    address &= mask;
+    for(int i=0; i<channels.size(); i++){
+        if((channels.at(i)->getMask() == mask) && (channels.at(i)->getCanId() == address)) return channels.at(i);
+    }
+
+    canClientChannel* channel = new canClientChannel(this, mask, address);
+    channels.append(channel);
+
+    if(ioThread) QMetaObject::invokeMethod(this, "addDemuxChannel", Qt::QueuedConnection, Q_ARG(canClientChannel*, channel));
+    else addDemuxChannel(channel);
+    return channel;
+}
+
+/**
+ * This function adds a channel to the reception lookup table
+ * and adds the channel acceptance filter.
+ *
+ * @param channel this is the registered channel
+ */
+void canClient::addDemuxChannel(canClientChannel* channel)
+{
+    demuxChannels.append(channel);
+    for(int canId=0; canId<CAN_ID_TABLE_SIZE; canId++){
+        if(channel->isAccepted(canId)) demuxTable[canId].append(channel);
+    }
+
+    // The extended canId lookup cache is computed again at the next receptions
+    demuxExtended.clear();
+
+    addAcceptanceFilter(channel->getMask(), channel->getCanId());
+}
+
+/**
+ * This function adds an acceptance filter to the connection.
+ *
+ * @param
+ * - mask: this is the acceptance filter mask;
+ * - address: this is the acceptance filter address;
+ */
+void canClient::addAcceptanceFilter(uint mask, uint address)
+{
+    address &= mask;
+    for(int i=0; i<rxFilters.size(); i++){
+        if((rxFilters[i].mask == mask) && (rxFilters[i].address == address)) return;
+    }
 
+    rxFilters.append({mask, address, false});
+
+    // A new filter closes the full acceptance status until it is acknowledged
+    if(rx_filter_open.loadRelaxed()){
+        rx_filter_open.storeRelaxed(0);
+        setConnectionState(STATE_REGISTERING);
+        emit canDriverConnectionStatus(false);
+    }
+    filterRetryTmo = CAN_FILTER_RETRY_MIN_TMO;
+    setAcceptanceFilter();
+}
+
+/**
+ * This function returns the channels accepting a received canId.
+ *
+ * The standard canId are read from the precomputed lookup table.
+ * The channels of an extended canId are computed at the first reception
+ * and added to the lookup cache (the cache is cleared when full).
+ *
+ * The returned list is implicitly shared: it remains valid also if a channel
+ * is registered while the frame is dispatched.
+ *
+ * @param canId this is the received canId
+ * @return the list of the channels
+ */
+QVector<canClientChannel*> canClient::demuxTargets(uint canId)
+{
+    if(canId < CAN_ID_TABLE_SIZE) return demuxTable[canId];
+
+    QHash<uint, QVector<canClientChannel*>>::const_iterator it = demuxExtended.constFind(canId);
+    if(it != demuxExtended.constEnd()) return it.value();
+
+    if(demuxExtended.size() >= CAN_EXTENDED_CACHE_SIZE) demuxExtended.clear();
+
+    QVector<canClientChannel*> targets;
+    for(int i=0; i<demuxChannels.size(); i++){
+        if(demuxChannels.at(i)->isAccepted(canId)) targets.append(demuxChannels.at(i));
+    }
+    demuxExtended.insert(canId, targets);
+    return targets;
+}
+
+/**
+ * This function notifies the acceptance filter status
+ * to the channels of the filter.
+ *
+ * @param
+ * - filter: this is the acceptance filter;
+ * - status: true if the filter is open;
+ */
+void canClient::notifyFilterStatus(const CAN_FILTER_t* filter, bool status)
+{
+    for(int i=0; i<demuxChannels.size(); i++){
+        canClientChannel* channel = demuxChannels.at(i);
+        if((channel->getMask() == filter->mask) && (channel->getCanId() == filter->address))
+            emit channel->canDriverConnectionStatus(status);
+    }
+}
+
+/**
+ * This function sets all the acceptance filters as closed,
+ * notifying the connection status change to the channels.
+ */
+void canClient::closeAcceptanceFilters(void)
+{
+    for(int i=0; i<rxFilters.size(); i++){
+        if(!rxFilters[i].open) continue;
+        rxFilters[i].open = false;
+        notifyFilterStatus(&rxFilters[i], false);
+    }
+
+    if(rx_filter_open.loadRelaxed()){
+        rx_filter_open.storeRelaxed(0);
+        emit canDriverConnectionStatus(false);
+    }
 }
 
 /**
@@ -61,10 +388,104 @@ void canClient::ConnectToCanServer(void)
     connect(socket,SIGNAL(readyRead()), this,SLOT(socketRxData()),Qt::UniqueConnection);
     connect(socket,SIGNAL(disconnected()),this,SLOT(socketDisconnected()),Qt::UniqueConnection);
 
+    // Non blocking transmission queue
+    txQueue = new socketTxQueue(socket);
+    connect(txQueue,SIGNAL(backpressure(bool)),this,SIGNAL(txBackpressure(bool)),Qt::UniqueConnection);
+
+    setConnectionState(STATE_CONNECTING);
     socket->connectToHost(serverip, serverport);
     return ;
 }
 
+/**
+ * This Method closes the connection with the Can Application Driver.
+ *
+ * The timers are stopped, the socket is deleted and no reconnection
+ * is scheduled: canClient::ConnectToCanServer() starts a new connection.
+ *
+ * The method shall be called in the connection thread.
+ */
+void canClient::DisconnectFromCanServer(void)
+{
+    filterTimer.stop();
+    reconnectTimer.stop();
+    statisticsTimer.stop();
+    if(!socket) return;
+
+    // The disconnection signal of the abort shall not schedule a reconnection
+    socket->disconnect(this);
+    socket->abort();
+    delete socket; // The tx queue is a child of the socket
+    socket = 0;
+    txQueue = 0;
+
+    connectionStatus = false;
+    binary_version = 0;
+    closeAcceptanceFilters();
+    setConnectionState(STATE_DISCONNECTED);
+}
+
+/**
+ * This function changes the connection state and
+ * emits the canClient::connectionStateChanged() signal.
+ *
+ * @param state this is the new connection state
+ */
+void canClient::setConnectionState(CAN_CONNECTION_STATE_t state)
+{
+    if(connectionState.loadRelaxed() == state) return;
+    connectionState.storeRelaxed(state);
+    emit connectionStateChanged(state);
+}
+
+/**
+ * This function handles a failed connection attempt or a lost connection.
+ *
+ * The socket is aborted, the acceptance filters are closed and
+ * a new connection attempt is scheduled after the reconnection delay
+ * (see the CONNECTION STATE AND RECONNECTION section of the canClientModule):
+ * the delay is doubled for the next attempt.
+ *
+ * The function is called by both the socket error and the disconnection events:
+ * only the first call of a connection attempt is processed.
+ */
+void canClient::connectionLost(void)
+{
+    if(getConnectionState() == STATE_BACKOFF) return;
+    setConnectionState(STATE_BACKOFF);
+
+    connectionStatus = false;
+    binary_version = 0;
+    filterTimer.stop();
+    closeAcceptanceFilters();
+
+    // The abort of a connected socket emits the disconnection signal:
+    // the BACKOFF state ignores it
+    socket->abort();
+
+    int jitter = reconnectDelay * CAN_RECONNECT_JITTER / 100;
+    int delay = reconnectDelay;
+    if(jitter) delay += QRandomGenerator::global()->bounded(-jitter, jitter + 1);
+    reconnectTimer.start(delay);
+
+    reconnectDelay *= 2;
+    if(reconnectDelay > CAN_RECONNECT_MAX_DELAY) reconnectDelay = CAN_RECONNECT_MAX_DELAY;
+}
+
+/**
+ * This is the timer slot of the reconnection delay:
+ * a new connection attempt is started.
+ */
+void canClient::reconnectEvent()
+{
+    if(!socket) return;
+    if(getConnectionState() != STATE_BACKOFF) return;
+
+    reconnections.fetchAndAddRelaxed(1);
+    setConnectionState(STATE_CONNECTING);
+    socket->connectToHost(serverip, serverport);
+}
+
 /**
  * This is the TcpIp socket callback when the Ethernet connection has been established.
  *
@@ -76,13 +497,19 @@ void canClient::socketConnected()
 {
     // Connessione avvenuta
     connectionStatus=true;
-    if(rx_filter_open){
-        rx_filter_open = false;
-        emit canDriverConnectionStatus(rx_filter_open);
-    }
+    closeAcceptanceFilters();
+    setConnectionState(STATE_REGISTERING);
     socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
 
-    // Open the Acceptance filter to the Can Server application
+    // The binary framing shall be negotiated again for every new connection
+    binary_version = 0;
+    binary_offers = 0;
+    rxParser.reset();
+    txQueue->clear();
+
+    // Open the Acceptance filter to the Can Server application:
+    // all the filters are sent in a single burst
+    filterRetryTmo = CAN_FILTER_RETRY_MIN_TMO;
     setAcceptanceFilter();
 
 }
@@ -90,218 +517,178 @@ void canClient::socketConnected()
 /**
  * This is the TcpIp socket callback of the disconnection event.
  *
- * In case of the disconnection, the Function start again a new connection attempt.
+ * In case of the disconnection, a new connection attempt is scheduled
+ * after the reconnection delay (see canClient::connectionLost()).
  */
 void canClient::socketDisconnected()
 {
-    if(rx_filter_open){
-        rx_filter_open = false;
-        emit canDriverConnectionStatus(rx_filter_open);
-    }
-    socket->connectToHost(serverip, serverport);
-
+    connectionLost();
 }
 
 /**
  * This is the TcpIp Socket connection error callback.
  *
  * In case of socket error, the socket is closed and a new
- * connection is activated.
+ * connection attempt is scheduled after the reconnection delay
+ * (see canClient::connectionLost()).
  *
  * @param
  * - error: this is the error code received from the tcpIp Socket handler.
  */
 void canClient::socketError(QAbstractSocket::SocketError error)
 {
-    // Invia la comunicazione tempestiva che la comunicazione è interrotta
-    if(connectionStatus==true)
-    {
-        connectionStatus=false;            
-        if(rx_filter_open){
-            rx_filter_open = false;
-            emit canDriverConnectionStatus(rx_filter_open);
-        }
-
-    }
-
-    if(error == QAbstractSocket::RemoteHostClosedError)
-    {        
-        if(rx_filter_open){
-            rx_filter_open = false;
-            emit canDriverConnectionStatus(rx_filter_open);
-        }
-        return ;
-    }
-
-
-    socket->abort();
-    socket->close();
-    socket->connectToHost(serverip, serverport);
-    return;
-}
-
-/**
- * This function get an Item from the tcpIp received frame.
- *
- * This function is used to decode an incoming data frame
- * from the Can Application Driver.
- *
- * @param
- * - index: this is the current character index of the received ethernet frame;
- * - data: this is the received ethernet frame data array;
- * - data_ok: this is a pointer that the caller provides to have the result of the item identification;
- *
- * @return always returns 0;
- *
- */
-ushort canClient::getItem(int* index, QByteArray* data, bool* data_ok){
-    *data_ok = false;
-    bool is_hex = false;
-    QString val;
-
-    for(; *index< data->size(); (*index)++) if(data->at(*index) != ' ') break; // Removes the spaces
-
-    for(; *index< data->size(); (*index)++){
-        if(data->at(*index) == ' '){
-            if(!val.size()) return 0;
-            *data_ok = true;
-            if(is_hex) return val.toUShort(data_ok, 16);
-            else return val.toUShort();
-        }
-        if((data->at(*index) == 'x') |(data->at(*index) == 'X')) is_hex = true;
-        val.append(data->at(*index));
-    }
-
-    // Non è terminato con uno spazio: errore
-    return 0;
+    Q_UNUSED(error);
+    connectionLost();
 }
 
 /**
- * This is the handler of every received frame.
+ * This is the handler of every decoded frame.
  *
- * The handler decodes the frame format, providing:
+ * The handler processes:
  * - the Acceptance Filter acknowledge;
+ * - the Binary Framing acknowledge;
  * - the CAN DATA received from the can Application Driver;
  *
  * The Handler will emit the canClient::rxFromCan() SIGNAL
- * for every correct can frame received.
+ * for every correct can frame received and the canClientChannel::rxFromCan() SIGNAL
+ * of all the channels accepting the received canId (see canClient::registerMaskChannel()).
+ * With the I/O thread, the frames of the registered channels are added
+ * to the channel rings instead (see canClientChannel::pushFrame()).
  *
  *
  *  NOTE: only the can frame with the canId matching the rule
  *  of the acceptance filter will generate the Signal.
  *
  *
- * @param data
+ * @param
+ * - frame: this is the pointer to the decoded frame;
+ * - rxTime: this is the socket reading timestamp of the frame (see canClient::timestamp());
  */
-void canClient::handleSocketFrame(QByteArray* data){
-
-    QByteArray frame;
-    bool is_register;
-    bool is_asynch;
-    bool is_valid;
+void canClient::handleRxFrame(const canFrameParser::CAN_RX_FRAME_t* frame, qint64 rxTime){
+    QVector<canClientChannel*> targets;
+    QByteArray data;
     int i;
-    bool data_ok;
-
-
-    is_valid = false;
-    for(i=0; i< data->size(); i++){
-        if(data->at(i)== ' ') continue;
-        if(data->at(i)== 'F') {
-            is_register = true;
-            is_asynch = false;
-            is_valid = true;
-            i++;
-            break;
-        }
 
-        if(data->at(i)== 'D') {
-            is_register = false;
-            is_asynch = false;
-            is_valid = true;
-            i++;
-            break;
-        }
+    // Traffic statistics and tap of the data frames
+    if((frame->type == canFrameParser::FRAME_DATA) || (frame->type == canFrameParser::FRAME_ASYNC)){
+        trafficStatistics.countRx(frame->canId, frame->len, (frame->type == canFrameParser::FRAME_ASYNC));
+        canFrameTap* tap = frameTap.loadAcquire();
+        if(tap) tap->tapFrame((frame->type == canFrameParser::FRAME_ASYNC) ? canFrameTap::TAP_RX_ASYNC : canFrameTap::TAP_RX, frame->canId, frame->d, frame->len, rxTime);
+    }
 
-        if(data->at(i)== 'A') {
-            is_register = false;
-            is_asynch = true;
-            is_valid = true;
-            i++;
-            break;
+    switch(frame->type){
+    case canFrameParser::FRAME_FILTER: // Can Registering Frame: set the reception mask and address
+        for(i=0; i<rxFilters.size(); i++){
+            if((rxFilters[i].mask == frame->mask) && (rxFilters[i].address == frame->canId)) break;
         }
-    }
-    if(!is_valid) return;
+        if(i == rxFilters.size()) return;
+        if(rxFilters[i].open) return;
+
+        qDebug() << QString("ACCEPTANCE FILTER OPEN TO MASK=0x%1 ADDR=0x%2").arg(frame->mask,1,16).arg(frame->canId,1,16);
+        rxFilters[i].open = true;
+        notifyFilterStatus(&rxFilters[i], true);
 
-    ushort address;
-    if(is_register){// Can Registering Frame: set the reception mask and address
-        address = getItem(&i, data, &data_ok);
-        if(!data_ok) return;       
-        if(address != rxCanId) return;
+        // The connection is ready when all the filters are open
+        for(i=0; i<rxFilters.size(); i++){
+            if(!rxFilters[i].open) break;
+        }
+        if(i == rxFilters.size()){
+            filterTimer.stop();
+            reconnectDelay = CAN_RECONNECT_MIN_DELAY;
+            rx_filter_open.storeRelaxed(1);
+            setConnectionState(STATE_READY);
+            emit canDriverConnectionStatus(true);
+        }
 
-        qDebug() << QString("ACCEPTANCE FILTER OPEN TO ADDR=0x%1").arg(rxCanId,1,16);
-        rx_filter_open = true;
-        emit canDriverConnectionStatus(rx_filter_open);
+        // Starts the binary framing negotiation
+        if(!binary_offers) offerBinaryFraming();
         return;
 
-    }else{
+    case canFrameParser::FRAME_BINARY: // Binary Framing acknowledge: the server accepted the binary frames
+        if((frame->canId < 1) || (frame->canId > CAN_BINARY_VERSION)) return;
+        if(binary_version >= frame->canId) return;
+
+        qDebug() << QString("BINARY FRAMING VERSION %1 ACCEPTED FOR %2:%3").arg(frame->canId).arg(serverip.toString()).arg(serverport);
+        binary_version = frame->canId;
+        return;
 
+    case canFrameParser::FRAME_ASYNC:
+        targets = demuxTargets(frame->canId);
+        if((ioThread) && (targets.size())){
+            for(i=0; i<targets.size(); i++) targets.at(i)->pushFrame(frame, rxTime);
+            recordRxLatency(RX_STAGE_DISPATCH, rxTime);
+            return;
+        }
 
-        frame.clear();
-        ushort canid = getItem(&i, data, &data_ok);        
-        if(!data_ok) return;
+        data = QByteArray((const char*) frame->d, frame->len);
+        emit rxAsyncFromCan(frame->canId, data);
+        emit rxAsyncStampedFromCan(frame->canId, data, rxTime);
+        for(i=0; i<targets.size(); i++){
+            emit targets.at(i)->rxAsyncFromCan(frame->canId, data);
+            emit targets.at(i)->rxAsyncStampedFromCan(frame->canId, data, rxTime);
+        }
+        recordRxLatency(RX_STAGE_DISPATCH, rxTime);
+        return;
 
-        ushort val;
-        for(; (i< data->size()) && (frame.size() <= 8) ; i++){
-            val = getItem(&i, data, &data_ok)&0xFF;
-            if(data_ok) {
-                frame.append((unsigned char) val);
-            } else break;
+    case canFrameParser::FRAME_DATA:
+        targets = demuxTargets(frame->canId);
+        if((ioThread) && (targets.size())){
+            for(i=0; i<targets.size(); i++) targets.at(i)->pushFrame(frame, rxTime);
+            recordRxLatency(RX_STAGE_DISPATCH, rxTime);
+            return;
         }
 
-        // If a valid set of data has been identified they will be sent to the driver
-        //ushort devId = (canid & (~filter_mask) );
-        if(frame.size()) {
-            if(is_asynch) emit rxAsyncFromCan(canid,frame);
-            else emit rxFromCan(canid,frame);
+        data = QByteArray((const char*) frame->d, frame->len);
+        emit rxFromCan(frame->canId, data);
+        emit rxStampedFromCan(frame->canId, data, rxTime);
+        for(i=0; i<targets.size(); i++){
+            emit targets.at(i)->rxFromCan(frame->canId, data);
+            emit targets.at(i)->rxStampedFromCan(frame->canId, data, rxTime);
         }
+        recordRxLatency(RX_STAGE_DISPATCH, rxTime);
+        return;
     }
+
     return;
 }
 
 /**
- * This callback is called every received data frame from the ethernet.
- *
- * A Valid data frame is determined when the initiator and terminator\n
- * characters are identified (as for the protocol spec):
- * - initiator = '<';
- * - terminator = '>';
+ * This callback is called every time data are available from the ethernet.
  *
- * A valid data frame is < .... >.
+ * The data are read directly into the ring buffer of the streaming
+ * frame parser (see canFrameParser) and decoded in batches of
+ * canFrameParser::RX_BATCH_SIZE frames.
  *
- * The function is able to identify nested valid frames: < frame 1 >  <frame 2>.
+ * The parser handles:
+ * - nested frames in a single reception: < frame 1 >  <frame 2>;
+ * - frames split along two or more receptions;
+ * - ascii and binary frames.
  *
- * For every nested frame the function will call the canClient::handleSocketFrame() method.
+ * For every decoded frame the function will call the canClient::handleRxFrame() method,
+ * with the timestamp of the socket reading.
  */
 void canClient::socketRxData()
 {
     if(connectionStatus ==false) return;
-    if(socket->bytesAvailable()==0) return;
-    QByteArray data = socket->readAll();
-    QByteArray frame;
-
-    // Identifies all the possible frames in the received stream
-    for(int i=0; i<data.size(); i++){
-        if(data.at(i) == '<') {
-            frame.clear();
-        }else if(data.at(i) == '>'){
-            if(frame.size() > 4) {
-                frame.append(' ');
-                handleSocketFrame(&frame);
-                frame.clear();
-            }
-        }else{
-            frame.append(data.at(i));
-        }
+
+    canFrameParser::CAN_RX_FRAME_t batch[canFrameParser::RX_BATCH_SIZE];
+    int free;
+    int n;
+
+    while(socket->bytesAvailable()){
+
+        // Reads the socket directly into the parser ring buffer:
+        // the frames completed by this reading are tagged with the reading time
+        qint64 rxTime = timestamp();
+        char* ptr = rxParser.writePointer(&free);
+        if(free) rxParser.commit(socket->read(ptr, free));
+
+        // Decodes and dispatches the received frames
+        do{
+            n = rxParser.decode(batch, canFrameParser::RX_BATCH_SIZE);
+            if(n) recordRxLatency(RX_STAGE_PARSE, rxTime);
+            for(int i=0; i<n; i++) handleRxFrame(&batch[i], rxTime);
+        }while(n == canFrameParser::RX_BATCH_SIZE);
     }
 
 }
@@ -314,31 +701,189 @@ void canClient::socketRxData()
  * to be sent to the Can Application Driver.
  *
  * @param
- * - canId: this is the 11 bit Target Can ID;
- * - data: this is the can data load. Max 8 bytes are admitted.
+ * - canId: this is the 11 or 29 bit Target Can ID;
+ * - data: this is the can data load. Max canClient::CAN_MAX_PAYLOAD bytes are admitted.
+ *
+ * The frame is queued in a non blocking socketTxQueue:
+ * see canClient::txBackpressure() and canClient::txFlush().
+ *
+ * With the binary framing version 1, the frames with an extended canId
+ * or with more than 8 data bytes are sent in the ascii format.
  */
-void canClient::txToCanData(ushort canId, QByteArray data)
+void canClient::txToCanData(uint canId, QByteArray data)
 {
     // Invia i dati ed attende di ricevere la risposta
     if(!socket) return;
     if(!connectionStatus) return;
+    if(canId > CAN_MAX_EXTENDED_ID) return;
+    if(data.size() > CAN_MAX_PAYLOAD) data.truncate(CAN_MAX_PAYLOAD);
 
+    canFrameTap* tap = frameTap.loadAcquire();
+    if(tap) tap->tapFrame(canFrameTap::TAP_TX, canId, (const uchar*) data.constData(), data.size(), timestamp());
+
+    // Binary framing version 2: variable size frame
+    if(binary_version >= 2){
+        CAN_BINARY_FD_FRAME_t frame;
+
+        frame.type = CAN_BINARY_FD_DATA_FRAME;
+        frame.id[0] = (uchar) canId;
+        frame.id[1] = (uchar) (canId >> 8);
+        frame.id[2] = (uchar) (canId >> 16);
+        frame.id[3] = (uchar) (canId >> 24);
+        frame.len = data.size();
+        memcpy(frame.d, data.constData(), data.size());
+
+        txQueue->send((const char*) &frame, CAN_BINARY_FD_HEADER_SIZE + frame.len);
+        trafficStatistics.countTx(canId, data.size(), txQueue->pending());
+        return;
+    }
+
+    // Binary framing version 1: fixed size frame
+    if((binary_version == 1) && (canId < CAN_ID_TABLE_SIZE) && (data.size() <= 8)){
+        CAN_BINARY_FRAME_t frame;
+        int len = data.size();
+
+        memset(&frame, 0, sizeof(frame));
+        frame.type = CAN_BINARY_DATA_FRAME;
+        frame.id[0] = (uchar) canId;
+        frame.id[1] = (uchar) (canId >> 8);
+        frame.len = len;
+        memcpy(frame.d, data.constData(), len);
+
+        txQueue->send((const char*) &frame, CAN_BINARY_FRAME_SIZE);
+        trafficStatistics.countTx(canId, data.size(), txQueue->pending());
+        return;
+    }
 
     QString frame = QString("<D %1 ").arg(canId);
     for(int i=0; i<data.size(); i++) frame.append(QString("%1 ").arg((unsigned char) data.at(i)));
     frame.append(">");
 
 
-    socket->write(frame.toLatin1());
-    socket->waitForBytesWritten(5000);
+    txQueue->send(frame.toLatin1());
+    trafficStatistics.countTx(canId, data.size(), txQueue->pending());
+
+}
 
+/**
+ * This function waits for all the pending tx data to be written to the Can Application Driver.
+ *
+ * The canClient::txToCanData() never blocks: the frames are queued
+ * in a socketTxQueue. This is the only blocking transmission method.
+ *
+ * @param timeout the maximum waiting time in ms
+ * @return true if all the pending data have been written
+ */
+bool canClient::txFlush(int timeout)
+{
+    // The socket is handled by the I/O thread
+    if((ioThread) && (QThread::currentThread() != ioThread)){
+        bool result = false;
+        QMetaObject::invokeMethod(this, "txFlush", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, result), Q_ARG(int, timeout));
+        return result;
+    }
 
+    if(!socket) return false;
+    if(!connectionStatus) return false;
+    return txQueue->flush(timeout);
 }
 
 /**
- * This is the slot function that is resceduled
- * every 50 ms until the Can application Driver will
- * acknowledge the correct Acceptance Filter registration.
+ * This function clears the traffic counters of the connection.
+ *
+ * With the I/O thread, the counters are cleared by the I/O thread.
+ */
+void canClient::resetTrafficStatistics(void)
+{
+    if((ioThread) && (QThread::currentThread() != ioThread)){
+        QMetaObject::invokeMethod(this, "resetTrafficStatistics", Qt::QueuedConnection);
+        return;
+    }
+
+    trafficStatistics.reset();
+    statisticsPrevious = trafficStatistics.snapshot(timestamp());
+}
+
+/**
+ * This function enables the periodic log of the traffic statistics.
+ *
+ * Every period the connection logs (qInfo()) the frame and byte rates,
+ * the estimated bus load and the traffic of the active canId
+ * in the period (see canTrafficStatistics::toString()).
+ *
+ * @param
+ * - period: this is the log period in ms (0 disables the log);
+ * - bitrate: this is the nominal bus bit rate used to estimate the bus load;
+ */
+void canClient::setStatisticsDump(int period, uint bitrate)
+{
+    if((ioThread) && (QThread::currentThread() != ioThread)){
+        QMetaObject::invokeMethod(this, "setStatisticsDump", Qt::QueuedConnection, Q_ARG(int, period), Q_ARG(uint, bitrate));
+        return;
+    }
+
+    statisticsBitrate = bitrate;
+    if(period <= 0){
+        statisticsTimer.stop();
+        return;
+    }
+
+    statisticsPrevious = trafficStatistics.snapshot(timestamp());
+    statisticsTimer.start(period);
+}
+
+/**
+ * This is the timer slot of the periodic statistics log.
+ */
+void canClient::dumpStatistics()
+{
+    canTrafficStatistics::CAN_TRAFFIC_SNAPSHOT_t current = trafficStatistics.snapshot(timestamp());
+    qInfo() << QString("CAN STATISTICS %1:%2 %3").arg(serverip.toString()).arg(serverport).arg(canTrafficStatistics::toString(&current, &statisticsPrevious, statisticsBitrate));
+    statisticsPrevious = current;
+}
+
+/**
+ * This function adds a data frame to the reception path
+ * as if it was received from the Can Application Driver.
+ *
+ * The frame is dispatched to the channels accepting the canId
+ * and to the canClient signals (see canClient::handleRxFrame()),
+ * also if the connection is not established: a recorded session
+ * can be replayed without the Can Application Driver (see canRecorderModule).
+ *
+ * With the I/O thread, the frame is queued to the I/O thread.
+ *
+ * @param
+ * - canId: this is the frame canId (11 or 29 bit);
+ * - data: this is the frame data (max canClient::CAN_MAX_PAYLOAD bytes);
+ * - async: true for an asynchronous frame;
+ * - rxTime: this is the reception timestamp assigned to the frame (see canClient::timestamp());
+ */
+void canClient::injectRxFrame(uint canId, QByteArray data, bool async, qint64 rxTime)
+{
+    if((ioThread) && (QThread::currentThread() != ioThread)){
+        QMetaObject::invokeMethod(this, "injectRxFrame", Qt::QueuedConnection, Q_ARG(uint, canId), Q_ARG(QByteArray, data), Q_ARG(bool, async), Q_ARG(qint64, rxTime));
+        return;
+    }
+
+    canFrameParser::CAN_RX_FRAME_t frame;
+    frame.type = (async) ? canFrameParser::FRAME_ASYNC : canFrameParser::FRAME_DATA;
+    frame.canId = canId;
+    frame.mask = 0;
+    frame.len = (data.size() > CAN_MAX_PAYLOAD) ? CAN_MAX_PAYLOAD : data.size();
+    memcpy(frame.d, data.constData(), frame.len);
+
+    handleRxFrame(&frame, rxTime);
+}
+
+/**
+ * This is the slot function that sends the acceptance filters
+ * not yet acknowledged.
+ *
+ * All the pending filters are queued in a single burst (the transmission queue never blocks).
+ * The function is rescheduled until the Can application Driver
+ * acknowledges all the registered Acceptance Filters: the retry interval
+ * is doubled at every attempt, from CAN_FILTER_RETRY_MIN_TMO up to CAN_FILTER_RETRY_MAX_TMO.
  *
  */
 void canClient::setAcceptanceFilter()
@@ -346,11 +891,193 @@ void canClient::setAcceptanceFilter()
     // Invia i dati ed attende di ricevere la risposta
     if(!socket) return;
     if(!connectionStatus) return;
-    if(rx_filter_open) return;
 
-    QString frame = QString("<F %1 >").arg(rxCanId);
-    socket->write(frame.toLatin1());
-    socket->waitForBytesWritten(5000);
+    bool pending = false;
+    for(int i=0; i<rxFilters.size(); i++){
+        if(rxFilters[i].open) continue;
+        // The single canId filters keep the legacy format
+        if(rxFilters[i].mask == CAN_FILTER_EXACT_MASK) txQueue->send(QString("<F %1 >").arg(rxFilters[i].address).toLatin1());
+        else txQueue->send(QString("<F %1 %2 >").arg(rxFilters[i].mask).arg(rxFilters[i].address).toLatin1());
+        pending = true;
+    }
+
+    if(!pending) return;
+    filterTimer.start(filterRetryTmo);
+    filterRetryTmo *= 2;
+    if(filterRetryTmo > CAN_FILTER_RETRY_MAX_TMO) filterRetryTmo = CAN_FILTER_RETRY_MAX_TMO;
+}
+
+/**
+ * This is the slot function that offers the binary framing
+ * to the Can application Driver.
+ *
+ * The offer is rescheduled every 50 ms until the Can application Driver
+ * acknowledges the binary framing or up to canClient::CAN_BINARY_OFFER_ATTEMPTS attempts
+ * for every version, starting from canClient::CAN_BINARY_VERSION:
+ * if no version is acknowledged the ascii framing is kept, so old Can application Driver
+ * releases remain compatible.
+ *
+ */
+void canClient::offerBinaryFraming()
+{
+    if(!socket) return;
+    if(!connectionStatus) return;
+    if(binary_version) return;
 
-    QTimer::singleShot(50,this, SLOT(setAcceptanceFilter()));
+    if(binary_offers >= CAN_BINARY_VERSION * CAN_BINARY_OFFER_ATTEMPTS){
+        qDebug() << QString("BINARY FRAMING NOT SUPPORTED: ASCII FRAMING FOR %1:%2").arg(serverip.toString()).arg(serverport);
+        return;
+    }
+
+    // The versions are offered from the highest one
+    int version = CAN_BINARY_VERSION - (binary_offers / CAN_BINARY_OFFER_ATTEMPTS);
+    binary_offers++;
+
+    txQueue->send(QString("<B %1 >").arg(version).toLatin1());
+
+    QTimer::singleShot(50,this, SLOT(offerBinaryFraming()));
+}
+
+/**
+ * This function returns the snapshot of the latency histogram of a reception stage.
+ *
+ * The RX_STAGE_HANDLER histogram merges the histograms of all the registered channels.
+ *
+ * @param stage this is the reception stage
+ * @return the histogram of the stage
+ */
+canLatencyHistogram canClient::getRxLatencyHistogram(CAN_RX_STAGE_t stage)
+{
+    if(stage != RX_STAGE_HANDLER) return rxHistograms[(stage < RX_STAGES) ? stage : RX_STAGE_PARSE].snapshot();
+
+    canLatencyHistogram histogram;
+    for(int i=0; i<channels.size(); i++) histogram.merge(channels.at(i)->getHandlerLatency());
+    return histogram;
+}
+
+/**
+ * This function clears the latency histograms of the reception stages.
+ *
+ * Every histogram is cleared by its writer thread before the next sample
+ * (see canLatencyCollector::reset()).
+ */
+void canClient::resetRxLatencyHistograms(void)
+{
+    for(int i=0; i<RX_STAGES; i++) rxHistograms[i].reset();
+    for(int i=0; i<channels.size(); i++) channels.at(i)->resetHandlerLatency();
+}
+
+/**
+ * This function adds the latency of a received frame to a stage histogram.
+ *
+ * The function is called only by the connection thread:
+ * the RX_STAGE_HANDLER latency is recorded by the channels (see canClientChannel::recordHandlerLatency()).
+ *
+ * @param
+ * - stage: this is the reception stage;
+ * - rxTime: this is the socket reading timestamp of the frame;
+ */
+void canClient::recordRxLatency(CAN_RX_STAGE_t stage, qint64 rxTime)
+{
+    if((stage >= RX_STAGES) || (stage == RX_STAGE_HANDLER)) return;
+    rxHistograms[stage].add(timestamp() - rxTime);
+}
+
+/**
+ * This is the class constructor of a reception channel.
+ *
+ * The channel is created by the canClient::registerMaskChannel() method.
+ *
+ * @param
+ * - client: this is the connection owning the channel;
+ * - mask: this is the acceptance filter mask of the channel;
+ * - canId: this is the acceptance filter address of the channel;
+ */
+canClientChannel::canClientChannel(canClient* client, uint mask, uint canId):QObject((client->isIoThread()) ? nullptr : client)
+{
+    this->client = client;
+    this->mask = mask;
+    this->canId = canId & mask;
+    ring = (client->isIoThread()) ? new canFrameRing() : nullptr;
+    drain_pending.storeRelaxed(0);
+}
+
+canClientChannel::~canClientChannel()
+{
+    if(ring) delete ring;
+}
+
+/**
+ * This function adds a received frame to the channel ring.
+ *
+ * The function is called by the I/O thread:
+ * a drain request is posted to the channel thread only if
+ * the previous request has not been yet served.
+ *
+ * @param
+ * - frame: this is the decoded frame;
+ * - rxTime: this is the socket reading timestamp of the frame;
+ *
+ * @return false if the ring is full
+ */
+bool canClientChannel::pushFrame(const canFrameParser::CAN_RX_FRAME_t* frame, qint64 rxTime)
+{
+    canFrameRing::CAN_RING_FRAME_t item;
+
+    item.rxTime = rxTime;
+    item.canId = frame->canId;
+    item.len = frame->len;
+    item.async = (frame->type == canFrameParser::FRAME_ASYNC) ? 1 : 0;
+    memcpy(item.d, frame->d, frame->len);
+
+    if(!ring->push(&item)) return false;
+
+    if(drain_pending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drainRing", Qt::QueuedConnection);
+    return true;
+}
+
+/**
+ * This is the drain request of the channel ring.
+ *
+ * The frames are read in batches and the reception signals
+ * are emitted in the channel thread.
+ */
+void canClientChannel::drainRing(void)
+{
+    canFrameRing::CAN_RING_FRAME_t batch[canFrameParser::RX_BATCH_SIZE];
+    int n;
+
+    // The request is cleared before the reading:
+    // a frame added during the reading posts a new request
+    drain_pending.fetchAndStoreOrdered(0);
+
+    while((n = ring->pop(batch, canFrameParser::RX_BATCH_SIZE))){
+        for(int i=0; i<n; i++){
+            const canFrameRing::CAN_RING_FRAME_t* frame = &batch[i];
+            QByteArray data((const char*) frame->d, frame->len);
+
+            if(frame->async){
+                emit rxAsyncFromCan(frame->canId, data);
+                emit rxAsyncStampedFromCan(frame->canId, data, frame->rxTime);
+            }else{
+                emit rxFromCan(frame->canId, data);
+                emit rxStampedFromCan(frame->canId, data, frame->rxTime);
+            }
+        }
+    }
+}
+
+/**
+ * This is the Slot that sends data to the Can Application Driver
+ * through the shared connection.
+ *
+ * @param
+ * - canId: this is the 11 or 29 bit Target Can ID;
+ * - data: this is the can data load. Max canClient::CAN_MAX_PAYLOAD bytes are admitted.
+ */
+void canClientChannel::txToCanData(uint canId, QByteArray data)
+{
+    if(ring) QMetaObject::invokeMethod(client, "txToCanData", Qt::QueuedConnection, Q_ARG(uint, canId), Q_ARG(QByteArray, data));
+    else client->txToCanData(canId, data);
 }
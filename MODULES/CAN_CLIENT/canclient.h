@@ -46,12 +46,15 @@
  *
  *
  *       <F filter_mask filter_address >
+ *       <F filter_address >
  *
  *  Where
  *  - '<' and '>' are frame delimiters
  *  - F: is the frame type identifier;
- *  - filter_mask: is the 16 bit filter mask;
- *  - filter_address: is the 16 bit filter address;
+ *  - filter_mask: is the 29 bit filter mask (11 bit canId are accepted with the same rule);
+ *  - filter_address: is the 29 bit filter address;
+ *  - the short format <F filter_address> sets a filter for the single canId filter_address
+ *    (filter_mask = canClient::CAN_FILTER_EXACT_MASK);
  *
  *
  *      NOTE: space characters are ignored for the frame syntax;
@@ -64,6 +67,13 @@
  *  - Client sends <F mask address>
  *  - Server answer replying the frame: <F mask address>
  *
+ *  A filter for a single canId (filter_mask = canClient::CAN_FILTER_EXACT_MASK)
+ *  is sent with the short format <F address>, replied as <F address>.
+ *
+ *  A connection can register many acceptance filters:
+ *  the Server forwards a frame if any of them accepts the canId.
+ *  All the filters are registered again after every reconnection to the Server.
+ *
  *
  *  ## CAN DATA FRAME FORMAT
  *
@@ -82,10 +92,67 @@
  *      the can frame is filled with 0;
  *      NOTE: if the data lenght should be greater than 8, the data will be truncated to 8.
  *
+ *  ## EXTENDED IDENTIFIERS AND CAN FD
+ *
+ *  The canId can be a standard 11 bit or an extended 29 bit identifier
+ *  (up to canClient::CAN_MAX_EXTENDED_ID), in all the frames:
+ *  the canId values up to 0x7FF are handled as standard identifiers.
+ *
+ *  With a CAN FD bus, a data frame can carry up to canClient::CAN_MAX_PAYLOAD bytes
+ *  (B0 to B63): the data are truncated to canClient::CAN_MAX_PAYLOAD bytes and
+ *  the Can Application Driver fills the frame up to the next valid CAN FD length.
+ *
  *  The can data content B0 to B7 can be of the following format:
  *  - Decimal format: example, 125;
  *  - Hexadecimal format: example, 0xCC
  *
+ * ## BINARY FRAMING MODE
+ *
+ * In order to reduce the encoding/decoding cost of the ascii format,
+ * the Client can negotiate a fixed size binary frame format.
+ *
+ * The binary framing negotiation workflow is:
+ * - The Client opens the Acceptance filter (see above);
+ * - The Client sends the offer frame of the version 2 (extended identifiers and CAN FD): <B 2 >
+ * - A Server supporting the version 2 answers replying the frame: <B 2 >
+ * - After canClient::CAN_BINARY_OFFER_ATTEMPTS attempts, the Client sends the offer of the version 1: <B 1 >
+ * - A Server supporting the version 1 answers replying the frame: <B 1 >
+ * - A Server not supporting the binary framing ignores the frames:
+ *   after canClient::CAN_BINARY_OFFER_ATTEMPTS more attempts, the Client keeps using the ascii format.
+ *
+ * When the binary framing is accepted, every CAN data frame is exchanged
+ * with the following fixed size (canClient::CAN_BINARY_FRAME_SIZE) format:
+ *
+ *      | TYPE | ID-L | ID-H | LEN | B0 | B1 | B2 | B3 | B4 | B5 | B6 | B7 |
+ *
+ *  Where
+ *  - TYPE: is the frame type identifier:
+ *      - canClient::CAN_BINARY_DATA_FRAME: Can Data frame;
+ *      - canClient::CAN_BINARY_ASYNC_FRAME: Can Asynchronous Data frame;
+ *  - ID-L, ID-H: is the 16 bit canId, little endian;
+ *  - LEN: is the number of valid data bytes (0 to 8);
+ *  - B0 to B7: are the can data content. Unused bytes are filled with 0.
+ *
+ * With the version 2, every CAN data frame is exchanged with the following
+ * variable size (canClient::CAN_BINARY_FD_HEADER_SIZE + LEN) format:
+ *
+ *      | TYPE | ID0 | ID1 | ID2 | ID3 | LEN | B0 | .. | B(LEN-1) |
+ *
+ *  Where
+ *  - TYPE: is the frame type identifier:
+ *      - canClient::CAN_BINARY_FD_DATA_FRAME: Can Data frame;
+ *      - canClient::CAN_BINARY_FD_ASYNC_FRAME: Can Asynchronous Data frame;
+ *  - ID0 to ID3: is the 29 bit canId, little endian;
+ *  - LEN: is the number of data bytes (0 to canClient::CAN_MAX_PAYLOAD);
+ *  - B0 to B(LEN-1): are the can data content.
+ *
+ * With the version 1, the frames with an extended canId or more than 8 data bytes
+ * are exchanged in the ascii format.
+ *
+ *      NOTE: the TYPE codes are greater than 0x7F, so they cannot be confused
+ *      with the '<' ascii frame initiator: ascii frames (as the acceptance filter)
+ *      remain valid also when the binary framing is active.
+ *
  * ## CAN DATA RECEPTION
  *
  * When the CAN Application receives a frame from the Can network, \n
@@ -100,8 +167,146 @@
  * - instance the Class (or subclass if needed) with the acceptance filter as a parameter;
  * - connect the SIGNAL canClient::rxFromCan() to a local Slot to handle the received can frames;
  * - connect a local signal to the SLOT canClient::txToCanData() to send data to the CAN BUS;
+ * - (optionally) connect the SIGNAL canClient::txBackpressure() to observe the tx queue congestion;
  * - start the tcpIClient connection;
  *
+ * # SHARED CONNECTION
+ *
+ * Many protocol objects of the same process can share a single connection
+ * with the Can Application Driver:
+ *
+ * - get the process-wide connection with canClient::getSharedClient():
+ *   the connection is created and started at the first call;
+ * - register a reception channel for every canId with canClient::registerChannel(),
+ *   or for a family of canId with canClient::registerMaskChannel():
+ *   the acceptance filter of the channel is added to the connection;
+ * - connect the SIGNAL canClientChannel::rxFromCan() to a local Slot to handle the received can frames;
+ * - connect a local signal to the SLOT canClientChannel::txToCanData() to send data to the CAN BUS;
+ * - (optionally) connect the SIGNAL canClientChannel::canDriverConnectionStatus()
+ *   to be notified when the acceptance filter of the channel is open.
+ *
+ * The received frames are dispatched to the channels through a lookup table indexed by the canId,
+ * precomputed at the channel registration: a frame is dispatched to all the channels accepting its canId
+ * with no filter evaluation in the reception path.
+ *
+ *      NOTE: the Can Application Driver shall keep all the acceptance filters
+ *      registered by the same connection.
+ *
+ * # I/O THREAD
+ *
+ * By default the connection lives in the thread of its creator (usually the main thread)
+ * and the frames reach the channels through queued signals:
+ * every frame costs an event and the reception timing depends on the load of that thread.
+ *
+ * Calling canClient::setIoThreadMode(true) before the first canClient::getSharedClient(),
+ * the next shared connections run the socket, the parser and the acceptance filter
+ * registration on a dedicated thread:
+ * - every channel owns a preallocated lock-free single-producer/single-consumer ring
+ *   of fixed size frames (see canFrameRing): the I/O thread writes the frames,
+ *   the channel thread reads them;
+ * - a single drain request is posted to the channel for a burst of frames:
+ *   the channel emits its reception signals for all the frames of the ring in batches;
+ * - the channel signals are emitted in the channel thread, so the receivers can
+ *   connect them with a Qt::DirectConnection (see canClientChannel::isRingMode());
+ * - the frames of the registered channels are not emitted with the canClient signals;
+ * - the transmitted frames are queued to the I/O thread;
+ * - when a ring is full the frames are discarded and counted (canClientChannel::getRingOverflows()).
+ *
+ * The shared connections are released with canClient::releaseSharedClient() or canClient::releaseSharedClients():
+ * the connection is closed, the I/O thread is stopped and joined and the connection is deleted
+ * with its channels. All the shared connections are released at the QCoreApplication::aboutToQuit() signal.
+ *
+ * # RECEPTION TIMESTAMPS
+ *
+ * Every received frame is tagged with the monotonic time (canClient::timestamp(), in ns)
+ * taken when the frame is read from the socket:
+ * - the SIGNAL canClient::rxStampedFromCan() (and canClientChannel::rxStampedFromCan())
+ *   carries the timestamp with the frame, also through the queued connections;
+ * - the SIGNAL canClient::rxFromCan() is still emitted for the receivers not using the timestamp.
+ *
+ * The connection collects the latency histograms of the reception stages
+ * (see canLatencyHistogram), measured from the socket reading:
+ * - canClient::RX_STAGE_PARSE: the frame has been decoded;
+ * - canClient::RX_STAGE_DISPATCH: the frame signal has been emitted;
+ * - canClient::RX_STAGE_HANDLER: the frame has been processed by the protocol handler
+ *   (the handler calls canClientChannel::recordHandlerLatency()).
+ *
+ * The difference between two consecutive stages is the time spent in the stage.
+ *
+ * Every histogram has a single writer (see canLatencyCollector):
+ * - the RX_STAGE_PARSE and RX_STAGE_DISPATCH histograms are written by the connection thread;
+ * - the RX_STAGE_HANDLER histogram is written per channel by the thread of its handler.
+ *
+ * The canClient::getRxLatencyHistogram() returns a snapshot from any thread
+ * (the RX_STAGE_HANDLER snapshot merges the histograms of the channels)
+ * and the canClient::resetRxLatencyHistograms() clears the histograms from any thread.
+ * Both functions shall be called by the thread registering the channels.
+ *
+ * # TRAFFIC TAP AND INJECTION
+ *
+ * The data frames of a connection can be observed and injected,
+ * for example to record and replay the CAN traffic (see canRecorderModule):
+ * - canClient::setFrameTap() assignes a canFrameTap: the tap receives every sent
+ *   and received data frame with its timestamp, in the connection thread;
+ * - canClient::injectRxFrame() adds a frame to the reception path as if it was
+ *   received from the Can Application Driver: the frame is dispatched to the
+ *   channels and to the canClient signals as a received frame.
+ *
+ * # CONNECTION STATE AND RECONNECTION
+ *
+ * The connection is handled by a single state machine (see canClient::CAN_CONNECTION_STATE_t):
+ *
+ *      DISCONNECTED -> CONNECTING -> REGISTERING -> READY
+ *                          ^              |           |
+ *                          |              v           v
+ *                          +--------- BACKOFF <-------+
+ *
+ * - CONNECTING: the socket is connecting to the Can Application Driver;
+ * - REGISTERING: the socket is connected and the acceptance filters are sent;
+ * - READY: all the acceptance filters have been acknowledged;
+ * - BACKOFF: the connection failed or has been lost: a new connection attempt
+ *   is started after a delay doubled at every failed attempt, from canClient::CAN_RECONNECT_MIN_DELAY
+ *   up to canClient::CAN_RECONNECT_MAX_DELAY, with a random jitter of canClient::CAN_RECONNECT_JITTER percent,
+ *   so the processes of the same Driver don't reconnect at the same time.
+ *   The delay is reset when the connection becomes READY.
+ *
+ * Every state change is notified with the canClient::connectionStateChanged() signal.
+ *
+ * When the socket is connected, all the acceptance filters are sent in a single burst;
+ * the filters not yet acknowledged are sent again with an interval doubled at every attempt,
+ * from canClient::CAN_FILTER_RETRY_MIN_TMO up to canClient::CAN_FILTER_RETRY_MAX_TMO.
+ *
+ * When the connection becomes READY every channel is notified with canClientChannel::canDriverConnectionStatus(true):
+ * the protocol objects resynchronize their state at this notification (see canDeviceModule).
+ *
+ * # TRAFFIC STATISTICS
+ *
+ * The connection counts the sent and received data frames and bytes,
+ * in total and per canId, and the bytes waiting in the transmission queue
+ * (see canTrafficStatistics):
+ * - the counters are cache line padded atomics updated by the connection thread only,
+ *   so the counting has no locks and no shared cache lines with the readers;
+ * - canClient::getTrafficStatistics() returns a snapshot of the counters from any thread;
+ * - canClient::setStatisticsDump() periodically logs the frame and byte rates,
+ *   the estimated bus load and the traffic of every active canId.
+ *
+ * The per Device counters (transactions, retries, timeouts, frame errors and
+ * pipeline depth) are provided by the canDeviceProtocol (see canDeviceModule).
+ *
+ * # DEPENDENCES
+ *
+ * This module requires the use of the:
+ *
+ * + sockettxqueue.cpp
+ * + sockettxqueue.h
+ * + canlatencyhistogram.cpp
+ * + canlatencyhistogram.h
+ * + canframering.cpp
+ * + canframering.h
+ * + canframetap.h
+ * + canstatistics.cpp
+ * + canstatistics.h
+ *
  *
  * \ingroup libraryModules
  *
@@ -115,6 +320,20 @@
 #include <QAbstractSocket>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QTimer>
+#include <QMap>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QRandomGenerator>
+#include "canframeparser.h"
+#include "canlatencyhistogram.h"
+#include "canframering.h"
+#include "canframetap.h"
+#include "canstatistics.h"
+#include "sockettxqueue.h"
+
+class canClientChannel;
 
 /**
  * @brief The canClient class definition
@@ -125,20 +344,120 @@ class canClient: public QTcpServer
     Q_OBJECT
 
 public:
-    explicit canClient(ushort can_rx_address, QString IP, int PORT);
+    explicit canClient(uint can_rx_address, QString IP, int PORT);
+    explicit canClient(QString IP, int PORT);
     ~canClient();
 
+    static const int   CAN_ID_TABLE_SIZE = 2048;        //!< Size of the channel lookup table (11 bit canId)
+    static const int   CAN_EXTENDED_CACHE_SIZE = 1024;  //!< Maximum number of extended canId in the channel lookup cache
+    static const uint  CAN_MAX_EXTENDED_ID = 0x1FFFFFFF; //!< Maximum extended canId (29 bit)
+    static const int   CAN_MAX_PAYLOAD = canFrameParser::MAX_PAYLOAD; //!< Maximum number of data bytes of a frame (CAN FD)
+    static const uint  CAN_FILTER_EXACT_MASK = 0xFFFFFFFF; //!< Acceptance filter mask of a single canId
+
+    static const uchar CAN_BINARY_DATA_FRAME = 0xD0;    //!< Binary framing: Can Data frame type
+    static const uchar CAN_BINARY_ASYNC_FRAME = 0xA0;   //!< Binary framing: Can Asynchronous Data frame type
+    static const int   CAN_BINARY_FRAME_SIZE = 12;      //!< Binary framing: size in bytes of a frame
+    static const uchar CAN_BINARY_FD_DATA_FRAME = 0xD1; //!< Binary framing version 2: Can Data frame type
+    static const uchar CAN_BINARY_FD_ASYNC_FRAME = 0xA1;//!< Binary framing version 2: Can Asynchronous Data frame type
+    static const int   CAN_BINARY_FD_HEADER_SIZE = 6;   //!< Binary framing version 2: size in bytes of the frame header
+    static const uchar CAN_BINARY_VERSION = 2;          //!< Highest binary framing version offered by the client
+    static const int   CAN_BINARY_OFFER_ATTEMPTS = 3;   //!< Number of binary framing offers of every version before the fallback
+    static const int   CAN_RECONNECT_MIN_DELAY = 100;   //!< Delay of the first reconnection attempt in ms
+    static const int   CAN_RECONNECT_MAX_DELAY = 5000;  //!< Maximum delay of a reconnection attempt in ms
+    static const int   CAN_RECONNECT_JITTER = 25;       //!< Random jitter of the reconnection delay in percent
+    static const int   CAN_FILTER_RETRY_MIN_TMO = 50;   //!< First acceptance filter retry interval in ms
+    static const int   CAN_FILTER_RETRY_MAX_TMO = 1000; //!< Maximum acceptance filter retry interval in ms
+
+    /**
+     *  This enumeration defines the connection states
+     */
+    typedef enum{
+        STATE_DISCONNECTED = 0, //!< The connection has not been started
+        STATE_CONNECTING,       //!< The socket is connecting to the Can Application Driver
+        STATE_REGISTERING,      //!< The socket is connected: the acceptance filters are being registered
+        STATE_READY,            //!< All the acceptance filters have been acknowledged
+        STATE_BACKOFF,          //!< Waiting the delay of the next connection attempt
+    }CAN_CONNECTION_STATE_t;
+
+    /**
+     *  This is the fixed size binary frame content
+     */
+    typedef struct{
+        uchar type;     //!< Frame type: CAN_BINARY_DATA_FRAME or CAN_BINARY_ASYNC_FRAME
+        uchar id[2];    //!< canId, little endian
+        uchar len;      //!< Number of valid data bytes
+        uchar d[8];     //!< Can data content
+    }CAN_BINARY_FRAME_t;
+
+    /**
+     *  This is the variable size binary frame content (version 2)
+     */
+    typedef struct{
+        uchar type;     //!< Frame type: CAN_BINARY_FD_DATA_FRAME or CAN_BINARY_FD_ASYNC_FRAME
+        uchar id[4];    //!< canId, little endian
+        uchar len;      //!< Number of data bytes
+        uchar d[CAN_MAX_PAYLOAD]; //!< Can data content: only len bytes are exchanged
+    }CAN_BINARY_FD_FRAME_t;
+
+    /**
+     *  This enumeration defines the reception stages of the latency histograms
+     */
+    typedef enum{
+        RX_STAGE_PARSE = 0,     //!< From the socket reading to the frame decoding
+        RX_STAGE_DISPATCH,      //!< From the socket reading to the frame signal emission
+        RX_STAGE_HANDLER,       //!< From the socket reading to the protocol handler
+        RX_STAGES               //!< Number of reception stages
+    }CAN_RX_STAGE_t;
 
-    void ConnectToCanServer(void);
-    _inline bool isCanReady(void) {return rx_filter_open;}
+    /**
+     * @brief This function returns the monotonic process time
+     *
+     * @return the time in ns from the first call
+     */
+    static qint64 timestamp(void){
+        if(!monotonicClock.isValid()) monotonicClock.start();
+        return monotonicClock.nsecsElapsed();
+    }
+
+
+    static canClient* getSharedClient(QString IP, int PORT); //!< Returns the process-wide connection
+    static void releaseSharedClient(QString IP, int PORT); //!< Closes and deletes a process-wide connection
+    static void releaseSharedClients(void); //!< Closes and deletes all the process-wide connections
+    static void setIoThreadMode(bool enable) {ioThreadMode = enable;} //!< The next shared connections run on a dedicated I/O thread
+    canClientChannel* registerChannel(uint canId); //!< Registers a reception channel for a canId
+    canClientChannel* registerMaskChannel(uint mask, uint address); //!< Registers a reception channel for a mask/address acceptance filter
+
+    Q_INVOKABLE void ConnectToCanServer(void);
+    Q_INVOKABLE void DisconnectFromCanServer(void); //!< Closes the connection with no reconnection
+    Q_INVOKABLE bool txFlush(int timeout); //!< Synchronous flush of the pending tx frames
+    Q_INVOKABLE void injectRxFrame(uint canId, QByteArray data, bool async, qint64 rxTime); //!< Adds a frame to the reception path
+    _inline void setFrameTap(canFrameTap* tap) {frameTap.storeRelease(tap);} //!< Assignes the traffic tap (nullptr to remove it)
+    _inline bool isIoThread(void) {return ioThread != nullptr;} //!< Test if the connection runs on a dedicated I/O thread
+    _inline CAN_CONNECTION_STATE_t getConnectionState(void) {return (CAN_CONNECTION_STATE_t) connectionState.loadRelaxed();} //!< Returns the connection state
+    _inline uint getReconnections(void) {return reconnections.loadRelaxed();} //!< Returns the number of reconnection attempts
+    _inline bool isCanReady(void) {return (rx_filter_open.loadRelaxed() != 0);}
+    _inline bool isBinaryFraming(void) {return binary_version != 0;} //!< Test if the binary framing has been accepted by the server
+    _inline uchar getBinaryVersion(void) {return binary_version;}   //!< Returns the accepted binary framing version (0 = ascii)
+
+    canLatencyHistogram getRxLatencyHistogram(CAN_RX_STAGE_t stage); //!< Returns the snapshot of the latency histogram of a reception stage
+    void resetRxLatencyHistograms(void); //!< Clears the latency histograms
+    void recordRxLatency(CAN_RX_STAGE_t stage, qint64 rxTime); //!< Connection thread: adds the latency of a frame to a stage histogram
+
+    _inline canTrafficStatistics::CAN_TRAFFIC_SNAPSHOT_t getTrafficStatistics(void) {return trafficStatistics.snapshot(timestamp());} //!< Returns the snapshot of the traffic counters
+    Q_INVOKABLE void resetTrafficStatistics(void); //!< Clears the traffic counters
+    Q_INVOKABLE void setStatisticsDump(int period, uint bitrate = canTrafficStatistics::CAN_STAT_DEFAULT_BITRATE); //!< Periodic log of the traffic statistics (0 = disabled)
 
 signals:
-    void rxFromCan(ushort canId, QByteArray data);
-    void rxAsyncFromCan(ushort canId, QByteArray data);
+    void rxFromCan(uint canId, QByteArray data);
+    void rxAsyncFromCan(uint canId, QByteArray data);
+    void rxStampedFromCan(uint canId, QByteArray data, qint64 rxTime); //!< Received frame with the socket reading timestamp
+    void rxAsyncStampedFromCan(uint canId, QByteArray data, qint64 rxTime); //!< Received asynchronous frame with the socket reading timestamp
     void canDriverConnectionStatus(bool status);
+    void txBackpressure(bool congested); //!< Emitted when the tx queue crosses the high-water mark
+    void connectionStateChanged(int state); //!< Emitted at every connection state change (see CAN_CONNECTION_STATE_t)
 
 public slots:
-    void txToCanData(ushort canId, QByteArray data);
+    void txToCanData(uint canId, QByteArray data);
 
 
 private slots:
@@ -147,6 +466,11 @@ private slots:
     void socketConnected(); // Segnale di connessione avvenuta con il server
     void socketDisconnected(); // IL server ha chiiuso la connessione
     void setAcceptanceFilter();
+    void offerBinaryFraming();
+    void addAcceptanceFilter(uint mask, uint address);
+    void addDemuxChannel(canClientChannel* channel);
+    void dumpStatistics();
+    void reconnectEvent();
 
 public:
     bool connectionStatus;
@@ -156,14 +480,101 @@ private:
     QHostAddress serverip;      // Addrees of the remote server
     quint16      serverport;    // Port of the remote server
     QTcpSocket*  socket;
+    socketTxQueue* txQueue;     //!< Non blocking transmission queue
+
+    /**
+     *  This is the Acceptance filter registration status
+     */
+    typedef struct{
+        uint   mask;    //!< Acceptance filter mask
+        uint   address; //!< Acceptance filter address
+        bool   open;    //!< The filter has been acknowledged by the server
+    }CAN_FILTER_t;
 
-    ushort  rxCanId;             //!< The CAN Rx Acceptance Filter
-    bool    rx_filter_open;        //!< The Acceptance filter has been set
+    QList<CAN_FILTER_t> rxFilters; //!< The CAN Rx Acceptance Filters
+    QAtomicInteger<int> rx_filter_open; //!< All the Acceptance filters have been set (written by the I/O thread)
+    QTimer  filterTimer;           //!< Acceptance filter registration retry timer
+    int     filterRetryTmo;        //!< Current acceptance filter retry interval in ms
+    QTimer  reconnectTimer;        //!< Reconnection delay timer
+    int     reconnectDelay;        //!< Delay of the next reconnection attempt in ms (before the jitter)
+    QAtomicInteger<int>  connectionState; //!< Connection state (see CAN_CONNECTION_STATE_t)
+    QAtomicInteger<uint> reconnections;   //!< Number of reconnection attempts
+    QList<canClientChannel*> channels;      //!< Registered channels (registration thread)
+    QList<canClientChannel*> demuxChannels; //!< Registered channels (connection thread)
+    QVector<canClientChannel*> demuxTable[CAN_ID_TABLE_SIZE]; //!< Channels accepting every canId, precomputed at the registration
+    QHash<uint, QVector<canClientChannel*>> demuxExtended;    //!< Channels accepting the received extended canId, computed at the first reception
+    inline static QMap<QString, canClient*> sharedClients; //!< Process-wide connections
+    uchar   binary_version;        //!< Binary framing version accepted by the server (0 = ascii)
+    int     binary_offers;         //!< Number of binary framing offers sent
+    canFrameParser rxParser;       //!< Streaming parser of the received frames
+    canLatencyCollector rxHistograms[RX_STAGES]; //!< Latency histograms of the connection thread stages (RX_STAGE_HANDLER is collected by the channels)
+    inline static QElapsedTimer monotonicClock; //!< Process-wide monotonic time base
+    inline static bool ioThreadMode = false;     //!< The next shared connections run on a dedicated I/O thread
+    inline static bool releaseHooked = false;    //!< The shared connections release is hooked to the application exit
+    QThread* ioThread;             //!< Dedicated I/O thread (nullptr if not used)
+    QAtomicPointer<canFrameTap> frameTap; //!< Traffic tap (nullptr if not used)
+    canTrafficStatistics trafficStatistics; //!< Traffic counters
+    QTimer  statisticsTimer;       //!< Periodic statistics log timer
+    uint    statisticsBitrate;     //!< Nominal bus bit rate of the statistics log
+    canTrafficStatistics::CAN_TRAFFIC_SNAPSHOT_t statisticsPrevious; //!< Snapshot of the previous statistics log
 
     void clientConnect();       // Try to connect the remote server    
 
-    void handleSocketFrame(QByteArray* data);
-    ushort getItem(int* index, QByteArray* data, bool* data_ok);
+    void handleRxFrame(const canFrameParser::CAN_RX_FRAME_t* frame, qint64 rxTime);
+    void startIoThread(void);
+    void stopIoThread(void);
+    void notifyFilterStatus(const CAN_FILTER_t* filter, bool status);
+    QVector<canClientChannel*> demuxTargets(uint canId);
+    void closeAcceptanceFilters(void);
+    void setConnectionState(CAN_CONNECTION_STATE_t state);
+    void connectionLost(void);
+};
+
+/**
+ * @brief The canClientChannel class definition
+ *
+ * This is the reception channel of a canId on a shared connection.
+ * The channel is created with the canClient::registerChannel() method.
+ *
+ */
+class canClientChannel: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit canClientChannel(canClient* client, uint mask, uint canId);
+    ~canClientChannel();
+
+    _inline uint getCanId(void) {return canId;} //!< Returns the canId (acceptance filter address) of the channel
+    _inline uint getMask(void) {return mask;}   //!< Returns the acceptance filter mask of the channel
+    _inline bool isAccepted(uint id) {return (id & mask) == canId;} //!< Test if the channel receives a canId
+    _inline bool isRingMode(void) {return ring != nullptr;} //!< Test if the frames are received through the I/O thread ring
+    _inline uint getRingOverflows(void) {return (ring) ? ring->getOverflows() : 0;} //!< Returns the frames discarded because of the full ring
+    bool pushFrame(const canFrameParser::CAN_RX_FRAME_t* frame, qint64 rxTime); //!< I/O thread: adds a received frame to the ring
+    _inline void recordHandlerLatency(qint64 rxTime) {handlerLatency.add(canClient::timestamp() - rxTime);} //!< Handler thread: records the protocol handler latency of a frame
+    _inline canLatencyHistogram getHandlerLatency(void) {return handlerLatency.snapshot();} //!< Returns the snapshot of the protocol handler latency histogram
+    _inline void resetHandlerLatency(void) {handlerLatency.reset();} //!< Clears the protocol handler latency histogram
+
+signals:
+    void rxFromCan(uint canId, QByteArray data);
+    void rxAsyncFromCan(uint canId, QByteArray data);
+    void rxStampedFromCan(uint canId, QByteArray data, qint64 rxTime); //!< Received frame with the socket reading timestamp
+    void rxAsyncStampedFromCan(uint canId, QByteArray data, qint64 rxTime); //!< Received asynchronous frame with the socket reading timestamp
+    void canDriverConnectionStatus(bool status); //!< Acceptance filter of the channel open/closed
+
+public slots:
+    void txToCanData(uint canId, QByteArray data);
+
+private slots:
+    void drainRing(void);
+
+private:
+    canClient* client;  //!< Shared connection
+    uint   canId;       //!< The channel canId (acceptance filter address)
+    uint   mask;        //!< The channel acceptance filter mask
+    canFrameRing* ring; //!< Reception ring from the I/O thread (nullptr if not used)
+    QAtomicInteger<uint> drain_pending; //!< A drain request has been posted to the channel thread
+    canLatencyCollector handlerLatency; //!< Protocol handler latency histogram (written by the handler thread)
 };
 
 
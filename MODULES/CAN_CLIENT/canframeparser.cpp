@@ -0,0 +1,363 @@
+#include "canframeparser.h"
+#include "canclient.h"
+
+/**
+ * This is the class constructor.
+ *
+ * The Constructor only initializes the ring buffer indexes and the decoding status.
+ */
+canFrameParser::canFrameParser()
+{
+    legacy = false;
+    reset();
+}
+
+/**
+ * This function discards all the received bytes
+ * and the decoding status of an unfinished frame.
+ *
+ * It shall be called every new connection with the Can Application Driver.
+ */
+void canFrameParser::reset(void)
+{
+    head = 0;
+    tail = 0;
+    status = PARSE_IDLE;
+    binary_len = 0;
+    binary_size = 0;
+    nitems = 0;
+}
+
+/**
+ * This function returns the pointer to the contiguous free area of the ring buffer.
+ *
+ * The caller can write directly at the returned pointer up to free bytes
+ * and then shall call the canFrameParser::commit() with the number of written bytes.
+ *
+ * @param free pointer to the returned size of the contiguous free area
+ * @return the pointer to the free area
+ */
+char* canFrameParser::writePointer(int* free){
+    uint idx = head & (RX_BUFFER_SIZE - 1);
+    uint available = RX_BUFFER_SIZE - (head - tail);
+
+    if(available > RX_BUFFER_SIZE - idx) available = RX_BUFFER_SIZE - idx;
+    *free = available;
+    return &ring[idx];
+}
+
+/**
+ * This function commits the bytes written at the canFrameParser::writePointer().
+ *
+ * @param n the number of written bytes (negative values are ignored)
+ */
+void canFrameParser::commit(qint64 n){
+    if(n <= 0) return;
+    head += n;
+}
+
+/**
+ * This function terminates the current ascii item.
+ *
+ * A valid item is added to the item list of the frame.\n
+ * An invalid item (not a number or greater than canFrameParser::MAX_ITEM_VALUE) truncates the frame:
+ * the next items are discarded, as for the legacy ascii decoder.
+ */
+void canFrameParser::closeItem(void){
+    if(!item_digits) return;
+
+    if((item_error) || (item > MAX_ITEM_VALUE)) frame_truncated = true;
+    else if((!frame_truncated) && (nitems < MAX_ASCII_ITEMS)) items[nitems++] = (uint) item;
+
+    item = 0;
+    item_digits = 0;
+    item_hex = false;
+    item_error = false;
+}
+
+/**
+ * This function terminates the current ascii frame.
+ *
+ * @param frame pointer to the decoded frame
+ * @return true if the frame is valid
+ */
+bool canFrameParser::closeAsciiFrame(CAN_RX_FRAME_t* frame){
+
+    switch(ascii_type){
+    case 'F':
+        if(nitems < 1) return false;
+        frame->type = FRAME_FILTER;
+        if(nitems >= 2){
+            frame->mask = items[0];
+            frame->canId = items[1];
+        }else{
+            frame->mask = 0xFFFFFFFF; // canClient::CAN_FILTER_EXACT_MASK
+            frame->canId = items[0];
+        }
+        frame->len = 0;
+        return true;
+
+    case 'B':
+        if(nitems < 1) return false;
+        frame->type = FRAME_BINARY;
+        frame->canId = items[0];
+        frame->len = 0;
+        return true;
+
+    case 'D':
+    case 'A':
+        if(nitems < 2) return false;
+        frame->type = (ascii_type == 'A') ? FRAME_ASYNC : FRAME_DATA;
+        frame->canId = items[0];
+        frame->len = (nitems - 1 > MAX_PAYLOAD) ? MAX_PAYLOAD : nitems - 1;
+        for(int i=0; i< frame->len; i++) frame->d[i] = (uchar) items[1+i];
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * This function terminates the current binary frame.
+ *
+ * @param frame pointer to the decoded frame
+ * @return true if the frame is valid
+ */
+bool canFrameParser::closeBinaryFrame(CAN_RX_FRAME_t* frame){
+
+    // Version 2: variable size frame
+    if((binary[0] == canClient::CAN_BINARY_FD_DATA_FRAME) || (binary[0] == canClient::CAN_BINARY_FD_ASYNC_FRAME)){
+        const canClient::CAN_BINARY_FD_FRAME_t* fd = (const canClient::CAN_BINARY_FD_FRAME_t*) binary;
+
+        frame->type = (fd->type == canClient::CAN_BINARY_FD_ASYNC_FRAME) ? FRAME_ASYNC : FRAME_DATA;
+        frame->canId = (uint) fd->id[0] | ((uint) fd->id[1] << 8) | ((uint) fd->id[2] << 16) | ((uint) fd->id[3] << 24);
+        frame->len = fd->len;
+        memcpy(frame->d, fd->d, fd->len);
+        return (frame->canId <= MAX_ITEM_VALUE);
+    }
+
+    const canClient::CAN_BINARY_FRAME_t* bin = (const canClient::CAN_BINARY_FRAME_t*) binary;
+
+    if((bin->len == 0) || (bin->len > 8)) return false;
+
+    frame->type = (bin->type == canClient::CAN_BINARY_ASYNC_FRAME) ? FRAME_ASYNC : FRAME_DATA;
+    frame->canId = (ushort) bin->id[0] | ((ushort) bin->id[1] << 8);
+    frame->len = bin->len;
+    memcpy(frame->d, bin->d, bin->len);
+    return true;
+}
+
+/**
+ * This function decodes the committed bytes.
+ *
+ * The decoding stops when all the committed bytes are processed
+ * or when the batch is full: in this case the caller shall call again the function
+ * until it returns less than max frames.
+ *
+ * An unfinished frame is kept in the decoding status
+ * and it is completed with the next committed bytes.
+ *
+ * The ascii frame rules are the same of the canClientModule protocol:
+ * - a frame is < .... >;
+ * - the first character is the frame type;
+ * - the items are separated by spaces, in decimal or hexadecimal (0x) format.
+ *
+ * Outside of an ascii frame, a binary frame type code starts a
+ * binary frame of canClient::CAN_BINARY_FRAME_SIZE bytes (version 1)
+ * or of canClient::CAN_BINARY_FD_HEADER_SIZE + LEN bytes (version 2).
+ *
+ * @param batch pointer to the array of decoded frames
+ * @param max size of the batch array
+ * @return the number of decoded frames
+ */
+int canFrameParser::decode(CAN_RX_FRAME_t* batch, int max){
+    if(legacy) return decodeLegacy(batch, max);
+    int count = 0;
+
+    while((tail != head) && (count < max)){
+        uchar c = (uchar) ring[tail & (RX_BUFFER_SIZE - 1)];
+        tail++;
+
+        // Binary frame content
+        if(status == PARSE_BINARY){
+            binary[binary_len++] = c;
+
+            // Version 2: the LEN field sets the frame size
+            if((binary_len == canClient::CAN_BINARY_FD_HEADER_SIZE) && (binary_size == canClient::CAN_BINARY_FD_HEADER_SIZE)){
+                if(c > MAX_PAYLOAD){
+                    status = PARSE_IDLE;
+                    continue;
+                }
+                binary_size += c;
+            }
+
+            if(binary_len == binary_size){
+                if(closeBinaryFrame(&batch[count])) count++;
+                status = PARSE_IDLE;
+            }
+            continue;
+        }
+
+        // Every initiator starts a new ascii frame
+        if(c == '<'){
+            status = PARSE_ASCII;
+            ascii_type = 0;
+            nitems = 0;
+            item = 0;
+            item_digits = 0;
+            item_hex = false;
+            item_error = false;
+            frame_truncated = false;
+            continue;
+        }
+
+        if(status == PARSE_IDLE){
+            if((c == canClient::CAN_BINARY_DATA_FRAME) || (c == canClient::CAN_BINARY_ASYNC_FRAME)){
+                status = PARSE_BINARY;
+                binary[0] = c;
+                binary_len = 1;
+                binary_size = canClient::CAN_BINARY_FRAME_SIZE;
+            }else if((c == canClient::CAN_BINARY_FD_DATA_FRAME) || (c == canClient::CAN_BINARY_FD_ASYNC_FRAME)){
+                status = PARSE_BINARY;
+                binary[0] = c;
+                binary_len = 1;
+                binary_size = canClient::CAN_BINARY_FD_HEADER_SIZE;
+            }
+            continue;
+        }
+
+        // Ascii frame content
+        if(c == '>'){
+            closeItem();
+            if(closeAsciiFrame(&batch[count])) count++;
+            status = PARSE_IDLE;
+            continue;
+        }
+
+        if(c == ' '){
+            closeItem();
+            continue;
+        }
+
+        // The first character is the frame type identifier
+        if(!ascii_type){
+            ascii_type = c;
+            continue;
+        }
+
+        item_digits++;
+        if((c >= '0') && (c <= '9')){
+            if(item_hex) item = item * 16 + (c - '0');
+            else item = item * 10 + (c - '0');
+        }else if((c == 'x') || (c == 'X')){
+            item_hex = true;
+        }else if((item_hex) && (c >= 'a') && (c <= 'f')){
+            item = item * 16 + (c - 'a' + 10);
+        }else if((item_hex) && (c >= 'A') && (c <= 'F')){
+            item = item * 16 + (c - 'A' + 10);
+        }else item_error = true;
+
+        // Prevents the overflow of very long items
+        if(item > MAX_ITEM_VALUE) item_error = true;
+    }
+
+    return count;
+}
+
+/**
+ * This function terminates the current legacy frame.
+ *
+ * @param frame pointer to the decoded frame
+ * @return true if the frame is valid
+ */
+bool canFrameParser::closeLegacyFrame(CAN_RX_FRAME_t* frame){
+
+    switch(ascii_type){
+    case 'D':
+        frame->type = FRAME_DATA;
+        frame->canId = 0;
+        frame->len = LEGACY_DATA_SIZE;
+        memcpy(frame->d, binary, LEGACY_DATA_SIZE);
+        return true;
+
+    case 'C':
+        frame->type = FRAME_FILTER;
+        frame->canId = ((uint) binary[0] | ((uint) binary[1] << 8)) & 0x7FF;
+        frame->mask = 0xFFFFFFFF; // canClient::CAN_FILTER_EXACT_MASK
+        frame->len = 0;
+        return true;
+
+    case 'H':
+        frame->type = FRAME_HEARTBEAT;
+        frame->canId = 0;
+        frame->len = 0;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * This function decodes the committed bytes with the legacy Device framing.
+ *
+ * See the canFrameParser::decode() for the batch handling and
+ * the LEGACY FRAMING section of the canFrameParserModule for the frame format.
+ *
+ * @param batch pointer to the array of decoded frames
+ * @param max size of the batch array
+ * @return the number of decoded frames
+ */
+int canFrameParser::decodeLegacy(CAN_RX_FRAME_t* batch, int max){
+    int count = 0;
+
+    while((tail != head) && (count < max)){
+        uchar c = (uchar) ring[tail & (RX_BUFFER_SIZE - 1)];
+        tail++;
+
+        switch(status){
+        case PARSE_LEGACY_PAYLOAD:
+            binary[binary_len++] = c;
+            if(binary_len == binary_size){
+                if(closeLegacyFrame(&batch[count])) count++;
+                status = PARSE_IDLE;
+            }
+            continue;
+
+        case PARSE_LEGACY_TYPE:
+            ascii_type = c;
+            if(c == 'D') binary_size = LEGACY_DATA_SIZE;
+            else if(c == 'C') binary_size = LEGACY_CONFIG_SIZE;
+            else if(c == 'H') binary_size = 0;
+            else{
+                status = (c == '<') ? PARSE_LEGACY_TYPE : PARSE_IDLE;
+                continue;
+            }
+            status = PARSE_LEGACY_CLOSE;
+            continue;
+
+        case PARSE_LEGACY_CLOSE:
+            if(c != '>'){
+                status = (c == '<') ? PARSE_LEGACY_TYPE : PARSE_IDLE;
+                continue;
+            }
+            binary_len = 0;
+            if(binary_size){
+                status = PARSE_LEGACY_PAYLOAD;
+                continue;
+            }
+            if(closeLegacyFrame(&batch[count])) count++;
+            status = PARSE_IDLE;
+            continue;
+
+        default:
+            // Waiting for a frame initiator
+            if(c == '<') status = PARSE_LEGACY_TYPE;
+            else status = PARSE_IDLE;
+            continue;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,144 @@
+#ifndef CANFRAMEPARSER_H
+#define CANFRAMEPARSER_H
+
+/*!
+ * \defgroup  canFrameParserModule Can Client Streaming Frame Parser.
+ *
+ * This Library Module implements the incremental decoder of the
+ * data stream received from the CAN Application Driver.
+ *
+ * # MODULE OVERVIEW
+ *
+ * The TcpIp stream doesn't preserve the frame boundaries:
+ * a single reception can contain many frames (coalesced frames)
+ * or only a part of a frame (split frame).
+ *
+ * The canFrameParser class:
+ * - receives the socket data directly into a preallocated ring buffer;
+ * - decodes the ascii frames (see the canClientModule protocol) digit by digit,
+ *   without any intermediate string;
+ * - decodes the binary frames (see the canClientModule binary framing);
+ * - keeps the decoding status of an unfinished frame between two receptions;
+ * - returns the decoded frames in a batch.
+ *
+ * No heap allocation is performed after the construction.
+ *
+ * # LEGACY FRAMING
+ *
+ * The canFrameParser::setLegacyFraming() selects the framing of the legacy
+ * Device connection, where a short ascii header is followed by raw bytes:
+ * - <D> + 8 raw bytes: protocol data frame (FRAME_DATA, canId = 0, len = 8);
+ * - <C> + 2 raw bytes: configured canId acknowledge (FRAME_FILTER, little endian canId);
+ * - <H>: heartbeat (FRAME_HEARTBEAT).
+ *
+ * The raw bytes can contain any value, '<' and '>' included: the payload is
+ * collected by size, so the coalesced and split frames are decoded as the other framings.
+ * A header with an unknown type is discarded up to the next '<'.
+ *
+ * # USAGE
+ *
+ * \code
+ *   canFrameParser::CAN_RX_FRAME_t batch[canFrameParser::RX_BATCH_SIZE];
+ *
+ *   int free;
+ *   char* ptr = parser.writePointer(&free);
+ *   parser.commit(socket->read(ptr, free));
+ *
+ *   int n;
+ *   while((n = parser.decode(batch, canFrameParser::RX_BATCH_SIZE))){
+ *       ... handle batch[0] to batch[n-1]
+ *   }
+ * \endcode
+ *
+ * \ingroup canClientModule
+ */
+
+#include <QtCore>
+
+/**
+ * @brief The canFrameParser class definition
+ *
+ */
+class canFrameParser
+{
+
+public:
+    explicit canFrameParser();
+    ~canFrameParser(){};
+
+    static const uint RX_BUFFER_SIZE = 4096;    //!< Size of the reception ring buffer (power of 2)
+    static const int  RX_BATCH_SIZE = 64;       //!< Suggested size of the decoded frames batch
+    static const int  MAX_PAYLOAD = 64;         //!< Maximum number of data bytes of a frame (CAN FD)
+    static const int  MAX_ASCII_ITEMS = MAX_PAYLOAD + 1; //!< Maximum number of items of an ascii frame (canId and data)
+    static const uint MAX_ITEM_VALUE = 0x1FFFFFFF; //!< Maximum value of an ascii item (29 bit canId)
+    static const int  LEGACY_DATA_SIZE = 8;     //!< Legacy framing: raw bytes of a <D> frame
+    static const int  LEGACY_CONFIG_SIZE = 2;   //!< Legacy framing: raw bytes of a <C> frame
+
+    /**
+     *  This enumeration defines the decoded frame types
+     */
+    typedef enum{
+        FRAME_DATA = 0,     //!< Can Data frame
+        FRAME_ASYNC,        //!< Can Asynchronous Data frame
+        FRAME_FILTER,       //!< Acceptance Filter acknowledge
+        FRAME_BINARY,       //!< Binary Framing acknowledge
+        FRAME_HEARTBEAT,    //!< Legacy framing heartbeat
+    }CAN_RX_FRAME_TYPE_t;
+
+    /**
+     *  This is the decoded frame content
+     */
+    typedef struct{
+        uchar  type;    //!< Frame type (see CAN_RX_FRAME_TYPE_t)
+        uint   canId;   //!< canId (11 or 29 bit) for data frames, or the acknowledged filter address/binary version
+        uint   mask;    //!< Acknowledged filter mask (0xFFFFFFFF for the short filter format)
+        uchar  len;     //!< Number of valid data bytes (0 to MAX_PAYLOAD)
+        uchar  d[MAX_PAYLOAD]; //!< Can data content
+    }CAN_RX_FRAME_t;
+
+    char* writePointer(int* free); //!< Returns the pointer and the size of the contiguous free ring area
+    void  commit(qint64 n);        //!< Commits n bytes written at the writePointer()
+    int   decode(CAN_RX_FRAME_t* batch, int max); //!< Decodes the committed bytes into the batch
+    void  reset(void);             //!< Discards any received byte and unfinished frame
+    void  setLegacyFraming(bool enable) {legacy = enable; reset();} //!< Selects the legacy Device framing
+
+private:
+    char  ring[RX_BUFFER_SIZE];    //!< Reception ring buffer
+    uint  head;                    //!< Write index (free running)
+    uint  tail;                    //!< Read index (free running)
+
+    /**
+     *  This is the decoding status
+     */
+    typedef enum{
+        PARSE_IDLE = 0,     //!< Waiting for a frame initiator
+        PARSE_ASCII,        //!< Decoding an ascii frame
+        PARSE_BINARY,       //!< Decoding a binary frame
+        PARSE_LEGACY_TYPE,  //!< Legacy framing: waiting for the frame type
+        PARSE_LEGACY_CLOSE, //!< Legacy framing: waiting for the header terminator
+        PARSE_LEGACY_PAYLOAD,//!< Legacy framing: collecting the raw bytes
+    }PARSE_STATUS_t;
+
+    bool    legacy;                //!< Legacy Device framing selected
+    PARSE_STATUS_t status;         //!< Current decoding status
+    char    ascii_type;            //!< Ascii frame type identifier
+    uint    items[MAX_ASCII_ITEMS];//!< Ascii frame decoded items
+    int     nitems;                //!< Number of ascii decoded items
+    quint64 item;                  //!< Current ascii item value
+    int     item_digits;           //!< Current ascii item number of characters
+    bool    item_hex;              //!< Current ascii item is in hexadecimal format
+    bool    item_error;            //!< Current ascii item contains invalid characters
+    bool    frame_truncated;       //!< An invalid item has been detected: the next items are discarded
+    uchar   binary[8 + MAX_PAYLOAD];//!< Binary frame being received
+    int     binary_len;            //!< Number of binary frame bytes received
+    int     binary_size;           //!< Expected size of the binary frame being received
+
+    void closeItem(void);
+    bool closeAsciiFrame(CAN_RX_FRAME_t* frame);
+    bool closeBinaryFrame(CAN_RX_FRAME_t* frame);
+    bool closeLegacyFrame(CAN_RX_FRAME_t* frame);
+    int  decodeLegacy(CAN_RX_FRAME_t* batch, int max);
+};
+
+
+#endif // CANFRAMEPARSER_H
@@ -0,0 +1,66 @@
+#include "canframering.h"
+
+/**
+ * This is the class constructor.
+ *
+ * @param size this is the number of frames, rounded up to a power of 2
+ */
+canFrameRing::canFrameRing(uint size)
+{
+    uint n = 2;
+    while((n < size) && (n < 0x80000000)) n <<= 1;
+
+    frames = new CAN_RING_FRAME_t[n];
+    mask = n - 1;
+    head.storeRelaxed(0);
+    tail.storeRelaxed(0);
+    overflows.storeRelaxed(0);
+}
+
+canFrameRing::~canFrameRing()
+{
+    delete[] frames;
+}
+
+/**
+ * This function adds a frame to the ring.
+ *
+ * The function shall be called only by the producer thread.
+ *
+ * @param frame this is the frame to be added
+ * @return false if the ring is full: the frame is discarded
+ */
+bool canFrameRing::push(const CAN_RING_FRAME_t* frame)
+{
+    uint h = head.loadRelaxed();
+    if((h - tail.loadAcquire()) > mask){
+        overflows.fetchAndAddRelaxed(1);
+        return false;
+    }
+
+    frames[h & mask] = *frame;
+    head.storeRelease(h + 1);
+    return true;
+}
+
+/**
+ * This function removes the oldest frames from the ring.
+ *
+ * The function shall be called only by the consumer thread.
+ *
+ * @param
+ * - batch: this is the destination array;
+ * - max: this is the size of the destination array;
+ *
+ * @return the number of removed frames
+ */
+int canFrameRing::pop(CAN_RING_FRAME_t* batch, int max)
+{
+    uint t = tail.loadRelaxed();
+    uint available = head.loadAcquire() - t;
+    if(available > (uint) max) available = max;
+
+    for(uint i=0; i<available; i++) batch[i] = frames[(t + i) & mask];
+    tail.storeRelease(t + available);
+    return available;
+}
@@ -0,0 +1,58 @@
+#ifndef CANFRAMERING_H
+#define CANFRAMERING_H
+
+#include <QtCore>
+#include <QAtomicInteger>
+#include "canframeparser.h"
+
+/**
+ * @brief This class implements a lock-free single-producer/single-consumer ring of CAN frames
+ *
+ * The ring transfers the received frames from the canClient I/O thread
+ * to the thread of a canClientChannel without locks and without
+ * allocations:
+ * + the frames have a fixed size and the ring is preallocated at the construction;
+ * + only one thread shall call canFrameRing::push() (the producer);
+ * + only one thread shall call canFrameRing::pop() (the consumer);
+ * + the head index is written only by the producer and the tail index only by the consumer:
+ *   the release/acquire ordering publishes the frame content with the index.
+ *
+ * When the ring is full the new frames are discarded and counted
+ * (see canFrameRing::getOverflows()).
+ *
+ * \ingroup canClientModule
+ */
+class canFrameRing
+{
+public:
+    explicit canFrameRing(uint size = RING_DEFAULT_SIZE);
+    ~canFrameRing();
+
+    static const uint RING_DEFAULT_SIZE = 1024; //!< Default number of frames (power of 2)
+
+    /**
+     *  This is the fixed size frame of the ring
+     */
+    typedef struct{
+        qint64 rxTime;  //!< Socket reading timestamp (see canClient::timestamp())
+        uint   canId;   //!< Frame canId (11 or 29 bit)
+        uchar  len;     //!< Number of valid data bytes
+        uchar  async;   //!< 1 for an asynchronous frame
+        uchar  d[canFrameParser::MAX_PAYLOAD]; //!< Can data content
+    }CAN_RING_FRAME_t;
+
+    bool push(const CAN_RING_FRAME_t* frame);    //!< Producer: adds a frame (false if the ring is full)
+    int  pop(CAN_RING_FRAME_t* batch, int max);  //!< Consumer: removes up to max frames
+
+    _inline uint getSize(void) const {return mask + 1;}                 //!< Returns the ring capacity
+    _inline uint getOverflows(void) const {return overflows.loadRelaxed();} //!< Returns the number of discarded frames
+
+private:
+    CAN_RING_FRAME_t*     frames;       //!< Preallocated frames
+    uint                  mask;         //!< Index mask (size - 1)
+    QAtomicInteger<uint>  head;         //!< Write index (free running): written by the producer
+    QAtomicInteger<uint>  tail;         //!< Read index (free running): written by the consumer
+    QAtomicInteger<uint>  overflows;    //!< Number of discarded frames
+};
+
+#endif // CANFRAMERING_H
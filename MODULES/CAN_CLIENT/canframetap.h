@@ -0,0 +1,48 @@
+#ifndef CANFRAMETAP_H
+#define CANFRAMETAP_H
+
+#include <QtCore>
+
+/**
+ * @brief This is the interface of a CAN traffic observer
+ *
+ * A tap is assigned to a connection with canClient::setFrameTap():
+ * the connection calls canFrameTap::tapFrame() for every data frame
+ * sent to and received from the Can Application Driver.
+ *
+ * The function is called in the connection thread (the I/O thread, if used),
+ * before the frame is dispatched to the channels:
+ * + the implementation shall be thread safe if the tap is shared by many connections;
+ * + the implementation shall not block, because it delays the frame reception.
+ *
+ * \ingroup canClientModule
+ */
+class canFrameTap
+{
+public:
+    virtual ~canFrameTap(){};
+
+    /**
+     *  This enumeration defines the direction of a tapped frame
+     */
+    typedef enum{
+        TAP_TX = 0,     //!< Frame sent to the Can Application Driver
+        TAP_RX,         //!< Data frame received from the Can Application Driver
+        TAP_RX_ASYNC,   //!< Asynchronous data frame received from the Can Application Driver
+    }TAP_DIRECTION_t;
+
+    /**
+     * This function is called for every data frame of the connection.
+     *
+     * @param
+     * - direction: this is the frame direction (see TAP_DIRECTION_t);
+     * - canId: this is the frame canId (11 or 29 bit);
+     * - data: this is the pointer to the frame data;
+     * - len: this is the number of data bytes;
+     * - time: this is the frame timestamp (see canClient::timestamp()):
+     *   the socket reading time for the received frames, the queuing time for the sent frames;
+     */
+    virtual void tapFrame(uchar direction, uint canId, const uchar* data, int len, qint64 time) = 0;
+};
+
+#endif // CANFRAMETAP_H
@@ -0,0 +1,209 @@
+#include "canlatencyhistogram.h"
+
+/**
+ * This is the class constructor.
+ */
+canLatencyHistogram::canLatencyHistogram()
+{
+    reset();
+}
+
+/**
+ * This function clears all the samples.
+ */
+void canLatencyHistogram::reset(void)
+{
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+/**
+ * This function adds a latency sample.
+ *
+ * @param ns this is the latency in ns: negative values are counted as 0
+ */
+void canLatencyHistogram::add(qint64 ns)
+{
+    if(ns < 0) ns = 0;
+
+    buckets[bucketIndex(ns)]++;
+    if((!count) || (ns < min)) min = ns;
+    if(ns > max) max = ns;
+    sum += ns;
+    count++;
+}
+
+/**
+ * This function returns the bucket collecting a latency.
+ *
+ * @param ns this is the latency in ns: negative values are counted as 0
+ * @return the bucket index: position of the most significant bit
+ */
+int canLatencyHistogram::bucketIndex(qint64 ns)
+{
+    if(ns <= 0) return 0;
+
+    quint64 v = (quint64) ns;
+    int i = 0;
+    if(v >> 32) { v >>= 32; i += 32; }
+    if(v >> 16) { v >>= 16; i += 16; }
+    if(v >> 8)  { v >>= 8;  i += 8; }
+    if(v >> 4)  { v >>= 4;  i += 4; }
+    if(v >> 2)  { v >>= 2;  i += 2; }
+    if(v >> 1)  { i += 1; }
+    if(i >= HISTOGRAM_BUCKETS) i = HISTOGRAM_BUCKETS - 1;
+    return i;
+}
+
+/**
+ * This function adds the samples of another histogram.
+ *
+ * @param other this is the histogram to be added
+ */
+void canLatencyHistogram::merge(const canLatencyHistogram& other)
+{
+    if(!other.count) return;
+
+    for(int i=0; i<HISTOGRAM_BUCKETS; i++) buckets[i] += other.buckets[i];
+    if((!count) || (other.min < min)) min = other.min;
+    if(other.max > max) max = other.max;
+    sum += other.sum;
+    count += other.count;
+}
+
+/**
+ * This function returns the average latency.
+ *
+ * @return the average latency in ns
+ */
+double canLatencyHistogram::getAverage(void) const
+{
+    if(!count) return 0;
+    return (double) sum / count;
+}
+
+/**
+ * This function returns the estimated percentile of the latency.
+ *
+ * @param p this is the percentile, from 0 to 1
+ * @return the upper bound of the bucket containing the percentile in ns
+ */
+qint64 canLatencyHistogram::getPercentile(double p) const
+{
+    if(!count) return 0;
+    if(p < 0) p = 0;
+    if(p > 1) p = 1;
+
+    ulong target = (ulong) (p * count + 0.999999);
+    if(!target) target = 1;
+
+    ulong cumulated = 0;
+    for(int i=0; i<HISTOGRAM_BUCKETS; i++){
+        cumulated += buckets[i];
+        if(cumulated < target) continue;
+
+        qint64 upper = ((qint64) 2 << i) - 1;
+        return (upper > max) ? max : upper;
+    }
+
+    return max;
+}
+
+/**
+ * This function returns a readable summary of the histogram:
+ *
+ *      n=COUNT avg=AVG p50=P50 p99=P99 p999=P999 max=MAX (us)
+ */
+QString canLatencyHistogram::toString(void) const
+{
+    return QString("n=%1 avg=%2 p50=%3 p99=%4 p999=%5 max=%6 (us)")
+            .arg(count)
+            .arg(getAverage() / 1000.0, 0, 'f', 1)
+            .arg((double) getPercentile(0.5) / 1000.0, 0, 'f', 1)
+            .arg((double) getPercentile(0.99) / 1000.0, 0, 'f', 1)
+            .arg((double) getPercentile(0.999) / 1000.0, 0, 'f', 1)
+            .arg((double) max / 1000.0, 0, 'f', 1);
+}
+
+/**
+ * This is the class constructor.
+ */
+canLatencyCollector::canLatencyCollector()
+{
+    resetRequests.storeRelaxed(0);
+    resetDone.storeRelaxed(0);
+    clear();
+}
+
+/**
+ * This function clears the counters.
+ *
+ * The function is called only by the writer thread (or before the first sample).
+ */
+void canLatencyCollector::clear(void)
+{
+    count.storeRelease(0);
+    for(int i=0; i<canLatencyHistogram::HISTOGRAM_BUCKETS; i++) buckets[i].storeRelaxed(0);
+    sum.storeRelaxed(0);
+    min.storeRelaxed(0);
+    max.storeRelaxed(0);
+}
+
+/**
+ * This function adds a latency sample.
+ *
+ * The function is called only by the writer thread:
+ * a pending clearing request is served before the sample is added.
+ *
+ * @param ns this is the latency in ns: negative values are counted as 0
+ */
+void canLatencyCollector::add(qint64 ns)
+{
+    uint requests = resetRequests.loadAcquire();
+    if(requests != resetDone.loadRelaxed()){
+        clear();
+        resetDone.storeRelease(requests);
+    }
+
+    if(ns < 0) ns = 0;
+
+    quint64 n = count.loadRelaxed();
+    int i = canLatencyHistogram::bucketIndex(ns);
+    buckets[i].storeRelaxed(buckets[i].loadRelaxed() + 1);
+    if((!n) || (ns < min.loadRelaxed())) min.storeRelaxed(ns);
+    if(ns > max.loadRelaxed()) max.storeRelaxed(ns);
+    sum.storeRelaxed(sum.loadRelaxed() + ns);
+    count.storeRelease(n + 1);
+}
+
+/**
+ * This function requests the clearing of all the samples.
+ *
+ * The counters are cleared by the writer thread before its next sample:
+ * until then, the canLatencyCollector::snapshot() returns an empty histogram.
+ */
+void canLatencyCollector::reset(void)
+{
+    resetRequests.fetchAndAddRelease(1);
+}
+
+/**
+ * This function returns a copy of the collected samples.
+ *
+ * @return the histogram of the samples
+ */
+canLatencyHistogram canLatencyCollector::snapshot(void) const
+{
+    canLatencyHistogram histogram;
+    if(resetRequests.loadAcquire() != resetDone.loadAcquire()) return histogram;
+
+    histogram.count = (ulong) count.loadAcquire();
+    for(int i=0; i<canLatencyHistogram::HISTOGRAM_BUCKETS; i++) histogram.buckets[i] = (ulong) buckets[i].loadRelaxed();
+    histogram.sum = sum.loadRelaxed();
+    histogram.min = min.loadRelaxed();
+    histogram.max = max.loadRelaxed();
+    return histogram;
+}
@@ -0,0 +1,86 @@
+#ifndef CANLATENCYHISTOGRAM_H
+#define CANLATENCYHISTOGRAM_H
+
+#include <QtCore>
+#include <QAtomicInteger>
+
+/**
+ * @brief This class implements a latency histogram with logarithmic buckets
+ *
+ * The bucket i collects the latencies from 2^i ns to 2^(i+1) - 1 ns
+ * (the bucket 0 collects also the 0 ns latency):
+ * the bucket index is computed with a few shift operations,
+ * so the class can be used in the reception path of every frame.
+ *
+ * The percentiles are estimated with the upper bound of the bucket
+ * containing the requested percentile, limited to the maximum detected latency.
+ *
+ * \ingroup canClientModule
+ */
+class canLatencyHistogram
+{
+public:
+    canLatencyHistogram();
+
+    static const int HISTOGRAM_BUCKETS = 40; //!< Number of buckets: the last bucket collects all the latencies > 2^39 ns
+
+    void    add(qint64 ns);                  //!< Adds a latency sample in ns
+    void    reset(void);                     //!< Clears all the samples
+    void    merge(const canLatencyHistogram& other); //!< Adds the samples of another histogram
+    static int bucketIndex(qint64 ns);       //!< Returns the bucket of a latency in ns
+
+    _inline ulong  getCount(void) const {return count;}  //!< Returns the number of samples
+    _inline qint64 getMin(void) const {return min;}      //!< Returns the minimum latency in ns
+    _inline qint64 getMax(void) const {return max;}      //!< Returns the maximum latency in ns
+    _inline ulong  getBucket(int i) const {return ((i < 0) || (i >= HISTOGRAM_BUCKETS)) ? 0 : buckets[i];} //!< Returns the samples of a bucket
+    double  getAverage(void) const;          //!< Returns the average latency in ns
+    qint64  getPercentile(double p) const;   //!< Returns the estimated percentile (0 to 1) in ns
+    QString toString(void) const;            //!< Returns a readable summary of the histogram
+
+private:
+    ulong   buckets[HISTOGRAM_BUCKETS];     //!< Samples per bucket
+    ulong   count;                          //!< Number of samples
+    qint64  sum;                            //!< Sum of the samples in ns
+    qint64  min;                            //!< Minimum sample in ns
+    qint64  max;                            //!< Maximum sample in ns
+
+    friend class canLatencyCollector;
+};
+
+/**
+ * @brief This class collects the latency samples of a single writer thread
+ *
+ * The samples are stored in atomic counters with the same buckets of the canLatencyHistogram:
+ * + only one thread calls canLatencyCollector::add(): the update is a relaxed load and store,
+ *   without locked instructions (as the canStatCounter);
+ * + any thread calls canLatencyCollector::snapshot() to get a canLatencyHistogram copy;
+ * + any thread calls canLatencyCollector::reset(): the clearing is requested to the writer
+ *   and done before its next sample, while the snapshot of a pending clearing is empty.
+ *
+ * The count is published after the buckets, so a snapshot taken while a sample is added
+ * may contain the sample in its bucket but not yet in the count.
+ *
+ * \ingroup canClientModule
+ */
+class canLatencyCollector
+{
+public:
+    canLatencyCollector();
+
+    void add(qint64 ns);                     //!< Writer: adds a latency sample in ns
+    void reset(void);                        //!< Any thread: clears all the samples
+    canLatencyHistogram snapshot(void) const;//!< Any thread: returns a copy of the samples
+
+private:
+    void clear(void);                        //!< Writer: clears the counters
+
+    QAtomicInteger<quint64> buckets[canLatencyHistogram::HISTOGRAM_BUCKETS]; //!< Samples per bucket
+    QAtomicInteger<quint64> count;          //!< Number of samples
+    QAtomicInteger<qint64>  sum;            //!< Sum of the samples in ns
+    QAtomicInteger<qint64>  min;            //!< Minimum sample in ns
+    QAtomicInteger<qint64>  max;            //!< Maximum sample in ns
+    QAtomicInteger<uint>    resetRequests;  //!< Clearing requests (any thread)
+    QAtomicInteger<uint>    resetDone;      //!< Clearing requests served (writer)
+};
+
+#endif // CANLATENCYHISTOGRAM_H
@@ -0,0 +1,244 @@
+#include "canstatistics.h"
+
+/**
+ * This is the class constructor.
+ */
+canTrafficStatistics::canTrafficStatistics()
+{
+    idSlots = new CAN_ID_SLOT_t[CAN_STAT_ID_SLOTS];
+    reset();
+}
+
+canTrafficStatistics::~canTrafficStatistics()
+{
+    delete[] idSlots;
+}
+
+/**
+ * This function clears all the counters and releases the per canId table.
+ *
+ * The function shall be called by the connection thread.
+ */
+void canTrafficStatistics::reset(void)
+{
+    rxFrames.set(0);
+    rxAsyncFrames.set(0);
+    rxBytes.set(0);
+    txFrames.set(0);
+    txBytes.set(0);
+    txPending.set(0);
+    txPendingMax.set(0);
+    busBits.set(0);
+    otherFrames.set(0);
+
+    for(int i=0; i<CAN_STAT_ID_SLOTS; i++){
+        idSlots[i].key.storeRelease(0);
+        idSlots[i].rx_frames.storeRelaxed(0);
+        idSlots[i].rx_bytes.storeRelaxed(0);
+        idSlots[i].tx_frames.storeRelaxed(0);
+        idSlots[i].tx_bytes.storeRelaxed(0);
+    }
+}
+
+/**
+ * This function returns the slot of a canId, assigning a free slot
+ * at the first frame of the canId.
+ *
+ * The slot is published with a release store of the key,
+ * so the readers never see a slot with a partially assigned key.
+ *
+ * @param canId this is the 11 or 29 bit canId
+ * @return the slot or nullptr if the table has no free slot for the canId
+ */
+canTrafficStatistics::CAN_ID_SLOT_t* canTrafficStatistics::findSlot(uint canId)
+{
+    uint key = canId + 1;
+    uint i = (canId * 0x9E3779B1u) >> 22; // 10 bit hash: CAN_STAT_ID_SLOTS = 1024
+
+    for(int probe=0; probe<CAN_STAT_MAX_PROBES; probe++, i = (i + 1) & (CAN_STAT_ID_SLOTS - 1)){
+        uint slot_key = idSlots[i].key.loadRelaxed();
+        if(slot_key == key) return &idSlots[i];
+        if(slot_key) continue;
+
+        idSlots[i].key.storeRelease(key);
+        return &idSlots[i];
+    }
+
+    return nullptr;
+}
+
+/**
+ * This function counts a received data frame.
+ *
+ * @param
+ * - canId: this is the frame canId;
+ * - len: this is the number of data bytes;
+ * - async: true for an asynchronous frame;
+ */
+void canTrafficStatistics::countRx(uint canId, int len, bool async)
+{
+    rxFrames.add();
+    rxBytes.add(len);
+    if(async) rxAsyncFrames.add();
+    busBits.add(frameBits(canId, len));
+
+    CAN_ID_SLOT_t* slot = findSlot(canId);
+    if(!slot){
+        otherFrames.add();
+        return;
+    }
+    slotAdd(&slot->rx_frames, 1);
+    slotAdd(&slot->rx_bytes, len);
+}
+
+/**
+ * This function counts a sent data frame.
+ *
+ * @param
+ * - canId: this is the frame canId;
+ * - len: this is the number of data bytes;
+ * - pending: this is the number of bytes waiting in the transmission queue;
+ */
+void canTrafficStatistics::countTx(uint canId, int len, qint64 pending)
+{
+    txFrames.add();
+    txBytes.add(len);
+    busBits.add(frameBits(canId, len));
+    if(pending < 0) pending = 0;
+    txPending.set(pending);
+    txPendingMax.setMax(pending);
+
+    CAN_ID_SLOT_t* slot = findSlot(canId);
+    if(!slot){
+        otherFrames.add();
+        return;
+    }
+    slotAdd(&slot->tx_frames, 1);
+    slotAdd(&slot->tx_bytes, len);
+}
+
+/**
+ * This function returns the current counters.
+ *
+ * The function can be called by any thread: every counter is read atomically,
+ * but the counters are not read at the same instant.
+ *
+ * @param time this is the snapshot time (see canClient::timestamp())
+ * @return the snapshot of the counters
+ */
+canTrafficStatistics::CAN_TRAFFIC_SNAPSHOT_t canTrafficStatistics::snapshot(qint64 time) const
+{
+    CAN_TRAFFIC_SNAPSHOT_t snap;
+
+    snap.time = time;
+    snap.rx_frames = rxFrames.get();
+    snap.rx_async_frames = rxAsyncFrames.get();
+    snap.rx_bytes = rxBytes.get();
+    snap.tx_frames = txFrames.get();
+    snap.tx_bytes = txBytes.get();
+    snap.tx_pending = txPending.get();
+    snap.tx_pending_max = txPendingMax.get();
+    snap.bus_bits = busBits.get();
+    snap.other_frames = otherFrames.get();
+
+    for(int i=0; i<CAN_STAT_ID_SLOTS; i++){
+        uint key = idSlots[i].key.loadAcquire();
+        if(!key) continue;
+
+        CAN_ID_TRAFFIC_t item;
+        item.canId = key - 1;
+        item.rx_frames = idSlots[i].rx_frames.loadRelaxed();
+        item.rx_bytes = idSlots[i].rx_bytes.loadRelaxed();
+        item.tx_frames = idSlots[i].tx_frames.loadRelaxed();
+        item.tx_bytes = idSlots[i].tx_bytes.loadRelaxed();
+        snap.ids.append(item);
+    }
+
+    return snap;
+}
+
+/**
+ * This function returns the estimated number of bus bits of a frame.
+ *
+ * The estimation counts the nominal frame fields (SOF, arbitration, control,
+ * data, CRC, ACK, EOF and interframe space) without the stuff bits:
+ * - 47 + 8 * len bits for a standard canId (up to 0x7FF);
+ * - 67 + 8 * len bits for an extended canId.
+ *
+ * The CAN FD frames are estimated at the nominal bit rate:
+ * with a faster data phase the estimation is an upper bound.
+ *
+ * @param
+ * - canId: this is the frame canId;
+ * - len: this is the number of data bytes;
+ *
+ * @return the estimated bits
+ */
+quint64 canTrafficStatistics::frameBits(uint canId, int len)
+{
+    return ((canId > 0x7FF) ? 67 : 47) + 8 * (quint64) len;
+}
+
+/**
+ * This function returns a readable report of the traffic between two snapshots:
+ *
+ *      rx=RX f/s (RXB B/s) async=ASYNC f/s tx=TX f/s (TXB B/s) load=LOAD% txq=TXQ B (max TXQMAX B) other=OTHER
+ *        id 0xID: rx=RX f/s (RXB B/s) tx=TX f/s (TXB B/s)
+ *
+ * Only the canId with traffic in the period are reported.
+ *
+ * The bus load is estimated with the frames sent and received by the connection:
+ * the frames discarded by the acceptance filters of the Can Application Driver
+ * are not counted, so the result is a lower bound of the real bus load.
+ *
+ * @param
+ * - current: this is the snapshot at the end of the period;
+ * - previous: this is the snapshot at the beginning of the period (nullptr for the whole connection life);
+ * - bitrate: this is the nominal bit rate of the bus in bit/s;
+ *
+ * @return the report
+ */
+QString canTrafficStatistics::toString(const CAN_TRAFFIC_SNAPSHOT_t* current, const CAN_TRAFFIC_SNAPSHOT_t* previous, uint bitrate)
+{
+    CAN_TRAFFIC_SNAPSHOT_t zero = {};
+    if(!previous) previous = &zero;
+
+    double dt = (double) (current->time - previous->time) / 1e9;
+    if(dt <= 0) dt = 1e-9;
+    if(!bitrate) bitrate = CAN_STAT_DEFAULT_BITRATE;
+
+    QString report = QString("rx=%1 f/s (%2 B/s) async=%3 f/s tx=%4 f/s (%5 B/s) load=%6% txq=%7 B (max %8 B) other=%9")
+            .arg((current->rx_frames - previous->rx_frames) / dt, 0, 'f', 1)
+            .arg((current->rx_bytes - previous->rx_bytes) / dt, 0, 'f', 1)
+            .arg((current->rx_async_frames - previous->rx_async_frames) / dt, 0, 'f', 1)
+            .arg((current->tx_frames - previous->tx_frames) / dt, 0, 'f', 1)
+            .arg((current->tx_bytes - previous->tx_bytes) / dt, 0, 'f', 1)
+            .arg(100.0 * (current->bus_bits - previous->bus_bits) / (dt * bitrate), 0, 'f', 1)
+            .arg(current->tx_pending)
+            .arg(current->tx_pending_max)
+            .arg(current->other_frames);
+
+    QHash<uint, int> before;
+    for(int i=0; i<previous->ids.size(); i++) before.insert(previous->ids.at(i).canId, i);
+
+    for(int i=0; i<current->ids.size(); i++){
+        CAN_ID_TRAFFIC_t item = current->ids.at(i);
+        int j = before.value(item.canId, -1);
+        if(j >= 0){
+            item.rx_frames -= previous->ids.at(j).rx_frames;
+            item.rx_bytes -= previous->ids.at(j).rx_bytes;
+            item.tx_frames -= previous->ids.at(j).tx_frames;
+            item.tx_bytes -= previous->ids.at(j).tx_bytes;
+        }
+        if((!item.rx_frames) && (!item.tx_frames)) continue;
+
+        report.append(QString("\n  id 0x%1: rx=%2 f/s (%3 B/s) tx=%4 f/s (%5 B/s)")
+                      .arg(item.canId, 1, 16)
+                      .arg(item.rx_frames / dt, 0, 'f', 1)
+                      .arg(item.rx_bytes / dt, 0, 'f', 1)
+                      .arg(item.tx_frames / dt, 0, 'f', 1)
+                      .arg(item.tx_bytes / dt, 0, 'f', 1));
+    }
+
+    return report;
+}
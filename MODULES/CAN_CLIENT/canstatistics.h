@@ -0,0 +1,124 @@
+#ifndef CANSTATISTICS_H
+#define CANSTATISTICS_H
+
+#include <QtCore>
+#include <QAtomicInteger>
+
+/**
+ * @brief This class implements a statistic counter padded to a cache line
+ *
+ * Every counter occupies a whole cache line (64 bytes), so the counters
+ * updated by different threads never share a cache line.
+ *
+ * The counter has a single writer: the update is a relaxed load and store,
+ * without locked instructions, so counting a frame costs a few cycles.
+ * Any thread can read the counter at any time.
+ *
+ * \ingroup canClientModule
+ */
+class alignas(64) canStatCounter
+{
+public:
+    canStatCounter() {value.storeRelaxed(0);}
+
+    _inline void    add(quint64 n = 1) {value.storeRelaxed(value.loadRelaxed() + n);} //!< Writer: increments the counter
+    _inline void    set(quint64 v) {value.storeRelaxed(v);}                           //!< Writer: assignes a gauge value
+    _inline void    setMax(quint64 v) {if(v > value.loadRelaxed()) value.storeRelaxed(v);} //!< Writer: keeps the maximum value
+    _inline quint64 get(void) const {return value.loadRelaxed();}                     //!< Any thread: returns the counter
+
+private:
+    QAtomicInteger<quint64> value; //!< Counter value
+};
+
+/**
+ * @brief This class collects the traffic statistics of a CAN connection
+ *
+ * The class counts the frames and the bytes sent and received
+ * by a canClient, in total and per canId:
+ * + the counters are updated only by the connection thread (see canStatCounter);
+ * + the per canId counters are kept in a fixed table of CAN_STAT_ID_SLOTS slots,
+ *   assigned at the first frame of a canId: the frames of the canId not fitting in
+ *   the table are counted in CAN_TRAFFIC_SNAPSHOT_t::other_frames;
+ * + the estimated bus occupation is accumulated in bits for every frame
+ *   (see canTrafficStatistics::frameBits()).
+ *
+ * The canTrafficStatistics::snapshot() can be called by any thread.
+ *
+ * \ingroup canClientModule
+ */
+class canTrafficStatistics
+{
+public:
+    canTrafficStatistics();
+    ~canTrafficStatistics();
+
+    static const int  CAN_STAT_ID_SLOTS = 1024;     //!< Size of the per canId table (power of 2)
+    static const int  CAN_STAT_MAX_PROBES = 8;      //!< Maximum slots inspected to find a canId
+    static const uint CAN_STAT_DEFAULT_BITRATE = 1000000; //!< Default nominal bit rate of the bus in bit/s
+
+    /**
+     *  This is the traffic of a canId
+     */
+    typedef struct{
+        uint    canId;      //!< The canId
+        quint64 rx_frames;  //!< Received frames
+        quint64 rx_bytes;   //!< Received data bytes
+        quint64 tx_frames;  //!< Sent frames
+        quint64 tx_bytes;   //!< Sent data bytes
+    }CAN_ID_TRAFFIC_t;
+
+    /**
+     *  This is the snapshot of the connection traffic
+     */
+    typedef struct{
+        qint64  time;           //!< Snapshot time (see canClient::timestamp())
+        quint64 rx_frames;      //!< Received data frames (asynchronous included)
+        quint64 rx_async_frames;//!< Received asynchronous data frames
+        quint64 rx_bytes;       //!< Received data bytes
+        quint64 tx_frames;      //!< Sent data frames
+        quint64 tx_bytes;       //!< Sent data bytes
+        quint64 tx_pending;     //!< Bytes waiting in the transmission queue
+        quint64 tx_pending_max; //!< Maximum bytes waiting in the transmission queue
+        quint64 bus_bits;       //!< Estimated bus bits of the sent and received frames
+        quint64 other_frames;   //!< Frames of the canId not fitting in the per canId table
+        QList<CAN_ID_TRAFFIC_t> ids; //!< Traffic per canId
+    }CAN_TRAFFIC_SNAPSHOT_t;
+
+    void countRx(uint canId, int len, bool async); //!< Connection thread: counts a received frame
+    void countTx(uint canId, int len, qint64 pending); //!< Connection thread: counts a sent frame
+    void reset(void);                              //!< Connection thread: clears all the counters
+    CAN_TRAFFIC_SNAPSHOT_t snapshot(qint64 time) const; //!< Any thread: returns the current counters
+
+    static quint64 frameBits(uint canId, int len);
+    static QString toString(const CAN_TRAFFIC_SNAPSHOT_t* current, const CAN_TRAFFIC_SNAPSHOT_t* previous, uint bitrate);
+
+private:
+    Q_DISABLE_COPY(canTrafficStatistics)
+
+    /**
+     *  This is a slot of the per canId table
+     */
+    typedef struct alignas(64){
+        QAtomicInteger<uint>    key;        //!< canId + 1 (0 = free slot)
+        QAtomicInteger<quint64> rx_frames;  //!< Received frames
+        QAtomicInteger<quint64> rx_bytes;   //!< Received data bytes
+        QAtomicInteger<quint64> tx_frames;  //!< Sent frames
+        QAtomicInteger<quint64> tx_bytes;   //!< Sent data bytes
+    }CAN_ID_SLOT_t;
+
+    canStatCounter rxFrames;        //!< Received data frames
+    canStatCounter rxAsyncFrames;   //!< Received asynchronous data frames
+    canStatCounter rxBytes;         //!< Received data bytes
+    canStatCounter txFrames;        //!< Sent data frames
+    canStatCounter txBytes;         //!< Sent data bytes
+    canStatCounter txPending;       //!< Bytes waiting in the transmission queue
+    canStatCounter txPendingMax;    //!< Maximum bytes waiting in the transmission queue
+    canStatCounter busBits;         //!< Estimated bus bits
+    canStatCounter otherFrames;     //!< Frames of the canId not fitting in the table
+    CAN_ID_SLOT_t* idSlots;         //!< Per canId table
+
+    CAN_ID_SLOT_t* findSlot(uint canId);
+    static void slotAdd(QAtomicInteger<quint64>* counter, quint64 n) {counter->storeRelaxed(counter->loadRelaxed() + n);}
+};
+
+#endif // CANSTATISTICS_H
@@ -1,6 +1,7 @@
 #include "application.h"
 #include "can_bootloader_protocol.h"
 #include "canclient.h"
+#include "can_firmware_download.h"
 
 
 /**
@@ -18,11 +19,17 @@ canBootloaderProtocol::canBootloaderProtocol(uchar devid, QString ip_driver, uin
     // Create the Can Client Object to communicate with the can driver process
     bootId =  devid ;
 
-    // Activation of the communicaitone with the CAN DRIVER SERVER
-    canClient* pBoot = new canClient(canDeviceProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS + bootId, ip_driver, port_driver);
-    connect(pBoot, SIGNAL(rxFromCan(ushort , QByteArray )), this, SLOT(rxFromBootloader(ushort , QByteArray )), Qt::QueuedConnection);
-    connect(this,SIGNAL(txToBootloader(ushort , QByteArray )), pBoot,SLOT(txToCanData(ushort , QByteArray )), Qt::QueuedConnection);
-    pBoot->ConnectToCanServer();
+    // Activation of the communicaitone with the CAN DRIVER SERVER:
+    // the connection is shared with all the protocol instances of the process
+    bootChannel = canClient::getSharedClient(ip_driver, port_driver)->registerChannel(canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS + bootId);
+    if(!bootChannel){
+        // Invalid canId: the protocol stays disconnected
+        qDebug() << "BOOTLOADER CHANNEL NOT REGISTERED" << bootId;
+    }else{
+        connect(bootChannel, SIGNAL(rxFromCan(uint , QByteArray )), this, SLOT(rxFromBootloader(uint , QByteArray )), Qt::QueuedConnection);
+        connect(this,SIGNAL(txToBootloader(uint , QByteArray )), bootChannel,SLOT(txToCanData(uint , QByteArray )), Qt::QueuedConnection);
+    }
+    firmwareDownload = nullptr;
 
     req_command = 0;
     busy = false;
@@ -37,6 +44,24 @@ canBootloaderProtocol::~canBootloaderProtocol()
 }
 
 
+/**
+ * @brief This function returns the firmware download engine of the Device
+ *
+ * The engine is created at the first call and connected to the bootloader channel.
+ *
+ * @return the firmware download engine
+ */
+canFirmwareDownload* canBootloaderProtocol::getFirmwareDownload(void){
+    if(firmwareDownload) return firmwareDownload;
+
+    firmwareDownload = new canFirmwareDownload(bootId, this);
+    if(bootChannel){
+        connect(bootChannel, SIGNAL(rxFromCan(uint , QByteArray )), firmwareDownload, SLOT(rxFrame(uint , QByteArray )), Qt::QueuedConnection);
+        connect(firmwareDownload, SIGNAL(txFrame(uint , QByteArray )), bootChannel, SLOT(txToCanData(uint , QByteArray )), Qt::QueuedConnection);
+    }
+    return firmwareDownload;
+}
+
 /**
  * @brief This is the CAN frame reception handler
  *
@@ -52,7 +77,7 @@ canBootloaderProtocol::~canBootloaderProtocol()
  * @param devId received device ID
  * @param data CAN data frame to be processed
  */
-void canBootloaderProtocol::rxFromBootloader(ushort canId, QByteArray data){
+void canBootloaderProtocol::rxFromBootloader(uint canId, QByteArray data){
     emit dataReceivedFromBootloaderCan(canId,data); // For debug
 
     // No pending reception
@@ -18,6 +18,13 @@
  *
  * + canclient.cpp
  * + canclient.h
+ * + can_firmware_download.cpp
+ * + can_firmware_download.h
+ *
+ * # FIRMWARE DOWNLOAD
+ *
+ * The canBootloaderProtocol::getFirmwareDownload() returns the firmware download engine
+ * of the Device, connected to the bootloader channel (see canFirmwareDownloadModule).
  *
  */
 
@@ -25,6 +32,8 @@
 
 #include <QtCore>
 
+class canClientChannel;
+class canFirmwareDownload;
 
 /**
  * @brief This class implements the Device Can communication protocol
@@ -59,6 +68,8 @@ public:
           BOOTLOADER_GET_INFO = 1,      //!< Request the bootloader informations
           BOOTLOADER_START,             //!< Request the bootloader to start execution
           BOOTLOADER_EXIT,              //!< Request the bootloader to exit execution
+          BOOTLOADER_PAGE_START,        //!< Firmware download: start of a page (see canFirmwareDownloadModule)
+          BOOTLOADER_PAGE_CRC,          //!< Firmware download: verification of a page (see canFirmwareDownloadModule)
       }CAN_BOOTLOADER_COMMANDS_t;
 
      /**
@@ -87,10 +98,12 @@ public:
      inline uint getBootloaderMin(void)   { return bootloaderMin;}
      inline uint getBootloaderSub(void)   { return bootloaderSub;}
 
+     canFirmwareDownload* getFirmwareDownload(void);
+
 
 signals:
-    void txToBootloader(ushort canId, QByteArray data); //!< Sends Can data frame to the canDriver
-    void dataReceivedFromBootloaderCan(ushort canId, QByteArray data); //!< Emitted when a frame is received for debug purpose
+    void txToBootloader(uint canId, QByteArray data); //!< Sends Can data frame to the canDriver
+    void dataReceivedFromBootloaderCan(uint canId, QByteArray data); //!< Emitted when a frame is received for debug purpose
 
 protected:
 
@@ -119,7 +132,7 @@ protected:
     uint bootloaderSub;
 
 private slots:
-   void rxFromBootloader(ushort canId, QByteArray data);//!< Receive Can data frame from the canDriver  
+   void rxFromBootloader(uint canId, QByteArray data);//!< Receive Can data frame from the canDriver  
    void bootloaderTmoEvent(void);         //!< Tx/Rx timeout event
 
 protected slots:
@@ -127,6 +140,8 @@ protected slots:
 
 private:
     ushort bootId; //!< This is the target device ID
+    canClientChannel* bootChannel;   //!< Bootloader reception channel
+    canFirmwareDownload* firmwareDownload; //!< Firmware download engine, created at the first request
 
     bool  busy;             //!< Busy flag waiting for the Device answer
     bool  rxOk;             //!< The Frame has been correctly received
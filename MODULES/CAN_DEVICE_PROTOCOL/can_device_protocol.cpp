@@ -3,6 +3,57 @@
 #include "canclient.h"
 
 
+/**
+ * This is the constructor of a reply handle.
+ *
+ * @param request this is the request identifier: 0 creates a reply already completed with error
+ */
+canDeviceReply::canDeviceReply(uint request)
+{
+    state = QSharedPointer<CAN_REPLY_STATE_t>::create();
+    state->request = request;
+    state->finished = (request == 0);
+    state->ok = false;
+    memset(&state->answer, 0, sizeof(state->answer));
+}
+
+/**
+ * This function assignes a completion handler to the request.
+ *
+ * If the request is already completed the handler is called immediately,
+ * otherwise it is called by the canDeviceProtocol at the request completion.
+ * Many handlers can be assigned: they are called in the assignment order.
+ *
+ * @param handler this is the completion handler
+ * @return the reply handle
+ */
+const canDeviceReply& canDeviceReply::then(CAN_REPLY_HANDLER_t handler) const
+{
+    if(state->finished) handler(state->ok, state->answer);
+    else state->handlers.append(handler);
+    return *this;
+}
+
+/**
+ * This function completes the request and calls the completion handlers.
+ *
+ * @param ok true if the request has been successfully completed
+ * @param answer this is the decoded answer frame (nullptr if not received)
+ */
+void canDeviceReply::finish(bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* answer) const
+{
+    if(state->finished) return;
+
+    state->finished = true;
+    state->ok = ok;
+    if(answer) state->answer = *answer;
+
+    // A handler can assign new handlers to other replies: the list is detached first
+    QList<CAN_REPLY_HANDLER_t> handlers = state->handlers;
+    state->handlers.clear();
+    for(int i=0; i<handlers.size(); i++) handlers[i](state->ok, state->answer);
+}
+
 /**
  * This is the class constructor.
  *
@@ -18,19 +69,91 @@ canDeviceProtocol::canDeviceProtocol(uchar devid, QString ip_driver, uint port_d
     // Create the Can Client Object to communicate with the can driver process
     devId = devid ;
 
-    // Activation of the communicaitone with the CAN DRIVER SERVER
-    canClient* pCan = new canClient(canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId, ip_driver, port_driver);
-    connect(pCan, SIGNAL(rxFromCan(ushort , QByteArray )), this, SLOT(rxFromDeviceCan(ushort , QByteArray )), Qt::QueuedConnection);
-    connect(pCan, SIGNAL(canDriverConnectionStatus(bool)), this, SLOT(canDriverConnectionStatus(bool )), Qt::QueuedConnection);
-    connect(this,SIGNAL(txToDeviceCan(ushort , QByteArray )), pCan,SLOT(txToCanData(ushort , QByteArray )), Qt::QueuedConnection);
-    pCan->ConnectToCanServer();
+    // Activation of the communicaitone with the CAN DRIVER SERVER:
+    // the connection is shared with all the protocol instances of the process
+    canClientChannel* pCan = canClient::getSharedClient(ip_driver, port_driver)->registerChannel(canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId);
+    deviceChannel = pCan;
+    deviceRxTime = 0;
+    if(!pCan){
+        // Invalid canId: the protocol stays disconnected
+        qDebug() << "DEVICE CHANNEL NOT REGISTERED" << devId;
+    }else{
+        // With the I/O thread the channel already emits the frames from a posted batch
+        // of the ring (see canClientModule): the frames are handled without a further event
+        Qt::ConnectionType channelConnection = (pCan->isRingMode()) ? Qt::DirectConnection : Qt::QueuedConnection;
+        connect(pCan, SIGNAL(rxStampedFromCan(uint , QByteArray, qint64 )), this, SLOT(rxStampedFromDeviceCan(uint , QByteArray, qint64 )), channelConnection);
+        connect(pCan, SIGNAL(canDriverConnectionStatus(bool)), this, SLOT(canDriverConnectionStatus(bool )), Qt::QueuedConnection);
+        connect(this,SIGNAL(txToDeviceCan(uint , QByteArray )), pCan,SLOT(txToCanData(uint , QByteArray )), channelConnection);
+    }
 
 
     frame_sequence = 1;
+    access_sequence = 0;
     busy = false;
+    access_pipelined = false;
     canDriverConnected = false;
+    canDriverWasConnected = false;
+    deviceTmo.setSingleShot(true);
     connect(&deviceTmo, SIGNAL(timeout()), this, SLOT(deviceTmoEvent()), Qt::UniqueConnection);
 
+    // Transaction deadlines initialization
+    deviceTimeout = CAN_RXTX_TMO;
+    deviceRetries = 0;
+    deviceBackoff = CAN_RETRY_BACKOFF;
+    access_retries = 0;
+    access_attempt = 0;
+    access_backoff = false;
+
+    // Pipelined requests initialization: the clock is the time base of the statistics too
+    pipelineWindow = CAN_PIPELINE_DEFAULT_WINDOW;
+    requestId = 0;
+    for(int i=0; i<256; i++) inflight[i].active = false;
+    pipelineClock.start();
+    resetDeviceStatistics();
+    connect(&statisticsTmo, SIGNAL(timeout()), this, SLOT(statisticsTmoEvent()), Qt::UniqueConnection);
+    pipelineTmo.setSingleShot(true);
+    connect(&pipelineTmo, SIGNAL(timeout()), this, SLOT(pipelineTmoEvent()), Qt::UniqueConnection);
+
+    // Batch requests initialization: the snapshot of the deviceBatchCompleted() signal
+    // can be delivered through a queued connection
+    batchId = 0;
+    qRegisterMetaType<QList<canDeviceProtocolFrame::CAN_REGISTER_t>>("QList<canDeviceProtocolFrame::CAN_REGISTER_t>");
+    connect(this, SIGNAL(deviceRequestCompleted(uint, uchar, uchar, bool)), this, SLOT(batchRequestCompleted(uint, uchar, uchar, bool)), Qt::UniqueConnection);
+
+    // Register change notification initialization
+    registerGeneration = 0;
+    rxMulti.count = 0;
+
+    // Single registers initialization: not valid until received
+    memset(&deviceRevisionRegister, 0, sizeof(deviceRevisionRegister));
+    memset(&deviceErrorsRegister, 0, sizeof(deviceErrorsRegister));
+    memset(&deviceCommandRegister, 0, sizeof(deviceCommandRegister));
+    deviceRevisionRegister.valid = false;
+    deviceErrorsRegister.valid = false;
+    deviceCommandRegister.valid = false;
+
+    // Register banks initialization: no register until the Device declares its register map
+    memset(&deviceStatusRegisters, 0, sizeof(deviceStatusRegisters));
+    memset(&deviceDataRegisters, 0, sizeof(deviceDataRegisters));
+    memset(&deviceParamRegisters, 0, sizeof(deviceParamRegisters));
+    registerMapWarned = false;
+    for(int i=0; i<CAN_FRAME_CODES; i++) registerBanks[i] = nullptr;
+    registerBanks[canDeviceProtocolFrame::READ_STATUS] = &deviceStatusRegisters;
+    registerBanks[canDeviceProtocolFrame::READ_DATA] = &deviceDataRegisters;
+    registerBanks[canDeviceProtocolFrame::WRITE_DATA] = &deviceDataRegisters;
+    registerBanks[canDeviceProtocolFrame::READ_PARAM] = &deviceParamRegisters;
+    registerBanks[canDeviceProtocolFrame::WRITE_PARAM] = &deviceParamRegisters;
+
+    // Polling scheduler initialization
+    pollTmo.setSingleShot(true);
+    connect(&pollTmo, SIGNAL(timeout()), this, SLOT(pollTmoEvent()), Qt::UniqueConnection);
+
+    // Command tracker initialization
+    commandTracker.active = false;
+    commandTracker.reading = false;
+    commandTmo.setSingleShot(true);
+    connect(&commandTmo, SIGNAL(timeout()), this, SLOT(commandTmoEvent()), Qt::UniqueConnection);
+
 
 }
 
@@ -53,64 +176,133 @@ QString canDeviceProtocol::getDeviceFrameErrorStr(void){
     return "";
 }
 
+/**
+ * @brief This is the timestamped CAN frame reception handler
+ *
+ * The socket reading timestamp of the frame is stored (see getDeviceRxTimestamp())
+ * and the frame is processed by the canDeviceProtocol::rxFromDeviceCan():
+ * the time elapsed from the socket reading is added to the
+ * canClient::RX_STAGE_HANDLER latency histogram of the connection.
+ *
+ * @param canId received canId
+ * @param data CAN data frame to be processed
+ * @param rxTime socket reading timestamp (see canClient::timestamp())
+ */
+void canDeviceProtocol::rxStampedFromDeviceCan(uint canId, QByteArray data, qint64 rxTime){
+    deviceRxTime = rxTime;
+    rxFromDeviceCan(canId, data);
+    if(deviceChannel) deviceChannel->recordHandlerLatency(rxTime);
+}
+
 /**
  * @brief This is the CAN frame reception handler
  *
  * The function is called when a can frame is received.
  *
- * The function decode the content and allow to proceed with the
+ * A frame answering a pipelined request (see canDeviceProtocol::deviceQueueRegister())
+ * is matched by its sequence number and completes that request:
+ * the answer shall have the frame code and the idx of the request, except
+ * the READ_COMMAND and abort answers where the idx is the executing command code.
+ *
+ * Otherwise, the function decode the content and allow to proceed with the
  * protocol implementation only if the following rules are meet:
  * + there isn't a pending reception frame;
  * + the received device ID matches with the internal device ID;
  * + the sequence number matches with the expected;
  *
+ * Frames with wrong CRC or unexpected sequence number are counted and discarded:
+ * the pending transaction keeps waiting for the answer up to its deadline.
+ * The frames discarded while a transaction is pending are counted as stray frames
+ * and don't change the error cause of the transaction (see getDeviceFrameErrorStr()).
+ *
+ * Frames longer than 8 bytes are decoded as READ_MULTI CAN FD answers.
  *
  * @param devId received device ID
  * @param data CAN data frame to be processed
  */
-void canDeviceProtocol::rxFromDeviceCan(ushort canId, QByteArray data){
+void canDeviceProtocol::rxFromDeviceCan(uint canId, QByteArray data){
     emit dataReceivedFromDeviceCan(devId,data); // For debug
+    deviceCounters.rx_frames.add();
 
-    // No pending reception
-    if(!busy) return;
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t content;
+    canDeviceProtocolFrame::CAN_FRAME_t frame;
+    if(data.size() > 8) content = canDeviceProtocolFrame::toMultiContent(&data, &rxMulti);
+    else{
+        content.seq = 0;
+        if(canDeviceProtocolFrame::fromCanData(data, &frame)) canDeviceProtocolFrame::fromFrame(frame, &content);
+        rxMulti.count = 0;
+    }
+
+    if(devId == (canId & 0x3F)){
+
+        // Invalid Frame Format (lenght or crc)
+        if(content.seq == 0){
+            deviceCounters.crc_errors.add();
+            if(busy) deviceCounters.stray_frames.add();
+            return;
+        }
+
+        // Pipelined requests are matched by the sequence number
+        if(inflight[content.seq].active){
+            const uchar* request = inflight[content.seq].frame.b;
+            bool ok = (content.frame_type == request[canDeviceProtocolFrame::FRAME_CODE]);
+
+            // The COMMAND register answers (READ_COMMAND and abort) carry the code
+            // of the executing command in the idx field: only the frame code is matched
+            bool command_answer = (request[canDeviceProtocolFrame::FRAME_CODE] == canDeviceProtocolFrame::READ_COMMAND) ||
+                                  ((request[canDeviceProtocolFrame::FRAME_CODE] == canDeviceProtocolFrame::COMMAND_EXEC) && (request[canDeviceProtocolFrame::FRAME_IDX] == canDeviceProtocolFrame::CAN_ABORT_COMMAND));
+            if((ok) && (!command_answer)) ok = (content.idx == request[canDeviceProtocolFrame::FRAME_IDX]);
+            if((ok) && (content.frame_type == canDeviceProtocolFrame::READ_MULTI)) ok = (!memcmp(content.d, request + canDeviceProtocolFrame::FRAME_D0, 2));
+            bool access = inflight[content.seq].access;
+            if(!ok){
+                deviceCounters.seq_errors.add();
+                if(access) frameError.seq = 1;
+            }
+            if(ok){
+                STORE_RESULT_t result = storeRegister(&content);
+                if(result == STORE_IDX_ERROR){
+                    deviceCounters.idx_errors.add();
+                    if(access) frameError.idx = 1;
+                }else if(result == STORE_FRAME_CODE_ERROR){
+                    deviceCounters.frame_code_errors.add();
+                    if(access) frameError.frame_code = 1;
+                }
+                ok = (result == STORE_OK);
+            }
+            pipelineComplete(content.seq, ok, &content);
+            return;
+        }
+
+        // Late or unexpected answer
+        if((!busy) || (access_sequence != content.seq)){
+            deviceCounters.seq_errors.add();
+            if(busy) deviceCounters.stray_frames.add();
+            return;
+        }
+    }else deviceCounters.id_errors.add();
 
-    // Stops the timeout
+    // No pending reception (a pipelined access is matched by the sequence number)
+    if((!busy) || (access_pipelined)) return;
+
+    // Stops the deadline
     deviceTmo.stop();
 
     // Timeout signaled by the client
     if(devId==0){
-        busy = false;
-        rxOk = false;
         frameError.tmo = 1;
+        accessCompleted(false);
         return;
     }
 
     // Device ID not matching the expected
     if(devId != (canId & 0x3F)) {
-        busy = false;
-        rxOk = false;
         frameError.id = 1;
+        accessCompleted(false);
         return; // Invalid ID
     }
 
-
-    // Test the received sequence number mutches the sent frame
-    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t content = canDeviceProtocolFrame::toContent(&data);
-    if(content.seq == 0){
-        busy = false;
-        rxOk = false;
-        frameError.seq = 1;
-        return; // Invalid Frame Format (lenght or crc)
-    }
-
-    if(frame_sequence != content.seq){
-        busy = false;
-        rxOk = false;
-        frameError.seq = 1;        
-        return;
-    }
-
     // Received a correct protocol frame    
+    access_backoff = false;
     receptionEvent(&content);
     return;
 }
@@ -118,27 +310,198 @@ void canDeviceProtocol::rxFromDeviceCan(ushort canId, QByteArray data){
 /**
  * This is the timer event routine used to detect a transmission timeout
  *
- * @param event
+ * When the deadline expires and retries are available,
+ * the timer is restarted with the backoff time: the frame is sent again
+ * at the backoff time expiration.
+ *
  */
 void canDeviceProtocol::deviceTmoEvent(void){
     deviceTmo.stop();
     if(!busy) return;
 
+    // Backoff expired: retry
+    if(access_backoff){
+        accessSend();
+        return;
+    }
+
     // Timeout Event
     qDebug() << "TIMEOUT CLIENT EVENT";
+    deviceCounters.timeouts.add();
 
-    busy = false;
-    rxOk = false;
+    if(access_retries > 0){
+        access_retries--;
+        access_attempt++;
+        access_backoff = true;
+        deviceCounters.retries.add();
+        deviceTmo.start(retryBackoff(access_attempt));
+        return;
+    }
+
+    deviceCounters.failures.add();
     frameError.tmo = 1;
+    accessCompleted(false);
     return;
 
 }
 
+/**
+ * @brief This function sets the transaction deadline and the retries
+ *
+ * The new values are applied to the next transactions.
+ *
+ * @param timeout is the transaction deadline in ms
+ * @param retries is the number of retries of an expired transaction (0 to canDeviceProtocol::CAN_MAX_RETRIES)
+ * @param backoff is the backoff time of the first retry in ms: the time is doubled at every retry
+ */
+void canDeviceProtocol::setDeviceTimeout(int timeout, int retries, int backoff){
+    if(timeout < 1) timeout = 1;
+    if(retries < 0) retries = 0;
+    if(retries > CAN_MAX_RETRIES) retries = CAN_MAX_RETRIES;
+    if(backoff < 0) backoff = 0;
+
+    deviceTimeout = timeout;
+    deviceRetries = retries;
+    deviceBackoff = backoff;
+}
+
+/**
+ * @brief This function resets the device communication statistics
+ */
+void canDeviceProtocol::resetDeviceStatistics(void){
+    deviceCounters.timeouts.set(0);
+    deviceCounters.crc_errors.set(0);
+    deviceCounters.seq_errors.set(0);
+    deviceCounters.retries.set(0);
+    deviceCounters.failures.set(0);
+    deviceCounters.requests.set(0);
+    deviceCounters.tx_frames.set(0);
+    deviceCounters.rx_frames.set(0);
+    deviceCounters.id_errors.set(0);
+    deviceCounters.idx_errors.set(0);
+    deviceCounters.frame_code_errors.set(0);
+    deviceCounters.stray_frames.set(0);
+    deviceCounters.inflight_max.set(deviceCounters.inflight.get());
+    statisticsPrevious = getDeviceStatistics();
+    statisticsTime = pipelineClock.elapsed();
+}
+
+/**
+ * @brief This function returns the device communication statistics
+ *
+ * The function can be called by any thread: every counter is read atomically,
+ * but the counters are not read at the same instant.
+ *
+ * @return the snapshot of the counters
+ */
+canDeviceProtocol::CAN_DEVICE_STATISTICS_t canDeviceProtocol::getDeviceStatistics(void){
+    CAN_DEVICE_STATISTICS_t stat;
+
+    stat.timeouts = deviceCounters.timeouts.get();
+    stat.crc_errors = deviceCounters.crc_errors.get();
+    stat.seq_errors = deviceCounters.seq_errors.get();
+    stat.retries = deviceCounters.retries.get();
+    stat.failures = deviceCounters.failures.get();
+    stat.requests = deviceCounters.requests.get();
+    stat.tx_frames = deviceCounters.tx_frames.get();
+    stat.rx_frames = deviceCounters.rx_frames.get();
+    stat.id_errors = deviceCounters.id_errors.get();
+    stat.idx_errors = deviceCounters.idx_errors.get();
+    stat.frame_code_errors = deviceCounters.frame_code_errors.get();
+    stat.stray_frames = deviceCounters.stray_frames.get();
+    stat.inflight = deviceCounters.inflight.get();
+    stat.inflight_max = deviceCounters.inflight_max.get();
+    stat.queued = deviceCounters.queued.get();
+    return stat;
+}
+
+/**
+ * @brief This function enables the periodic log of the device communication statistics
+ *
+ * Every period the device logs (qInfo()) the request and frame rates
+ * and the errors detected in the period.
+ *
+ * @param period is the log period in ms (0 disables the log)
+ */
+void canDeviceProtocol::setDeviceStatisticsDump(int period){
+    if(period <= 0){
+        statisticsTmo.stop();
+        return;
+    }
+
+    statisticsPrevious = getDeviceStatistics();
+    statisticsTime = pipelineClock.elapsed();
+    statisticsTmo.start(period);
+}
+
+/**
+ * This is the timer event routine of the periodic statistics log.
+ */
+void canDeviceProtocol::statisticsTmoEvent(void){
+    CAN_DEVICE_STATISTICS_t current = getDeviceStatistics();
+    qint64 now = pipelineClock.elapsed();
+    double dt = (now > statisticsTime) ? (double) (now - statisticsTime) / 1000.0 : 0.001;
+    const CAN_DEVICE_STATISTICS_t* prev = &statisticsPrevious;
+
+    QString rates = QString("req=%1/s tx=%2 f/s rx=%3 f/s")
+            .arg((current.requests - prev->requests) / dt, 0, 'f', 1)
+            .arg((current.tx_frames - prev->tx_frames) / dt, 0, 'f', 1)
+            .arg((current.rx_frames - prev->rx_frames) / dt, 0, 'f', 1);
+    QString failures = QString("retries=%1 tmo=%2 fail=%3")
+            .arg(current.retries - prev->retries)
+            .arg(current.timeouts - prev->timeouts)
+            .arg(current.failures - prev->failures);
+    QString errors = QString("crc=%1 seq=%2 id=%3 idx=%4 code=%5 stray=%6")
+            .arg(current.crc_errors - prev->crc_errors)
+            .arg(current.seq_errors - prev->seq_errors)
+            .arg(current.id_errors - prev->id_errors)
+            .arg(current.idx_errors - prev->idx_errors)
+            .arg(current.frame_code_errors - prev->frame_code_errors)
+            .arg(current.stray_frames - prev->stray_frames);
+    QString depth = QString("inflight=%1 (max %2) queued=%3")
+            .arg(current.inflight)
+            .arg(current.inflight_max)
+            .arg(current.queued);
+
+    qInfo() << QString("DEVICE %1 STATISTICS: %2 %3 %4 %5").arg(devId).arg(rates).arg(failures).arg(errors).arg(depth);
+
+    statisticsPrevious = current;
+    statisticsTime = now;
+}
+
+/**
+ * This function updates the transaction depth counters:
+ * the transactions waiting for the answer and the requests waiting to be sent.
+ */
+void canDeviceProtocol::updateDepth(void){
+    ulong depth = inflightSeq.size() + (((busy) && (!access_pipelined)) ? 1 : 0);
+    deviceCounters.inflight.set(depth);
+    deviceCounters.inflight_max.setMax(depth);
+    deviceCounters.queued.set(requestQueue.size() + retryQueue.size());
+}
+
+/**
+ * This function returns the backoff time of a retry.
+ *
+ * @param attempt is the retry counter, starting from 1
+ * @return the backoff time in ms
+ */
+int canDeviceProtocol::retryBackoff(int attempt){
+    int backoff = deviceBackoff;
+    for(int i=1; (i<attempt) && (backoff < CAN_RETRY_MAX_BACKOFF); i++) backoff *= 2;
+    if(backoff > CAN_RETRY_MAX_BACKOFF) backoff = CAN_RETRY_MAX_BACKOFF;
+    return backoff;
+}
+
 
 
 /**
  * @brief This is the interface function to request a protocol register access.
  *
+ * The COMMAND_EXEC frame is queued as a pipelined request, so it is sent
+ * before the polling requests (the abort command before all the queued requests):
+ * the transaction is completed with the canDeviceProtocol::deviceAccessCompleted() signal
+ * as the other accesses.
  *
  * @param regtype is the type of access
  * @param idx is the register or command idx code
@@ -151,32 +514,71 @@ void canDeviceProtocol::deviceTmoEvent(void){
  */
 bool  canDeviceProtocol::deviceAccessRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, uchar d0, uchar d1, uchar d2, uchar d3){
     if(busy) return false;
-    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t content;
-
-    // Assignes a new frame sequence
-    frame_sequence++;
-    if(!frame_sequence) frame_sequence = 1;
 
     // Fills the register content
-    content.seq = frame_sequence;
-    content.frame_type = regtype;
-    content.idx = idx;
-    content.d[0] = d0;
-    content.d[1] = d1;
-    content.d[2] = d2;
-    content.d[3] = d3;
+    access_content.frame_type = regtype;
+    access_content.idx = idx;
+    access_content.d[0] = d0;
+    access_content.d[1] = d1;
+    access_content.d[2] = d2;
+    access_content.d[3] = d3;
+    access_retries = deviceRetries;
+    access_attempt = 0;
 
     // Initialize the frame status variables
-    busy = true;
     rxOk = false;
     (*(uchar*) &frameError) = 0;
 
+    // The commands are scheduled with the pipelined requests
+    if(regtype == canDeviceProtocolFrame::COMMAND_EXEC){
+        access_content.seq = 0;
+        access_sequence = 0;
+        access_pipelined = true;
+        busy = true;
+        if(queueRequest(canDeviceProtocolFrame::toFrame(access_content), (idx == canDeviceProtocolFrame::CAN_ABORT_COMMAND), true)) return true;
 
-    emit txToDeviceCan(devId + canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS, canDeviceProtocolFrame::toCanData(&content));
-    deviceTmo.stop();
+        access_pipelined = false;
+        busy = false;
+        return false;
+    }
+
+    deviceCounters.requests.add();
+    accessSend();
     return true;
 }
 
+/**
+ * This function sends the deviceAccessRegister() frame
+ * with a new sequence number and arms the deadline.
+ */
+void canDeviceProtocol::accessSend(void){
+
+    // Assignes a new frame sequence
+    access_sequence = nextSequence();
+    access_content.seq = access_sequence;
+    access_backoff = false;
+    busy = true;
+
+    deviceCounters.tx_frames.add();
+    updateDepth();
+    emit txToDeviceCan(devId + canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS, canDeviceProtocolFrame::toCanData(&access_content));
+    deviceTmo.start(deviceTimeout);
+}
+
+/**
+ * This function terminates the deviceAccessRegister() transaction
+ * and emits the canDeviceProtocol::deviceAccessCompleted() signal.
+ *
+ * @param ok true if the transaction is successfully concluded
+ */
+void canDeviceProtocol::accessCompleted(bool ok){
+    busy = false;
+    access_pipelined = false;
+    rxOk = ok;
+    updateDepth();
+    emit deviceAccessCompleted(access_content.frame_type, access_content.idx, ok);
+}
+
 
 
 
@@ -187,98 +589,1280 @@ bool  canDeviceProtocol::deviceAccessRegister(canDeviceProtocolFrame::CAN_FRAME_
  */
 void canDeviceProtocol::receptionEvent( canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* pContent){
 
+    switch(storeRegister(pContent)){
+    case STORE_IDX_ERROR:
+        deviceCounters.idx_errors.add();
+        frameError.idx = 1;
+        accessCompleted(false);
+        return;
+
+    case STORE_FRAME_CODE_ERROR:
+        deviceCounters.frame_code_errors.add();
+        frameError.frame_code = 1;
+        accessCompleted(false);
+        return;
+
+    default:
+        break;
+    }
+
+    // Reception completed
+    accessCompleted(true);
+    return;
+}
+
+/**
+ * This function stores the content of a received frame into the related register.
+ *
+ * If the register content changes, the canDeviceProtocol::deviceRegisterChanged() signal is emitted.
+ *
+ * @param pContent this is the pointer to the decoded protocol frame
+ * @return the result of the operation
+ */
+canDeviceProtocol::STORE_RESULT_t canDeviceProtocol::storeRegister( canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* pContent){
+    bool changed;
+
     // Evaluate the operation
     switch(pContent->frame_type){
         case canDeviceProtocolFrame::READ_REVISION:
-            memcpy(deviceRevisionRegister.d, pContent->d, 4);
-            deviceRevisionRegister.valid = true;
+            storeRegisterContent(canDeviceProtocolFrame::READ_REVISION, 0, &deviceRevisionRegister, pContent->d);
             break;
         case canDeviceProtocolFrame::READ_ERRORS:
-            memcpy(deviceErrorsRegister.d, pContent->d, 4);
-            deviceErrorsRegister.valid = true;
+            storeRegisterContent(canDeviceProtocolFrame::READ_ERRORS, 0, &deviceErrorsRegister, pContent->d);
             break;
 
         case canDeviceProtocolFrame::COMMAND_EXEC:
         case canDeviceProtocolFrame::READ_COMMAND:
+            changed = (!deviceCommandRegister.valid) ||
+                      (deviceCommandRegister.command != pContent->idx) ||
+                      (deviceCommandRegister.status != pContent->d[0]) ||
+                      (deviceCommandRegister.b0 != pContent->d[1]) ||
+                      (deviceCommandRegister.b1 != pContent->d[2]) ||
+                      (deviceCommandRegister.error != pContent->d[3]);
+
             deviceCommandRegister.command = pContent->idx;
             deviceCommandRegister.status =  pContent->d[0];
             deviceCommandRegister.b0 =      pContent->d[1];
             deviceCommandRegister.b1 =      pContent->d[2];
             deviceCommandRegister.error =   pContent->d[3];
             deviceCommandRegister.valid = true;
+            if(changed) registerChanged(canDeviceProtocolFrame::READ_COMMAND, 0);
             break;
         case canDeviceProtocolFrame::READ_STATUS:
-            if(pContent->idx >= deviceStatusRegisters.size() ){
-                busy = false;
-                rxOk = false;
-                frameError.idx = 1;
-                return;
-            }
-
-            memcpy(deviceStatusRegisters[pContent->idx].d, pContent->d,4);
-            deviceStatusRegisters[pContent->idx].valid = true;
+            if(pContent->idx >= deviceStatusRegisters.count) return bankIdxError(&deviceStatusRegisters, canDeviceProtocolFrame::READ_STATUS);
+            storeRegisterContent(canDeviceProtocolFrame::READ_STATUS, pContent->idx, &deviceStatusRegisters.reg[pContent->idx], pContent->d);
             break;
         case canDeviceProtocolFrame::READ_DATA:
-            if(pContent->idx >= deviceDataRegisters.size() ){
-                busy = false;
-                rxOk = false;
-                frameError.idx = 1;
-                return;
-            }
-
-            memcpy(deviceDataRegisters[pContent->idx].d, pContent->d,4);
-            deviceDataRegisters[pContent->idx].valid = true;
-            break;
-        case canDeviceProtocolFrame::READ_PARAM:
-            if(pContent->idx >= deviceParamRegisters.size() ){
-                busy = false;
-                rxOk = false;
-                frameError.idx = 1;
-                return;
-            }
-
-            memcpy(deviceParamRegisters[pContent->idx].d, pContent->d,4);
-            deviceParamRegisters[pContent->idx].valid = true;
-            break;
         case canDeviceProtocolFrame::WRITE_DATA:
-            if(pContent->idx >= deviceDataRegisters.size() ){
-                busy = false;
-                rxOk = false;
-                frameError.idx = 1;
-                return;
-            }
-
-            memcpy(deviceDataRegisters[pContent->idx].d, pContent->d,4);
-            deviceDataRegisters[pContent->idx].valid = true;
+            if(pContent->idx >= deviceDataRegisters.count) return bankIdxError(&deviceDataRegisters, canDeviceProtocolFrame::READ_DATA);
+            storeRegisterContent(canDeviceProtocolFrame::READ_DATA, pContent->idx, &deviceDataRegisters.reg[pContent->idx], pContent->d);
             break;
+        case canDeviceProtocolFrame::READ_PARAM:
         case canDeviceProtocolFrame::WRITE_PARAM:
-            if(pContent->idx >= deviceParamRegisters.size() ){
-                busy = false;
-                rxOk = false;
-                frameError.idx = 1;
-                return;
-            }
-
-            memcpy(deviceParamRegisters[pContent->idx].d, pContent->d,4);
-            deviceParamRegisters[pContent->idx].valid = true;
+            if(pContent->idx >= deviceParamRegisters.count) return bankIdxError(&deviceParamRegisters, canDeviceProtocolFrame::READ_PARAM);
+            storeRegisterContent(canDeviceProtocolFrame::READ_PARAM, pContent->idx, &deviceParamRegisters.reg[pContent->idx], pContent->d);
             break;
 
         case canDeviceProtocolFrame::STORE_PARAMS:
             break;
 
+        case canDeviceProtocolFrame::READ_MULTI:
+            return storeMultiRegister(pContent);
+
 
         default:
+            return STORE_FRAME_CODE_ERROR;
+    }
 
-            busy = false;
-            rxOk = false;
-            frameError.frame_code = 1;
-            return;
+    return STORE_OK;
+}
+
+/**
+ * This function returns the idx error of a register out of its bank.
+ *
+ * The first answer received for an empty bank is logged: the Device
+ * has not declared its registers (see canDeviceProtocol::setDeviceRegisterMap()).
+ *
+ * @param bank this is the register bank
+ * @param regtype this is the register read frame code
+ * @return STORE_IDX_ERROR
+ */
+canDeviceProtocol::STORE_RESULT_t canDeviceProtocol::bankIdxError(const CAN_REGISTER_BANK_t* bank, uchar regtype){
+    if((!bank->count) && (!registerMapWarned)){
+        registerMapWarned = true;
+        qDebug() << "DEVICE" << devId << "REGISTERS NOT DECLARED: ANSWER DISCARDED, FRAME CODE" << regtype;
     }
+    return STORE_IDX_ERROR;
+}
 
-    // Reception completed
-    busy = false;
-    rxOk = true;
-    return;
+/**
+ * This function stores the register contents of a READ_MULTI answer.
+ *
+ * The contents are read from the last decoded CAN FD frame (rxMulti):
+ * a READ_MULTI answer in a standard 8 byte frame is not valid.
+ *
+ * @param pContent this is the pointer to the decoded protocol frame
+ * @return the result of the operation
+ */
+canDeviceProtocol::STORE_RESULT_t canDeviceProtocol::storeMultiRegister( canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* pContent){
+    if((!rxMulti.count) || (rxMulti.count != pContent->d[1]) || (rxMulti.regtype != pContent->d[0])) return STORE_FRAME_CODE_ERROR;
+
+    // Only the read frame codes of the banks are valid register types
+    if((rxMulti.regtype != canDeviceProtocolFrame::READ_STATUS) &&
+       (rxMulti.regtype != canDeviceProtocolFrame::READ_DATA) &&
+       (rxMulti.regtype != canDeviceProtocolFrame::READ_PARAM)) return STORE_FRAME_CODE_ERROR;
+
+    CAN_REGISTER_BANK_t* registers = registerBanks[rxMulti.regtype];
+    if(pContent->idx + rxMulti.count > registers->count) return bankIdxError(registers, rxMulti.regtype);
+
+    for(int i=0; i<rxMulti.count; i++){
+        storeRegisterContent(rxMulti.regtype, pContent->idx + i, &registers->reg[pContent->idx + i], rxMulti.d[i]);
+    }
+    return STORE_OK;
+}
+
+/**
+ * This function stores a register content and detects the content change.
+ *
+ * @param regtype is the register read frame code
+ * @param idx is the register idx code
+ * @param reg pointer to the register
+ * @param d pointer to the received data content
+ */
+void canDeviceProtocol::storeRegisterContent(uchar regtype, uchar idx, canDeviceProtocolFrame::CAN_REGISTER_t* reg, const uchar* d){
+    bool changed = (!reg->valid) || (memcmp(reg->d, d, 4));
+
+    memcpy(reg->d, d, 4);
+    reg->valid = true;
+    if(changed) registerChanged(regtype, idx);
+}
+
+/**
+ * This function assignes a new generation to a changed register
+ * and emits the canDeviceProtocol::deviceRegisterChanged() signal.
+ *
+ * @param regtype is the register read frame code
+ * @param idx is the register idx code
+ */
+void canDeviceProtocol::registerChanged(uchar regtype, uchar idx){
+    registerGeneration++;
+    registerGenerations.insert(((ushort) regtype << 8) | idx, registerGeneration);
+    emit deviceRegisterChanged(regtype, idx, registerGeneration);
+}
+
+/**
+ * @brief This function returns the generation of the last change of a register
+ *
+ * @param regtype is the register read frame code (READ_REVISION to READ_PARAM)
+ * @param idx is the register idx code
+ * @return the generation or 0 if the register never changed
+ */
+ulong canDeviceProtocol::getDeviceRegisterGeneration(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx){
+    return registerGenerations.value(((ushort) regtype << 8) | idx, 0);
+}
+
+/**
+ * @brief This function returns the registers changed after a given generation
+ *
+ * Usage:
+ * \verbatim
+    ulong last = 0;
+    ...
+    QList<CAN_REGISTER_CHANGE_t> delta = getDeviceRegistersChangedSince(last);
+    last = getDeviceRegisterGeneration();
+    ... forward only the delta
+   \endverbatim
+ *
+ * @param generation is the last generation already handled by the caller
+ * @return the list of the changed registers, in change order
+ */
+QList<canDeviceProtocol::CAN_REGISTER_CHANGE_t> canDeviceProtocol::getDeviceRegistersChangedSince(ulong generation){
+    QList<CAN_REGISTER_CHANGE_t> list;
+    CAN_REGISTER_CHANGE_t change;
+
+    if(generation >= registerGeneration) return list;
+
+    QMap<ulong, ushort> changed;
+    QMap<ushort, ulong>::const_iterator i;
+    for(i = registerGenerations.constBegin(); i != registerGenerations.constEnd(); ++i){
+        if(i.value() > generation) changed.insert(i.value(), i.key());
+    }
+
+    QMap<ulong, ushort>::const_iterator j;
+    for(j = changed.constBegin(); j != changed.constEnd(); ++j){
+        change.regtype = j.value() >> 8;
+        change.idx = j.value() & 0xFF;
+        change.generation = j.key();
+        getDeviceRegister((canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t) change.regtype, change.idx, &change.reg);
+        list.append(change);
+    }
+
+    return list;
+}
+
+/**
+ * This function assignes a new frame sequence number.
+ *
+ * The sequence numbers of the frames waiting for the answer are skipped.
+ *
+ * @return the new sequence number (1 to 255)
+ */
+uchar canDeviceProtocol::nextSequence(void){
+    do{
+        frame_sequence++;
+        if(!frame_sequence) frame_sequence = 1;
+    }while((inflight[frame_sequence].active) || ((busy) && (frame_sequence == access_sequence)));
+
+    return frame_sequence;
+}
+
+/**
+ * @brief This is the interface function to queue a protocol register access.
+ *
+ * The request is queued and sent as soon as the number of requests
+ * waiting for the answer is lower than the pipeline window.
+ *
+ * When the request is completed (successfully or not) the
+ * canDeviceProtocol::deviceRequestCompleted() signal is emitted.
+ *
+ * @param regtype is the type of access
+ * @param idx is the register or command idx code
+ * @param d0 frame data 0
+ * @param d1 frame data 1
+ * @param d2 frame data 2
+ * @param d3 frame data 3
+ *
+ * @return the request identifier or 0 if the queue is full
+ */
+uint canDeviceProtocol::deviceQueueRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, uchar d0, uchar d1, uchar d2, uchar d3){
+    return queueRequest(canDeviceProtocolFrame::makeFrame(0, regtype, idx, d0, d1, d2, d3), false, false);
 }
 
+/**
+ * This function queues a pipelined request.
+ *
+ * @param frame is the encoded request frame (the sequence number is assigned at the sending)
+ * @param urgent true if the request is sent before all the queued requests (abort command)
+ * @param access true if the request is the deviceAccessRegister() transaction
+ *
+ * The urgent requests are never rejected: they are queued also
+ * when the queue has already CAN_PIPELINE_MAX_QUEUE requests.
+ *
+ * @return the request identifier or 0 if the queue is full
+ */
+uint canDeviceProtocol::queueRequest(canDeviceProtocolFrame::CAN_FRAME_t frame, bool urgent, bool access){
+    if((!urgent) && (requestQueue.size() >= CAN_PIPELINE_MAX_QUEUE)) return 0;
+
+    CAN_REQUEST_t request;
+    requestId++;
+    if(!requestId) requestId = 1;
+
+    request.id = requestId;
+    request.active = false;
+    request.poll = false;
+    request.refresh = false;
+    request.access = access;
+    request.deadline = 0;
+    request.retries = deviceRetries;
+    request.attempt = 0;
+    request.not_before = 0;
+    request.frame = frame;
+    if(urgent) requestQueue.prepend(request);
+    else requestQueue.append(request);
+
+    pipelinePump();
+    pipelineArmTimer();
+    return request.id;
+}
 
+/**
+ * @brief This is the asynchronous interface function to access a protocol register.
+ *
+ * The access is queued as a pipelined request (see canDeviceProtocol::deviceQueueRegister()):
+ * the returned handle is completed by the frame reception handler
+ * (see the ASYNCHRONOUS REQUESTS section of the canDeviceModule).
+ *
+ * @param regtype is the type of access
+ * @param idx is the register or command idx code
+ * @param d0 frame data 0
+ * @param d1 frame data 1
+ * @param d2 frame data 2
+ * @param d3 frame data 3
+ *
+ * @return the reply handle (not valid if the request queue is full)
+ */
+canDeviceReply canDeviceProtocol::deviceRequest(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, uchar d0, uchar d1, uchar d2, uchar d3){
+    return attachReply(deviceQueueRegister(regtype, idx, d0, d1, d2, d3));
+}
+
+/**
+ * @brief This is the asynchronous interface function to execute a Device command.
+ *
+ * The COMMAND_EXEC frame is queued as a pipelined request:
+ * the reply is completed with the COMMAND_EXEC answer of the Device.
+ *
+ * @param command is the command code
+ * @param d0 command parameter 0
+ * @param d1 command parameter 1
+ * @param d2 command parameter 2
+ * @param d3 command parameter 3
+ *
+ * @return the reply handle (not valid if the request queue is full)
+ */
+canDeviceReply canDeviceProtocol::deviceCommand(uchar command, uchar d0, uchar d1, uchar d2, uchar d3){
+    return deviceRequest(canDeviceProtocolFrame::COMMAND_EXEC, command, d0, d1, d2, d3);
+}
+
+/**
+ * @brief This is the asynchronous interface function to read many registers with a READ_MULTI request.
+ *
+ * See canDeviceProtocol::deviceQueueMultiRead(): the reply answer carries
+ * the register type in d[0] and the number of registers in d[1];
+ * the register contents are read with canDeviceProtocol::getDeviceRegister().
+ *
+ * @param regtype is the register read frame code (READ_STATUS, READ_DATA or READ_PARAM)
+ * @param first_idx is the idx code of the first register
+ * @param count is the number of registers
+ *
+ * @return the reply handle (not valid if the request is refused)
+ */
+canDeviceReply canDeviceProtocol::deviceMultiRequest(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar first_idx, uchar count){
+    return attachReply(deviceQueueMultiRead(regtype, first_idx, count));
+}
+
+/**
+ * @brief This is the interface function to execute a Device command up to its completion.
+ *
+ * See the COMMAND EXECUTION TRACKER section of the canDeviceModule.
+ *
+ * @param command is the command code (not the abort code)
+ * @param d0 command parameter 0
+ * @param d1 command parameter 1
+ * @param d2 command parameter 2
+ * @param d3 command parameter 3
+ * @param timeout is the maximum command duration in ms
+ *
+ * @return the reply handle of the command completion
+ * (not valid if a command is already tracked or the request queue is full)
+ */
+canDeviceReply canDeviceProtocol::deviceExecuteCommand(uchar command, uchar d0, uchar d1, uchar d2, uchar d3, int timeout){
+    if(commandTracker.active) return canDeviceReply();
+    if(command == canDeviceProtocolFrame::CAN_ABORT_COMMAND) return canDeviceReply();
+
+    canDeviceReply exec = deviceCommand(command, d0, d1, d2, d3);
+    if(!exec.isValid()) return exec;
+
+    requestId++;
+    if(!requestId) requestId = 1;
+    uint id = requestId;
+
+    commandTracker.active = true;
+    commandTracker.id = id;
+    commandTracker.command = command;
+    commandTracker.deadline = pipelineClock.elapsed() + ((timeout > 0) ? timeout : CAN_COMMAND_DEFAULT_TMO);
+    commandTracker.period = CAN_COMMAND_POLL_MIN;
+    commandTracker.reading = true;
+
+    exec.then([this, id](bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t& answer){
+        commandStatus(id, true, ok, answer);
+    });
+    return attachReply(id);
+}
+
+/**
+ * @brief This function aborts the executing command
+ *
+ * If a command is tracked (see canDeviceProtocol::deviceExecuteCommand())
+ * the abort command is queued and the tracked command is completed with the
+ * CAN_COMMAND_ABORT_CODE error. Otherwise the abort command is sent
+ * with the canDeviceProtocol::deviceAccessRegister().
+ *
+ * @return true if the abort command has been sent
+ */
+bool canDeviceProtocol::deviceAbortCommand(void){
+    if(!commandTracker.active) return deviceAccessRegister(canDeviceProtocolFrame::COMMAND_EXEC, canDeviceProtocolFrame::CAN_ABORT_COMMAND);
+
+    commandAbort();
+    return true;
+}
+
+/**
+ * This function handles the answer of the COMMAND_EXEC frame
+ * or of a COMMAND register read of the tracked command.
+ *
+ * @param id is the reply identifier of the tracked command
+ * @param exec true for the COMMAND_EXEC answer
+ * @param ok true if the frame has been answered
+ * @param answer is the answer frame: d[0] = status, d[1] = b0, d[2] = b1, d[3] = error
+ */
+void canDeviceProtocol::commandStatus(uint id, bool exec, bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t& answer){
+    if((!commandTracker.active) || (commandTracker.id != id)) return;
+    commandTracker.reading = false;
+
+    if(!ok){
+        // The command has not been received by the Device
+        if(exec){
+            commandCompleted(false, 0, 0, 0, 0);
+            return;
+        }
+        // A lost COMMAND register read is repeated at the next period
+    }else if((!exec) && (answer.idx != commandTracker.command)){
+        // The COMMAND register reports another command: the tracked command has not been executed
+        commandCompleted(false, answer.d[0], answer.d[1], answer.d[2], answer.d[3]);
+        return;
+    }else{
+        switch(answer.d[0]){
+        case canDeviceProtocolFrame::CAN_COMMAND_EXECUTING:
+            break;
+        case canDeviceProtocolFrame::CAN_COMMAND_EXECUTED:
+            commandCompleted(true, answer.d[0], answer.d[1], answer.d[2], answer.d[3]);
+            return;
+        default:
+            commandCompleted(false, answer.d[0], answer.d[1], answer.d[2], answer.d[3]);
+            return;
+        }
+    }
+
+    // Next COMMAND register read, not later than the command timeout
+    qint64 remaining = commandTracker.deadline - pipelineClock.elapsed();
+    if(remaining < 0) remaining = 0;
+    commandTmo.start((remaining < commandTracker.period) ? remaining : commandTracker.period);
+
+    commandTracker.period *= 2;
+    if(commandTracker.period > CAN_COMMAND_POLL_MAX) commandTracker.period = CAN_COMMAND_POLL_MAX;
+}
+
+/**
+ * This is the timer event routine of the tracked command:
+ * the COMMAND register is read or, if the command timeout is expired,
+ * the command is aborted.
+ */
+void canDeviceProtocol::commandTmoEvent(void){
+    if(!commandTracker.active) return;
+    if(commandTracker.reading) return;
+
+    if(pipelineClock.elapsed() >= commandTracker.deadline){
+        qDebug() << "TIMEOUT COMMAND" << commandTracker.command;
+        commandAbort();
+        return;
+    }
+
+    uint id = commandTracker.id;
+    canDeviceReply read = deviceRequest(canDeviceProtocolFrame::READ_COMMAND);
+    if(!read.isValid()){
+        commandTmo.start(commandTracker.period);
+        return;
+    }
+
+    commandTracker.reading = true;
+    read.then([this, id](bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t& answer){
+        commandStatus(id, false, ok, answer);
+    });
+}
+
+/**
+ * This function sends the abort command and completes the tracked command
+ * with the CAN_COMMAND_ABORT_CODE error.
+ *
+ * The abort command is an urgent request, so it is queued also with the queue full.
+ */
+void canDeviceProtocol::commandAbort(void){
+    queueRequest(canDeviceProtocolFrame::makeFrame(0, canDeviceProtocolFrame::COMMAND_EXEC, canDeviceProtocolFrame::CAN_ABORT_COMMAND, 0, 0, 0, 0), true, false);
+    commandCompleted(false, canDeviceProtocolFrame::CAN_COMMAND_ERROR, 0, 0, canDeviceProtocolFrame::CAN_COMMAND_ABORT_CODE);
+}
+
+/**
+ * This function completes the tracked command:
+ * the canDeviceProtocol::deviceCommandCompleted() signal is emitted
+ * and the handlers of the command reply are called.
+ *
+ * @param ok true if the command has been successfully executed
+ * @param status is the last command status
+ * @param b0 is the result byte 0
+ * @param b1 is the result byte 1
+ * @param error is the error code
+ */
+void canDeviceProtocol::commandCompleted(bool ok, uchar status, uchar b0, uchar b1, uchar error){
+    commandTmo.stop();
+    commandTracker.active = false;
+    commandTracker.reading = false;
+
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t result;
+    result.seq = 0;
+    result.frame_type = canDeviceProtocolFrame::READ_COMMAND;
+    result.idx = commandTracker.command;
+    result.d[0] = status;
+    result.d[1] = b0;
+    result.d[2] = b1;
+    result.d[3] = error;
+
+    emit deviceCommandCompleted(commandTracker.command, ok, b0, b1, error);
+
+    if(!pendingReplies.contains(commandTracker.id)) return;
+    canDeviceReply reply = pendingReplies.take(commandTracker.id);
+    reply.finish(ok, &result);
+}
+
+/**
+ * This function creates the reply handle of a queued request.
+ *
+ * @param request is the request identifier (0 if the request has been refused)
+ * @return the reply handle
+ */
+canDeviceReply canDeviceProtocol::attachReply(uint request){
+    canDeviceReply reply(request);
+    if(request) pendingReplies.insert(request, reply);
+    return reply;
+}
+
+/**
+ * @brief This is the interface function to queue a READ_MULTI request.
+ *
+ * The registers from first_idx to first_idx + count - 1 are read
+ * with a single transaction: the answer is a CAN FD frame.
+ *
+ * When the request is completed the canDeviceProtocol::deviceRequestCompleted()
+ * signal is emitted with the READ_MULTI frame code and the first_idx.
+ *
+ * @param regtype is the type of the registers (READ_STATUS, READ_DATA, READ_PARAM)
+ * @param first_idx is the first register idx code
+ * @param count is the number of registers (1 to canDeviceProtocolFrame::CAN_MULTI_MAX_REGISTERS)
+ *
+ * @return the request identifier or 0 if the request is not valid or the queue is full
+ */
+uint canDeviceProtocol::deviceQueueMultiRead(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar first_idx, uchar count){
+    if((regtype != canDeviceProtocolFrame::READ_STATUS) && (regtype != canDeviceProtocolFrame::READ_DATA) && (regtype != canDeviceProtocolFrame::READ_PARAM)) return 0;
+    if((!count) || (count > canDeviceProtocolFrame::CAN_MULTI_MAX_REGISTERS)) return 0;
+
+    return deviceQueueRegister(canDeviceProtocolFrame::READ_MULTI, first_idx, regtype, count);
+}
+
+/**
+ * @brief This function sets the maximum number of requests waiting for the answer
+ *
+ * @param window the number of requests, from 1 to canDeviceProtocol::CAN_PIPELINE_MAX_WINDOW
+ */
+void canDeviceProtocol::setDevicePipelineWindow(int window){
+    if(window < 1) window = 1;
+    if(window > CAN_PIPELINE_MAX_WINDOW) window = CAN_PIPELINE_MAX_WINDOW;
+    pipelineWindow = window;
+
+    pipelinePump();
+    pipelineArmTimer();
+}
+
+/**
+ * This function returns the position of the first retry
+ * with an expired backoff time.
+ *
+ * @return the position in the retry queue or -1
+ */
+int canDeviceProtocol::retryNext(void){
+    qint64 now = pipelineClock.elapsed();
+
+    for(int i=0; i<retryQueue.size(); i++){
+        if(retryQueue.at(i).not_before <= now) return i;
+    }
+    return -1;
+}
+
+/**
+ * This function sends the queued requests up to the pipeline window.
+ *
+ * The sending order is:
+ * + the retries with an expired backoff time;
+ * + the queued requests;
+ * + the polling requests, generated only when the request queue is empty.
+ */
+void canDeviceProtocol::pipelinePump(void){
+    CAN_REQUEST_t request;
+    int retry;
+
+    while(inflightSeq.size() < pipelineWindow){
+        if((retry = retryNext()) >= 0) request = retryQueue.takeAt(retry);
+        else if(requestQueue.size()) request = requestQueue.takeFirst();
+        else if(!pollNext(&request)) break;
+
+        uchar seq = nextSequence();
+
+        request.frame = canDeviceProtocolFrame::setFrameSequence(request.frame, seq);
+        request.active = true;
+        request.deadline = pipelineClock.elapsed() + deviceTimeout;
+        inflight[seq] = request;
+        inflightSeq.append(seq);
+
+        if(!request.attempt) deviceCounters.requests.add();
+        deviceCounters.tx_frames.add();
+        emit txToDeviceCan(devId + canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS, canDeviceProtocolFrame::toCanData(request.frame));
+    }
+
+    updateDepth();
+    pollArmTimer();
+}
+
+/**
+ * This function starts the timer to the earliest deadline
+ * of the requests waiting for the answer or to the earliest
+ * backoff time expiration of the retries.
+ */
+void canDeviceProtocol::pipelineArmTimer(void){
+    if((!inflightSeq.size()) && (!retryQueue.size())){
+        pipelineTmo.stop();
+        return;
+    }
+
+    qint64 deadline = -1;
+    for(int i=0; i<inflightSeq.size(); i++){
+        if((deadline < 0) || (inflight[inflightSeq.at(i)].deadline < deadline)) deadline = inflight[inflightSeq.at(i)].deadline;
+    }
+
+    // A retry waiting for a pipeline slot doesn't need the timer
+    if(inflightSeq.size() < pipelineWindow){
+        for(int i=0; i<retryQueue.size(); i++){
+            if((deadline < 0) || (retryQueue.at(i).not_before < deadline)) deadline = retryQueue.at(i).not_before;
+        }
+    }
+
+    if(deadline < 0){
+        pipelineTmo.stop();
+        return;
+    }
+
+    qint64 remaining = deadline - pipelineClock.elapsed();
+    if(remaining < 0) remaining = 0;
+    pipelineTmo.start(remaining);
+}
+
+/**
+ * This function completes a request waiting for the answer
+ * and sends the next queued requests.
+ *
+ * @param seq this is the sequence number of the request
+ * @param ok this is the result of the request
+ * @param answer this is the decoded answer frame (nullptr if not received)
+ */
+void canDeviceProtocol::pipelineComplete(uchar seq, bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* answer){
+    CAN_REQUEST_t* request = &inflight[seq];
+
+    request->active = false;
+    inflightSeq.removeOne(seq);
+    if(request->poll) pollCompleted(&request->frame, ok);
+    else if(!request->refresh) requestCompleted(request, ok, answer);
+
+    pipelinePump();
+    pipelineArmTimer();
+}
+
+/**
+ * This function notifies the completion of a queued request:
+ * the canDeviceProtocol::deviceRequestCompleted() signal is emitted and
+ * the handlers of the asynchronous reply are called (see canDeviceReply).
+ *
+ * @param request this is the completed request
+ * @param ok this is the result of the request
+ * @param answer this is the decoded answer frame (nullptr if not received)
+ */
+void canDeviceProtocol::requestCompleted(const CAN_REQUEST_t* request, bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* answer){
+
+    // The deviceAccessRegister() transaction is notified as a single access
+    if(request->access){
+        if((!ok) && (!answer)) frameError.tmo = 1;
+        accessCompleted(ok);
+        return;
+    }
+
+    emit deviceRequestCompleted(request->id, request->frame.b[canDeviceProtocolFrame::FRAME_CODE], request->frame.b[canDeviceProtocolFrame::FRAME_IDX], ok);
+
+    if(!pendingReplies.contains(request->id)) return;
+    canDeviceReply reply = pendingReplies.take(request->id);
+    reply.finish(ok, answer);
+}
+
+/**
+ * This is the timer event routine used to detect the pipelined requests timeout
+ *
+ * Every request with an expired deadline releases its pipeline slot:
+ * + if retries are available, the request is moved to the retry queue
+ *   and it will be sent again after the backoff time;
+ * + otherwise the request is completed with error.
+ *
+ * The timeouts are counted in the deviceCounters statistics (no per-request log).
+ */
+void canDeviceProtocol::pipelineTmoEvent(void){
+    qint64 now = pipelineClock.elapsed();
+
+    for(int i=0; i<inflightSeq.size(); ){
+        uchar seq = inflightSeq.at(i);
+        if(inflight[seq].deadline > now){
+            i++;
+            continue;
+        }
+
+        inflight[seq].active = false;
+        inflightSeq.removeAt(i);
+        deviceCounters.timeouts.add();
+
+        if((!inflight[seq].poll) && (inflight[seq].retries > 0)){
+            CAN_REQUEST_t retry = inflight[seq];
+            retry.retries--;
+            retry.attempt++;
+            retry.not_before = now + retryBackoff(retry.attempt);
+            retryQueue.append(retry);
+            deviceCounters.retries.add();
+            continue;
+        }
+
+        deviceCounters.failures.add();
+        if(inflight[seq].poll) pollCompleted(&inflight[seq].frame, false);
+        else if(!inflight[seq].refresh) requestCompleted(&inflight[seq], false, nullptr);
+    }
+
+    pipelinePump();
+    pipelineArmTimer();
+}
+
+/**
+ * This is the slot notifying the status of the device channel.
+ *
+ * When the channel becomes ready after a connection loss,
+ * the protocol state is resynchronized (see canDeviceProtocol::deviceResync()).
+ *
+ * @param status true if the acceptance filter of the device is open
+ */
+void canDeviceProtocol::canDriverConnectionStatus(bool status){
+    // The first connection is not a reconnection: there is no state to resynchronize
+    bool resync = (status) && (!canDriverConnected) && (canDriverWasConnected);
+    canDriverConnected = status;
+    if(status) canDriverWasConnected = true;
+    if(resync) deviceResync();
+}
+
+/**
+ * This function resynchronizes the protocol state after a reconnection.
+ *
+ * See the RESYNCHRONIZATION AFTER A RECONNECTION section of the canDeviceModule.
+ */
+void canDeviceProtocol::deviceResync(void){
+
+    // The answer of the pending transaction has been lost with the connection
+    // (a pipelined transaction is completed with the pipelined requests)
+    if((busy) && (!access_pipelined)){
+        deviceTmo.stop();
+        frameError.tmo = 1;
+        accessCompleted(false);
+    }
+
+    // The read requests waiting for the answer are queued again in the original order.
+    // The writes and the commands may have been executed by the Device:
+    // they are completed with error and never sent twice.
+    int requeued = 0;
+    QList<uchar> failed;
+    for(int i=inflightSeq.size() - 1; i>=0; i--){
+        CAN_REQUEST_t* request = &inflight[inflightSeq.at(i)];
+        request->active = false;
+        if(request->poll){
+            pollCompleted(&request->frame, false);
+            continue;
+        }
+
+        uchar frame_type = request->frame.b[canDeviceProtocolFrame::FRAME_CODE];
+        if((frame_type >= canDeviceProtocolFrame::WRITE_DATA) && (frame_type <= canDeviceProtocolFrame::COMMAND_EXEC)){
+            failed.prepend(inflightSeq.at(i));
+            continue;
+        }
+
+        requestQueue.prepend(*request);
+        requeued++;
+    }
+    inflightSeq.clear();
+
+    for(int i=0; i<failed.size(); i++){
+        deviceCounters.failures.add();
+        if(!inflight[failed.at(i)].refresh) requestCompleted(&inflight[failed.at(i)], false, nullptr);
+    }
+
+    // The retries don't wait for the backoff time
+    for(int i=0; i<retryQueue.size(); i++) retryQueue[i].not_before = 0;
+
+    frame_sequence = 1;
+
+    // Refresh of the cached registers
+    int refreshed = 0;
+    if(deviceRevisionRegister.valid) refreshed += resyncRefresh(canDeviceProtocolFrame::READ_REVISION, 0);
+    if(deviceErrorsRegister.valid) refreshed += resyncRefresh(canDeviceProtocolFrame::READ_ERRORS, 0);
+    for(int i=0; i<deviceStatusRegisters.count; i++){
+        if(deviceStatusRegisters.reg[i].valid) refreshed += resyncRefresh(canDeviceProtocolFrame::READ_STATUS, i);
+    }
+    for(int i=0; i<deviceDataRegisters.count; i++){
+        if(deviceDataRegisters.reg[i].valid) refreshed += resyncRefresh(canDeviceProtocolFrame::READ_DATA, i);
+    }
+    for(int i=0; i<deviceParamRegisters.count; i++){
+        if(deviceParamRegisters.reg[i].valid) refreshed += resyncRefresh(canDeviceProtocolFrame::READ_PARAM, i);
+    }
+
+    pipelinePump();
+    pipelineArmTimer();
+    emit deviceResynchronized(requeued, refreshed);
+}
+
+/**
+ * This function queues the read request of a cached register
+ * after a reconnection.
+ *
+ * The request is not notified with the canDeviceProtocol::deviceRequestCompleted() signal:
+ * the register content is stored and notified as for every read answer.
+ *
+ * @param regtype is the register read frame code
+ * @param idx is the register idx code
+ * @return true if the request has been queued
+ */
+bool canDeviceProtocol::resyncRefresh(uchar regtype, uchar idx){
+    if(requestQueue.size() >= CAN_PIPELINE_MAX_QUEUE) return false;
+
+    CAN_REQUEST_t request;
+    request.id = 0;
+    request.active = false;
+    request.poll = false;
+    request.refresh = true;
+    request.access = false;
+    request.deadline = 0;
+    request.retries = deviceRetries;
+    request.attempt = 0;
+    request.not_before = 0;
+    request.frame = canDeviceProtocolFrame::makeFrame(0, regtype, idx, 0, 0, 0, 0);
+    requestQueue.append(request);
+    return true;
+}
+
+/**
+ * @brief This function declares the number of registers of every type
+ *
+ * The registers out of the declared number are invalidated:
+ * their answers are discarded with an idx error.
+ *
+ * The typed register maps use canDeviceProtocol::setDeviceRegisterMap().
+ *
+ * @param status is the number of STATUS registers
+ * @param data is the number of DATA registers
+ * @param param is the number of PARAMETER registers
+ */
+void canDeviceProtocol::setDeviceRegisterCount(int status, int data, int param){
+    int count[3] = {status, data, param};
+    CAN_REGISTER_BANK_t* banks[3] = {&deviceStatusRegisters, &deviceDataRegisters, &deviceParamRegisters};
+
+    for(int i=0; i<3; i++){
+        if(count[i] < 0) count[i] = 0;
+        if(count[i] > CAN_MAX_REGISTERS) count[i] = CAN_MAX_REGISTERS;
+        for(int j=count[i]; j<CAN_MAX_REGISTERS; j++) banks[i]->reg[j].valid = false;
+        banks[i]->count = count[i];
+    }
+}
+
+/**
+ * @brief This function returns the current content of a register
+ *
+ * The COMMAND register is returned with the following data content:
+ * + d[0]: command status;
+ * + d[1]: result byte 0;
+ * + d[2]: result byte 1;
+ * + d[3]: error code;
+ *
+ * @param regtype is the type of access to the register
+ * @param idx is the register idx code
+ * @param reg pointer to the returned register content
+ *
+ * @return true if the register exists
+ */
+bool canDeviceProtocol::getDeviceRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, canDeviceProtocolFrame::CAN_REGISTER_t* reg){
+
+    switch(regtype){
+    case canDeviceProtocolFrame::READ_REVISION:
+        *reg = deviceRevisionRegister;
+        return true;
+    case canDeviceProtocolFrame::READ_ERRORS:
+        *reg = deviceErrorsRegister;
+        return true;
+    case canDeviceProtocolFrame::READ_COMMAND:
+    case canDeviceProtocolFrame::COMMAND_EXEC:
+        reg->d[0] = deviceCommandRegister.status;
+        reg->d[1] = deviceCommandRegister.b0;
+        reg->d[2] = deviceCommandRegister.b1;
+        reg->d[3] = deviceCommandRegister.error;
+        reg->valid = deviceCommandRegister.valid;
+        return true;
+    case canDeviceProtocolFrame::READ_STATUS:
+    case canDeviceProtocolFrame::READ_DATA:
+    case canDeviceProtocolFrame::WRITE_DATA:
+    case canDeviceProtocolFrame::READ_PARAM:
+    case canDeviceProtocolFrame::WRITE_PARAM:
+        if(idx >= registerBanks[regtype]->count) return false;
+        *reg = registerBanks[regtype]->reg[idx];
+        return true;
+    case canDeviceProtocolFrame::STORE_PARAMS:
+        memset(reg->d, 0, 4);
+        reg->valid = true;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief This is the interface function to schedule a batch of register accesses.
+ *
+ * All the accesses are queued as pipelined requests (see canDeviceProtocol::deviceQueueRegister()).
+ * A failed access is queued again up to retries times.
+ * An access that cannot be queued is completed with error.
+ *
+ * When all the accesses are completed the canDeviceProtocol::deviceBatchCompleted()
+ * signal is emitted with:
+ * + the batch identifier;
+ * + the batch result: true if all the accesses are successfully completed;
+ * + the snapshot of the accessed registers, in the same order of the items
+ *   (a failed access is returned with valid = false).
+ *
+ * @param items this is the list of register accesses
+ * @param retries this is the number of retries of a failed access
+ *
+ * @return the batch identifier or 0 if the batch cannot be queued
+ */
+uint canDeviceProtocol::deviceBatchAccess(const QList<CAN_BATCH_ITEM_t>& items, int retries){
+    if(!items.size()) return 0;
+    if(requestQueue.size() + items.size() > CAN_PIPELINE_MAX_QUEUE) return 0;
+
+    CAN_BATCH_t batch;
+    canDeviceProtocolFrame::CAN_REGISTER_t empty;
+    memset(empty.d, 0, 4);
+    empty.valid = false;
+
+    batch.items = items;
+    batch.pending = items.size();
+    batch.ok = true;
+    for(int i=0; i<items.size(); i++){
+        batch.retries.append(retries);
+        batch.snapshot.append(empty);
+    }
+
+    batchId++;
+    if(!batchId) batchId = 1;
+    batchList.insert(batchId, batch);
+
+    // An access not queued is completed with error
+    uint id = batchId;
+    for(int i=0; i<items.size(); i++){
+        if(!batchSchedule(id, i)) batchItemCompleted(id, i, false);
+    }
+    return id;
+}
+
+/**
+ * @brief This is the interface function to read a range of registers.
+ *
+ * @param regtype is the type of read access (READ_STATUS, READ_DATA, READ_PARAM)
+ * @param first_idx is the first register idx code
+ * @param count is the number of registers
+ * @param retries this is the number of retries of a failed access
+ *
+ * @return the batch identifier or 0 if the batch cannot be queued
+ */
+uint canDeviceProtocol::deviceBatchRead(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar first_idx, uchar count, int retries){
+    QList<CAN_BATCH_ITEM_t> items;
+    CAN_BATCH_ITEM_t item;
+
+    item.regtype = regtype;
+    memset(item.d, 0, 4);
+    for(int i=0; i<count; i++){
+        item.idx = first_idx + i;
+        items.append(item);
+    }
+
+    return deviceBatchAccess(items, retries);
+}
+
+/**
+ * This function queues a batch access as a pipelined request.
+ *
+ * @param batch this is the batch identifier
+ * @param item this is the index of the access in the batch
+ * @return true if the request is queued
+ */
+bool canDeviceProtocol::batchSchedule(uint batch, int item){
+    CAN_BATCH_ITEM_t* it = &batchList[batch].items[item];
+
+    uint request = deviceQueueRegister(it->regtype, it->idx, it->d[0], it->d[1], it->d[2], it->d[3]);
+    if(!request) return false;
+
+    batchRequests.insert(request, qMakePair(batch, item));
+    return true;
+}
+
+/**
+ * This is the completion handler of the pipelined requests belonging to a batch.
+ *
+ * A failed access is queued again if retries are still available.
+ *
+ * @param request this is the completed request identifier
+ * @param frame_type this is the request frame type
+ * @param idx this is the request idx code
+ * @param ok this is the request result
+ */
+void canDeviceProtocol::batchRequestCompleted(uint request, uchar frame_type, uchar idx, bool ok){
+    if(!batchRequests.contains(request)) return;
+
+    QPair<uint, int> ref = batchRequests.take(request);
+    if(!batchList.contains(ref.first)) return;
+
+    // Retry of a failed access
+    CAN_BATCH_t* batch = &batchList[ref.first];
+    if((!ok) && (batch->retries[ref.second] > 0)){
+        batch->retries[ref.second]--;
+        if(batchSchedule(ref.first, ref.second)) return;
+    }
+
+    batchItemCompleted(ref.first, ref.second, ok);
+}
+
+/**
+ * This function completes a batch access and, when all the accesses are completed,
+ * emits the canDeviceProtocol::deviceBatchCompleted() signal.
+ *
+ * @param batch this is the batch identifier
+ * @param item this is the index of the access in the batch
+ * @param ok this is the access result
+ */
+void canDeviceProtocol::batchItemCompleted(uint batch, int item, bool ok){
+    CAN_BATCH_t* pBatch = &batchList[batch];
+
+    if(ok) ok = getDeviceRegister(pBatch->items.at(item).regtype, pBatch->items.at(item).idx, &pBatch->snapshot[item]);
+    if(!ok) pBatch->ok = false;
+
+    pBatch->pending--;
+    if(pBatch->pending) return;
+
+    bool result = pBatch->ok;
+    QList<canDeviceProtocolFrame::CAN_REGISTER_t> snapshot = pBatch->snapshot;
+    batchList.remove(batch);
+
+    emit deviceBatchCompleted(batch, result, snapshot);
+}
+
+/**
+ * @brief This is the interface function to poll periodically a register.
+ *
+ * The register is read every period ms by the polling scheduler:
+ * when the bus load doesn't allow to respect the period,
+ * the higher priority registers are read first.
+ *
+ * Calling the function for an already polled register
+ * changes the period, the priority and the count and resets the statistics.
+ *
+ * With count greater than 1, the registers from idx to idx + count - 1
+ * are read with a single READ_MULTI request (CAN FD) every period:
+ * the polling is identified by the regtype and the first idx.
+ *
+ * @param regtype is the type of read access (READ_REVISION to READ_PARAM)
+ * @param idx is the register idx code
+ * @param period is the poll period in ms: 0 removes the register from the polling
+ * @param priority is the poll priority (higher value, higher priority)
+ * @param count is the number of consecutive registers (STATUS, DATA and PARAMETER registers only)
+ *
+ * @return true if the request is accepted
+ */
+bool canDeviceProtocol::setDevicePolling(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, int period, uchar priority, uchar count){
+    if((regtype < canDeviceProtocolFrame::READ_REVISION) || (regtype > canDeviceProtocolFrame::READ_PARAM)) return false;
+    if(period < 0) return false;
+    if((!count) || (count > canDeviceProtocolFrame::CAN_MULTI_MAX_REGISTERS)) return false;
+    if((count > 1) && (regtype < canDeviceProtocolFrame::READ_STATUS)) return false;
+
+    int i = pollFind(regtype, idx);
+
+    // Removes the register
+    if(!period){
+        if(i < 0) return false;
+        pollList.removeAt(i);
+        pollArmTimer();
+        return true;
+    }
+
+    CAN_POLL_t poll;
+    poll.regtype = regtype;
+    poll.idx = idx;
+    poll.period = period;
+    poll.priority = priority;
+    poll.count = count;
+    poll.pending = false;
+    poll.next_due = pipelineClock.elapsed();
+    poll.start = poll.next_due;
+    poll.jitter_sum = 0;
+    poll.jitter_max = 0;
+    poll.sent = 0;
+    poll.completed = 0;
+    poll.failed = 0;
+    poll.skipped = 0;
+
+    if(i < 0) pollList.append(poll);
+    else{
+        poll.pending = pollList.at(i).pending;
+        pollList[i] = poll;
+    }
+
+    pipelinePump();
+    pipelineArmTimer();
+    return true;
+}
+
+/**
+ * @brief This function removes all the registers from the polling.
+ *
+ * The polling requests already sent are completed normally.
+ */
+void canDeviceProtocol::clearDevicePolling(void){
+    pollList.clear();
+    pollTmo.stop();
+}
+
+/**
+ * @brief This function returns the polling statistics of a register
+ *
+ * @param regtype is the type of read access
+ * @param idx is the register idx code
+ * @param stat pointer to the returned statistics
+ *
+ * @return true if the register is polled
+ */
+bool canDeviceProtocol::getDevicePollingStatistics(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, CAN_POLL_STATISTICS_t* stat){
+    int i = pollFind(regtype, idx);
+    if(i < 0) return false;
+
+    const CAN_POLL_t* poll = &pollList.at(i);
+    qint64 elapsed = pipelineClock.elapsed() - poll->start;
+
+    stat->period = poll->period;
+    stat->priority = poll->priority;
+    stat->rate = (elapsed > 0) ? ((double) poll->completed * 1000.0 / (double) elapsed) : 0;
+    stat->jitter_avg = (poll->sent) ? (poll->jitter_sum / (qint64) poll->sent) : 0;
+    stat->jitter_max = poll->jitter_max;
+    stat->completed = poll->completed;
+    stat->failed = poll->failed;
+    stat->skipped = poll->skipped;
+    return true;
+}
+
+/**
+ * This function returns the position of a polled register in the poll list.
+ *
+ * @param regtype is the type of read access
+ * @param idx is the register idx code
+ * @return the position or -1 if the register is not polled
+ */
+int canDeviceProtocol::pollFind(uchar regtype, uchar idx){
+    for(int i=0; i<pollList.size(); i++){
+        if((pollList.at(i).regtype == regtype) && (pollList.at(i).idx == idx)) return i;
+    }
+    return -1;
+}
+
+/**
+ * This function selects the next polling request to be sent.
+ *
+ * The selected register is the higher priority register
+ * with an expired scheduled time (the oldest one for the same priority).
+ *
+ * @param request pointer to the returned request
+ * @return true if a polling request has to be sent
+ */
+bool canDeviceProtocol::pollNext(CAN_REQUEST_t* request){
+    if((pipelineWindow > CAN_POLL_RESERVED_SLOTS) && (inflightSeq.size() >= pipelineWindow - CAN_POLL_RESERVED_SLOTS)) return false;
+
+    qint64 now = pipelineClock.elapsed();
+    int sel = -1;
+    for(int i=0; i<pollList.size(); i++){
+        const CAN_POLL_t* poll = &pollList.at(i);
+        if((poll->pending) || (poll->next_due > now)) continue;
+        if((sel < 0) || (poll->priority > pollList.at(sel).priority) ||
+           ((poll->priority == pollList.at(sel).priority) && (poll->next_due < pollList.at(sel).next_due))) sel = i;
+    }
+    if(sel < 0) return false;
+
+    CAN_POLL_t* poll = &pollList[sel];
+    qint64 jitter = now - poll->next_due;
+    poll->pending = true;
+    poll->sent++;
+    poll->jitter_sum += jitter;
+    if(jitter > poll->jitter_max) poll->jitter_max = jitter;
+
+    // The periods completely elapsed while waiting are skipped
+    poll->next_due += poll->period;
+    while(poll->next_due <= now){
+        poll->next_due += poll->period;
+        poll->skipped++;
+    }
+
+    request->id = 0;
+    request->active = false;
+    request->poll = true;
+    request->refresh = false;
+    request->access = false;
+    request->deadline = 0;
+    request->retries = 0;
+    request->attempt = 0;
+    request->not_before = 0;
+    request->frame = canDeviceProtocolFrame::makeFrame(0, poll->regtype, poll->idx, 0, 0, 0, 0);
+
+    // Many registers in a single CAN FD answer
+    if(poll->count > 1) request->frame = canDeviceProtocolFrame::makeFrame(0, canDeviceProtocolFrame::READ_MULTI, poll->idx, poll->regtype, poll->count, 0, 0);
+    return true;
+}
+
+/**
+ * This function completes a polling request.
+ *
+ * @param frame this is the encoded request frame
+ * @param ok this is the result of the request
+ */
+void canDeviceProtocol::pollCompleted(const canDeviceProtocolFrame::CAN_FRAME_t* frame, bool ok){
+    uchar frame_type = frame->b[canDeviceProtocolFrame::FRAME_CODE];
+    uchar regtype = (frame_type == canDeviceProtocolFrame::READ_MULTI) ? frame->b[canDeviceProtocolFrame::FRAME_D0] : frame_type;
+    uchar idx = frame->b[canDeviceProtocolFrame::FRAME_IDX];
+
+    int i = pollFind(regtype, idx);
+    if(i >= 0){
+        pollList[i].pending = false;
+        if(ok) pollList[i].completed++;
+        else pollList[i].failed++;
+    }
+
+    emit devicePollCompleted(regtype, idx, ok);
+}
+
+/**
+ * This function starts the timer to the earliest scheduled time
+ * of the polled registers.
+ *
+ * If a register is already expired the timer is not started:
+ * the polling request will be sent as soon as a pipeline slot is released.
+ */
+void canDeviceProtocol::pollArmTimer(void){
+    qint64 next_due = -1;
+
+    for(int i=0; i<pollList.size(); i++){
+        if(pollList.at(i).pending) continue;
+        if((next_due < 0) || (pollList.at(i).next_due < next_due)) next_due = pollList.at(i).next_due;
+    }
+
+    qint64 remaining = next_due - pipelineClock.elapsed();
+    if((next_due < 0) || (remaining <= 0)){
+        pollTmo.stop();
+        return;
+    }
+
+    pollTmo.start(remaining);
+}
+
+/**
+ * This is the timer event routine used to schedule the polling requests.
+ */
+void canDeviceProtocol::pollTmoEvent(void){
+    pipelinePump();
+    pipelineArmTimer();
+}
@@ -18,13 +18,219 @@
  *
  * + canclient.cpp
  * + canclient.h
+ * + canstatistics.cpp
+ * + canstatistics.h
+ *
+ * # PIPELINED REGISTER ACCESS
+ *
+ * The canDeviceProtocol::deviceAccessRegister() handles one transaction at a time:
+ * a new request is refused until the previous one is completed
+ * and the canDeviceProtocol::deviceAccessCompleted() signal is emitted at the completion.
+ *
+ * The canDeviceProtocol::deviceQueueRegister() queues the request
+ * and returns a unique request identifier:
+ * + up to canDeviceProtocol::setDevicePipelineWindow() requests are sent
+ *   to the device without waiting for the previous answers;
+ * + every answer is matched with its request by the frame sequence number;
+ * + every request has its own deadline (see the TRANSACTION DEADLINES section);
+ * + the canDeviceProtocol::deviceRequestCompleted() signal is emitted for every request.
+ *
+ * The two access modes can be used at the same time.
+ *
+ * # BATCH REGISTER ACCESS
+ *
+ * The canDeviceProtocol::deviceBatchAccess() and canDeviceProtocol::deviceBatchRead()
+ * schedule a list (or a range) of register accesses as pipelined requests:
+ * + every failed access is retried up to the requested number of times;
+ * + when all the accesses are completed, the canDeviceProtocol::deviceBatchCompleted() signal
+ *   is emitted once, with the snapshot of all the accessed registers.
+ *
+ * # TRANSACTION DEADLINES
+ *
+ * Every transaction (canDeviceProtocol::deviceAccessRegister() or pipelined request)
+ * is armed with a deadline when the frame is sent:
+ * + the default deadline is canDeviceProtocol::CAN_RXTX_TMO;
+ * + the canDeviceProtocol::setDeviceTimeout() changes the deadline and assignes
+ *   a number of retries: an expired transaction is sent again (with a new sequence number)
+ *   after a backoff time, doubled at every retry up to canDeviceProtocol::CAN_RETRY_MAX_BACKOFF;
+ * + an expired pipelined request releases its pipeline slot immediately:
+ *   the retry waits for the backoff time without blocking the other requests;
+ * + the polling requests are never retried: the next poll period replaces the retry;
+ * + frames with a wrong CRC or an unexpected sequence number are discarded
+ *   and the transaction waits for the correct answer up to the deadline.
+ *
+ * The canDeviceProtocol::getDeviceStatistics() returns the device counters of
+ * timeouts, CRC errors, sequence mismatches, retries and failed transactions.
+ *
+ * # RESYNCHRONIZATION AFTER A RECONNECTION
+ *
+ * When the device channel becomes ready again after a connection loss
+ * (see the CONNECTION STATE AND RECONNECTION section of the canClientModule),
+ * the protocol state is resynchronized in a single burst:
+ * + the pending canDeviceProtocol::deviceAccessRegister() transaction is completed with error
+ *   (its answer is lost with the connection);
+ * + the pipelined read requests waiting for the answer are queued again in the original order
+ *   and the retries are sent without waiting for the backoff time;
+ * + the pipelined write, STORE_PARAMS and COMMAND_EXEC requests waiting for the answer
+ *   are completed with error: the Device may have executed them, so they are never sent twice;
+ *   the polling requests are completed with error and rescheduled by the poll period;
+ * + the frame sequence number restarts from 1;
+ * + a read request is queued for every valid cached register (REVISION, ERRORS,
+ *   STATUS, DATA and PARAMETER): the refreshed contents are notified
+ *   with canDeviceProtocol::deviceRegisterChanged() when changed;
+ * + the canDeviceProtocol::deviceResynchronized() signal is emitted.
+ *
+ * The first time the device channel becomes ready is not a reconnection:
+ * the state is not resynchronized and the signal is not emitted.
+ *
+ * # COMMUNICATION STATISTICS
+ *
+ * The device counters are cache line padded atomics (see canStatCounter)
+ * written only by the device thread: the canDeviceProtocol::getDeviceStatistics()
+ * returns a snapshot from any thread, with:
+ * + the started transactions and the sent and received frames;
+ * + the retries, the timeouts and the failed transactions;
+ * + the discarded frames per cause (CRC, sequence, Device ID, register idx, frame code);
+ * + the stray frames: the CRC and sequence errors received while a deviceAccessRegister()
+ *   transaction is pending (the canDeviceProtocol::getDeviceFrameErrorStr() reports only
+ *   the cause of a failed transaction);
+ * + the current and maximum number of transactions waiting for the answer
+ *   and the pipelined requests waiting to be sent.
+ *
+ * The canDeviceProtocol::setDeviceStatisticsDump() periodically logs the request rate
+ * and the counters increment in the period.
+ * The bus traffic of the whole connection is provided by the canClient (see canClientModule).
+ *
+ * # PERIODIC REGISTER POLLING
+ *
+ * The canDeviceProtocol::setDevicePolling() assignes a poll period and a priority
+ * to a register: the internal scheduler reads the register periodically
+ * using the pipelined requests:
+ * + the requests queued with canDeviceProtocol::deviceQueueRegister() (as the COMMAND_EXEC)
+ *   are always sent before the polling requests;
+ * + the COMMAND_EXEC frames of canDeviceProtocol::deviceAccessRegister() are queued
+ *   as pipelined requests too, so a user command never waits for the polling;
+ * + the abort command (canDeviceProtocol::deviceAbortCommand()) is sent before
+ *   all the queued requests;
+ * + canDeviceProtocol::CAN_POLL_RESERVED_SLOTS slots of the pipeline window
+ *   are never used by the polling requests;
+ * + when many registers are due at the same time, the higher priority register is read first;
+ * + the canDeviceProtocol::devicePollCompleted() signal is emitted for every polling request;
+ * + the canDeviceProtocol::getDevicePollingStatistics() returns the achieved
+ *   poll rate and the scheduling jitter of a register.
+ *
+ * # REGISTER CHANGE NOTIFICATION
+ *
+ * Every received register content is compared with the stored content:
+ * + when the content changes (or the register becomes valid) the device generation
+ *   counter is incremented and assigned to the register;
+ * + the canDeviceProtocol::deviceRegisterChanged() signal is emitted only on real changes;
+ * + the canDeviceProtocol::getDeviceRegistersChangedSince() returns all the registers
+ *   changed after a given generation, so a consumer can forward only the deltas
+ *   without keeping its own copy of the registers.
+ *
+ * The registers are identified by the read frame code (READ_REVISION to READ_PARAM) and the idx:
+ * the write and the COMMAND_EXEC answers are notified with the related read frame code.
+ *
+ * # REGISTER STORAGE
+ *
+ * The STATUS, DATA and PARAMETER registers are stored in fixed size contiguous banks
+ * (canDeviceProtocol::CAN_REGISTER_BANK_t) of canDeviceProtocol::CAN_MAX_REGISTERS registers:
+ * + the Device declares the number of registers of every type with
+ *   canDeviceProtocol::setDeviceRegisterMap() (or canDeviceProtocol::setDeviceRegisterCount());
+ * + the banks start empty: until the registers are declared, every STATUS, DATA and PARAMETER
+ *   answer is discarded as an idx error (the first one is logged);
+ * + the received register idx is checked against the declared number of registers:
+ *   the answers out of the map are discarded (idx error);
+ * + the registers and their fields can be declared at compile time with a typed register map
+ *   (see canDeviceRegisterMapModule) and accessed with canDeviceProtocol::getDeviceField(),
+ *   canDeviceProtocol::deviceReadRegister() and canDeviceProtocol::deviceWriteField().
+ *
+ * Migration from the previous QList storage:
+ * + the Device filling deviceStatusRegisters, deviceDataRegisters and deviceParamRegisters
+ *   with append() still compiles and works: every appended register increases the bank size;
+ * + the size(), at() and operator[]() accesses are unchanged, while the QList functions
+ *   not listed in CAN_REGISTER_BANK_t (as clear() or removeLast()) shall be replaced
+ *   with canDeviceProtocol::setDeviceRegisterCount();
+ * + the new Devices should declare their registers with canDeviceProtocol::setDeviceRegisterMap().
+ *
+ * # MULTI-REGISTER READ (CAN FD)
+ *
+ * With a CAN FD bus, the READ_MULTI frame reads up to
+ * canDeviceProtocolFrame::CAN_MULTI_MAX_REGISTERS consecutive STATUS, DATA or PARAMETER
+ * registers in a single transaction:
+ * + the request is a standard 8 byte frame: | SEQ | READ_MULTI | IDX | REGTYPE | COUNT | 0 | 0 | CRC |
+ * + the answer is a CAN FD frame: | SEQ | READ_MULTI | IDX | REGTYPE | COUNT | R(IDX) | .. | R(IDX+COUNT-1) | CRC |
+ *   where every register R is 4 bytes and the CRC is the XOR of all the previous bytes;
+ *   the answer can be padded up to the next valid CAN FD length (see canDeviceProtocolFrame::toFdLength()).
+ *
+ * The canDeviceProtocol::deviceQueueMultiRead() queues a pipelined READ_MULTI request and
+ * the canDeviceProtocol::setDevicePolling() polls a range of registers with a single
+ * READ_MULTI request per poll period: every register of the answer is stored
+ * and notified as for the single register reads.
+ *
+ * # ASYNCHRONOUS REQUESTS
+ *
+ * The canDeviceProtocol::deviceRequest(), canDeviceProtocol::deviceCommand() and
+ * canDeviceProtocol::deviceMultiRequest() queue a pipelined request
+ * and return a canDeviceReply handle:
+ * + the completion handlers assigned with canDeviceReply::then() are called
+ *   directly by the frame reception handler, as soon as the answer is decoded
+ *   (or when the request fails): no timer polls the result;
+ * + a handler can queue the next dependent request: a chain of register accesses
+ *   proceeds at the speed of the answers;
+ * + a handler assigned to a completed reply is called immediately;
+ * + the handle can be copied: all the copies share the same result.
+ *
+ * \code
+ *  deviceRequest(canDeviceProtocolFrame::READ_STATUS, 2).then([this](bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t& answer){
+ *      if(!ok) return;
+ *      deviceRequest(canDeviceProtocolFrame::WRITE_DATA, 0, answer.d[0]).then(...);
+ *  });
+ * \endcode
+ *
+ * The requests and the handlers shall be used in the thread of the canDeviceProtocol.
+ *
+ * # COMMAND EXECUTION TRACKER
+ *
+ * The canDeviceProtocol::deviceExecuteCommand() executes a Device command
+ * up to its completion:
+ * + the COMMAND_EXEC frame is sent as a pipelined request;
+ * + if the Device answers CAN_COMMAND_EXECUTING, the COMMAND register is read
+ *   with an adaptive period: the first read after canDeviceProtocol::CAN_COMMAND_POLL_MIN ms,
+ *   then the period is doubled at every read up to canDeviceProtocol::CAN_COMMAND_POLL_MAX ms,
+ *   so the short commands complete quickly and the long commands (as the motor moves)
+ *   generate a low bus traffic;
+ * + the command completes when the Device reports CAN_COMMAND_EXECUTED or CAN_COMMAND_ERROR;
+ * + if the command doesn't complete within the command timeout, the abort command is sent
+ *   and the command completes with the CAN_COMMAND_ABORT_CODE error;
+ * + the canDeviceProtocol::deviceAbortCommand() aborts the tracked command: it completes
+ *   with the CAN_COMMAND_ABORT_CODE error;
+ * + if the COMMAND_EXEC frame is not answered (after the retries, see canDeviceProtocol::setDeviceTimeout())
+ *   the command completes with error and status 0.
+ *
+ * The completion is notified once, with the canDeviceProtocol::deviceCommandCompleted() signal
+ * and with the handlers of the returned canDeviceReply: the reply answer is the last
+ * COMMAND register content (d[0] = status, d[1] = b0, d[2] = b1, d[3] = error).
+ *
+ * Only one command at a time can be tracked.
+ *
+ * # RECEPTION TIMESTAMPS
+ *
+ * The device frames are received with the socket reading timestamp (see canClientModule):
+ * + canDeviceProtocol::getDeviceRxTimestamp() returns the timestamp of the last received frame;
+ * + the time from the socket reading to the end of the frame processing is added
+ *   to the canClient::RX_STAGE_HANDLER latency histogram of the connection.
  *
  */
 
 
 
 #include <QtCore>
+#include <functional>
+#include <type_traits>
 #include "can_bootloader_protocol.h"
+#include "canstatistics.h"
 
 /**
  * @brief The canDeviceProtocolFrame class
@@ -36,6 +242,9 @@ class canDeviceProtocolFrame
 public:
 
     static const uchar CAN_ABORT_COMMAND = 0; //!< Defines the special command code for abort procedure
+    static const int   CAN_MULTI_HEADER_SIZE = 5;   //!< READ_MULTI answer: SEQ, READ_MULTI, IDX, REGTYPE and COUNT bytes
+    static const int   CAN_MULTI_MAX_REGISTERS = 14;//!< READ_MULTI answer: maximum number of registers in a 64 byte frame
+    static const int   CAN_FRAME_SIZE = 8;          //!< Size of the protocol frame: SEQ, FRAME CODE, IDX, D0..D3 and CRC
 
    /**
     *  This enumeration defines the Frame Command Codes
@@ -51,6 +260,7 @@ public:
         WRITE_PARAM,            //!< Request to Write a Parameter register
         STORE_PARAMS,           //!< Request to Store in non volatile memory the parameters
         COMMAND_EXEC,           //!< Command Execution	Request
+        READ_MULTI,             //!< Request to read many consecutive registers (CAN FD answer)
     }CAN_FRAME_COMMANDS_t;
 
     /**
@@ -88,6 +298,15 @@ public:
         uchar d[4];         //!  Frame data (Register content or Command parameters)
     }CAN_FRAME_CONTENT_t;
 
+    /**
+     *  This is the register content of a READ_MULTI answer
+     */
+    typedef struct{
+        uchar regtype;  //!< Register read frame code (READ_STATUS, READ_DATA, READ_PARAM)
+        uchar count;    //!< Number of registers
+        uchar d[CAN_MULTI_MAX_REGISTERS][4]; //!< Register contents, starting from the frame IDX
+    }CAN_MULTI_CONTENT_t;
+
     /**
      *  This is the Register data content
      */
@@ -109,6 +328,130 @@ public:
     }CAN_COMMAND_t;
 
 
+    /**
+     *  This is the encoded protocol frame:
+     *
+     *      | SEQ | FRAME CODE | IDX | D0 | D1 | D2 | D3 | CRC |
+     *
+     *  The frame is a trivially copyable 8 byte value: it is passed by value
+     *  and encoded and decoded without heap allocations.
+     */
+    typedef struct{
+        uchar b[CAN_FRAME_SIZE]; //!< Frame bytes
+    }CAN_FRAME_t;
+
+    /**
+     *  This enumeration defines the byte positions of the encoded frame
+     */
+    typedef enum{
+        FRAME_SEQ = 0,  //!< Sequence number
+        FRAME_CODE,     //!< Frame code
+        FRAME_IDX,      //!< Register idx or command code
+        FRAME_D0,       //!< Data byte 0
+        FRAME_D1,       //!< Data byte 1
+        FRAME_D2,       //!< Data byte 2
+        FRAME_D3,       //!< Data byte 3
+        FRAME_CRC,      //!< CRC byte
+    }CAN_FRAME_BYTES_t;
+
+    static_assert(sizeof(CAN_FRAME_CONTENT_t) == CAN_FRAME_SIZE - 1, "CAN_FRAME_CONTENT_t shall match the frame bytes without the CRC");
+    static_assert(std::is_trivially_copyable<CAN_FRAME_t>::value && (sizeof(CAN_FRAME_t) == CAN_FRAME_SIZE), "CAN_FRAME_t shall be a trivially copyable 8 byte value");
+
+    /**
+     * @brief This static function returns the CRC of a protocol frame
+     *
+     * The CRC is the XOR of the first 7 bytes: the function can be
+     * evaluated at compile time.
+     *
+     * @return the CRC byte
+     */
+    static constexpr uchar frameCrc(uchar seq, uchar frame_type, uchar idx, uchar d0, uchar d1, uchar d2, uchar d3){
+        return (uchar) (seq ^ frame_type ^ idx ^ d0 ^ d1 ^ d2 ^ d3);
+    }
+
+    /**
+     * @brief This static function builds an encoded protocol frame
+     *
+     * The function can be evaluated at compile time, so a constant frame
+     * (as the abort command) has no encoding cost.
+     *
+     * @return the encoded frame, CRC included
+     */
+    static constexpr CAN_FRAME_t makeFrame(uchar seq, uchar frame_type, uchar idx, uchar d0, uchar d1, uchar d2, uchar d3){
+        return CAN_FRAME_t{{seq, frame_type, idx, d0, d1, d2, d3, frameCrc(seq, frame_type, idx, d0, d1, d2, d3)}};
+    }
+
+    /**
+     * @brief This static function encodes a protocol frame
+     *
+     * @param content this is the protocol frame
+     * @return the encoded frame
+     */
+    static inline CAN_FRAME_t toFrame(const CAN_FRAME_CONTENT_t& content){
+        return makeFrame(content.seq, content.frame_type, content.idx, content.d[0], content.d[1], content.d[2], content.d[3]);
+    }
+
+    /**
+     * @brief This static function assignes the sequence number of an encoded frame
+     *
+     * The CRC is updated with the changed byte only: the frame is not encoded again.
+     *
+     * @param frame this is the encoded frame
+     * @param seq this is the sequence number
+     * @return the encoded frame with the new sequence number
+     */
+    static inline CAN_FRAME_t setFrameSequence(CAN_FRAME_t frame, uchar seq){
+        frame.b[FRAME_CRC] ^= (uchar) (frame.b[FRAME_SEQ] ^ seq);
+        frame.b[FRAME_SEQ] = seq;
+        return frame;
+    }
+
+    /**
+     * @brief This static function copies the received CAN data in an encoded frame
+     *
+     * @param data this is the received CAN data
+     * @param frame this is the encoded frame
+     * @return false if the data length is not a protocol frame (the frame is not assigned)
+     */
+    static inline bool fromCanData(const QByteArray& data, CAN_FRAME_t* frame){
+        if(data.size() != CAN_FRAME_SIZE) return false;
+        memcpy(frame->b, data.constData(), CAN_FRAME_SIZE);
+        return true;
+    }
+
+    /**
+     * @brief This static function returns the CAN data of an encoded frame
+     *
+     * @param frame this is the encoded frame
+     * @return the data to be sent on the CAN bus
+     */
+    static inline QByteArray toCanData(CAN_FRAME_t frame){
+        return QByteArray((const char*) frame.b, CAN_FRAME_SIZE);
+    }
+
+    /**
+     * @brief This static function decodes an encoded protocol frame
+     *
+     * The CRC is verified on the whole frame at once: the 8 bytes are loaded
+     * in a 64 bit word and folded with XOR operations, so a valid frame
+     * (CRC included) folds to 0.
+     *
+     * @param frame this is the encoded frame
+     * @param content this is the decoded protocol frame
+     * @return false if the CRC is wrong (the content is not assigned)
+     */
+    static inline bool fromFrame(CAN_FRAME_t frame, CAN_FRAME_CONTENT_t* content){
+        quint64 word;
+        memcpy(&word, frame.b, CAN_FRAME_SIZE);
+        word ^= word >> 32;
+        word ^= word >> 16;
+        word ^= word >> 8;
+        if((uchar) word) return false;
+
+        memcpy(content, frame.b, sizeof(CAN_FRAME_CONTENT_t));
+        return true;
+    }
+
     /**
      * This statis method converts the CAN data frame into a protocol decoded frame
      *
@@ -123,42 +466,110 @@ public:
         CAN_FRAME_CONTENT_t content;
         content.seq = 0;
 
-        uchar crc = 0;
-        if(data->size() != 8) return content;
-
-        for(int i=0; i<7; i++) crc ^= (uchar) data->at(i);
-        if(crc != (uchar) data->at(7)) return content;
-
-        content.seq = data->at(0);
-        content.frame_type = (CAN_FRAME_COMMANDS_t) data->at(1);
-        content.idx = data->at(2);
-        for(int i=0; i< 4; i++) content.d[i] = data->at(3+i);
+        CAN_FRAME_t frame;
+        if(!fromCanData(*data, &frame)) return content;
+        if(!fromFrame(frame, &content)) content.seq = 0;
         return content;
-
     }
 
     /**
      * @brief This static function encode a CAN frame with the data of the protocol frame
      *
+     * The frame is encoded as a value (see toFrame()) and copied
+     * in the returned data with a single allocation.
+     *
      * @param content this is the protocol frame
      * @return the data to be sent on the CAN bus
      *
      */
     static QByteArray toCanData(CAN_FRAME_CONTENT_t* content){
+        return toCanData(toFrame(*content));
+    }
+
+    /**
+     * This static method converts a READ_MULTI CAN FD frame into a protocol decoded frame
+     *
+     * The returned frame carries the register type in d[0] and the number of
+     * registers in d[1]: the register contents are returned in the multi parameter.
+     *
+     * @param data pointer to the CAN FD frame
+     * @param multi pointer to the returned register contents
+     *
+     * @return the decoded protocol data frame
+     * if the returned seq field should 0 then the
+     * can frame shal be discarded due to wrong crc or length.
+     */
+    static CAN_FRAME_CONTENT_t toMultiContent(QByteArray* data, CAN_MULTI_CONTENT_t* multi){
+        CAN_FRAME_CONTENT_t content;
+        content.seq = 0;
+        multi->count = 0;
+
+        if(data->size() < CAN_MULTI_HEADER_SIZE + 1) return content;
+        uchar count = data->at(4);
+        if((!count) || (count > CAN_MULTI_MAX_REGISTERS)) return content;
+
+        // The frame can be padded up to the CAN FD length
+        int crc_pos = CAN_MULTI_HEADER_SIZE + 4 * count;
+        if(data->size() <= crc_pos) return content;
+
+        uchar crc = 0;
+        for(int i=0; i<crc_pos; i++) crc ^= (uchar) data->at(i);
+        if(crc != (uchar) data->at(crc_pos)) return content;
+
+        content.seq = data->at(0);
+        content.frame_type = data->at(1);
+        content.idx = data->at(2);
+        content.d[0] = data->at(3);
+        content.d[1] = count;
+        content.d[2] = 0;
+        content.d[3] = 0;
+
+        multi->regtype = content.d[0];
+        multi->count = count;
+        memcpy(multi->d, data->constData() + CAN_MULTI_HEADER_SIZE, 4 * count);
+        return content;
+    }
+
+    /**
+     * @brief This static function encode a READ_MULTI CAN FD frame
+     *
+     * The frame is padded with 0 up to the next valid CAN FD length.
+     *
+     * @param content this is the protocol frame (SEQ, IDX)
+     * @param multi this is the register type, the number of registers and their contents
+     * @return the data to be sent on the CAN bus
+     */
+    static QByteArray toMultiCanData(CAN_FRAME_CONTENT_t* content, CAN_MULTI_CONTENT_t* multi){
         QByteArray data;
         data.append(content->seq);
-        data.append(content->frame_type);
+        data.append((char) READ_MULTI);
         data.append(content->idx);
-        data.append(content->d[0]);
-        data.append(content->d[1]);
-        data.append(content->d[2]);
-        data.append(content->d[3]);
+        data.append(multi->regtype);
+        data.append(multi->count);
+        data.append((const char*) multi->d, 4 * multi->count);
         uchar crc = 0;
-        for(int i=0; i<7; i++) crc ^= data.at(i);
+        for(int i=0; i<data.size(); i++) crc ^= data.at(i);
         data.append(crc);
+        data.append(QByteArray(toFdLength(data.size()) - data.size(), 0));
         return data;
     }
 
+    /**
+     * @brief This static function returns the CAN FD frame length for a given data length
+     *
+     * The valid CAN FD lengths are 0 to 8, 12, 16, 20, 24, 32, 48 and 64 bytes.
+     *
+     * @param len this is the data length
+     * @return the smallest valid CAN FD length not lower than len (max 64)
+     */
+    static int toFdLength(int len){
+        if(len <= 8) return len;
+        if(len <= 24) return (len + 3) & ~3;
+        if(len <= 32) return 32;
+        if(len <= 48) return 48;
+        return 64;
+    }
+
     /**
      * @brief This static function provides a readable string related to a COMMAND execution error code
      *
@@ -183,6 +594,57 @@ public:
     }
 };
 
+Q_DECLARE_METATYPE(canDeviceProtocolFrame::CAN_REGISTER_t)
+
+/**
+ * @brief This class is the handle of an asynchronous Device request
+ *
+ * The handle is returned by canDeviceProtocol::deviceRequest() and
+ * the related functions: see the ASYNCHRONOUS REQUESTS section of the canDeviceModule.
+ *
+ * A request refused by the protocol (full request queue) returns a handle
+ * already completed with error (canDeviceReply::isValid() returns false).
+ */
+class canDeviceReply
+{
+public:
+    /**
+     * This is the completion handler of a request
+     *
+     * @param ok true if the request has been successfully completed
+     * @param answer the decoded answer frame (valid only if ok is true)
+     */
+    typedef std::function<void(bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t& answer)> CAN_REPLY_HANDLER_t;
+
+    canDeviceReply():canDeviceReply(0){};
+
+    _inline bool isValid(void) const {return state->request != 0;}  //!< Test if the request has been accepted
+    _inline bool isFinished(void) const {return state->finished;}   //!< Test if the request is completed
+    _inline bool isOk(void) const {return state->ok;}               //!< Test if the request has been successfully completed
+    _inline uint getRequest(void) const {return state->request;}    //!< Returns the request identifier (see canDeviceProtocol::deviceRequestCompleted())
+    _inline canDeviceProtocolFrame::CAN_FRAME_CONTENT_t getAnswer(void) const {return state->answer;} //!< Returns the decoded answer frame
+    const canDeviceReply& then(CAN_REPLY_HANDLER_t handler) const;  //!< Assignes a completion handler
+
+private:
+    friend class canDeviceProtocol;
+
+    /**
+     *  This is the result shared by all the copies of a handle
+     */
+    typedef struct{
+        uint  request;      //!< Request identifier (0 = refused request)
+        bool  finished;     //!< The request is completed
+        bool  ok;           //!< The request has been successfully completed
+        canDeviceProtocolFrame::CAN_FRAME_CONTENT_t answer; //!< Decoded answer frame
+        QList<CAN_REPLY_HANDLER_t> handlers; //!< Completion handlers not yet called
+    }CAN_REPLY_STATE_t;
+
+    QSharedPointer<CAN_REPLY_STATE_t> state; //!< Shared result
+
+    explicit canDeviceReply(uint request);
+    void finish(bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* answer) const;
+};
+
 /**
  * @brief This class implements the Device Can communication protocol
  *
@@ -208,39 +670,176 @@ public:
 
      static const unsigned short CAN_PROTOCOL_DEVICE_BASE_ADDRESS = 0x140; //!< This is the Point to Point protocol device Base address
      static const unsigned short CAN_RXTX_TMO = 100; //!< This defines the maximum reception waiting time in ms
+     static const int CAN_PIPELINE_DEFAULT_WINDOW = 4; //!< Default number of pipelined requests waiting for the answer
+     static const int CAN_PIPELINE_MAX_WINDOW = 32;    //!< Maximum number of pipelined requests waiting for the answer
+     static const int CAN_PIPELINE_MAX_QUEUE = 256;    //!< Maximum number of queued requests (the abort command is always queued)
+     static const int CAN_BATCH_DEFAULT_RETRIES = 2;   //!< Default number of retries of a failed batch access
+     static const int CAN_POLL_RESERVED_SLOTS = 1;     //!< Pipeline window slots reserved to the not polling requests
+     static const int CAN_RETRY_BACKOFF = 10;          //!< Default backoff time of the first retry in ms
+     static const int CAN_RETRY_MAX_BACKOFF = 500;     //!< Maximum backoff time of a retry in ms
+     static const int CAN_MAX_RETRIES = 8;             //!< Maximum number of retries of a transaction
+     static const int CAN_COMMAND_POLL_MIN = 5;        //!< First COMMAND register read of a tracked command in ms
+     static const int CAN_COMMAND_POLL_MAX = 200;      //!< Maximum COMMAND register read period of a tracked command in ms
+     static const int CAN_COMMAND_DEFAULT_TMO = 10000; //!< Default timeout of a tracked command in ms
+     static const int CAN_MAX_REGISTERS = 256;         //!< Maximum number of registers of a type (8 bit idx)
+     static const int CAN_FRAME_CODES = canDeviceProtocolFrame::READ_MULTI + 1; //!< Size of the tables indexed by frame code
+
+     /**
+      *  This is the device communication statistics
+      */
+     typedef struct{
+         ulong timeouts;    //!< Number of expired transaction deadlines
+         ulong crc_errors;  //!< Number of received frames with wrong length or CRC
+         ulong seq_errors;  //!< Number of received frames with unexpected sequence number or content
+         ulong retries;     //!< Number of retried transactions
+         ulong failures;    //!< Number of transactions failed after all the retries
+         ulong requests;    //!< Number of started transactions (retries excluded)
+         ulong tx_frames;   //!< Number of sent frames (retries included)
+         ulong rx_frames;   //!< Number of received frames
+         ulong id_errors;   //!< Number of received frames with a wrong Device ID
+         ulong idx_errors;  //!< Number of answers with a register idx out of range
+         ulong frame_code_errors; //!< Number of answers with an invalid frame code
+         ulong stray_frames;//!< Number of frames discarded (CRC or sequence) while a deviceAccessRegister() transaction was pending
+         ulong inflight;    //!< Transactions waiting for the answer
+         ulong inflight_max;//!< Maximum number of transactions waiting for the answer
+         ulong queued;      //!< Pipelined requests and retries waiting to be sent
+     }CAN_DEVICE_STATISTICS_t;
+
+     /**
+      *  This is a batch register access item
+      */
+     typedef struct{
+         canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype; //!< Type of access
+         uchar idx;   //!< Register or command idx code
+         uchar d[4];  //!< Frame data (for write accesses and commands)
+     }CAN_BATCH_ITEM_t;
+
+     /**
+      *  This is the polling statistics of a register
+      */
+     typedef struct{
+         int    period;         //!< Requested poll period in ms
+         uchar  priority;       //!< Poll priority (higher value, higher priority)
+         double rate;           //!< Achieved poll rate in Hz
+         qint64 jitter_avg;     //!< Average delay of the poll requests from the scheduled time in ms
+         qint64 jitter_max;     //!< Maximum delay of the poll requests from the scheduled time in ms
+         ulong  completed;      //!< Number of successfully completed poll requests
+         ulong  failed;         //!< Number of failed poll requests
+         ulong  skipped;        //!< Number of poll periods skipped because of the bus load
+     }CAN_POLL_STATISTICS_t;
+
+     /**
+      *  This is a changed register description
+      */
+     typedef struct{
+         uchar regtype;     //!< Register read frame code (READ_REVISION to READ_PARAM)
+         uchar idx;         //!< Register idx code
+         ulong generation;  //!< Generation of the last change
+         canDeviceProtocolFrame::CAN_REGISTER_t reg; //!< Current register content
+     }CAN_REGISTER_CHANGE_t;
+
+     /**
+      *  This is the fixed size contiguous storage of the registers of a type
+      *
+      *  The append(), size(), at() and operator[]() functions keep the interface
+      *  of the previous QList storage: a Device appending its registers
+      *  declares the number of registers as with canDeviceProtocol::setDeviceRegisterCount().
+      */
+     typedef struct{
+         canDeviceProtocolFrame::CAN_REGISTER_t reg[CAN_MAX_REGISTERS]; //!< Register contents, indexed by the register idx
+         int count;  //!< Number of registers of the Device (see canDeviceProtocol::setDeviceRegisterMap())
+
+         _inline int size(void) const {return count;} //!< Returns the number of registers
+         _inline const canDeviceProtocolFrame::CAN_REGISTER_t& at(int i) const {return reg[i];} //!< Returns a register content
+         _inline canDeviceProtocolFrame::CAN_REGISTER_t& operator[](int i) {return reg[i];} //!< Returns a register content
+         _inline void append(const canDeviceProtocolFrame::CAN_REGISTER_t& r) {if(count < CAN_MAX_REGISTERS) reg[count++] = r;} //!< Adds a register to the bank
+     }CAN_REGISTER_BANK_t;
+
+    CAN_DEVICE_STATISTICS_t getDeviceStatistics(void); //!< Returns the snapshot of the device communication statistics
+    void  setDeviceStatisticsDump(int period);         //!< Periodic log of the device communication statistics (0 = disabled)
 
 signals:
-    void txToDeviceCan(ushort canId, QByteArray data); //!< Sends Can data frame to the canDriver
-    void dataReceivedFromDeviceCan(ushort canId, QByteArray data); //!< Emitted when a frame is received for debug purpose
+    void txToDeviceCan(uint canId, QByteArray data); //!< Sends Can data frame to the canDriver
+    void dataReceivedFromDeviceCan(uint canId, QByteArray data); //!< Emitted when a frame is received for debug purpose
+    void deviceAccessCompleted(uchar frame_type, uchar idx, bool ok); //!< Emitted when the deviceAccessRegister() transaction is completed
+    void deviceRequestCompleted(uint request, uchar frame_type, uchar idx, bool ok); //!< Emitted when a queued request is completed
+    void deviceBatchCompleted(uint batch, bool ok, QList<canDeviceProtocolFrame::CAN_REGISTER_t> snapshot); //!< Emitted when all the accesses of a batch are completed
+    void devicePollCompleted(uchar frame_type, uchar idx, bool ok); //!< Emitted when a polling request is completed
+    void deviceRegisterChanged(uchar regtype, uchar idx, ulong generation); //!< Emitted when a register content changes
+    void deviceResynchronized(int requeued, int refreshed); //!< Emitted when the state has been resynchronized after a reconnection
+    void deviceCommandCompleted(uchar command, bool ok, uchar b0, uchar b1, uchar error); //!< Emitted when a tracked command is completed
 
 protected:
     bool  deviceAccessRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx=0, uchar d0=0, uchar d1=0, uchar d2=0, uchar d3=0);
-    bool  inline deviceAbortCommand(void){return deviceAccessRegister(canDeviceProtocolFrame::COMMAND_EXEC, canDeviceProtocolFrame::CAN_ABORT_COMMAND);};
+    bool  deviceAbortCommand(void);
+    canDeviceReply deviceExecuteCommand(uchar command, uchar d0=0, uchar d1=0, uchar d2=0, uchar d3=0, int timeout = CAN_COMMAND_DEFAULT_TMO);
+    bool inline isDeviceCommandExecuting(void) {return commandTracker.active;} //!< Test if a tracked command is executing
     QString getDeviceFrameErrorStr(void);
 
+    void  setDeviceTimeout(int timeout, int retries = 0, int backoff = CAN_RETRY_BACKOFF);
+    void  resetDeviceStatistics(void);
+
+    uint  deviceQueueRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx=0, uchar d0=0, uchar d1=0, uchar d2=0, uchar d3=0);
+    uint  deviceQueueMultiRead(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar first_idx, uchar count);
+    canDeviceReply deviceRequest(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx=0, uchar d0=0, uchar d1=0, uchar d2=0, uchar d3=0);
+    canDeviceReply deviceCommand(uchar command, uchar d0=0, uchar d1=0, uchar d2=0, uchar d3=0);
+    canDeviceReply deviceMultiRequest(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar first_idx, uchar count);
+    void  setDevicePipelineWindow(int window);
+    int inline getDevicePipelinePending(void) {return requestQueue.size() + retryQueue.size() + inflightSeq.size();} //!< Number of queued requests not yet completed
+
+    uint  deviceBatchAccess(const QList<CAN_BATCH_ITEM_t>& items, int retries = CAN_BATCH_DEFAULT_RETRIES);
+    uint  deviceBatchRead(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar first_idx, uchar count, int retries = CAN_BATCH_DEFAULT_RETRIES);
+    bool  getDeviceRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, canDeviceProtocolFrame::CAN_REGISTER_t* reg);
+
+    bool  setDevicePolling(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, int period, uchar priority = 0, uchar count = 1);
+    void  clearDevicePolling(void);
+    bool  getDevicePollingStatistics(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, CAN_POLL_STATISTICS_t* stat);
+
+    ulong inline getDeviceRegisterGeneration(void) {return registerGeneration;} //!< Returns the current generation counter
+    ulong getDeviceRegisterGeneration(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx);
+    QList<CAN_REGISTER_CHANGE_t> getDeviceRegistersChangedSince(ulong generation);
+
     canDeviceProtocolFrame::CAN_REGISTER_t           deviceRevisionRegister; //!< Protocol special revision register
     canDeviceProtocolFrame::CAN_REGISTER_t           deviceErrorsRegister;   //!< Protocol special errors register
     canDeviceProtocolFrame::CAN_COMMAND_t            deviceCommandRegister;  //!< Protocol special command register
-    QList<canDeviceProtocolFrame::CAN_REGISTER_t>    deviceStatusRegisters;  //!< Array of the device STATUS register
-    QList<canDeviceProtocolFrame::CAN_REGISTER_t>    deviceDataRegisters;    //!< Array of the device DATA register
-    QList<canDeviceProtocolFrame::CAN_REGISTER_t>    deviceParamRegisters;   //!< Array of the device PARAMETER register
+    CAN_REGISTER_BANK_t                              deviceStatusRegisters;  //!< Array of the device STATUS register
+    CAN_REGISTER_BANK_t                              deviceDataRegisters;    //!< Array of the device DATA register
+    CAN_REGISTER_BANK_t                              deviceParamRegisters;   //!< Array of the device PARAMETER register
+
+    void  setDeviceRegisterCount(int status, int data, int param);
+    template<class MAP> _inline void setDeviceRegisterMap(void) {setDeviceRegisterCount(MAP::STATUS_REGISTERS, MAP::DATA_REGISTERS, MAP::PARAM_REGISTERS);} //!< Sizes the register banks with a register map (see canDeviceRegisterMapModule)
+    template<class FIELD> _inline typename FIELD::value_t getDeviceField(void) {return FIELD::decode(registerBanks[FIELD::regtype]->reg[FIELD::idx].d);} //!< Returns a field of the stored register content
+    template<class REG> _inline bool isDeviceRegisterValid(void) {return registerBanks[REG::regtype]->reg[REG::idx].valid;} //!< Test if the register content has been received
+    template<class REG> _inline canDeviceReply deviceReadRegister(void) {return deviceRequest((canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t) REG::regtype, REG::idx);} //!< Queues the read of a register
+    template<class FIELD> canDeviceReply deviceWriteField(typename FIELD::value_t value);
 
     bool inline isDeviceCommunicationPending(void) {return busy;} //!< Test if the last can rx/tx is still pending
     bool inline isDeviceCommunicationOk(void) {return rxOk;} //!< Test if the last can rx/tx is successfully concluded
     bool inline isCanConnected(void) {return canDriverConnected;} //!< Test if the CAN server process is connected
+    qint64 inline getDeviceRxTimestamp(void) {return deviceRxTime;} //!< Returns the socket reading timestamp of the last received frame (see canClient::timestamp())
 
 private slots:
-   void rxFromDeviceCan(ushort canId, QByteArray data);//!< Receive Can data frame from the canDriver
+   void rxFromDeviceCan(uint canId, QByteArray data);//!< Receive Can data frame from the canDriver
+   void rxStampedFromDeviceCan(uint canId, QByteArray data, qint64 rxTime);//!< Receive timestamped Can data frame from the canDriver
    void deviceTmoEvent(void);         //!< Timer event used for the rx/tx timeout
-   void canDriverConnectionStatus(bool status){canDriverConnected = status; }
+   void pipelineTmoEvent(void);       //!< Timer event used for the pipelined requests timeout
+   void batchRequestCompleted(uint request, uchar frame_type, uchar idx, bool ok); //!< Completion of a batch access
+   void pollTmoEvent(void);           //!< Timer event used to schedule the polling requests
+   void statisticsTmoEvent(void);     //!< Timer event used to log the device statistics
+   void commandTmoEvent(void);        //!< Timer event used to read the COMMAND register of the tracked command
+   void canDriverConnectionStatus(bool status); //!< Acceptance filter of the device channel open/closed
 
 
 
 private:
     bool canDriverConnected; //!< THis is the current connection status with the CAN driver process
+    bool canDriverWasConnected; //!< The device channel has been ready at least once (a new connection is a reconnection)
+    canClientChannel* deviceChannel; //!< Reception channel of the device canId
+    qint64 deviceRxTime;     //!< Socket reading timestamp of the last received frame
     ushort devId;      //!< This is the
     void receptionEvent(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* pContent); //!< Function handling a received frame
     uchar frame_sequence;   //!< Frame sequence iterator
+    uchar access_sequence;  //!< Sequence of the deviceAccessRegister() pending frame
     bool  busy;             //!< Busy flag waiting for the Device answer
     bool  rxOk;             //!< The Frame has been correctly received
 
@@ -254,11 +853,200 @@ private:
         uchar spare:2;
     }frameError;            //!< In case of error frame, this is the error cause
 
-     QTimer deviceTmo;
+     QTimer deviceTmo;      //!< Deadline and backoff timer of the deviceAccessRegister() transaction
+
+    int   deviceTimeout;    //!< Transaction deadline in ms
+    int   deviceRetries;    //!< Number of retries of an expired transaction
+    int   deviceBackoff;    //!< Backoff time of the first retry in ms
+
+    /**
+     *  This is the storage of the device communication statistics:
+     *  the counters are written only by the device thread and can be read by any thread
+     */
+    typedef struct{
+        canStatCounter timeouts;            //!< Expired transaction deadlines
+        canStatCounter crc_errors;          //!< Frames with wrong length or CRC
+        canStatCounter seq_errors;          //!< Frames with unexpected sequence number or content
+        canStatCounter retries;             //!< Retried transactions
+        canStatCounter failures;            //!< Failed transactions
+        canStatCounter requests;            //!< Started transactions
+        canStatCounter tx_frames;           //!< Sent frames
+        canStatCounter rx_frames;           //!< Received frames
+        canStatCounter id_errors;           //!< Frames with a wrong Device ID
+        canStatCounter idx_errors;          //!< Answers with a register idx out of range
+        canStatCounter frame_code_errors;   //!< Answers with an invalid frame code
+        canStatCounter stray_frames;        //!< Frames discarded while a deviceAccessRegister() transaction was pending
+        canStatCounter inflight;            //!< Transactions waiting for the answer
+        canStatCounter inflight_max;        //!< Maximum transactions waiting for the answer
+        canStatCounter queued;              //!< Requests waiting to be sent
+    }CAN_DEVICE_COUNTERS_t;
+
+    CAN_DEVICE_COUNTERS_t   deviceCounters;     //!< Device communication statistics
+    QTimer                  statisticsTmo;      //!< Periodic statistics log timer
+    CAN_DEVICE_STATISTICS_t statisticsPrevious; //!< Statistics of the previous log
+    qint64                  statisticsTime;     //!< Time of the previous log (pipelineClock ms)
+
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t access_content; //!< Content of the deviceAccessRegister() transaction
+    int   access_retries;   //!< Remaining retries of the deviceAccessRegister() transaction
+    int   access_attempt;   //!< Retry counter of the deviceAccessRegister() transaction
+    bool  access_backoff;   //!< The deviceAccessRegister() transaction is waiting the backoff time
+    bool  access_pipelined; //!< The deviceAccessRegister() transaction is sent as a pipelined request (COMMAND_EXEC)
+
+    void  accessSend(void);
+    void  accessCompleted(bool ok);
+    void  updateDepth(void);
+    int   retryBackoff(int attempt);
+
+    /**
+     *  This is the result of a register content storing
+     */
+    typedef enum{
+        STORE_OK = 0,           //!< The register content has been stored
+        STORE_IDX_ERROR,        //!< The register index is out of range
+        STORE_FRAME_CODE_ERROR, //!< The frame code is not valid
+    }STORE_RESULT_t;
+    STORE_RESULT_t storeRegister(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* pContent); //!< Stores a received register content
+    STORE_RESULT_t storeMultiRegister(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* pContent); //!< Stores the received READ_MULTI register contents
+    STORE_RESULT_t bankIdxError(const CAN_REGISTER_BANK_t* bank, uchar regtype); //!< Returns the idx error of a register out of its bank
+    bool registerMapWarned; //!< The answer to a Device without declared registers has been logged
+    canDeviceProtocolFrame::CAN_MULTI_CONTENT_t rxMulti; //!< Register contents of the last received READ_MULTI frame
+    CAN_REGISTER_BANK_t* registerBanks[CAN_FRAME_CODES]; //!< Register bank of every frame code (nullptr for the not register frame codes)
+
+    ulong registerGeneration;               //!< Generation counter, incremented at every register change
+    QMap<ushort, ulong> registerGenerations;//!< Generation of the last change of every register, key = (regtype << 8) | idx
+
+    void storeRegisterContent(uchar regtype, uchar idx, canDeviceProtocolFrame::CAN_REGISTER_t* reg, const uchar* d);
+    void registerChanged(uchar regtype, uchar idx);
+
+    /**
+     *  This is a pipelined request
+     */
+    typedef struct{
+        uint   id;          //!< Request identifier
+        bool   active;      //!< The request is waiting for the answer
+        bool   poll;        //!< The request has been generated by the polling scheduler
+        bool   refresh;     //!< The request refreshes a cached register after a reconnection (no completion signal)
+        bool   access;      //!< The request is the deviceAccessRegister() transaction (completed with deviceAccessCompleted())
+        qint64 deadline;    //!< Answer deadline (pipelineClock ms)
+        int    retries;     //!< Remaining retries
+        int    attempt;     //!< Retry counter
+        qint64 not_before;  //!< Earliest sending time of a retry (pipelineClock ms)
+        canDeviceProtocolFrame::CAN_FRAME_t frame; //!< Encoded request frame (the sequence number is assigned at the sending)
+    }CAN_REQUEST_t;
+
+    QList<CAN_REQUEST_t> requestQueue;  //!< Requests waiting to be sent
+    QList<CAN_REQUEST_t> retryQueue;    //!< Expired requests waiting the backoff time to be sent again
+    CAN_REQUEST_t inflight[256];        //!< Requests waiting for the answer, indexed by sequence number
+    QList<uchar>  inflightSeq;          //!< Sequence numbers of the requests waiting for the answer
+    int           pipelineWindow;       //!< Maximum number of requests waiting for the answer
+    uint          requestId;            //!< Request identifier counter
+    QElapsedTimer pipelineClock;        //!< Time base of the request deadlines
+    QTimer        pipelineTmo;          //!< Timer of the earliest request deadline
+
+    uchar nextSequence(void);
+    void  pipelinePump(void);
+    int   retryNext(void);
+    void  pipelineComplete(uchar seq, bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* answer = nullptr);
+    void  requestCompleted(const CAN_REQUEST_t* request, bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* answer);
+    uint  queueRequest(canDeviceProtocolFrame::CAN_FRAME_t frame, bool urgent, bool access);
+    QHash<uint, canDeviceReply> pendingReplies; //!< Replies of the asynchronous requests not yet completed
+
+    /**
+     *  This is the tracked command
+     */
+    typedef struct{
+        bool   active;      //!< A command is executing
+        uint   id;          //!< Reply identifier of the command
+        uchar  command;     //!< Command code
+        qint64 deadline;    //!< Command timeout (pipelineClock ms)
+        int    period;      //!< Current COMMAND register read period in ms
+        bool   reading;     //!< A COMMAND register read is waiting for the answer
+    }CAN_COMMAND_TRACKER_t;
+
+    CAN_COMMAND_TRACKER_t commandTracker; //!< Tracked command
+    QTimer                commandTmo;     //!< COMMAND register read timer of the tracked command
+
+    void commandStatus(uint id, bool exec, bool ok, const canDeviceProtocolFrame::CAN_FRAME_CONTENT_t& answer);
+    void commandAbort(void);
+    void commandCompleted(bool ok, uchar status, uchar b0, uchar b1, uchar error);
+    canDeviceReply attachReply(uint request);
+    void  pipelineArmTimer(void);
+    void  deviceResync(void);
+    bool  resyncRefresh(uchar regtype, uchar idx);
+
+    /**
+     *  This is a batch register access
+     */
+    typedef struct{
+        QList<CAN_BATCH_ITEM_t> items;      //!< Accesses of the batch
+        QList<int>              retries;    //!< Remaining retries of every access
+        QList<canDeviceProtocolFrame::CAN_REGISTER_t> snapshot; //!< Register content of every access
+        int                     pending;    //!< Number of accesses not yet completed
+        bool                    ok;         //!< All the accesses have been successfully completed
+    }CAN_BATCH_t;
+
+    QMap<uint, CAN_BATCH_t> batchList;      //!< Batches not yet completed
+    QMap<uint, QPair<uint, int>> batchRequests; //!< Pipelined request -> (batch, item)
+    uint batchId;                           //!< Batch identifier counter
+
+    bool batchSchedule(uint batch, int item);
+    void batchItemCompleted(uint batch, int item, bool ok);
+
+    /**
+     *  This is a polled register
+     */
+    typedef struct{
+        uchar  regtype;     //!< Type of read access
+        uchar  idx;         //!< Register idx code
+        int    period;      //!< Poll period in ms
+        uchar  priority;    //!< Poll priority
+        uchar  count;       //!< Number of registers read by every poll request (READ_MULTI if greater than 1)
+        bool   pending;     //!< A poll request is waiting for the answer
+        qint64 next_due;    //!< Scheduled time of the next poll request (pipelineClock ms)
+        qint64 start;       //!< Start time of the statistics (pipelineClock ms)
+        qint64 jitter_sum;  //!< Sum of the delays from the scheduled time
+        qint64 jitter_max;  //!< Maximum delay from the scheduled time
+        ulong  sent;        //!< Number of sent poll requests
+        ulong  completed;   //!< Number of successfully completed poll requests
+        ulong  failed;      //!< Number of failed poll requests
+        ulong  skipped;     //!< Number of skipped poll periods
+    }CAN_POLL_t;
+
+    QList<CAN_POLL_t> pollList;             //!< Polled registers
+    QTimer            pollTmo;              //!< Timer of the earliest poll scheduled time
+
+    int  pollFind(uchar regtype, uchar idx);
+    bool pollNext(CAN_REQUEST_t* request);
+    void pollCompleted(const canDeviceProtocolFrame::CAN_FRAME_t* frame, bool ok);
+    void pollArmTimer(void);
 
 };
 
 
 
 
+/**
+ * @brief This function queues the write of a field of a DATA or PARAMETER register
+ *
+ * The written content is the stored register content (0 if not yet received)
+ * with the field changed: the stored content is updated by the write answer,
+ * so the writes of many fields of the same register shall be chained
+ * with canDeviceReply::then().
+ *
+ * See the canDeviceRegisterMapModule.
+ *
+ * @param value is the field value
+ * @return the reply handle of the write request
+ */
+template<class FIELD> canDeviceReply canDeviceProtocol::deviceWriteField(typename FIELD::value_t value){
+    static_assert(FIELD::write_code != 0, "deviceWriteField: the STATUS registers are read only");
+
+    const canDeviceProtocolFrame::CAN_REGISTER_t* reg = &registerBanks[FIELD::regtype]->reg[FIELD::idx];
+    uchar d[4] = {0, 0, 0, 0};
+    if(reg->valid) memcpy(d, reg->d, 4);
+
+    FIELD::encode(d, value);
+    return deviceRequest((canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t) FIELD::write_code, FIELD::idx, d[0], d[1], d[2], d[3]);
+}
+
 #endif // CAN_DEVICE_PROTOCOL_H
@@ -0,0 +1,240 @@
+#ifndef CAN_DEVICE_REGISTER_MAP_H
+#define CAN_DEVICE_REGISTER_MAP_H
+
+/*!
+ * \defgroup  canDeviceRegisterMapModule CAN Device Typed Register Map.
+ * \ingroup canDeviceModule
+ *
+ * This module implements the compile time declaration of the
+ * STATUS, DATA and PARAMETER registers of a Device.
+ *
+ * # MODULE OVERVIEW
+ *
+ * A Device declares its register map once, as a structure derived from
+ * canDeviceRegisterMap with the number of registers of every type:
+ * + every register is a type (canDeviceRegisterMap::status, canDeviceRegisterMap::data,
+ *   canDeviceRegisterMap::param) with its register idx checked at compile time;
+ * + every field of a register is a type (canRegisterField, canRegisterScaledField)
+ *   with its bit position, its size and its scaling;
+ * + the field decoding and encoding are inline shift and mask operations:
+ *   no code is generated for the map itself.
+ *
+ * The register contents are stored by the canDeviceProtocol in fixed size
+ * contiguous banks (see canDeviceProtocol::setDeviceRegisterMap()) and the fields
+ * are accessed with the typed functions:
+ * + canDeviceProtocol::getDeviceField() returns the decoded field of the stored content;
+ * + canDeviceProtocol::isDeviceRegisterValid() tests if the register has been received;
+ * + canDeviceProtocol::deviceReadRegister() queues the register read;
+ * + canDeviceProtocol::deviceWriteField() queues the write of a DATA or PARAMETER register
+ *   with the field changed and the other bits of the stored content unchanged.
+ *
+ * # REGISTER CONTENT
+ *
+ * The register content is a 32 bit little endian word:
+ *
+ *      | D0 (bits 0..7) | D1 (bits 8..15) | D2 (bits 16..23) | D3 (bits 24..31) |
+ *
+ * A field is identified by the bit position of its least significant bit and by its size.
+ * A field with a signed value type is sign extended.
+ *
+ * # USAGE
+ *
+ * \code
+ *  struct motorRegisterMap: public canDeviceRegisterMap<4, 2, 8>
+ *  {
+ *      typedef status<0>                           SYSTEM;
+ *      typedef canRegisterField<SYSTEM, 0, 8>      SYSTEM_STATE;
+ *      typedef canRegisterField<SYSTEM, 8, 1, bool> SYSTEM_READY;
+ *      typedef status<1>                           POSITION;
+ *      typedef canRegisterField<POSITION, 0, 32, int> POSITION_STEPS;
+ *      typedef data<0>                             SPEED;
+ *      typedef canRegisterScaledField<SPEED, 0, 16, 1, 10> SPEED_RPM; // 0.1 rpm
+ *      typedef param<3>                            CURRENT;
+ *  };
+ *
+ *  class motorDevice: public canDeviceProtocol
+ *  {
+ *      motorDevice(...):canDeviceProtocol(...) {setDeviceRegisterMap<motorRegisterMap>();}
+ *
+ *      int position(void) {return getDeviceField<motorRegisterMap::POSITION_STEPS>();}
+ *      void setSpeed(double rpm) {deviceWriteField<motorRegisterMap::SPEED_RPM>(rpm);}
+ *  };
+ * \endcode
+ *
+ * A register idx out of the declared map (as status<4> in the example) is a compilation error.
+ *
+ */
+
+#include <type_traits>
+#include "can_device_protocol.h"
+
+/**
+ * @brief This is a register of the map
+ *
+ * The register is declared with the canDeviceRegisterMap::status,
+ * canDeviceRegisterMap::data and canDeviceRegisterMap::param aliases.
+ *
+ * @param REGTYPE is the register read frame code (READ_STATUS, READ_DATA, READ_PARAM)
+ * @param IDX is the register idx code
+ * @param COUNT is the number of registers of the type in the map
+ *
+ * \ingroup canDeviceRegisterMapModule
+ */
+template<uchar REGTYPE, int IDX, int COUNT>
+struct canDeviceRegister
+{
+    static_assert((IDX >= 0) && (IDX < COUNT), "canDeviceRegister: register idx out of the register map");
+    static_assert((REGTYPE == canDeviceProtocolFrame::READ_STATUS) ||
+                  (REGTYPE == canDeviceProtocolFrame::READ_DATA) ||
+                  (REGTYPE == canDeviceProtocolFrame::READ_PARAM), "canDeviceRegister: invalid register type");
+
+    static const uchar regtype = REGTYPE;   //!< Register read frame code
+    static const uchar idx = (uchar) IDX;   //!< Register idx code
+
+    //! Register write frame code (0 for the read only STATUS registers)
+    static const uchar write_code = (REGTYPE == canDeviceProtocolFrame::READ_DATA) ? (uchar) canDeviceProtocolFrame::WRITE_DATA :
+                                    (REGTYPE == canDeviceProtocolFrame::READ_PARAM) ? (uchar) canDeviceProtocolFrame::WRITE_PARAM : 0;
+};
+
+/**
+ * @brief This is the base structure of a Device register map
+ *
+ * See the canDeviceRegisterMapModule.
+ *
+ * @param STATUS is the number of STATUS registers
+ * @param DATA is the number of DATA registers
+ * @param PARAM is the number of PARAMETER registers
+ *
+ * \ingroup canDeviceRegisterMapModule
+ */
+template<int STATUS, int DATA, int PARAM>
+struct canDeviceRegisterMap
+{
+    static_assert((STATUS >= 0) && (STATUS <= canDeviceProtocol::CAN_MAX_REGISTERS), "canDeviceRegisterMap: invalid number of STATUS registers");
+    static_assert((DATA >= 0) && (DATA <= canDeviceProtocol::CAN_MAX_REGISTERS), "canDeviceRegisterMap: invalid number of DATA registers");
+    static_assert((PARAM >= 0) && (PARAM <= canDeviceProtocol::CAN_MAX_REGISTERS), "canDeviceRegisterMap: invalid number of PARAMETER registers");
+
+    static const int STATUS_REGISTERS = STATUS; //!< Number of STATUS registers
+    static const int DATA_REGISTERS = DATA;     //!< Number of DATA registers
+    static const int PARAM_REGISTERS = PARAM;   //!< Number of PARAMETER registers
+
+    template<int IDX> using status = canDeviceRegister<canDeviceProtocolFrame::READ_STATUS, IDX, STATUS>; //!< STATUS register declaration
+    template<int IDX> using data = canDeviceRegister<canDeviceProtocolFrame::READ_DATA, IDX, DATA>;       //!< DATA register declaration
+    template<int IDX> using param = canDeviceRegister<canDeviceProtocolFrame::READ_PARAM, IDX, PARAM>;    //!< PARAMETER register declaration
+};
+
+/**
+ * @brief This is a bit field of a register
+ *
+ * @param REG is the register (see canDeviceRegisterMap)
+ * @param LSB is the bit position of the least significant bit of the field (0 to 31)
+ * @param BITS is the field size in bits (1 to 32 - LSB)
+ * @param T is the field value type: a signed type is sign extended
+ *
+ * \ingroup canDeviceRegisterMapModule
+ */
+template<class REG, int LSB, int BITS, typename T = uint>
+struct canRegisterField
+{
+    static_assert((LSB >= 0) && (BITS >= 1) && (LSB + BITS <= 32), "canRegisterField: the field exceeds the 32 bit register");
+
+    typedef REG register_t; //!< Register of the field
+    typedef T   value_t;    //!< Field value type
+
+    static const uchar regtype = REG::regtype;      //!< Register read frame code
+    static const uchar idx = REG::idx;              //!< Register idx code
+    static const uchar write_code = REG::write_code;//!< Register write frame code
+    static const uint  mask = 0xFFFFFFFFu >> (32 - BITS); //!< Field mask (not shifted)
+
+    /**
+     * This function returns the raw field value of a register content.
+     *
+     * @param d is the register content
+     * @return the field bits, right aligned
+     */
+    static _inline uint raw(const uchar* d){
+        uint word = (uint) d[0] | ((uint) d[1] << 8) | ((uint) d[2] << 16) | ((uint) d[3] << 24);
+        return (word >> LSB) & mask;
+    }
+
+    /**
+     * This function decodes the field of a register content.
+     *
+     * @param d is the register content
+     * @return the field value
+     */
+    static _inline T decode(const uchar* d){
+        uint value = raw(d);
+        if(std::is_signed<T>::value && (value & (1u << (BITS - 1)))) value |= ~mask;
+        return (T) (int) value;
+    }
+
+    /**
+     * This function encodes the field in a register content:
+     * the other bits of the content are unchanged.
+     *
+     * @param d is the register content
+     * @param value is the field value
+     */
+    static _inline void encode(uchar* d, T value){
+        uint word = (uint) d[0] | ((uint) d[1] << 8) | ((uint) d[2] << 16) | ((uint) d[3] << 24);
+        word = (word & ~(mask << LSB)) | (((uint) value & mask) << LSB);
+        d[0] = (uchar) word;
+        d[1] = (uchar) (word >> 8);
+        d[2] = (uchar) (word >> 16);
+        d[3] = (uchar) (word >> 24);
+    }
+};
+
+/**
+ * @brief This is a scaled bit field of a register
+ *
+ * The field value is: raw * NUM / DEN + OFFSET
+ *
+ * @param REG is the register (see canDeviceRegisterMap)
+ * @param LSB is the bit position of the least significant bit of the field
+ * @param BITS is the field size in bits
+ * @param NUM is the numerator of the scale factor
+ * @param DEN is the denominator of the scale factor
+ * @param OFFSET is the value of the raw 0
+ * @param RAW is the raw field type: a signed type is sign extended
+ *
+ * \ingroup canDeviceRegisterMapModule
+ */
+template<class REG, int LSB, int BITS, int NUM, int DEN = 1, int OFFSET = 0, typename RAW = int>
+struct canRegisterScaledField
+{
+    static_assert(DEN != 0, "canRegisterScaledField: invalid scale factor");
+
+    typedef canRegisterField<REG, LSB, BITS, RAW> field_t; //!< Raw field
+    typedef REG    register_t;  //!< Register of the field
+    typedef double value_t;     //!< Field value type
+
+    static const uchar regtype = REG::regtype;      //!< Register read frame code
+    static const uchar idx = REG::idx;              //!< Register idx code
+    static const uchar write_code = REG::write_code;//!< Register write frame code
+
+    /**
+     * This function decodes and scales the field of a register content.
+     *
+     * @param d is the register content
+     * @return the field value
+     */
+    static _inline double decode(const uchar* d){
+        return (double) field_t::decode(d) * NUM / DEN + OFFSET;
+    }
+
+    /**
+     * This function encodes the field in a register content,
+     * rounding the value to the nearest raw value.
+     *
+     * @param d is the register content
+     * @param value is the field value
+     */
+    static _inline void encode(uchar* d, double value){
+        double scaled = (value - OFFSET) * DEN / NUM;
+        field_t::encode(d, (RAW) ((scaled < 0) ? (scaled - 0.5) : (scaled + 0.5)));
+    }
+};
+
+#endif // CAN_DEVICE_REGISTER_MAP_H
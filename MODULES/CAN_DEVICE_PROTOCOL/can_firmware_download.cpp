@@ -0,0 +1,526 @@
+#include "application.h"
+#include "can_firmware_download.h"
+#include <QFile>
+
+
+/**
+ * This is the class constructor.
+ *
+ * @param devid the target device ID
+ * @param parent the parent object
+ *
+ */
+canFirmwareDownload::canFirmwareDownload(uchar devid, QObject* parent):QObject(parent)
+{
+    devId = devid;
+    pageSize = CAN_FW_DEFAULT_PAGE_SIZE;
+    window = CAN_FW_DEFAULT_WINDOW;
+    autoPump = true;
+    imageBytes = 0;
+    status = FW_IDLE;
+    page = 0;
+    blocks = 0;
+    base = 0;
+    next = 0;
+    sentMax = 0;
+    ackTimeouts = 0;
+    pageRetries = 0;
+    memset(&statistics, 0, sizeof(statistics));
+
+    tmo.setSingleShot(true);
+    connect(&tmo, SIGNAL(timeout()), this, SLOT(tmoEvent()), Qt::UniqueConnection);
+}
+
+/**
+ * @brief This function loads the firmware image from a file
+ *
+ * The files with the .hex extension are loaded as Intel HEX files,
+ * any other file is loaded as a raw binary image.
+ *
+ * @param filename this is the image file
+ * @param address this is the load address of a raw binary image
+ * @return true if the image is successfully loaded
+ */
+bool canFirmwareDownload::loadFile(QString filename, uint address){
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly)) return false;
+
+    QByteArray content = file.readAll();
+    file.close();
+
+    if(filename.endsWith(".hex", Qt::CaseInsensitive)) return loadIntelHex(content);
+    return loadBinary(content, address);
+}
+
+/**
+ * @brief This function loads a firmware image in Intel HEX format
+ *
+ * The following record types are handled:
+ * + 00: data record;
+ * + 01: end of file record;
+ * + 02: extended segment address record;
+ * + 04: extended linear address record;
+ * + 03, 05: start address records (ignored).
+ *
+ * Every record checksum is verified.
+ *
+ * @param content this is the content of the file
+ * @return true if the image is successfully loaded
+ */
+bool canFirmwareDownload::loadIntelHex(const QByteArray& content){
+    if(isRunning()) return false;
+    clearImage();
+
+    uint offset = 0;
+    uchar record[256 + 5];
+    QList<QByteArray> lines = content.split('\n');
+
+    for(int l=0; l<lines.size(); l++){
+        QByteArray line = lines.at(l).trimmed();
+        if(!line.size()) continue;
+        if((line.at(0) != ':') || (!(line.size() & 1)) || (line.size() < 11)) {
+            clearImage();
+            return false;
+        }
+
+        // Hex to binary conversion of the record
+        QByteArray bin = QByteArray::fromHex(line.mid(1));
+        if((bin.size() < 5) || (bin.size() > (int) sizeof(record)) || (bin.size() != (uchar) bin.at(0) + 5)) {
+            clearImage();
+            return false;
+        }
+        memcpy(record, bin.constData(), bin.size());
+
+        uchar checksum = 0;
+        for(int i=0; i<bin.size(); i++) checksum += record[i];
+        if(checksum){
+            clearImage();
+            return false;
+        }
+
+        uchar len = record[0];
+        uint address = ((uint) record[1] << 8) | record[2];
+        switch(record[3]){
+        case 0x00: // Data
+            addImageData(offset + address, (const char*) &record[4], len);
+            break;
+        case 0x01: // End of file
+            pageList = pages.keys();
+            return (imageBytes != 0);
+        case 0x02: // Extended segment address
+            if(len != 2) { clearImage(); return false; }
+            offset = (((uint) record[4] << 8) | record[5]) << 4;
+            break;
+        case 0x04: // Extended linear address
+            if(len != 2) { clearImage(); return false; }
+            offset = (((uint) record[4] << 8) | record[5]) << 16;
+            break;
+        case 0x03:
+        case 0x05:
+            break;
+        default:
+            clearImage();
+            return false;
+        }
+    }
+
+    // Missing end of file record
+    clearImage();
+    return false;
+}
+
+/**
+ * @brief This function loads a raw binary firmware image
+ *
+ * @param content this is the image content
+ * @param address this is the load address of the image
+ * @return true if the image is successfully loaded
+ */
+bool canFirmwareDownload::loadBinary(const QByteArray& content, uint address){
+    if(isRunning()) return false;
+    clearImage();
+    if(!content.size()) return false;
+
+    addImageData(address, content.constData(), content.size());
+    pageList = pages.keys();
+    return true;
+}
+
+/**
+ * This function discards the loaded image.
+ */
+void canFirmwareDownload::clearImage(void){
+    pages.clear();
+    pageList.clear();
+    imageBytes = 0;
+}
+
+/**
+ * This function adds data to the loaded image.
+ *
+ * The data are copied into the pages they belong to:
+ * a new page is initialized with 0xFF.
+ *
+ * @param address this is the data address
+ * @param data pointer to the data
+ * @param len number of bytes
+ */
+void canFirmwareDownload::addImageData(uint address, const char* data, int len){
+
+    while(len > 0){
+        uint pageAddress = address - (address % pageSize);
+        int  pageOffset = address - pageAddress;
+        int  n = pageSize - pageOffset;
+        if(n > len) n = len;
+
+        if(!pages.contains(pageAddress)) pages.insert(pageAddress, QByteArray(pageSize, (char) 0xFF));
+
+        memcpy(pages[pageAddress].data() + pageOffset, data, n);
+        imageBytes += n;
+        address += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief This function sets the page size
+ *
+ * The page size shall be a power of 2, from 16 to canFirmwareDownload::CAN_FW_MAX_PAGE_SIZE bytes.\n
+ * The page size shall be set before loading the image.
+ *
+ * @param size this is the page size in bytes
+ */
+void canFirmwareDownload::setPageSize(int size){
+    if(isRunning()) return;
+
+    int value = 16;
+    while((value < size) && (value < CAN_FW_MAX_PAGE_SIZE)) value *= 2;
+    pageSize = value;
+    clearImage();
+}
+
+/**
+ * @brief This function sets the number of blocks sent without waiting for the Ack
+ *
+ * @param window the number of blocks, from 1 to canFirmwareDownload::CAN_FW_MAX_WINDOW
+ */
+void canFirmwareDownload::setWindow(int window){
+    if(window < 1) window = 1;
+    if(window > CAN_FW_MAX_WINDOW) window = CAN_FW_MAX_WINDOW;
+    this->window = window;
+}
+
+/**
+ * @brief This function enables the automatic sending of the blocks
+ *
+ * When the automatic sending is disabled, the blocks are sent
+ * only by calling the canFirmwareDownload::pump() function:
+ * this allows the caller to limit the bus load of the download.
+ *
+ * @param enable true to enable the automatic sending (default)
+ */
+void canFirmwareDownload::setAutoPump(bool enable){
+    autoPump = enable;
+    if((autoPump) && (status == FW_PAGE_BLOCKS)) pump(-1);
+}
+
+/**
+ * @brief This function starts the download of the loaded image
+ *
+ * @return true if the download is started
+ */
+bool canFirmwareDownload::start(void){
+    if(isRunning()) return false;
+    if(!pageList.size()) return false;
+
+    memset(&statistics, 0, sizeof(statistics));
+    statistics.bytes = pageList.size() * pageSize;
+    statistics.pages = pageList.size();
+    errorStr = "";
+    page = 0;
+    pageRetries = 0;
+    clock.start();
+
+    sendPageStart();
+    return true;
+}
+
+/**
+ * @brief This function aborts the download in progress
+ *
+ * The canFirmwareDownload::downloadCompleted() signal is emitted with error.
+ */
+void canFirmwareDownload::abort(void){
+    if(!isRunning()) return;
+    terminate(false, "DOWNLOAD ABORTED");
+}
+
+/**
+ * This function terminates the download.
+ *
+ * @param ok this is the download result
+ * @param error this is the error description
+ */
+void canFirmwareDownload::terminate(bool ok, QString error){
+    tmo.stop();
+    status = (ok) ? FW_COMPLETED : FW_ERROR;
+    errorStr = error;
+    statistics.elapsed = clock.elapsed();
+
+    emit downloadCompleted(ok, error);
+}
+
+/**
+ * This function sends a bootloader command frame and starts the answer timer.
+ */
+void canFirmwareDownload::sendCommand(uchar command, uchar d0, uchar d1, uchar d2, uchar d3, uchar d4, uchar d5, uchar d6){
+    QByteArray frame;
+
+    frame.append((char) command);
+    frame.append((char) d0);
+    frame.append((char) d1);
+    frame.append((char) d2);
+    frame.append((char) d3);
+    frame.append((char) d4);
+    frame.append((char) d5);
+    frame.append((char) d6);
+
+    emit txFrame(devId + canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS, frame);
+    tmo.start(CAN_FW_COMMAND_TMO);
+}
+
+/**
+ * This function starts the download of the current page.
+ */
+void canFirmwareDownload::sendPageStart(void){
+    uint address = pageList.at(page);
+
+    status = FW_PAGE_START;
+    blocks = (pageSize + CAN_FW_BLOCK_SIZE - 1) / CAN_FW_BLOCK_SIZE;
+    base = 0;
+    next = 0;
+    sentMax = 0;
+    ackTimeouts = 0;
+
+    sendCommand(canBootloaderProtocol::BOOTLOADER_PAGE_START, address & 0xFF, (address >> 8) & 0xFF, (address >> 16) & 0xFF, (address >> 24) & 0xFF, pageSize & 0xFF, (pageSize >> 8) & 0xFF, 0);
+}
+
+/**
+ * This function requests the verification of the current page.
+ */
+void canFirmwareDownload::sendPageCrc(void){
+    ushort crc = crc16(pages.value(pageList.at(page)));
+
+    status = FW_PAGE_CRC;
+    sendCommand(canBootloaderProtocol::BOOTLOADER_PAGE_CRC, crc & 0xFF, (crc >> 8) & 0xFF, 0, 0, 0, 0, 0);
+}
+
+/**
+ * @brief This function returns the number of blocks that can be sent immediatelly
+ *
+ * @return the number of blocks inside the acknowledgement window not yet sent
+ */
+int canFirmwareDownload::getPendingBlocks(void){
+    if(status != FW_PAGE_BLOCKS) return 0;
+
+    int limit = base + window;
+    if(limit > blocks) limit = blocks;
+    return (limit > next) ? (limit - next) : 0;
+}
+
+/**
+ * @brief This function sends the blocks of the current page inside the acknowledgement window
+ *
+ * The function is automatically called if the automatic sending is enabled
+ * (see canFirmwareDownload::setAutoPump()).
+ *
+ * @param maxFrames maximum number of blocks to be sent, or -1 for no limit
+ * @return the number of sent blocks
+ */
+int canFirmwareDownload::pump(int maxFrames){
+    int count = 0;
+    if(status != FW_PAGE_BLOCKS) return 0;
+
+    const QByteArray& data = pages[pageList.at(page)];
+    QByteArray frame(8, (char) 0xFF);
+
+    while((getPendingBlocks()) && ((maxFrames < 0) || (count < maxFrames))){
+        int offset = next * CAN_FW_BLOCK_SIZE;
+        int n = pageSize - offset;
+        if(n > CAN_FW_BLOCK_SIZE) n = CAN_FW_BLOCK_SIZE;
+
+        frame.fill((char) 0xFF, 8);
+        frame[0] = (char) (CAN_FW_BLOCK_FRAME | next);
+        memcpy(frame.data() + 1, data.constData() + offset, n);
+
+        emit txFrame(devId + canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS, frame);
+
+        statistics.blocks_sent++;
+        if(next < sentMax) statistics.blocks_resent++;
+        else sentMax = next + 1;
+        next++;
+        count++;
+    }
+
+    // The Ack timer is started at the first block waiting for the Ack
+    if((count) && (!tmo.isActive())) tmo.start(CAN_FW_ACK_TMO);
+    return count;
+}
+
+/**
+ * This function handles a block Ack.
+ *
+ * @param seq this is the last block received in order
+ * @param ackStatus this is the Ack status (0 = in order, 1 = out of order)
+ */
+void canFirmwareDownload::handleAck(uchar seq, uchar ackStatus){
+    if(status != FW_PAGE_BLOCKS) return;
+
+    // Acknowledged blocks
+    if((seq >= base) && (seq < next)){
+        base = seq + 1;
+        ackTimeouts = 0;
+        tmo.stop();
+        if(next > base) tmo.start(CAN_FW_ACK_TMO);
+    }
+
+    // The Device detected a missing block: the blocks following the acknowledged block are sent again
+    if(ackStatus){
+        next = base;
+        tmo.stop();
+    }
+
+    // All the blocks of the page have been acknowledged
+    if(base >= blocks){
+        sendPageCrc();
+        return;
+    }
+
+    if(autoPump) pump(-1);
+}
+
+/**
+ * @brief This is the Can frame reception handler
+ *
+ * @param canId this is the received canId
+ * @param data this is the received frame
+ */
+void canFirmwareDownload::rxFrame(uint canId, QByteArray data){
+    if(!isRunning()) return;
+    if((canId & 0x3F) != devId) return;
+    if(data.size() != 8) return;
+
+    uchar code = (uchar) data.at(0);
+
+    // Error answer
+    if(code == BOOTLOADER_ERROR_FRAME){
+        terminate(false, QString("BOOTLOADER ERROR %1 ON COMMAND %2").arg((uchar) data.at(2)).arg((uchar) data.at(1)));
+        return;
+    }
+
+    // Block Ack
+    if(code & CAN_FW_BLOCK_FRAME){
+        handleAck(code & 0x7F, (uchar) data.at(1));
+        return;
+    }
+
+    if((code == canBootloaderProtocol::BOOTLOADER_PAGE_START) && (status == FW_PAGE_START)){
+        tmo.stop();
+        status = FW_PAGE_BLOCKS;
+        if(autoPump) pump(-1);
+        return;
+    }
+
+    if((code == canBootloaderProtocol::BOOTLOADER_PAGE_CRC) && (status == FW_PAGE_CRC)){
+        tmo.stop();
+
+        // Wrong page CRC: the page is downloaded again
+        if(data.at(1)){
+            pageRetries++;
+            statistics.page_retries++;
+            if(pageRetries > CAN_FW_PAGE_RETRIES){
+                terminate(false, QString("PAGE CRC ERROR AT ADDRESS 0x%1").arg(pageList.at(page), 8, 16, QChar('0')));
+                return;
+            }
+            sendPageStart();
+            return;
+        }
+
+        // Page verified
+        statistics.pages_done++;
+        statistics.bytes_done += pageSize;
+        statistics.elapsed = clock.elapsed();
+        statistics.throughput = (statistics.elapsed) ? ((double) statistics.bytes_done * 1000.0 / (double) statistics.elapsed) : 0;
+        emit downloadProgress(statistics.pages_done * 100 / statistics.pages, statistics.bytes_done, statistics.throughput);
+
+        page++;
+        pageRetries = 0;
+        if(page >= pageList.size()){
+            terminate(true, "");
+            return;
+        }
+
+        sendPageStart();
+        return;
+    }
+}
+
+/**
+ * This is the timer event routine of the Ack and command answers.
+ *
+ * An Ack timeout sends again all the blocks waiting for the Ack;
+ * a command timeout terminates the download.
+ */
+void canFirmwareDownload::tmoEvent(void){
+    if(!isRunning()) return;
+
+    if(status != FW_PAGE_BLOCKS){
+        terminate(false, "BOOTLOADER COMMAND TIMEOUT");
+        return;
+    }
+
+    ackTimeouts++;
+    if(ackTimeouts > CAN_FW_ACK_RETRIES){
+        terminate(false, "BLOCK ACK TIMEOUT");
+        return;
+    }
+
+    next = base;
+    if(autoPump) pump(-1);
+}
+
+/**
+ * @brief This function returns the download statistics
+ *
+ * @return the statistics of the current (or last) download
+ */
+canFirmwareDownload::FW_STATISTICS_t canFirmwareDownload::getStatistics(void){
+    if(isRunning()){
+        statistics.elapsed = clock.elapsed();
+        statistics.throughput = (statistics.elapsed) ? ((double) statistics.bytes_done * 1000.0 / (double) statistics.elapsed) : 0;
+    }
+    return statistics;
+}
+
+/**
+ * @brief This function calculates the CRC16-CCITT of a data buffer
+ *
+ * Polynomial 0x1021, initial value 0xFFFF.
+ *
+ * @param data this is the data buffer
+ * @return the CRC16 code
+ */
+ushort canFirmwareDownload::crc16(const QByteArray& data){
+    ushort crc = 0xFFFF;
+
+    for(int i=0; i<data.size(); i++){
+        crc ^= ((ushort) (uchar) data.at(i)) << 8;
+        for(int b=0; b<8; b++){
+            if(crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+            else crc <<= 1;
+        }
+    }
+
+    return crc;
+}
@@ -0,0 +1,211 @@
+#ifndef CAN_FIRMWARE_DOWNLOAD_H
+#define CAN_FIRMWARE_DOWNLOAD_H
+
+
+
+/*!
+ * \defgroup  canFirmwareDownloadModule CAN Device Firmware Download Module.
+ * \ingroup canBootloaderModule
+ *
+ * This library module implements the streaming firmware download
+ * to a Device running the bootloader.
+ *
+ * # MODULE OVERVIEW
+ *
+ * The canFirmwareDownload class:
+ * - loads an Intel HEX or a raw binary firmware image;
+ * - splits the image into pages of canFirmwareDownload::setPageSize() bytes
+ *   (the pages without data are not downloaded);
+ * - splits every page into 7 bytes payload blocks;
+ * - sends the blocks with a sliding acknowledgement window;
+ * - verifies every page with a CRC16 before downloading the next one;
+ * - reports the progress and the throughput of the download.
+ *
+ * # DOWNLOAD PROTOCOL
+ *
+ * The download uses the bootloader canId (canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS + devId)
+ * and the following frames:
+ *
+ * ## PAGE START
+ *
+ *      Request: | canBootloaderProtocol::BOOTLOADER_PAGE_START | ADDR0 | ADDR1 | ADDR2 | ADDR3 | LEN-L | LEN-H | 0 |
+ *      Answer:  | canBootloaderProtocol::BOOTLOADER_PAGE_START | ADDR0 | ADDR1 | ADDR2 | ADDR3 | LEN-L | LEN-H | 0 |
+ *
+ * The Device prepares the reception of a page of LEN bytes at the ADDR address (little endian).
+ *
+ * ## PAGE DATA BLOCK
+ *
+ *      Block:   | 0x80 + SEQ | B0 | B1 | B2 | B3 | B4 | B5 | B6 |
+ *      Ack:     | 0x80 + SEQ | STATUS | 0 | 0 | 0 | 0 | 0 | 0 |
+ *
+ * - SEQ is the block index in the page (0 to 127): the block content
+ *   is stored at the page offset SEQ * 7. The last block of a page is filled with 0xFF;
+ * - the Ack is cumulative: SEQ is the last block received in order;
+ * - STATUS = 0: the block has been received in order;
+ * - STATUS = 1: an out of order block has been received:
+ *   the blocks following SEQ are sent again.
+ *
+ * Up to canFirmwareDownload::setWindow() blocks are sent without waiting for the Ack.
+ *
+ * ## PAGE CRC
+ *
+ *      Request: | canBootloaderProtocol::BOOTLOADER_PAGE_CRC | CRC-L | CRC-H | 0 | 0 | 0 | 0 | 0 |
+ *      Answer:  | canBootloaderProtocol::BOOTLOADER_PAGE_CRC | RESULT | CRC-L | CRC-H | 0 | 0 | 0 | 0 |
+ *
+ * The CRC is the CRC16-CCITT (polynomial 0x1021, initial value 0xFFFF) of the page.\n
+ * The Device programs the page and answers RESULT = 0 if the received page matches the CRC.\n
+ * A page with a wrong CRC is downloaded again, up to canFirmwareDownload::CAN_FW_PAGE_RETRIES times.
+ *
+ * ## ERROR ANSWER
+ *
+ * The Device can answer to any request with the bootloader error frame:
+ *
+ *      | 0xFF | COMMAND | ERROR | ...
+ *
+ * The download is terminated with error.
+ *
+ * # USAGE
+ *
+ * The class doesn't depend on the CAN connection: the frames are exchanged
+ * with the canFirmwareDownload::txFrame() signal and the canFirmwareDownload::rxFrame() slot,
+ * so the engine can be connected to a simulated bootloader endpoint.
+ *
+ * The canBootloaderProtocol::getFirmwareDownload() returns an engine
+ * already connected to the Device bootloader channel.
+ *
+ * \verbatim
+    canFirmwareDownload* fw = getFirmwareDownload();
+    connect(fw, SIGNAL(downloadCompleted(bool, QString)), this, SLOT(...));
+    if(fw->loadFile("firmware.hex")) fw->start();
+   \endverbatim
+ *
+ * The download shall be started when the bootloader is running (see canBootloaderProtocol::bootloaderStart()).
+ *
+ */
+
+
+
+#include <QtCore>
+#include "can_bootloader_protocol.h"
+
+/**
+ * @brief This class implements the streaming firmware download engine
+ *
+ */
+class canFirmwareDownload: public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit canFirmwareDownload(uchar devid, QObject* parent = nullptr);
+    ~canFirmwareDownload(){};
+
+    static const uchar BOOTLOADER_ERROR_FRAME = 0xFF;   //!< Bootloader error answer code
+    static const uchar CAN_FW_BLOCK_FRAME = 0x80;       //!< Block and Ack frame code
+    static const int   CAN_FW_BLOCK_SIZE = 7;           //!< Payload bytes of a block
+    static const int   CAN_FW_MAX_BLOCKS = 128;         //!< Maximum number of blocks of a page
+    static const int   CAN_FW_DEFAULT_PAGE_SIZE = 512;  //!< Default page size in bytes
+    static const int   CAN_FW_MAX_PAGE_SIZE = 512;      //!< Maximum page size in bytes
+    static const int   CAN_FW_DEFAULT_WINDOW = 16;      //!< Default number of blocks waiting for the Ack
+    static const int   CAN_FW_MAX_WINDOW = 64;          //!< Maximum number of blocks waiting for the Ack
+    static const int   CAN_FW_ACK_TMO = 100;            //!< Ack waiting time in ms
+    static const int   CAN_FW_COMMAND_TMO = 1000;       //!< Page command answer waiting time in ms
+    static const int   CAN_FW_ACK_RETRIES = 5;          //!< Number of consecutive Ack timeouts before the failure
+    static const int   CAN_FW_PAGE_RETRIES = 3;         //!< Number of downloads of a page with a wrong CRC
+
+    /**
+     *  This is the download status
+     */
+    typedef enum{
+        FW_IDLE = 0,        //!< No download in progress
+        FW_PAGE_START,      //!< Waiting for the page start answer
+        FW_PAGE_BLOCKS,     //!< Sending the page blocks
+        FW_PAGE_CRC,        //!< Waiting for the page CRC answer
+        FW_COMPLETED,       //!< The download has been successfully completed
+        FW_ERROR,           //!< The download has been terminated with error
+    }FW_STATUS_t;
+
+    /**
+     *  This is the download statistics
+     */
+    typedef struct{
+        uint   bytes;           //!< Number of bytes to be downloaded (pages content)
+        uint   bytes_done;      //!< Number of verified bytes
+        uint   pages;           //!< Number of pages of the image
+        uint   pages_done;      //!< Number of verified pages
+        ulong  blocks_sent;     //!< Number of sent blocks (retransmissions included)
+        ulong  blocks_resent;   //!< Number of retransmitted blocks
+        ulong  page_retries;    //!< Number of pages downloaded again for a wrong CRC
+        qint64 elapsed;         //!< Download time in ms
+        double throughput;      //!< Verified bytes per second
+    }FW_STATISTICS_t;
+
+    bool loadFile(QString filename, uint address = 0);
+    bool loadIntelHex(const QByteArray& content);
+    bool loadBinary(const QByteArray& content, uint address);
+    void setPageSize(int size);
+    void setWindow(int window);
+    void setAutoPump(bool enable);
+
+    bool start(void);
+    void abort(void);
+    int  pump(int maxFrames = -1);
+
+    _inline FW_STATUS_t getStatus(void) {return status;} //!< Returns the download status
+    _inline bool isRunning(void) {return (status != FW_IDLE) && (status != FW_COMPLETED) && (status != FW_ERROR);} //!< Test if the download is in progress
+    _inline QString getErrorStr(void) {return errorStr;} //!< Returns the description of the download error
+    _inline uchar getDeviceId(void) {return devId;} //!< Returns the target device ID
+    int  getPendingBlocks(void);
+    FW_STATISTICS_t getStatistics(void);
+
+    static ushort crc16(const QByteArray& data);
+
+signals:
+    void txFrame(uint canId, QByteArray data); //!< Sends a Can data frame to the bootloader
+    void downloadProgress(int percent, uint bytes, double throughput); //!< Emitted when a page has been verified
+    void downloadCompleted(bool ok, QString error); //!< Emitted when the download terminates
+
+public slots:
+    void rxFrame(uint canId, QByteArray data); //!< Receives a Can data frame from the bootloader
+
+private slots:
+    void tmoEvent(void);
+
+private:
+    uchar devId;            //!< Target device ID
+    int   pageSize;         //!< Page size in bytes
+    int   window;           //!< Number of blocks waiting for the Ack
+    bool  autoPump;         //!< The blocks are sent automatically
+
+    QMap<uint, QByteArray> pages;   //!< Image pages, indexed by address
+    QList<uint> pageList;           //!< Addresses of the image pages, in download order
+    uint  imageBytes;               //!< Number of bytes of the image
+
+    FW_STATUS_t status;     //!< Download status
+    QString errorStr;       //!< Download error description
+    int   page;             //!< Current page in the pageList
+    int   blocks;           //!< Number of blocks of the current page
+    int   base;             //!< First block waiting for the Ack
+    int   next;             //!< Next block to be sent
+    int   sentMax;          //!< Highest block sent, used to count the retransmissions
+    int   ackTimeouts;      //!< Consecutive Ack timeouts
+    int   pageRetries;      //!< Downloads of the current page
+
+    QTimer        tmo;          //!< Ack and command answer timer
+    QElapsedTimer clock;        //!< Download time base
+    FW_STATISTICS_t statistics; //!< Download statistics
+
+    void addImageData(uint address, const char* data, int len);
+    void clearImage(void);
+    void sendPageStart(void);
+    void sendPageCrc(void);
+    void sendCommand(uchar command, uchar d0, uchar d1, uchar d2, uchar d3, uchar d4, uchar d5, uchar d6);
+    void handleAck(uchar seq, uchar ackStatus);
+    void terminate(bool ok, QString error);
+};
+
+
+
+
+#endif // CAN_FIRMWARE_DOWNLOAD_H
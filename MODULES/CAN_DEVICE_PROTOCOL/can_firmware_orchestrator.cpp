@@ -0,0 +1,306 @@
+#include "application.h"
+#include "can_firmware_orchestrator.h"
+
+
+/**
+ * This is the class constructor.
+ *
+ * @param parent the parent object
+ *
+ */
+canFirmwareOrchestrator::canFirmwareOrchestrator(QObject* parent):QObject(parent)
+{
+    budget = CAN_FW_DEFAULT_BUDGET;
+    globalTokens = 0;
+    rrIndex = 0;
+    running = false;
+    lastTick = 0;
+    elapsed = 0;
+
+    connect(&tick, SIGNAL(timeout()), this, SLOT(tickEvent()), Qt::UniqueConnection);
+}
+
+/**
+ * @brief This function adds the update of a Device
+ *
+ * The firmware image is loaded into the download engine of the Device
+ * (see canBootloaderProtocol::getFirmwareDownload()).
+ *
+ * @param board this is the Device bootloader protocol
+ * @param name this is the session name used in the report
+ * @param filename this is the firmware image file (see canFirmwareDownload::loadFile())
+ * @param address this is the load address of a raw binary image
+ * @return true if the session has been added
+ */
+bool canFirmwareOrchestrator::addSession(canBootloaderProtocol* board, QString name, QString filename, uint address){
+    canFirmwareDownload* engine = board->getFirmwareDownload();
+    if(!engine->loadFile(filename, address)) return false;
+    return addSession(engine, name);
+}
+
+/**
+ * @brief This function adds a download session
+ *
+ * The engine shall be already loaded with the firmware image.
+ *
+ * @param engine this is the download engine
+ * @param name this is the session name used in the report
+ * @param rate this is the fixed session rate in blocks per second: 0 = fair share of the global budget
+ * @return true if the session has been added
+ */
+bool canFirmwareOrchestrator::addSession(canFirmwareDownload* engine, QString name, double rate){
+    if(running) return false;
+    if(findSession(engine) >= 0) return false;
+
+    SESSION_t session;
+    session.engine = engine;
+    session.name = name;
+    session.rate = (rate < 0) ? 0 : rate;
+    session.tokens = 0;
+    session.done = false;
+    session.ok = false;
+    session.error = "";
+    sessions.append(session);
+    return true;
+}
+
+/**
+ * @brief This function sets the global frame-rate budget
+ *
+ * @param frames_per_second this is the maximum number of data blocks per second of all the sessions
+ */
+void canFirmwareOrchestrator::setGlobalBudget(int frames_per_second){
+    if(frames_per_second < 1) frames_per_second = 1;
+    budget = frames_per_second;
+}
+
+/**
+ * This function returns the position of the session of an engine.
+ *
+ * @param engine this is the download engine
+ * @return the session position or -1
+ */
+int canFirmwareOrchestrator::findSession(QObject* engine){
+    for(int i=0; i<sessions.size(); i++){
+        if(sessions.at(i).engine == engine) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief This function starts all the sessions
+ *
+ * A session that cannot be started is terminated with error.
+ *
+ * @return true if the update is started
+ */
+bool canFirmwareOrchestrator::start(void){
+    if(running) return false;
+    if(!sessions.size()) return false;
+
+    running = true;
+    globalTokens = 0;
+    rrIndex = 0;
+    elapsed = 0;
+    clock.start();
+    lastTick = 0;
+
+    for(int i=0; i<sessions.size(); i++){
+        SESSION_t* session = &sessions[i];
+        session->tokens = 0;
+        session->done = false;
+        session->ok = false;
+        session->error = "";
+
+        connect(session->engine, SIGNAL(downloadProgress(int, uint, double)), this, SLOT(sessionProgress(int, uint, double)), Qt::UniqueConnection);
+        connect(session->engine, SIGNAL(downloadCompleted(bool, QString)), this, SLOT(sessionCompleted(bool, QString)), Qt::UniqueConnection);
+        session->engine->setAutoPump(false);
+
+        if(!session->engine->start()){
+            session->done = true;
+            session->error = "DOWNLOAD NOT STARTED";
+        }
+    }
+
+    tick.start(CAN_FW_TICK);
+
+    // All the sessions failed to start
+    finish();
+    return true;
+}
+
+/**
+ * @brief This function aborts all the running sessions
+ */
+void canFirmwareOrchestrator::abort(void){
+    if(!running) return;
+
+    for(int i=0; i<sessions.size(); i++){
+        if(!sessions.at(i).done) sessions.at(i).engine->abort();
+    }
+}
+
+/**
+ * This is the sending cycle.
+ *
+ * The token buckets are refilled with the time elapsed from the last cycle,
+ * then every session sends the blocks allowed by its bucket and by the global bucket.
+ */
+void canFirmwareOrchestrator::tickEvent(void){
+    if(!running) return;
+
+    qint64 now = clock.elapsed();
+    double dt = (double) (now - lastTick) / 1000.0;
+    lastTick = now;
+
+    int active = 0;
+    for(int i=0; i<sessions.size(); i++){
+        if(!sessions.at(i).done) active++;
+    }
+    if(!active) return;
+
+    // Global bucket: capacity of one cycle at the budget rate
+    double globalCapacity = (double) budget * CAN_FW_TICK / 1000.0;
+    if(globalCapacity < CAN_FW_MIN_BURST) globalCapacity = CAN_FW_MIN_BURST;
+    globalTokens += budget * dt;
+    if(globalTokens > globalCapacity) globalTokens = globalCapacity;
+
+    // Session buckets
+    for(int i=0; i<sessions.size(); i++){
+        SESSION_t* session = &sessions[i];
+        if(session->done) continue;
+
+        double rate = (session->rate > 0) ? session->rate : (double) budget / active;
+        double capacity = rate * CAN_FW_TICK / 1000.0;
+        if(capacity < CAN_FW_MIN_BURST) capacity = CAN_FW_MIN_BURST;
+        session->tokens += rate * dt;
+        if(session->tokens > capacity) session->tokens = capacity;
+    }
+
+    // Round robin sending
+    for(int n=0; n<sessions.size(); n++){
+        SESSION_t* session = &sessions[(rrIndex + n) % sessions.size()];
+        if(session->done) continue;
+
+        int allowed = (int) session->tokens;
+        if(allowed > (int) globalTokens) allowed = (int) globalTokens;
+        if(allowed <= 0) continue;
+
+        int sent = session->engine->pump(allowed);
+        session->tokens -= sent;
+        globalTokens -= sent;
+    }
+    rrIndex = (rrIndex + 1) % sessions.size();
+}
+
+/**
+ * This is the progress handler of the sessions.
+ *
+ * The update progress is the ratio of the verified bytes of all the sessions.
+ */
+void canFirmwareOrchestrator::sessionProgress(int percent, uint bytes, double throughput){
+    Q_UNUSED(percent);
+    Q_UNUSED(bytes);
+    Q_UNUSED(throughput);
+
+    qint64 total = 0;
+    qint64 done = 0;
+
+    for(int i=0; i<sessions.size(); i++){
+        canFirmwareDownload::FW_STATISTICS_t stat = sessions.at(i).engine->getStatistics();
+        total += stat.bytes;
+        done += stat.bytes_done;
+    }
+
+    if(total) emit updateProgress(done * 100 / total);
+}
+
+/**
+ * This is the completion handler of the sessions.
+ */
+void canFirmwareOrchestrator::sessionCompleted(bool ok, QString error){
+    int i = findSession(sender());
+    if(i < 0) return;
+
+    sessions[i].done = true;
+    sessions[i].ok = ok;
+    sessions[i].error = error;
+    finish();
+}
+
+/**
+ * This function terminates the update when all the sessions are terminated
+ * and emits the canFirmwareOrchestrator::updateCompleted() signal.
+ */
+void canFirmwareOrchestrator::finish(void){
+    if(!running) return;
+
+    bool ok = true;
+    for(int i=0; i<sessions.size(); i++){
+        if(!sessions.at(i).done) return;
+        if(!sessions.at(i).ok) ok = false;
+    }
+
+    tick.stop();
+    running = false;
+    elapsed = clock.elapsed();
+
+    for(int i=0; i<sessions.size(); i++) sessions.at(i).engine->setAutoPump(true);
+
+    emit updateCompleted(ok, getReportStr());
+}
+
+/**
+ * @brief This function returns the report of all the sessions
+ *
+ * @return the list of the session reports
+ */
+QList<canFirmwareOrchestrator::SESSION_REPORT_t> canFirmwareOrchestrator::getReport(void){
+    QList<SESSION_REPORT_t> report;
+    SESSION_REPORT_t item;
+
+    for(int i=0; i<sessions.size(); i++){
+        item.name = sessions.at(i).name;
+        item.devId = sessions.at(i).engine->getDeviceId();
+        item.ok = sessions.at(i).ok;
+        item.error = sessions.at(i).error;
+        item.statistics = sessions.at(i).engine->getStatistics();
+        report.append(item);
+    }
+
+    return report;
+}
+
+/**
+ * @brief This function returns the readable report of the update
+ *
+ * Every line of the report describes a session:
+ *
+ *      NAME (ID): OK|FAILED bytes time throughput resent-blocks page-retries [error]
+ *
+ * The last line reports the total update time.
+ *
+ * @return the report string
+ */
+QString canFirmwareOrchestrator::getReportStr(void){
+    QString str;
+    QList<SESSION_REPORT_t> report = getReport();
+
+    for(int i=0; i<report.size(); i++){
+        const SESSION_REPORT_t* item = &report.at(i);
+        str += QString("%1 (%2): %3 %4 bytes %5 ms %6 B/s resent:%7 page-retries:%8")
+                .arg(item->name)
+                .arg(item->devId)
+                .arg((item->ok) ? "OK" : "FAILED")
+                .arg(item->statistics.bytes_done)
+                .arg(item->statistics.elapsed)
+                .arg(item->statistics.throughput, 0, 'f', 0)
+                .arg(item->statistics.blocks_resent)
+                .arg(item->statistics.page_retries);
+        if(!item->ok) str += QString(" %1").arg(item->error);
+        str += "\n";
+    }
+
+    str += QString("TOTAL UPDATE TIME: %1 ms\n").arg((running) ? clock.elapsed() : elapsed);
+    return str;
+}
@@ -0,0 +1,131 @@
+#ifndef CAN_FIRMWARE_ORCHESTRATOR_H
+#define CAN_FIRMWARE_ORCHESTRATOR_H
+
+
+
+/*!
+ * \defgroup  canFirmwareOrchestratorModule CAN Multi-Board Firmware Update Module.
+ * \ingroup canBootloaderModule
+ *
+ * This library module implements the parallel firmware update of many Devices.
+ *
+ * # MODULE OVERVIEW
+ *
+ * The canFirmwareOrchestrator class runs a firmware download session
+ * (see canFirmwareDownloadModule) for every Device at the same time:
+ * the total update time is the time of the slowest Device,
+ * instead of the sum of the update times.
+ *
+ * The bus is shared between the sessions with the following rules:
+ * + every session has a token bucket refilled at the session rate
+ *   (by default the global budget divided by the number of running sessions);
+ * + a global token bucket limits the data blocks of all the sessions
+ *   to the global frame-rate budget (canFirmwareOrchestrator::setGlobalBudget());
+ * + every sending cycle starts from a different session (round robin).
+ *
+ *      NOTE: only the data blocks are metered: the page commands
+ *      (a couple of frames every page) are sent immediatelly.
+ *
+ * When all the sessions are terminated, the canFirmwareOrchestrator::updateCompleted()
+ * signal is emitted with a single report of all the sessions.
+ *
+ * # USAGE
+ *
+ * \verbatim
+    canFirmwareOrchestrator* update = new canFirmwareOrchestrator();
+    update->addSession(pCompressor, "COMPRESSOR", "compressor.hex");
+    update->addSession(pCollimator, "COLLIMATOR", "collimator.hex");
+    connect(update, SIGNAL(updateCompleted(bool, QString)), this, SLOT(...));
+    update->start();
+   \endverbatim
+ *
+ * The bootloader of every Device shall be running before the update is started.
+ *
+ */
+
+
+
+#include <QtCore>
+#include "can_firmware_download.h"
+
+/**
+ * @brief This class implements the parallel firmware update orchestrator
+ *
+ */
+class canFirmwareOrchestrator: public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit canFirmwareOrchestrator(QObject* parent = nullptr);
+    ~canFirmwareOrchestrator(){};
+
+    static const int CAN_FW_DEFAULT_BUDGET = 4000;  //!< Default global budget in data blocks per second
+    static const int CAN_FW_TICK = 5;               //!< Sending cycle period in ms
+    static const int CAN_FW_MIN_BURST = 4;          //!< Minimum token bucket capacity of a session
+
+    /**
+     *  This is the report of a session
+     */
+    typedef struct{
+        QString name;       //!< Session name
+        uchar   devId;      //!< Target device ID
+        bool    ok;         //!< The download has been successfully completed
+        QString error;      //!< Error description
+        canFirmwareDownload::FW_STATISTICS_t statistics; //!< Download statistics
+    }SESSION_REPORT_t;
+
+    bool addSession(canBootloaderProtocol* board, QString name, QString filename, uint address = 0);
+    bool addSession(canFirmwareDownload* engine, QString name, double rate = 0);
+    void setGlobalBudget(int frames_per_second);
+
+    bool start(void);
+    void abort(void);
+
+    _inline bool isRunning(void) {return running;} //!< Test if the update is in progress
+    QList<SESSION_REPORT_t> getReport(void);
+    QString getReportStr(void);
+
+signals:
+    void updateProgress(int percent); //!< Emitted when a page of any session has been verified
+    void updateCompleted(bool ok, QString report); //!< Emitted when all the sessions are terminated
+
+private slots:
+    void tickEvent(void);
+    void sessionProgress(int percent, uint bytes, double throughput);
+    void sessionCompleted(bool ok, QString error);
+
+private:
+
+    /**
+     *  This is a download session
+     */
+    typedef struct{
+        canFirmwareDownload* engine;    //!< Download engine
+        QString name;                   //!< Session name
+        double  rate;                   //!< Fixed session rate in blocks per second (0 = fair share)
+        double  tokens;                 //!< Session token bucket
+        bool    done;                   //!< The session is terminated
+        bool    ok;                     //!< Session result
+        QString error;                  //!< Session error description
+    }SESSION_t;
+
+    QList<SESSION_t> sessions;  //!< Download sessions
+    int     budget;             //!< Global budget in blocks per second
+    double  globalTokens;       //!< Global token bucket
+    int     rrIndex;            //!< First session of the next sending cycle
+    bool    running;            //!< The update is in progress
+    QTimer  tick;               //!< Sending cycle timer
+    QElapsedTimer clock;        //!< Update time base
+    qint64  lastTick;           //!< Time of the last sending cycle
+    qint64  elapsed;            //!< Total update time in ms
+
+    int  findSession(QObject* engine);
+    void finish(void);
+};
+
+
+
+
+#endif // CAN_FIRMWARE_ORCHESTRATOR_H
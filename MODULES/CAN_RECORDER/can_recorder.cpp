@@ -0,0 +1,467 @@
+#include "can_recorder.h"
+
+/**
+ * This is the class constructor.
+ *
+ * @param
+ * - basename: this is the log base name (path included):
+ *   the segments are named BASENAME.NNN.canlog;
+ * - parent: this is the QObject parent;
+ */
+canRecorder::canRecorder(QString basename, QObject* parent):QObject(parent)
+{
+    this->basename = basename;
+    segmentSize = CAN_LOG_DEFAULT_SEGMENT_SIZE;
+    recording.storeRelaxed(0);
+    current.file = nullptr;
+    next.file = nullptr;
+    segmentCount = 0;
+    startEpoch = 0;
+    startTime = 0;
+    frames = 0;
+    dropped = 0;
+    overflowBase = 0;
+    maintenance_pending = false;
+    unassigned.storeRelaxed(0);
+    drain_pending.storeRelaxed(0);
+
+    for(int i=0; i<CAN_RECORDER_MAX_TAPS; i++){
+        tapThreads[i].storeRelaxed(nullptr);
+        rings[i] = new canFrameRing(CAN_RECORDER_RING_SIZE);
+    }
+}
+
+canRecorder::~canRecorder()
+{
+    stop();
+    for(int i=0; i<CAN_RECORDER_MAX_TAPS; i++) delete rings[i];
+}
+
+/**
+ * This function returns the file name of a log segment.
+ *
+ * @param
+ * - basename: this is the log base name;
+ * - segment: this is the segment index;
+ *
+ * @return BASENAME.NNN.canlog
+ */
+QString canRecorder::segmentName(QString basename, int segment)
+{
+    return QString("%1.%2.canlog").arg(basename).arg(segment, 3, 10, QChar('0'));
+}
+
+/**
+ * This function sets the size of the segments created from now on.
+ *
+ * @param size this is the segment size in bytes (minimum CAN_LOG_MIN_SEGMENT_SIZE)
+ */
+void canRecorder::setSegmentSize(qint64 size)
+{
+    if(size < CAN_LOG_MIN_SEGMENT_SIZE) size = CAN_LOG_MIN_SEGMENT_SIZE;
+    segmentSize = size;
+}
+
+/**
+ * This function starts a new recording.
+ *
+ * A running recording is stopped first: the segments of a previous
+ * recording with the same base name are overwritten.
+ *
+ * The first segment and the next one are created and mapped
+ * before to enable the recording.
+ *
+ * @return false if the segments cannot be created
+ */
+bool canRecorder::start(void)
+{
+    stop();
+
+    // The frames tapped after the previous stop are discarded
+    drainRings();
+
+    segmentCount = 0;
+    frames = 0;
+    dropped = 0;
+    overflowBase = ringOverflows();
+    startEpoch = QDateTime::currentMSecsSinceEpoch();
+    startTime = canClient::timestamp();
+
+    if(!createSegment(segmentCount++, &current)) return false;
+    if(!createSegment(segmentCount++, &next)){
+        closeSegment(&current, false);
+        return false;
+    }
+
+    recording.storeRelease(1);
+    return true;
+}
+
+/**
+ * This function stops the recording.
+ *
+ * The frames still in the rings are recorded, then the written segments
+ * are truncated to their valid length and closed;
+ * the prepared segment not yet used is removed.
+ */
+void canRecorder::stop(void)
+{
+    recording.storeRelease(0);
+    if(current.file) drainRings();
+
+    while(!retired.isEmpty()){
+        CAN_LOG_SEGMENT_t segment = retired.takeFirst();
+        closeSegment(&segment, true);
+    }
+    closeSegment(&current, true);
+    closeSegment(&next, false);
+}
+
+/**
+ * This function returns the number of discarded frames
+ * of the current recording.
+ */
+ulong canRecorder::getDroppedFrames(void)
+{
+    return dropped + (ringOverflows() - overflowBase);
+}
+
+/**
+ * This function returns the total number of frames discarded by the taps:
+ * the overflows of the rings and the frames of the threads with no ring.
+ */
+ulong canRecorder::ringOverflows(void)
+{
+    ulong count = unassigned.loadRelaxed();
+    for(int i=0; i<CAN_RECORDER_MAX_TAPS; i++) count += rings[i]->getOverflows();
+    return count;
+}
+
+/**
+ * This function records a frame.
+ *
+ * The function is called by the connection thread (see canFrameTap):
+ * the frame is copied in the ring of the calling thread, with no locks
+ * and no file operations, and a drain request is posted to the recorder thread
+ * only if the previous request has not been yet served.
+ */
+void canRecorder::tapFrame(uchar direction, uint canId, const uchar* data, int len, qint64 time)
+{
+    if(!recording.loadAcquire()) return;
+    if((len < 0) || (len > canClient::CAN_MAX_PAYLOAD)) return;
+
+    canFrameRing* ring = tapRing();
+    if(ring == nullptr){
+        unassigned.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    canFrameRing::CAN_RING_FRAME_t item;
+    item.rxTime = time;
+    item.canId = canId;
+    item.len = (uchar) len;
+    item.async = direction;
+    if(len) memcpy(item.d, data, len);
+
+    if(!ring->push(&item)) return;
+
+    if(drain_pending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drainRings", Qt::QueuedConnection);
+}
+
+/**
+ * This function returns the ring of the calling connection thread.
+ *
+ * A free ring is assigned to the thread at its first frame:
+ * every ring has a single producer.
+ *
+ * @return the ring or nullptr if all the rings are assigned to other threads
+ */
+canFrameRing* canRecorder::tapRing(void)
+{
+    QThread* thread = QThread::currentThread();
+
+    for(int i=0; i<CAN_RECORDER_MAX_TAPS; i++){
+        QThread* owner = tapThreads[i].loadAcquire();
+        if(owner == thread) return rings[i];
+        if(owner != nullptr) continue;
+        if(tapThreads[i].testAndSetOrdered(nullptr, thread)) return rings[i];
+    }
+
+    return nullptr;
+}
+
+/**
+ * This is the drain request of the rings, executed in the recorder thread.
+ *
+ * The frames are read in batches and written to the current segment:
+ * without a current segment (recording stopped) the frames are discarded.
+ */
+void canRecorder::drainRings(void)
+{
+    canFrameRing::CAN_RING_FRAME_t batch[canFrameParser::RX_BATCH_SIZE];
+    int n;
+
+    // The request is cleared before the reading:
+    // a frame added during the reading posts a new request
+    drain_pending.fetchAndStoreOrdered(0);
+
+    for(int i=0; i<CAN_RECORDER_MAX_TAPS; i++){
+        while((n = rings[i]->pop(batch, canFrameParser::RX_BATCH_SIZE))){
+            if(current.file == nullptr) continue;
+            for(int j=0; j<n; j++) writeRecord(&batch[j]);
+        }
+    }
+}
+
+/**
+ * This function writes a record in the current segment.
+ *
+ * The segment length is updated only when the record is complete.
+ *
+ * When the current segment is full the prepared segment becomes the current one
+ * and a separate request closes the full segment and prepares a new one,
+ * so the file operations don't delay the rings reading.
+ *
+ * @param frame this is the tapped frame
+ */
+void canRecorder::writeRecord(const canFrameRing::CAN_RING_FRAME_t* frame)
+{
+    qint64 needed = CAN_LOG_RECORD_HEADER_SIZE + frame->len;
+    if(current.header->length + needed > current.size){
+        if(next.file == nullptr){
+            // The next segment is not ready: the frame is lost
+            dropped++;
+            return;
+        }
+
+        retired.append(current);
+        current = next;
+        next.file = nullptr;
+
+        if(!maintenance_pending){
+            maintenance_pending = true;
+            QMetaObject::invokeMethod(this, "maintainSegments", Qt::QueuedConnection);
+        }
+    }
+
+    uchar* p = current.base + current.header->length;
+    memcpy(p, &frame->rxTime, 8);
+    memcpy(p + 8, &frame->canId, 4);
+    p[12] = frame->async;
+    p[13] = frame->len;
+    if(frame->len) memcpy(p + CAN_LOG_RECORD_HEADER_SIZE, frame->d, frame->len);
+
+    current.header->length += needed;
+    frames++;
+}
+
+/**
+ * This function is executed in the recorder thread after a segment rotation.
+ *
+ * The full segments are truncated and closed and the next segment is created
+ * and mapped.
+ */
+void canRecorder::maintainSegments(void)
+{
+    maintenance_pending = false;
+
+    while(!retired.isEmpty()){
+        CAN_LOG_SEGMENT_t segment = retired.takeFirst();
+        closeSegment(&segment, true);
+    }
+
+    if((!recording.loadRelaxed()) || (next.file != nullptr)) return;
+
+    int index = segmentCount++;
+    if(!createSegment(index, &next)){
+        qDebug() << "canRecorder: unable to create the segment " << segmentName(basename, index);
+    }
+}
+
+/**
+ * This function creates, preallocates and maps a segment file.
+ *
+ * @param
+ * - index: this is the segment index;
+ * - segment: this is the segment to be initialized;
+ *
+ * @return false if the file cannot be created or mapped
+ */
+bool canRecorder::createSegment(int index, CAN_LOG_SEGMENT_t* segment)
+{
+    QFile* file = new QFile(segmentName(basename, index));
+    if(!file->open(QIODevice::ReadWrite | QIODevice::Truncate)){
+        delete file;
+        return false;
+    }
+
+    uchar* base = nullptr;
+    if(file->resize(segmentSize)) base = file->map(0, segmentSize);
+    if(base == nullptr){
+        file->close();
+        file->remove();
+        delete file;
+        return false;
+    }
+
+    segment->file = file;
+    segment->base = base;
+    segment->size = segmentSize;
+    segment->header = (CAN_LOG_HEADER_t*) base;
+    segment->header->magic = CAN_LOG_MAGIC;
+    segment->header->version = CAN_LOG_VERSION;
+    segment->header->segment = index;
+    segment->header->reserved = 0;
+    segment->header->start_epoch = startEpoch;
+    segment->header->start_time = startTime;
+    segment->header->length = sizeof(CAN_LOG_HEADER_t);
+    return true;
+}
+
+/**
+ * This function unmaps and closes a segment file.
+ *
+ * @param
+ * - segment: this is the segment to be closed (ignored if not used);
+ * - keep: true to truncate the file to the valid length, false to remove the file;
+ */
+void canRecorder::closeSegment(CAN_LOG_SEGMENT_t* segment, bool keep)
+{
+    if(segment->file == nullptr) return;
+
+    qint64 length = segment->header->length;
+    segment->file->unmap(segment->base);
+    if(keep) segment->file->resize(length);
+    else segment->file->remove();
+    segment->file->close();
+
+    delete segment->file;
+    segment->file = nullptr;
+}
+
+/**
+ * This is the class constructor.
+ */
+canLogReader::canLogReader()
+{
+    file = nullptr;
+    base = nullptr;
+    length = 0;
+    offset = 0;
+    segment = 0;
+    startEpoch = 0;
+    startTime = 0;
+}
+
+canLogReader::~canLogReader()
+{
+    close();
+}
+
+/**
+ * This function opens a log.
+ *
+ * @param basename this is the log base name (see canRecorder)
+ * @return false if the first segment is missing or invalid
+ */
+bool canLogReader::open(QString basename)
+{
+    close();
+    this->basename = basename;
+    return openSegment(0);
+}
+
+/**
+ * This function closes the log.
+ */
+void canLogReader::close(void)
+{
+    if(file == nullptr) return;
+
+    file->unmap(base);
+    file->close();
+    delete file;
+    file = nullptr;
+    base = nullptr;
+}
+
+/**
+ * This function maps a segment in read-only mode.
+ *
+ * The segment is accepted only if the header is valid and belongs
+ * to the same recording of the first segment.
+ *
+ * @param index this is the segment index
+ * @return false if the segment is missing or invalid
+ */
+bool canLogReader::openSegment(int index)
+{
+    close();
+
+    file = new QFile(canRecorder::segmentName(basename, index));
+    qint64 size = 0;
+    if(file->open(QIODevice::ReadOnly)) size = file->size();
+    if(size >= (qint64) sizeof(canRecorder::CAN_LOG_HEADER_t)) base = file->map(0, size);
+
+    if(base == nullptr){
+        delete file;
+        file = nullptr;
+        return false;
+    }
+
+    const canRecorder::CAN_LOG_HEADER_t* header = (const canRecorder::CAN_LOG_HEADER_t*) base;
+    bool valid = (header->magic == canRecorder::CAN_LOG_MAGIC) &&
+                 (header->version == canRecorder::CAN_LOG_VERSION) &&
+                 (header->segment == (quint32) index) &&
+                 (header->length >= (qint64) sizeof(canRecorder::CAN_LOG_HEADER_t));
+    if(valid && index){
+        valid = (header->start_epoch == startEpoch) && (header->start_time == startTime);
+    }
+    if(!valid){
+        close();
+        return false;
+    }
+
+    // A segment of an interrupted recording is not truncated: the header length is used
+    length = (header->length < size) ? header->length : size;
+    offset = sizeof(canRecorder::CAN_LOG_HEADER_t);
+    segment = index;
+    startEpoch = header->start_epoch;
+    startTime = header->start_time;
+    return true;
+}
+
+/**
+ * This function reads the next frame of the log.
+ *
+ * The segments are read in sequence: the log ends at the first
+ * missing or invalid segment.
+ *
+ * @param record this is the destination of the frame
+ * @return false at the end of the log
+ */
+bool canLogReader::next(CAN_LOG_RECORD_t* record)
+{
+    while(file){
+        if(offset + canRecorder::CAN_LOG_RECORD_HEADER_SIZE <= length){
+            const uchar* p = base + offset;
+            int len = p[13];
+            if((len <= canClient::CAN_MAX_PAYLOAD) &&
+               (offset + canRecorder::CAN_LOG_RECORD_HEADER_SIZE + len <= length)){
+                memcpy(&record->time, p, 8);
+                memcpy(&record->canId, p + 8, 4);
+                record->direction = p[12];
+                record->len = (uchar) len;
+                if(len) memcpy(record->d, p + canRecorder::CAN_LOG_RECORD_HEADER_SIZE, len);
+
+                offset += canRecorder::CAN_LOG_RECORD_HEADER_SIZE + len;
+                return true;
+            }
+        }
+
+        if(!openSegment(segment + 1)) return false;
+    }
+
+    return false;
+}
@@ -0,0 +1,250 @@
+#ifndef CAN_RECORDER_H
+#define CAN_RECORDER_H
+
+/*!
+ * \defgroup  canRecorderModule Can Traffic Recorder and Replay Library Module.
+ *
+ * This Library Module implements the recording of the CAN traffic
+ * of a canClient connection and its replay.
+ *
+ * # MODULE OVERVIEW
+ *
+ * The canRecorder class taps one or more canClient connections (see canFrameTap)
+ * and writes every sent and received data frame, with its timestamp,
+ * to a compact binary log.
+ *
+ * The canLogReader class reads a recorded log.
+ *
+ * The canReplay class feeds a recorded session back into the reception path
+ * of a canClient (see canClient::injectRxFrame()): the received frames reach
+ * the channels and the protocol objects (canDeviceProtocol, canBootloaderProtocol)
+ * as if they were received from the Can Application Driver:
+ * - at the recorded speed (1x);
+ * - N times faster (Nx);
+ * - as fast as possible: the replay is a realistic throughput benchmark
+ *   of the protocol layer, without the TcpIp connection.
+ *
+ * # LOG FORMAT
+ *
+ * The log is a sequence of segment files: BASENAME.000.canlog, BASENAME.001.canlog, ...
+ *
+ * Every segment is preallocated with canRecorder::setSegmentSize() bytes and
+ * memory mapped (QFile::map()): the frames are appended with a memory copy,
+ * without system calls. When a segment is closed, the file is truncated to
+ * the written length.
+ *
+ * Every segment starts with the header (canRecorder::CAN_LOG_HEADER_t):
+ *
+ *      | MAGIC | VERSION | SEGMENT | RESERVED | LENGTH | START EPOCH | START TIME |
+ *
+ *  Where
+ *  - MAGIC: canRecorder::CAN_LOG_MAGIC (32 bit);
+ *  - VERSION: canRecorder::CAN_LOG_VERSION (32 bit);
+ *  - SEGMENT: segment index, from 0 (32 bit);
+ *  - LENGTH: number of valid bytes of the segment, header included (64 bit);
+ *  - START EPOCH: wall clock time of the recording start in ms since epoch (64 bit);
+ *  - START TIME: canClient::timestamp() of the recording start in ns (64 bit).
+ *
+ * followed by the frame records (canRecorder::CAN_LOG_RECORD_HEADER_SIZE + LEN bytes, host byte order):
+ *
+ *      | TIME (8) | CANID (4) | DIRECTION (1) | LEN (1) | B0 | .. | B(LEN-1) |
+ *
+ *  Where
+ *  - TIME: canClient::timestamp() of the frame in ns;
+ *  - CANID: the 11 or 29 bit canId;
+ *  - DIRECTION: canFrameTap::TAP_TX, canFrameTap::TAP_RX or canFrameTap::TAP_RX_ASYNC;
+ *  - LEN: number of data bytes (0 to canClient::CAN_MAX_PAYLOAD).
+ *
+ * The LENGTH field is updated after every record: a record is valid only when
+ * it is completely written, so a log of a crashed process can be read
+ * up to the last complete frame.
+ *
+ * # TAP AND SEGMENT ROTATION
+ *
+ * The tap is called in the connection thread, so the recording never takes locks
+ * nor performs file operations in the reception path:
+ * - every connection thread owns a preallocated lock-free single-producer/single-consumer
+ *   ring (see canFrameRing), assigned at its first frame (up to canRecorder::CAN_RECORDER_MAX_TAPS threads);
+ * - the tap copies the frame in the ring and posts a single drain request
+ *   to the recorder thread for a burst of frames;
+ * - the recorder thread reads the rings and writes the records to the mapped segment;
+ * - the next segment is created and mapped in advance in the recorder thread;
+ * - when the current segment is full, the recorder switches to the next segment,
+ *   then it closes the full segment and prepares a new one with a separate request;
+ * - the frames of a full ring, of a connection thread with no ring or with
+ *   the next segment not ready are discarded and counted (canRecorder::getDroppedFrames()).
+ *
+ * The records of different connection threads are written in batches,
+ * so they can be out of time order in the log.
+ *
+ * The canRecorder::start(), canRecorder::stop() and canRecorder::setSegmentSize()
+ * functions shall be called in the recorder thread (the thread of the canRecorder object).
+ *
+ * # USAGE
+ *
+ * \code
+ *  canRecorder* recorder = new canRecorder("/tmp/session");
+ *  recorder->start();
+ *  canClient::getSharedClient(ip, port)->setFrameTap(recorder);
+ *  ...
+ *  canClient::getSharedClient(ip, port)->setFrameTap(nullptr);
+ *  recorder->stop();
+ *
+ *  canReplay* replay = new canReplay(canClient::getSharedClient(ip, port));
+ *  replay->open("/tmp/session");
+ *  replay->setSpeed(0); // As fast as possible
+ *  replay->start();
+ * \endcode
+ *
+ * # DEPENDENCES
+ *
+ * This module requires the use of the:
+ *
+ * + canclient.cpp
+ * + canclient.h
+ * + canframetap.h
+ *
+ * \ingroup libraryModules
+ */
+
+#include <QtCore>
+#include <QFile>
+#include "canclient.h"
+#include "canframering.h"
+
+/**
+ * @brief This class records the CAN traffic to memory mapped log segments
+ *
+ * See the canRecorderModule for the log format.
+ *
+ * \ingroup canRecorderModule
+ */
+class canRecorder: public QObject, public canFrameTap
+{
+    Q_OBJECT
+
+public:
+    explicit canRecorder(QString basename, QObject* parent = nullptr);
+    ~canRecorder();
+
+    static const quint32 CAN_LOG_MAGIC = 0x474F4C43;        //!< Log segment identifier ("CLOG")
+    static const quint32 CAN_LOG_VERSION = 1;               //!< Log format version
+    static const int     CAN_LOG_RECORD_HEADER_SIZE = 14;   //!< Size of the record header (TIME, CANID, DIRECTION, LEN)
+    static const qint64  CAN_LOG_DEFAULT_SEGMENT_SIZE = 16 * 1024 * 1024; //!< Default size of a segment in bytes
+    static const qint64  CAN_LOG_MIN_SEGMENT_SIZE = 4096;   //!< Minimum size of a segment in bytes
+    static const int     CAN_RECORDER_MAX_TAPS = 4;         //!< Maximum number of tapped connection threads
+    static const uint    CAN_RECORDER_RING_SIZE = 4096;     //!< Number of frames of the ring of a connection thread
+
+    /**
+     *  This is the header of a log segment
+     */
+    typedef struct{
+        quint32 magic;          //!< CAN_LOG_MAGIC
+        quint32 version;        //!< CAN_LOG_VERSION
+        quint32 segment;        //!< Segment index
+        quint32 reserved;       //!< Reserved (0)
+        qint64  length;         //!< Valid bytes of the segment, header included
+        qint64  start_epoch;    //!< Wall clock time of the recording start (ms since epoch)
+        qint64  start_time;     //!< canClient::timestamp() of the recording start (ns)
+    }CAN_LOG_HEADER_t;
+
+    static QString segmentName(QString basename, int segment); //!< Returns the file name of a segment
+
+    void setSegmentSize(qint64 size); //!< Sets the size of the next segments
+    bool start(void);                 //!< Starts a new recording
+    void stop(void);                  //!< Stops the recording and closes the segments
+
+    void tapFrame(uchar direction, uint canId, const uchar* data, int len, qint64 time) override;
+
+    _inline bool   isRecording(void) {return (recording.loadRelaxed() != 0);} //!< Test if the recording is active
+    _inline ulong  getRecordedFrames(void) {return frames;}   //!< Returns the number of recorded frames
+    _inline int    getSegments(void) {return segmentCount;}   //!< Returns the number of created segments
+    ulong getDroppedFrames(void);                             //!< Returns the number of discarded frames
+
+private slots:
+    void drainRings(void);
+    void maintainSegments(void);
+
+private:
+
+    /**
+     *  This is a memory mapped segment
+     */
+    typedef struct{
+        QFile*            file;     //!< Segment file (nullptr if not used)
+        uchar*            base;     //!< Mapped segment
+        CAN_LOG_HEADER_t* header;   //!< Segment header (at the mapped base)
+        qint64            size;     //!< Mapped size
+    }CAN_LOG_SEGMENT_t;
+
+    QString basename;               //!< Log base name
+    qint64  segmentSize;            //!< Size of the next segments
+    QAtomicInteger<int> recording;  //!< The recording is active (read by the taps)
+    CAN_LOG_SEGMENT_t current;      //!< Segment being written
+    CAN_LOG_SEGMENT_t next;         //!< Segment prepared in advance
+    QList<CAN_LOG_SEGMENT_t> retired; //!< Full segments waiting to be closed
+    int     segmentCount;           //!< Number of created segments
+    qint64  startEpoch;             //!< Wall clock time of the recording start
+    qint64  startTime;              //!< canClient::timestamp() of the recording start
+    ulong   frames;                 //!< Number of recorded frames
+    ulong   dropped;                //!< Number of frames discarded by the recorder thread
+    ulong   overflowBase;           //!< Ring overflows and unassigned frames at the recording start
+    bool    maintenance_pending;    //!< A maintenance request has been posted to the recorder thread
+    QAtomicPointer<QThread> tapThreads[CAN_RECORDER_MAX_TAPS]; //!< Connection thread of every ring (nullptr if free)
+    canFrameRing* rings[CAN_RECORDER_MAX_TAPS]; //!< Frame rings (the direction is carried in the async field)
+    QAtomicInteger<uint> unassigned;    //!< Frames of the connection threads with no ring
+    QAtomicInteger<uint> drain_pending; //!< A drain request has been posted to the recorder thread
+
+    canFrameRing* tapRing(void);
+    ulong ringOverflows(void);
+    void writeRecord(const canFrameRing::CAN_RING_FRAME_t* frame);
+    bool createSegment(int index, CAN_LOG_SEGMENT_t* segment);
+    void closeSegment(CAN_LOG_SEGMENT_t* segment, bool keep);
+};
+
+/**
+ * @brief This class reads a log recorded by the canRecorder
+ *
+ * The segments are memory mapped in read-only mode and read in sequence.
+ *
+ * \ingroup canRecorderModule
+ */
+class canLogReader
+{
+public:
+    explicit canLogReader();
+    ~canLogReader();
+
+    /**
+     *  This is a recorded frame
+     */
+    typedef struct{
+        qint64 time;        //!< canClient::timestamp() of the frame (ns)
+        uint   canId;       //!< Frame canId
+        uchar  direction;   //!< Frame direction (see canFrameTap::TAP_DIRECTION_t)
+        uchar  len;         //!< Number of data bytes
+        uchar  d[canClient::CAN_MAX_PAYLOAD]; //!< Frame data
+    }CAN_LOG_RECORD_t;
+
+    bool open(QString basename);    //!< Opens the first segment of a log
+    void close(void);               //!< Closes the log
+    bool next(CAN_LOG_RECORD_t* record); //!< Reads the next frame
+
+    _inline qint64 getStartEpoch(void) {return startEpoch;} //!< Returns the wall clock time of the recording start (ms since epoch)
+    _inline qint64 getStartTime(void) {return startTime;}   //!< Returns the canClient::timestamp() of the recording start (ns)
+    _inline int    getSegment(void) {return segment;}       //!< Returns the index of the segment being read
+
+private:
+    QString basename;   //!< Log base name
+    QFile*  file;       //!< Segment being read (nullptr if closed)
+    uchar*  base;       //!< Mapped segment
+    qint64  length;     //!< Valid bytes of the segment
+    qint64  offset;     //!< Read offset in the segment
+    int     segment;    //!< Index of the segment being read
+    qint64  startEpoch; //!< Wall clock time of the recording start
+    qint64  startTime;  //!< canClient::timestamp() of the recording start
+
+    bool openSegment(int index);
+};
+
+#endif // CAN_RECORDER_H
@@ -0,0 +1,144 @@
+#include "can_replay.h"
+
+/**
+ * This is the class constructor.
+ *
+ * @param
+ * - client: this is the connection receiving the replayed frames;
+ * - parent: this is the QObject parent;
+ */
+canReplay::canReplay(canClient* client, QObject* parent):QObject(parent)
+{
+    this->client = client;
+    speed = 1;
+    running = false;
+    pending = false;
+    firstTime = -1;
+    injected = 0;
+    skipped = 0;
+
+    stepTimer.setSingleShot(true);
+    connect(&stepTimer, SIGNAL(timeout()), this, SLOT(replayStep()), Qt::UniqueConnection);
+}
+
+/**
+ * This function opens a recorded log.
+ *
+ * @param basename this is the log base name (see canRecorder)
+ * @return false if the log is missing or invalid
+ */
+bool canReplay::open(QString basename)
+{
+    stop();
+    this->basename = basename;
+    return reader.open(basename);
+}
+
+/**
+ * This function sets the replay speed.
+ *
+ * @param speed this is the time scale factor: 1 for the recorded timing,
+ * N for N times faster, 0 (or negative) for as fast as possible
+ */
+void canReplay::setSpeed(double speed)
+{
+    this->speed = (speed > 0) ? speed : 0;
+}
+
+/**
+ * This function starts the replay from the beginning of the log.
+ *
+ * @return false if the log cannot be opened
+ */
+bool canReplay::start(void)
+{
+    stop();
+    if(!reader.open(basename)) return false;
+
+    running = true;
+    pending = false;
+    firstTime = -1;
+    injected = 0;
+    skipped = 0;
+    clock.start();
+    stepTimer.start(0);
+    return true;
+}
+
+/**
+ * This function stops the replay.
+ */
+void canReplay::stop(void)
+{
+    stepTimer.stop();
+    running = false;
+    pending = false;
+}
+
+/**
+ * This is the scheduling slot of the replay.
+ *
+ * The function injects all the records already due, up to CAN_REPLAY_BATCH records,
+ * then reschedules itself:
+ * - immediately if the batch is completed or in the as fast as possible mode;
+ * - at the due time of the next record in the timed modes.
+ *
+ * The timer has a millisecond resolution: the records due within
+ * CAN_REPLAY_TOLERANCE are injected in advance and the wait is rounded up
+ * to the next millisecond, so the replay never spins on a 0 ms timer.
+ */
+void canReplay::replayStep(void)
+{
+    if(!running) return;
+
+    for(int i=0; i<CAN_REPLAY_BATCH; i++){
+        if(!pending){
+            if(!reader.next(&record)){
+                complete();
+                return;
+            }
+
+            if(record.direction == canFrameTap::TAP_TX){
+                skipped++;
+                continue;
+            }
+
+            pending = true;
+            if(firstTime < 0) firstTime = record.time;
+        }
+
+        if(speed > 0){
+            qint64 due = (qint64) ((double) (record.time - firstTime) / speed);
+            qint64 elapsed = clock.nsecsElapsed();
+            if(due > elapsed + CAN_REPLAY_TOLERANCE){
+                stepTimer.start((int) ((due - elapsed + 999999) / 1000000));
+                return;
+            }
+        }
+
+        inject();
+        pending = false;
+    }
+
+    stepTimer.start(0);
+}
+
+/**
+ * This function injects the current record in the connection.
+ */
+void canReplay::inject(void)
+{
+    QByteArray data((const char*) record.d, record.len);
+    client->injectRxFrame(record.canId, data, (record.direction == canFrameTap::TAP_RX_ASYNC), canClient::timestamp());
+    injected++;
+}
+
+/**
+ * This function terminates the replay at the end of the log.
+ */
+void canReplay::complete(void)
+{
+    running = false;
+    reader.close();
+    emit replayCompleted(injected, clock.nsecsElapsed());
+}
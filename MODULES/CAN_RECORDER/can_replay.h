@@ -0,0 +1,79 @@
+#ifndef CAN_REPLAY_H
+#define CAN_REPLAY_H
+
+#include <QtCore>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "can_recorder.h"
+
+/**
+ * @brief This class replays a recorded session into a canClient
+ *
+ * The received frames of the log (canFrameTap::TAP_RX and canFrameTap::TAP_RX_ASYNC)
+ * are injected in the reception path of the connection with canClient::injectRxFrame():
+ * they are demultiplexed to the channels and decoded by the protocol objects
+ * exactly as the frames received from the Can Application Driver.
+ * The sent frames (canFrameTap::TAP_TX) are not replayed and are only counted.
+ *
+ * The replay speed is set with canReplay::setSpeed():
+ * - 1: the frames are injected with the recorded timing;
+ * - N: the recorded timing is scaled N times faster (or slower if N < 1);
+ * - 0: the frames are injected as fast as possible, in batches of
+ *   CAN_REPLAY_BATCH frames, returning to the event loop between the batches.
+ *
+ * The injected frames are timestamped at the injection time, so the
+ * latency statistics of the channels measure the replay path only.
+ *
+ * The recorded answers are consistent with the protocol state only if
+ * the application repeats the requests of the recorded session:
+ * otherwise the protocol objects discard them as unexpected answers (sequence errors),
+ * but the demultiplexing and the decoding path is still completely exercised.
+ *
+ * \ingroup canRecorderModule
+ */
+class canReplay: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit canReplay(canClient* client, QObject* parent = nullptr);
+    ~canReplay(){};
+
+    static const int CAN_REPLAY_BATCH = 256;    //!< Maximum frames injected before returning to the event loop
+    static const qint64 CAN_REPLAY_TOLERANCE = 1000000; //!< Records due within this time (ns) are injected in advance
+
+    bool open(QString basename);    //!< Opens a recorded log
+    void setSpeed(double speed);    //!< Sets the replay speed (0 = as fast as possible)
+    bool start(void);               //!< Starts the replay from the beginning of the log
+    void stop(void);                //!< Stops the replay
+
+    _inline bool   isRunning(void) {return running;}        //!< Test if the replay is running
+    _inline double getSpeed(void) {return speed;}           //!< Returns the replay speed
+    _inline ulong  getInjectedFrames(void) {return injected;} //!< Returns the number of injected frames
+    _inline ulong  getSkippedFrames(void) {return skipped;}   //!< Returns the number of not replayed (sent) frames
+
+signals:
+    void replayCompleted(ulong frames, qint64 elapsed_ns); //!< Emitted at the end of the log
+
+private slots:
+    void replayStep(void);
+
+private:
+    canClient*      client;     //!< Target connection
+    QString         basename;   //!< Log base name
+    canLogReader    reader;     //!< Log reader
+    QTimer          stepTimer;  //!< Replay scheduling timer
+    QElapsedTimer   clock;      //!< Replay time base
+    double          speed;      //!< Replay speed (0 = as fast as possible)
+    bool            running;    //!< The replay is running
+    bool            pending;    //!< The record is read and waits for its replay time
+    qint64          firstTime;  //!< Timestamp of the first replayed record
+    ulong           injected;   //!< Number of injected frames
+    ulong           skipped;    //!< Number of not replayed frames
+    canLogReader::CAN_LOG_RECORD_t record; //!< Next record to be replayed
+
+    void inject(void);
+    void complete(void);
+};
+
+#endif // CAN_REPLAY_H
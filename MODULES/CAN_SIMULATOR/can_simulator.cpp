@@ -0,0 +1,427 @@
+#include "can_simulator.h"
+#include "can_simulator_device.h"
+#include "canclient.h"
+
+
+/**
+ * This is the class constructor of a client connection.
+ *
+ * The client becomes the parent of the socket.
+ *
+ * @param
+ * - socket: this is the connected socket;
+ * - id: this is the unique client identifier;
+ * - binary_enabled: the binary framing offers are accepted;
+ */
+canSimulatorClient::canSimulatorClient(QTcpSocket* socket, ushort id, bool binary_enabled)
+{
+    this->socket = socket;
+    this->id = id;
+    this->binary_enabled = binary_enabled;
+    binary_version = 0;
+
+    socket->setParent(this);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+    txQueue = new socketTxQueue(socket);
+
+    connect(socket,SIGNAL(disconnected()),this, SLOT(socketDisconnected()),Qt::UniqueConnection);
+    connect(socket,SIGNAL(readyRead()), this, SLOT(socketRxData()),Qt::UniqueConnection);
+}
+
+/**
+ * This function tests if a canId matches an acceptance filter of the client.
+ *
+ * @param canId this is the frame canId
+ * @return true if the client shall receive the frame
+ */
+bool canSimulatorClient::isAccepted(uint canId)
+{
+    for(int i=0; i<filters.size(); i++){
+        if((canId & filters[i].mask) == filters[i].address) return true;
+    }
+    return false;
+}
+
+/**
+ * This function sends a frame to the client,
+ * in binary or ascii format depending on the negotiated framing.
+ *
+ * @param
+ * - canId: this is the frame canId;
+ * - data: this is the frame content (max canClient::CAN_MAX_PAYLOAD bytes);
+ * - async: true for an asynchronous frame;
+ */
+void canSimulatorClient::sendFrame(uint canId, const QByteArray& data, bool async)
+{
+    int len = (data.size() > canClient::CAN_MAX_PAYLOAD) ? canClient::CAN_MAX_PAYLOAD : data.size();
+
+    if(binary_version >= 2){
+        canClient::CAN_BINARY_FD_FRAME_t frame;
+        frame.type = (async) ? canClient::CAN_BINARY_FD_ASYNC_FRAME : canClient::CAN_BINARY_FD_DATA_FRAME;
+        frame.id[0] = (uchar) canId;
+        frame.id[1] = (uchar) (canId >> 8);
+        frame.id[2] = (uchar) (canId >> 16);
+        frame.id[3] = (uchar) (canId >> 24);
+        frame.len = len;
+        memcpy(frame.d, data.constData(), len);
+        txQueue->send((const char*) &frame, canClient::CAN_BINARY_FD_HEADER_SIZE + len);
+        return;
+    }
+
+    // The version 1 frames carry only the standard canId and up to 8 bytes
+    if((binary_version == 1) && (canId < canClient::CAN_ID_TABLE_SIZE) && (len <= 8)){
+        canClient::CAN_BINARY_FRAME_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.type = (async) ? canClient::CAN_BINARY_ASYNC_FRAME : canClient::CAN_BINARY_DATA_FRAME;
+        frame.id[0] = (uchar) canId;
+        frame.id[1] = (uchar) (canId >> 8);
+        frame.len = len;
+        memcpy(frame.d, data.constData(), len);
+        txQueue->send((const char*) &frame, canClient::CAN_BINARY_FRAME_SIZE);
+        return;
+    }
+
+    QString frame = QString("<%1 %2 ").arg((async) ? "A" : "D").arg(canId);
+    for(int i=0; i<len; i++) frame.append(QString("%1 ").arg((unsigned char) data.at(i)));
+    frame.append(">");
+    txQueue->send(frame.toLatin1());
+}
+
+/**
+ * This is the socket reception callback.
+ *
+ * The received frames are decoded with the canFrameParser:
+ * + the acceptance filter frame is acknowledged and the filter is added;
+ * + the binary framing offer is accepted, if enabled;
+ * + the data frames are signaled to the server.
+ */
+void canSimulatorClient::socketRxData()
+{
+    canFrameParser::CAN_RX_FRAME_t batch[canFrameParser::RX_BATCH_SIZE];
+    int free, n;
+
+    while(socket->bytesAvailable()){
+        char* ptr = rxParser.writePointer(&free);
+        if(!free) break;
+        rxParser.commit(socket->read(ptr, free));
+
+        while((n = rxParser.decode(batch, canFrameParser::RX_BATCH_SIZE))){
+            for(int i=0; i<n; i++){
+                const canFrameParser::CAN_RX_FRAME_t* frame = &batch[i];
+
+                switch(frame->type){
+                case canFrameParser::FRAME_FILTER:{
+                    int f;
+                    for(f=0; f<filters.size(); f++){
+                        if((filters[f].mask == frame->mask) && (filters[f].address == frame->canId)) break;
+                    }
+                    if(f == filters.size()) filters.append({frame->mask, frame->canId & frame->mask});
+
+                    // The acknowledge replies the format of the request
+                    if(frame->mask == canClient::CAN_FILTER_EXACT_MASK) txQueue->send(QString("<F %1 >").arg(frame->canId).toLatin1());
+                    else txQueue->send(QString("<F %1 %2 >").arg(frame->mask).arg(frame->canId).toLatin1());
+                    }break;
+
+                case canFrameParser::FRAME_BINARY:
+                    if((!binary_enabled) || (frame->canId < 1) || (frame->canId > canClient::CAN_BINARY_VERSION)) break;
+                    txQueue->send(QString("<B %1 >").arg(frame->canId).toLatin1());
+                    binary_version = frame->canId;
+                    break;
+
+                case canFrameParser::FRAME_DATA:
+                    emit clientFrame(id, frame->canId, QByteArray((const char*) frame->d, frame->len));
+                    break;
+
+                default:
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * This is the socket disconnection callback.
+ */
+void canSimulatorClient::socketDisconnected()
+{
+    emit clientDisconnected(id);
+}
+
+
+/**
+ * This is the class constructor.
+ *
+ * @param
+ * - ipaddress: this is the listening address;
+ * - port: this is the listening port;
+ */
+canSimulatorServer::canSimulatorServer(QHostAddress ipaddress, int port):QTcpServer()
+{
+    localip = ipaddress;
+    localport = port;
+    idseq = 0;
+    binary_enabled = true;
+    latency_min = 0;
+    latency_max = 0;
+    loss_rate = 0;
+    reorder_rate = 0;
+    reorder_delay = 0;
+    memset(&statistics, 0, sizeof(statistics));
+
+    clock.start();
+    deliverTmo.setSingleShot(true);
+    connect(&deliverTmo, SIGNAL(timeout()), this, SLOT(deliverEvent()), Qt::UniqueConnection);
+}
+
+canSimulatorServer::~canSimulatorServer()
+{
+    close();
+}
+
+/**
+ * This function starts the server listening.
+ *
+ * @return true if the server is listening
+ */
+bool canSimulatorServer::Start(void)
+{
+    return listen(localip, localport);
+}
+
+/**
+ * This function adds a virtual device.
+ *
+ * @param device this is the virtual device
+ * @return false if a device with the same ID is already present
+ */
+bool canSimulatorServer::addDevice(canSimulatorDevice* device)
+{
+    if(getDevice(device->getDeviceId())) return false;
+
+    device->setParent(this);
+    devices.append(device);
+    connect(device, SIGNAL(txFrame(uint, QByteArray, bool)), this, SLOT(deviceFrame(uint, QByteArray, bool)), Qt::UniqueConnection);
+    return true;
+}
+
+/**
+ * This function returns a virtual device.
+ *
+ * @param devId this is the device ID
+ * @return the device or nullptr
+ */
+canSimulatorDevice* canSimulatorServer::getDevice(uchar devId)
+{
+    for(int i=0; i<devices.size(); i++){
+        if(devices.at(i)->getDeviceId() == devId) return devices.at(i);
+    }
+    return nullptr;
+}
+
+/**
+ * This function sets the delivery latency.
+ *
+ * Every frame is delivered after a random time between min_ms and max_ms.
+ *
+ * @param
+ * - min_ms: this is the minimum latency in ms;
+ * - max_ms: this is the maximum latency in ms;
+ */
+void canSimulatorServer::setLatency(int min_ms, int max_ms)
+{
+    if(min_ms < 0) min_ms = 0;
+    if(max_ms < min_ms) max_ms = min_ms;
+    latency_min = min_ms;
+    latency_max = max_ms;
+}
+
+/**
+ * This function sets the frame loss probability.
+ *
+ * @param probability this is the loss probability, from 0 to 1
+ */
+void canSimulatorServer::setLossRate(double probability)
+{
+    if(probability < 0) probability = 0;
+    if(probability > 1) probability = 1;
+    loss_rate = probability;
+}
+
+/**
+ * This function sets the frame reordering.
+ *
+ * @param
+ * - probability: this is the probability that a frame is delayed, from 0 to 1;
+ * - delay_ms: this is the additional delay of a reordered frame in ms;
+ */
+void canSimulatorServer::setReorderRate(double probability, int delay_ms)
+{
+    if(probability < 0) probability = 0;
+    if(probability > 1) probability = 1;
+    if(delay_ms < 0) delay_ms = 0;
+    reorder_rate = probability;
+    reorder_delay = delay_ms;
+}
+
+/**
+ * This function seeds the impairments random generator.
+ *
+ * @param seed this is the random seed
+ */
+void canSimulatorServer::setSeed(quint32 seed)
+{
+    random.seed(seed);
+}
+
+/**
+ * This is the incoming connection handler.
+ *
+ * Every connection is handled by a canSimulatorClient.
+ */
+void canSimulatorServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket* socket = new QTcpSocket();
+    if(!socket->setSocketDescriptor(socketDescriptor)){
+        delete socket;
+        return;
+    }
+
+    idseq++;
+    if(!idseq) idseq = 1;
+
+    canSimulatorClient* client = new canSimulatorClient(socket, idseq, binary_enabled);
+    client->setParent(this);
+    clients.append(client);
+
+    connect(client, SIGNAL(clientFrame(ushort, uint, QByteArray)), this, SLOT(clientFrame(ushort, uint, QByteArray)), Qt::UniqueConnection);
+    connect(client, SIGNAL(clientDisconnected(ushort)), this, SLOT(clientDisconnected(ushort)), Qt::UniqueConnection);
+}
+
+/**
+ * This is the client disconnection handler.
+ *
+ * @param id this is the client identifier
+ */
+void canSimulatorServer::clientDisconnected(ushort id)
+{
+    for(int i=0; i<clients.size(); i++){
+        if(clients.at(i)->getId() != id) continue;
+        clients.at(i)->deleteLater();
+        clients.removeAt(i);
+        return;
+    }
+}
+
+/**
+ * This function returns true if a frame shall be discarded by the loss impairment.
+ */
+bool canSimulatorServer::isLost(void)
+{
+    if(loss_rate <= 0) return false;
+    if(random.generateDouble() >= loss_rate) return false;
+
+    statistics.lost_frames++;
+    return true;
+}
+
+/**
+ * This is the handler of a data frame received from a client.
+ *
+ * The frame is handled by the addressed virtual device (if any)
+ * and forwarded to the other clients as on a real bus.
+ *
+ * @param
+ * - id: this is the source client identifier;
+ * - canId: this is the frame canId;
+ * - data: this is the frame content;
+ */
+void canSimulatorServer::clientFrame(ushort id, uint canId, QByteArray data)
+{
+    statistics.rx_frames++;
+    if(isLost()) return;
+
+    for(int i=0; i<devices.size(); i++){
+        if(devices.at(i)->handleFrame(canId, data)) break;
+    }
+
+    enqueue(id, canId, data, false);
+}
+
+/**
+ * This is the handler of a frame sent by a virtual device.
+ */
+void canSimulatorServer::deviceFrame(uint canId, QByteArray data, bool async)
+{
+    enqueue(0, canId, data, async);
+}
+
+/**
+ * This function queues a frame for the delivery, applying the impairments.
+ *
+ * The queue is ordered by delivery time: a delayed frame is overtaken
+ * by the following frames.
+ */
+void canSimulatorServer::enqueue(ushort source, uint canId, const QByteArray& data, bool async)
+{
+    if(isLost()) return;
+
+    PENDING_FRAME_t frame;
+    frame.source = source;
+    frame.canId = canId;
+    frame.async = async;
+    frame.data = data;
+    frame.due = clock.elapsed() + latency_min;
+    if(latency_max > latency_min) frame.due += random.bounded(latency_max - latency_min + 1);
+
+    if((reorder_rate > 0) && (random.generateDouble() < reorder_rate)){
+        frame.due += reorder_delay;
+        statistics.reordered_frames++;
+    }
+
+    int i = pending.size();
+    while((i > 0) && (pending.at(i - 1).due > frame.due)) i--;
+    pending.insert(i, frame);
+
+    armDelivery();
+}
+
+/**
+ * This function starts the timer to the earliest delivery time.
+ */
+void canSimulatorServer::armDelivery(void)
+{
+    if(!pending.size()){
+        deliverTmo.stop();
+        return;
+    }
+
+    qint64 remaining = pending.first().due - clock.elapsed();
+    if(remaining < 0) remaining = 0;
+    deliverTmo.start(remaining);
+}
+
+/**
+ * This is the delivery timer event.
+ *
+ * Every expired frame is sent to all the clients with a matching acceptance filter,
+ * excluding the client that sent the frame.
+ */
+void canSimulatorServer::deliverEvent(void)
+{
+    qint64 now = clock.elapsed();
+
+    while((pending.size()) && (pending.first().due <= now)){
+        PENDING_FRAME_t frame = pending.takeFirst();
+
+        for(int i=0; i<clients.size(); i++){
+            if(clients.at(i)->getId() == frame.source) continue;
+            if(!clients.at(i)->isAccepted(frame.canId)) continue;
+
+            clients.at(i)->sendFrame(frame.canId, frame.data, frame.async);
+            statistics.tx_frames++;
+        }
+    }
+
+    armDelivery();
+}
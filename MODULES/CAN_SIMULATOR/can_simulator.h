@@ -0,0 +1,219 @@
+#ifndef CAN_SIMULATOR_H
+#define CAN_SIMULATOR_H
+
+/*!
+ * \defgroup  canSimulatorModule Can Driver Simulator Library Module.
+ *
+ * This Library Module implements a local simulator of the CAN Application Driver.
+ *
+ * # MODULE OVERVIEW
+ *
+ * The simulator allows to load-test the CAN stack (canClient, canDeviceProtocol,
+ * canBootloaderProtocol and the applications based on them) without a real CAN network.
+ *
+ * The canSimulatorServer class:
+ * - listens to the CAN Application Driver address (by default 127.0.0.1:10001);
+ * - accepts many clients at the same time;
+ * - implements the canClientModule protocol:
+ *   the acceptance filter frames <F address > and <F mask address >, the data frames <D canId B0 .. B7 >
+ *   and <A canId B0 .. B7 > (29 bit canId and up to 64 data bytes),
+ *   the binary framing negotiation (<B 1 > and <B 2 >) and the binary frames of both versions;
+ * - hosts many virtual devices (see canSimulatorDevice) answering to the
+ *   Device protocol and to the Bootloader protocol;
+ * - forwards the frames of a client to the other clients with a matching
+ *   acceptance filter, as for a real bus;
+ * - injects configurable latency, loss and reordering of the frames.
+ *
+ * # IMPAIRMENTS
+ *
+ * The impairments are applied to every frame delivered to the clients:
+ * - latency: every frame is delayed by a random time between the min and max latency;
+ * - reordering: a frame is delayed by an additional time with the given probability,
+ *   so the following frames overtake it;
+ * - loss: a frame (delivered to a client or received from a client) is discarded
+ *   with the given probability.
+ *
+ * The random generator can be seeded (canSimulatorServer::setSeed()) to get repeatable tests.
+ *
+ * The binary framing can be disabled (canSimulatorServer::setBinaryFraming()):
+ * the offers of the clients are ignored and the clients keep the ascii format.
+ *
+ * # USAGE
+ *
+ * The simulator can be embedded in a test application:
+ *
+ * \verbatim
+    int main(int argc, char *argv[])
+    {
+        QCoreApplication a(argc, argv);
+
+        canSimulatorServer* server = new canSimulatorServer(QHostAddress(QHostAddress::LocalHost), 10001);
+        server->addDevice(new canSimulatorDevice(0x11, 8, 8, 16));
+        server->addDevice(new canSimulatorDevice(0x12, 8, 8, 16));
+        server->setLatency(1, 3);
+        server->setLossRate(0.001);
+        server->Start();
+
+        return a.exec();
+    }
+   \endverbatim
+ *
+ * # DEPENDENCES
+ *
+ * This module requires the use of the:
+ *
+ * + canframeparser.cpp
+ * + canframeparser.h
+ * + canclient.h
+ * + canlatencyhistogram.h
+ * + sockettxqueue.cpp
+ * + sockettxqueue.h
+ * + can_device_protocol.h
+ * + can_bootloader_protocol.h
+ * + can_firmware_download.cpp
+ * + can_firmware_download.h
+ *
+ * \ingroup libraryModules
+ */
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include "canframeparser.h"
+#include "sockettxqueue.h"
+
+class canSimulatorDevice;
+
+/**
+ * @brief This class implements a client connection of the simulator
+ *
+ * \ingroup canSimulatorModule
+ */
+class canSimulatorClient: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit canSimulatorClient(QTcpSocket* socket, ushort id, bool binary_enabled = true);
+    ~canSimulatorClient(){};
+
+    bool isAccepted(uint canId);                         //!< Test if the canId matches an acceptance filter
+    void sendFrame(uint canId, const QByteArray& data, bool async); //!< Sends a frame with the client framing
+
+    _inline ushort getId(void) {return id;}                 //!< Returns the unique client identifier
+    _inline bool isBinaryFraming(void) {return binary_version != 0;} //!< Test if the binary framing is active
+
+signals:
+    void clientFrame(ushort id, uint canId, QByteArray data); //!< Emitted for every data frame received from the client
+    void clientDisconnected(ushort id);                          //!< Emitted when the client disconnects
+
+private slots:
+    void socketRxData();
+    void socketDisconnected();
+
+private:
+    QTcpSocket*     socket;         //!< Client socket
+    socketTxQueue*  txQueue;        //!< Non blocking transmission queue
+    canFrameParser  rxParser;       //!< Streaming parser of the received frames
+    /**
+     *  This is an acceptance filter of the client
+     */
+    typedef struct{
+        uint   mask;    //!< Filter mask
+        uint   address; //!< Filter address
+    }SIM_FILTER_t;
+
+    QList<SIM_FILTER_t> filters;    //!< Acceptance filters of the client
+    bool            binary_enabled; //!< The binary framing offers are accepted
+    uchar           binary_version; //!< Accepted binary framing version (0 = ascii)
+    ushort          id;             //!< Unique client identifier
+};
+
+/**
+ * @brief This class implements the CAN Application Driver simulator
+ *
+ * \ingroup canSimulatorModule
+ */
+class canSimulatorServer: public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit canSimulatorServer(QHostAddress ipaddress, int port = CAN_SIMULATOR_DEFAULT_PORT);
+    ~canSimulatorServer();
+
+    static const int CAN_SIMULATOR_DEFAULT_PORT = 10001; //!< Default CAN Application Driver port
+
+    /**
+     *  This is the simulator statistics
+     */
+    typedef struct{
+        ulong rx_frames;        //!< Frames received from the clients
+        ulong tx_frames;        //!< Frames delivered to the clients
+        ulong lost_frames;      //!< Frames discarded by the loss impairment
+        ulong reordered_frames; //!< Frames delayed by the reordering impairment
+    }CAN_SIMULATOR_STATISTICS_t;
+
+    bool Start(void);                           //!< Starts the server listening
+    bool addDevice(canSimulatorDevice* device); //!< Adds a virtual device (the server becomes its parent)
+    canSimulatorDevice* getDevice(uchar devId); //!< Returns a virtual device
+
+    void setLatency(int min_ms, int max_ms);    //!< Sets the delivery latency range
+    void setLossRate(double probability);       //!< Sets the frame loss probability (0 to 1)
+    void setReorderRate(double probability, int delay_ms); //!< Sets the frame reordering probability and delay
+    void setSeed(quint32 seed);                 //!< Seeds the impairments random generator
+    _inline void setBinaryFraming(bool enable) {binary_enabled = enable;} //!< Enables the binary framing for the next connections
+
+    _inline CAN_SIMULATOR_STATISTICS_t getStatistics(void) {return statistics;} //!< Returns the simulator statistics
+    _inline int getClients(void) {return clients.size();} //!< Returns the number of connected clients
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override; //!< Incoming connection slot
+
+private slots:
+    void clientFrame(ushort id, uint canId, QByteArray data);
+    void clientDisconnected(ushort id);
+    void deviceFrame(uint canId, QByteArray data, bool async);
+    void deliverEvent(void);
+
+private:
+
+    /**
+     *  This is a frame waiting for the delivery
+     */
+    typedef struct{
+        qint64     due;     //!< Delivery time (clock ms)
+        ushort     source;  //!< Source client identifier (0 = virtual device)
+        uint       canId;   //!< Frame canId
+        bool       async;   //!< Asynchronous frame
+        QByteArray data;    //!< Frame data
+    }PENDING_FRAME_t;
+
+    QHostAddress    localip;        //!< Address of the server
+    quint16         localport;      //!< Port of the server
+    ushort          idseq;          //!< Client identifier counter
+    bool            binary_enabled; //!< The binary framing is accepted by the new clients
+
+    QList<canSimulatorClient*>  clients;    //!< Connected clients
+    QList<canSimulatorDevice*>  devices;    //!< Virtual devices
+    QList<PENDING_FRAME_t>      pending;    //!< Frames waiting for the delivery, ordered by delivery time
+    QTimer          deliverTmo;     //!< Timer of the earliest delivery
+    QElapsedTimer   clock;          //!< Delivery time base
+
+    int     latency_min;            //!< Minimum latency in ms
+    int     latency_max;            //!< Maximum latency in ms
+    double  loss_rate;              //!< Frame loss probability
+    double  reorder_rate;           //!< Frame reordering probability
+    int     reorder_delay;          //!< Additional delay of a reordered frame in ms
+    QRandomGenerator random;        //!< Impairments random generator
+    CAN_SIMULATOR_STATISTICS_t statistics; //!< Simulator statistics
+
+    bool isLost(void);
+    void enqueue(ushort source, uint canId, const QByteArray& data, bool async);
+    void armDelivery(void);
+};
+
+#endif // CAN_SIMULATOR_H
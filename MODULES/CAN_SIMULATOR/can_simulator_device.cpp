@@ -0,0 +1,514 @@
+#include "can_simulator_device.h"
+#include "can_firmware_download.h"
+
+
+/**
+ * This is the class constructor.
+ *
+ * All the registers are initialized to 0 and valid.
+ *
+ * @param
+ * - devId: this is the device ID;
+ * - status_registers: this is the number of STATUS registers;
+ * - data_registers: this is the number of DATA registers;
+ * - param_registers: this is the number of PARAMETER registers;
+ * - parent: this is the parent object;
+ */
+canSimulatorDevice::canSimulatorDevice(uchar devId, int status_registers, int data_registers, int param_registers, QObject* parent):QObject(parent)
+{
+    canDeviceProtocolFrame::CAN_REGISTER_t reg;
+    memset(reg.d, 0, 4);
+    reg.valid = true;
+
+    this->devId = devId;
+    revision = reg;
+    errors = reg;
+    for(int i=0; i<status_registers; i++) statusRegisters.append(reg);
+    for(int i=0; i<data_registers; i++) dataRegisters.append(reg);
+    for(int i=0; i<param_registers; i++) paramRegisters.append(reg);
+
+    memset(&command, 0, sizeof(command));
+    command.status = canDeviceProtocolFrame::CAN_COMMAND_EXECUTED;
+    command.valid = true;
+    command_duration = 0;
+    command_b0 = 0;
+    command_b1 = 0;
+    command_error = 0;
+    commandTmo.setSingleShot(true);
+    connect(&commandTmo, SIGNAL(timeout()), this, SLOT(commandTmoEvent()), Qt::UniqueConnection);
+
+    bootloader_present = true;
+    bootloader_running = false;
+    memset(bootloader_rev, 0, sizeof(bootloader_rev));
+    page_address = 0;
+    expected_block = 0;
+    nack_sent = false;
+    ack_interval = 1;
+}
+
+/**
+ * This function handles a frame received from the bus.
+ *
+ * @param
+ * - canId: this is the frame canId;
+ * - data: this is the frame content;
+ *
+ * @return true if the frame is addressed to the device
+ */
+bool canSimulatorDevice::handleFrame(uint canId, const QByteArray& data)
+{
+    if(canId == (uint) (canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId)) return handleDeviceFrame(data);
+    if(canId == (uint) (canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS + devId)) return handleBootloaderFrame(data);
+    return false;
+}
+
+/**
+ * This function sets the application revision (REVISION register).
+ */
+void canSimulatorDevice::setRevision(uchar maj, uchar min, uchar sub)
+{
+    revision.d[0] = maj;
+    revision.d[1] = min;
+    revision.d[2] = sub;
+    revision.d[3] = 0;
+}
+
+/**
+ * This function sets the ERRORS register content.
+ */
+void canSimulatorDevice::setErrors(uchar d0, uchar d1, uchar d2, uchar d3)
+{
+    errors.d[0] = d0;
+    errors.d[1] = d1;
+    errors.d[2] = d2;
+    errors.d[3] = d3;
+}
+
+/**
+ * This function sets a STATUS register content.
+ *
+ * @return false if the register idx is out of range
+ */
+bool canSimulatorDevice::setStatusRegister(uchar idx, uchar d0, uchar d1, uchar d2, uchar d3)
+{
+    if(idx >= statusRegisters.size()) return false;
+    uchar d[4] = {d0, d1, d2, d3};
+    memcpy(statusRegisters[idx].d, d, 4);
+    return true;
+}
+
+/**
+ * This function sets a DATA register content.
+ *
+ * @return false if the register idx is out of range
+ */
+bool canSimulatorDevice::setDataRegister(uchar idx, uchar d0, uchar d1, uchar d2, uchar d3)
+{
+    if(idx >= dataRegisters.size()) return false;
+    uchar d[4] = {d0, d1, d2, d3};
+    memcpy(dataRegisters[idx].d, d, 4);
+    return true;
+}
+
+/**
+ * This function sets a PARAMETER register content.
+ *
+ * @return false if the register idx is out of range
+ */
+bool canSimulatorDevice::setParamRegister(uchar idx, uchar d0, uchar d1, uchar d2, uchar d3)
+{
+    if(idx >= paramRegisters.size()) return false;
+    uchar d[4] = {d0, d1, d2, d3};
+    memcpy(paramRegisters[idx].d, d, 4);
+    return true;
+}
+
+/**
+ * This function returns a register content.
+ *
+ * @param
+ * - regtype: this is the read or write frame code of the register;
+ * - idx: this is the register idx;
+ * - reg: pointer to the returned register;
+ *
+ * @return false if the register doesn't exist
+ */
+bool canSimulatorDevice::getRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, canDeviceProtocolFrame::CAN_REGISTER_t* reg)
+{
+    canDeviceProtocolFrame::CAN_REGISTER_t* pReg = findRegister(regtype, idx);
+    if(!pReg) return false;
+    *reg = *pReg;
+    return true;
+}
+
+/**
+ * This function sets the command execution time.
+ *
+ * @param ms this is the execution time in ms: 0 = the command is completed immediatelly
+ */
+void canSimulatorDevice::setCommandDuration(int ms)
+{
+    command_duration = (ms < 0) ? 0 : ms;
+}
+
+/**
+ * This function sends an asynchronous frame with the device canId.
+ *
+ * @param data this is the frame content
+ */
+void canSimulatorDevice::sendAsync(const QByteArray& data)
+{
+    emit txFrame(canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId, data, true);
+}
+
+/**
+ * This function sets the bootloader presence and revision.
+ */
+void canSimulatorDevice::setBootloader(bool present, uchar maj, uchar min, uchar sub)
+{
+    bootloader_present = present;
+    if(!present) bootloader_running = false;
+    bootloader_rev[0] = maj;
+    bootloader_rev[1] = min;
+    bootloader_rev[2] = sub;
+}
+
+/**
+ * This function sets the number of in order blocks acknowledged by a single Ack.
+ *
+ *      NOTE: the download window (canFirmwareDownload::setWindow()) shall be
+ *      greater than the Ack interval.
+ *
+ * @param blocks this is the number of blocks (minimum 1)
+ */
+void canSimulatorDevice::setBlockAckInterval(int blocks)
+{
+    ack_interval = (blocks < 1) ? 1 : blocks;
+}
+
+/**
+ * This is the default command execution handler.
+ *
+ * The subclass can reimplement the function to simulate the device commands.
+ *
+ * @param
+ * - command: this is the command code;
+ * - params: pointer to the 4 command parameters;
+ * - b0: pointer to the returned result byte 0;
+ * - b1: pointer to the returned result byte 1;
+ *
+ * @return the command error code (canDeviceProtocolFrame::CAN_COMMAND_NO_ERROR if successfull)
+ */
+uchar canSimulatorDevice::executeCommand(uchar command, const uchar* params, uchar* b0, uchar* b1)
+{
+    Q_UNUSED(command);
+    Q_UNUSED(params);
+
+    *b0 = 0;
+    *b1 = 0;
+    return canDeviceProtocolFrame::CAN_COMMAND_NO_ERROR;
+}
+
+/**
+ * This is the command execution timer event: the executing command is completed.
+ */
+void canSimulatorDevice::commandTmoEvent(void)
+{
+    if(command.status != canDeviceProtocolFrame::CAN_COMMAND_EXECUTING) return;
+
+    command.b0 = command_b0;
+    command.b1 = command_b1;
+    command.error = command_error;
+    command.status = (command_error) ? canDeviceProtocolFrame::CAN_COMMAND_ERROR : canDeviceProtocolFrame::CAN_COMMAND_EXECUTED;
+}
+
+/**
+ * This function returns the register addressed by a frame.
+ *
+ * @return the register or nullptr
+ */
+canDeviceProtocolFrame::CAN_REGISTER_t* canSimulatorDevice::findRegister(uchar regtype, uchar idx)
+{
+    switch(regtype){
+    case canDeviceProtocolFrame::READ_REVISION: return &revision;
+    case canDeviceProtocolFrame::READ_ERRORS: return &errors;
+    case canDeviceProtocolFrame::READ_STATUS:
+        if(idx >= statusRegisters.size()) return nullptr;
+        return &statusRegisters[idx];
+    case canDeviceProtocolFrame::READ_DATA:
+    case canDeviceProtocolFrame::WRITE_DATA:
+        if(idx >= dataRegisters.size()) return nullptr;
+        return &dataRegisters[idx];
+    case canDeviceProtocolFrame::READ_PARAM:
+    case canDeviceProtocolFrame::WRITE_PARAM:
+        if(idx >= paramRegisters.size()) return nullptr;
+        return &paramRegisters[idx];
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * This function sends a Device protocol answer.
+ */
+void canSimulatorDevice::sendDeviceAnswer(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* content)
+{
+    emit txFrame(canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId, canDeviceProtocolFrame::toCanData(content), false);
+}
+
+/**
+ * This function answers to a READ_MULTI request with a CAN FD frame.
+ *
+ * Requests with an invalid register type or count, or with a register
+ * out of range, are not answered.
+ */
+void canSimulatorDevice::sendMultiAnswer(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* content)
+{
+    canDeviceProtocolFrame::CAN_MULTI_CONTENT_t multi;
+    canDeviceProtocolFrame::CAN_REGISTER_t* reg;
+
+    multi.regtype = content->d[0];
+    multi.count = content->d[1];
+    if((!multi.count) || (multi.count > canDeviceProtocolFrame::CAN_MULTI_MAX_REGISTERS)) return;
+    if((multi.regtype != canDeviceProtocolFrame::READ_STATUS) && (multi.regtype != canDeviceProtocolFrame::READ_DATA) && (multi.regtype != canDeviceProtocolFrame::READ_PARAM)) return;
+
+    for(int i=0; i<multi.count; i++){
+        readEvent(multi.regtype, content->idx + i);
+        reg = findRegister(multi.regtype, content->idx + i);
+        if(!reg) return;
+        memcpy(multi.d[i], reg->d, 4);
+    }
+
+    emit txFrame(canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId, canDeviceProtocolFrame::toMultiCanData(content, &multi), false);
+}
+
+/**
+ * This function handles a Device protocol frame.
+ *
+ * Frames with wrong length, CRC or register idx are not answered.
+ *
+ * @param data this is the frame content
+ * @return true
+ */
+bool canSimulatorDevice::handleDeviceFrame(const QByteArray& data)
+{
+    QByteArray frame = data;
+    canDeviceProtocolFrame::CAN_FRAME_CONTENT_t content = canDeviceProtocolFrame::toContent(&frame);
+    if(!content.seq) return true;
+
+    canDeviceProtocolFrame::CAN_REGISTER_t* reg;
+    uchar b0, b1, error;
+
+    switch(content.frame_type){
+    case canDeviceProtocolFrame::READ_REVISION:
+    case canDeviceProtocolFrame::READ_ERRORS:
+    case canDeviceProtocolFrame::READ_STATUS:
+    case canDeviceProtocolFrame::READ_DATA:
+    case canDeviceProtocolFrame::READ_PARAM:
+        readEvent(content.frame_type, content.idx);
+        reg = findRegister(content.frame_type, content.idx);
+        if(!reg) return true;
+        memcpy(content.d, reg->d, 4);
+        break;
+
+    case canDeviceProtocolFrame::WRITE_DATA:
+    case canDeviceProtocolFrame::WRITE_PARAM:
+        reg = findRegister(content.frame_type, content.idx);
+        if(!reg) return true;
+        memcpy(reg->d, content.d, 4);
+        writeEvent(content.frame_type, content.idx);
+        emit registerWritten(content.frame_type, content.idx);
+        break;
+
+    case canDeviceProtocolFrame::STORE_PARAMS:
+        break;
+
+    case canDeviceProtocolFrame::READ_MULTI:
+        sendMultiAnswer(&content);
+        return true;
+
+    case canDeviceProtocolFrame::READ_COMMAND:
+        content.idx = command.command;
+        break;
+
+    case canDeviceProtocolFrame::COMMAND_EXEC:
+        if(content.idx == canDeviceProtocolFrame::CAN_ABORT_COMMAND){
+            if(command.status == canDeviceProtocolFrame::CAN_COMMAND_EXECUTING){
+                commandTmo.stop();
+                command.status = canDeviceProtocolFrame::CAN_COMMAND_ERROR;
+                command.error = canDeviceProtocolFrame::CAN_COMMAND_ABORT_CODE;
+            }
+            content.idx = command.command;
+            break;
+        }
+
+        // A command is already executing
+        if(command.status == canDeviceProtocolFrame::CAN_COMMAND_EXECUTING){
+            content.d[0] = canDeviceProtocolFrame::CAN_COMMAND_ERROR;
+            content.d[1] = 0;
+            content.d[2] = 0;
+            content.d[3] = canDeviceProtocolFrame::CAN_COMMAND_BUSY;
+            sendDeviceAnswer(&content);
+            return true;
+        }
+
+        error = executeCommand(content.idx, content.d, &b0, &b1);
+        command.command = content.idx;
+        command.b0 = 0;
+        command.b1 = 0;
+        command.error = 0;
+
+        if(error){
+            command.status = canDeviceProtocolFrame::CAN_COMMAND_ERROR;
+            command.error = error;
+        }else if(command_duration){
+            command.status = canDeviceProtocolFrame::CAN_COMMAND_EXECUTING;
+            command_b0 = b0;
+            command_b1 = b1;
+            command_error = 0;
+            commandTmo.start(command_duration);
+        }else{
+            command.status = canDeviceProtocolFrame::CAN_COMMAND_EXECUTED;
+            command.b0 = b0;
+            command.b1 = b1;
+        }
+        break;
+
+    default:
+        return true;
+    }
+
+    // The COMMAND register content
+    if((content.frame_type == canDeviceProtocolFrame::READ_COMMAND) || (content.frame_type == canDeviceProtocolFrame::COMMAND_EXEC)){
+        content.d[0] = command.status;
+        content.d[1] = command.b0;
+        content.d[2] = command.b1;
+        content.d[3] = command.error;
+    }
+
+    sendDeviceAnswer(&content);
+    return true;
+}
+
+/**
+ * This function sends a Bootloader protocol answer.
+ */
+void canSimulatorDevice::sendBootloaderAnswer(uchar d0, uchar d1, uchar d2, uchar d3, uchar d4, uchar d5, uchar d6, uchar d7)
+{
+    QByteArray frame;
+    frame.append((char) d0);
+    frame.append((char) d1);
+    frame.append((char) d2);
+    frame.append((char) d3);
+    frame.append((char) d4);
+    frame.append((char) d5);
+    frame.append((char) d6);
+    frame.append((char) d7);
+
+    emit txFrame(canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS + devId, frame, false);
+}
+
+/**
+ * This function handles a Bootloader protocol frame.
+ *
+ * @param data this is the frame content
+ * @return true
+ */
+bool canSimulatorDevice::handleBootloaderFrame(const QByteArray& data)
+{
+    if(data.size() != 8) return true;
+    const uchar* d = (const uchar*) data.constData();
+
+    // Firmware download block
+    if(d[0] & canFirmwareDownload::CAN_FW_BLOCK_FRAME){
+        if(!page.size()) return true;
+
+        int seq = d[0] & 0x7F;
+        int blocks = (page.size() + canFirmwareDownload::CAN_FW_BLOCK_SIZE - 1) / canFirmwareDownload::CAN_FW_BLOCK_SIZE;
+        uchar last = (expected_block) ? (expected_block - 1) : 0x7F;
+
+        if((seq == expected_block) && (seq < blocks)){
+            int offset = seq * canFirmwareDownload::CAN_FW_BLOCK_SIZE;
+            int n = page.size() - offset;
+            if(n > canFirmwareDownload::CAN_FW_BLOCK_SIZE) n = canFirmwareDownload::CAN_FW_BLOCK_SIZE;
+            memcpy(page.data() + offset, &d[1], n);
+            expected_block++;
+            nack_sent = false;
+
+            if((!(expected_block % ack_interval)) || (expected_block == blocks))
+                sendBootloaderAnswer(canFirmwareDownload::CAN_FW_BLOCK_FRAME | seq, 0, 0, 0, 0, 0, 0, 0);
+        }else if(seq < expected_block){
+            // Retransmitted block: the last block received in order is acknowledged again
+            if(seq == expected_block - 1) sendBootloaderAnswer(canFirmwareDownload::CAN_FW_BLOCK_FRAME | last, 0, 0, 0, 0, 0, 0, 0);
+        }else if(!nack_sent){
+            nack_sent = true;
+            sendBootloaderAnswer(canFirmwareDownload::CAN_FW_BLOCK_FRAME | last, 1, 0, 0, 0, 0, 0, 0);
+        }
+        return true;
+    }
+
+    switch(d[0]){
+    case canBootloaderProtocol::BOOTLOADER_GET_INFO:
+        sendBootloaderAnswer(canBootloaderProtocol::BOOTLOADER_GET_INFO,
+                             (!bootloader_present) ? canBootloaderProtocol::BOOTLOADER_NOT_PRESENT : ((bootloader_running) ? canBootloaderProtocol::BOOTLOADER_RUNNING : canBootloaderProtocol::BOOTLOADER_NOT_RUNNING),
+                             bootloader_rev[0], bootloader_rev[1], bootloader_rev[2],
+                             revision.d[0], revision.d[1], revision.d[2]);
+        return true;
+
+    case canBootloaderProtocol::BOOTLOADER_START:
+        if(!bootloader_present){
+            sendBootloaderAnswer(canFirmwareDownload::BOOTLOADER_ERROR_FRAME, d[0], 1, 0, 0, 0, 0, 0);
+            return true;
+        }
+        bootloader_running = true;
+        sendBootloaderAnswer(d[0], 0, 0, 0, 0, 0, 0, 0);
+        return true;
+
+    case canBootloaderProtocol::BOOTLOADER_EXIT:
+        bootloader_running = false;
+        page.clear();
+        sendBootloaderAnswer(d[0], 0, 0, 0, 0, 0, 0, 0);
+        return true;
+
+    case canBootloaderProtocol::BOOTLOADER_PAGE_START:
+    {
+        int len = (int) d[5] | ((int) d[6] << 8);
+        if(!bootloader_running){
+            sendBootloaderAnswer(canFirmwareDownload::BOOTLOADER_ERROR_FRAME, d[0], 1, 0, 0, 0, 0, 0);
+            return true;
+        }
+        if((!len) || (len > canFirmwareDownload::CAN_FW_MAX_BLOCKS * canFirmwareDownload::CAN_FW_BLOCK_SIZE)){
+            sendBootloaderAnswer(canFirmwareDownload::BOOTLOADER_ERROR_FRAME, d[0], 2, 0, 0, 0, 0, 0);
+            return true;
+        }
+
+        page_address = (uint) d[1] | ((uint) d[2] << 8) | ((uint) d[3] << 16) | ((uint) d[4] << 24);
+        page = QByteArray(len, (char) 0xFF);
+        expected_block = 0;
+        nack_sent = false;
+        sendBootloaderAnswer(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+        return true;
+    }
+
+    case canBootloaderProtocol::BOOTLOADER_PAGE_CRC:
+    {
+        if(!page.size()){
+            sendBootloaderAnswer(canFirmwareDownload::BOOTLOADER_ERROR_FRAME, d[0], 3, 0, 0, 0, 0, 0);
+            return true;
+        }
+
+        int blocks = (page.size() + canFirmwareDownload::CAN_FW_BLOCK_SIZE - 1) / canFirmwareDownload::CAN_FW_BLOCK_SIZE;
+        ushort crc = canFirmwareDownload::crc16(page);
+        bool ok = (expected_block == blocks) && (crc == ((ushort) d[1] | ((ushort) d[2] << 8)));
+
+        if(ok) flash.insert(page_address, page);
+        page.clear();
+        sendBootloaderAnswer(d[0], (ok) ? 0 : 1, crc & 0xFF, (crc >> 8) & 0xFF, 0, 0, 0, 0);
+        return true;
+    }
+
+    default:
+        sendBootloaderAnswer(canFirmwareDownload::BOOTLOADER_ERROR_FRAME, d[0], 0xFF, 0, 0, 0, 0, 0);
+        return true;
+    }
+}
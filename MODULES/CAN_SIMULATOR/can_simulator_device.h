@@ -0,0 +1,111 @@
+#ifndef CAN_SIMULATOR_DEVICE_H
+#define CAN_SIMULATOR_DEVICE_H
+
+#include <QtCore>
+#include "can_device_protocol.h"
+
+/**
+ * @brief This class implements a virtual device of the CAN simulator
+ *
+ * The virtual device answers to the frames of:
+ * + the Device protocol (canId = canDeviceProtocol::CAN_PROTOCOL_DEVICE_BASE_ADDRESS + devId);
+ * + the Bootloader protocol (canId = canBootloaderProtocol::CAN_BOOTLOADER_DEVICE_BASE_ADDRESS + devId),
+ *   including the firmware download (see canFirmwareDownloadModule).
+ *
+ * # REGISTER MAP
+ *
+ * The device implements the REVISION, ERRORS, COMMAND, STATUS, DATA and PARAMETER
+ * registers of the Device protocol:
+ * + the register content can be set at any time (setStatusRegister(), setDataRegister(), ...);
+ * + the DATA and PARAMETER registers are written by the clients;
+ * + the READ_MULTI requests are answered with a CAN FD frame;
+ * + a frame with a wrong CRC or an out of range idx is not answered.
+ *
+ * The behavior can be scripted subclassing the device:
+ * + canSimulatorDevice::readEvent() is called before the answer to a read request,
+ *   so the register content can be updated (for example a simulated sensor);
+ * + canSimulatorDevice::writeEvent() is called when a register is written;
+ * + canSimulatorDevice::executeCommand() executes a COMMAND_EXEC request:
+ *   the command is answered EXECUTING and it is completed after the
+ *   command duration (canSimulatorDevice::setCommandDuration()).
+ *
+ * The device can send asynchronous frames with canSimulatorDevice::sendAsync().
+ *
+ * # BOOTLOADER
+ *
+ * The bootloader answers to GET_INFO, START and EXIT commands and
+ * receives the firmware pages: the verified pages are stored in the
+ * flash image (canSimulatorDevice::getFlashImage()).
+ *
+ * \ingroup canSimulatorModule
+ */
+class canSimulatorDevice: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit canSimulatorDevice(uchar devId, int status_registers, int data_registers, int param_registers, QObject* parent = nullptr);
+    ~canSimulatorDevice(){};
+
+    _inline uchar getDeviceId(void) {return devId;} //!< Returns the device ID
+    bool handleFrame(uint canId, const QByteArray& data); //!< Handles a frame received from the bus
+
+    void setRevision(uchar maj, uchar min, uchar sub);
+    void setErrors(uchar d0, uchar d1, uchar d2, uchar d3);
+    bool setStatusRegister(uchar idx, uchar d0, uchar d1, uchar d2, uchar d3);
+    bool setDataRegister(uchar idx, uchar d0, uchar d1, uchar d2, uchar d3);
+    bool setParamRegister(uchar idx, uchar d0, uchar d1, uchar d2, uchar d3);
+    bool getRegister(canDeviceProtocolFrame::CAN_FRAME_COMMANDS_t regtype, uchar idx, canDeviceProtocolFrame::CAN_REGISTER_t* reg);
+    void setCommandDuration(int ms);
+    void sendAsync(const QByteArray& data);
+
+    void setBootloader(bool present, uchar maj, uchar min, uchar sub); //!< Sets the bootloader presence and revision
+    _inline bool isBootloaderRunning(void) {return bootloader_running;} //!< Test if the bootloader is running
+    _inline QMap<uint, QByteArray> getFlashImage(void) {return flash;} //!< Returns the verified pages, indexed by address
+    void setBlockAckInterval(int blocks);       //!< Sets the number of in order blocks acknowledged by a single Ack
+
+signals:
+    void txFrame(uint canId, QByteArray data, bool async); //!< Sends a frame to the bus
+    void registerWritten(uchar regtype, uchar idx);          //!< Emitted when a client writes a register
+
+protected:
+    virtual void readEvent(uchar regtype, uchar idx){};     //!< Called before the answer to a read request
+    virtual void writeEvent(uchar regtype, uchar idx){};    //!< Called when a register has been written
+    virtual uchar executeCommand(uchar command, const uchar* params, uchar* b0, uchar* b1); //!< Executes a command: returns the error code
+
+private slots:
+    void commandTmoEvent(void);
+
+private:
+    uchar   devId;              //!< Device ID
+    canDeviceProtocolFrame::CAN_REGISTER_t revision;       //!< Revision register
+    canDeviceProtocolFrame::CAN_REGISTER_t errors;         //!< Errors register
+    canDeviceProtocolFrame::CAN_COMMAND_t  command;        //!< Command register
+    QList<canDeviceProtocolFrame::CAN_REGISTER_t> statusRegisters; //!< Status registers
+    QList<canDeviceProtocolFrame::CAN_REGISTER_t> dataRegisters;   //!< Data registers
+    QList<canDeviceProtocolFrame::CAN_REGISTER_t> paramRegisters;  //!< Parameter registers
+    int     command_duration;   //!< Command execution time in ms
+    QTimer  commandTmo;         //!< Command execution timer
+    uchar   command_b0;         //!< Result byte 0 of the executing command
+    uchar   command_b1;         //!< Result byte 1 of the executing command
+    uchar   command_error;      //!< Error code of the executing command
+
+    bool    bootloader_present; //!< The bootloader is present
+    bool    bootloader_running; //!< The bootloader is running
+    uchar   bootloader_rev[3];  //!< Bootloader revision
+    QMap<uint, QByteArray> flash; //!< Verified pages
+    uint    page_address;       //!< Address of the page being received
+    QByteArray page;            //!< Page being received
+    int     expected_block;     //!< Next expected block of the page
+    bool    nack_sent;          //!< An out of order Ack has been sent for the current gap
+    int     ack_interval;       //!< Number of in order blocks acknowledged by a single Ack
+
+    bool handleDeviceFrame(const QByteArray& data);
+    bool handleBootloaderFrame(const QByteArray& data);
+    canDeviceProtocolFrame::CAN_REGISTER_t* findRegister(uchar regtype, uchar idx);
+    void sendDeviceAnswer(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* content);
+    void sendMultiAnswer(canDeviceProtocolFrame::CAN_FRAME_CONTENT_t* content);
+    void sendBootloaderAnswer(uchar d0, uchar d1, uchar d2, uchar d3, uchar d4, uchar d5, uchar d6, uchar d7);
+};
+
+#endif // CAN_SIMULATOR_DEVICE_H
@@ -0,0 +1,173 @@
+#include "sockettxqueue.h"
+#include <QTimer>
+#include <QElapsedTimer>
+
+/**
+ * This is the class constructor.
+ *
+ * The queue is created as a child of the socket.
+ *
+ * @param
+ * - socket: this is the target socket;
+ * - high_water: this is the high-water mark in bytes;
+ */
+socketTxQueue::socketTxQueue(QTcpSocket* socket, qint64 high_water):QObject(socket)
+{
+    this->socket = socket;
+    write_scheduled = false;
+    congested = false;
+    discarded = 0;
+    high_water_mark = high_water;
+
+    connect(socket,SIGNAL(bytesWritten(qint64)),this,SLOT(socketBytesWritten(qint64)),Qt::UniqueConnection);
+}
+
+/**
+ * This function returns the number of bytes not yet written
+ * to the network: the queued data plus the socket buffer.
+ */
+qint64 socketTxQueue::pending(void)
+{
+    return queue.size() + socket->bytesToWrite();
+}
+
+/**
+ * This function changes the high-water mark.
+ *
+ * @param high_water this is the new high-water mark in bytes
+ */
+void socketTxQueue::setHighWaterMark(qint64 high_water)
+{
+    high_water_mark = high_water;
+    updateBackpressure();
+}
+
+/**
+ * This function evaluates the backpressure status with hysteresis
+ * and emits the socketTxQueue::backpressure() signal when the status changes.
+ */
+void socketTxQueue::updateBackpressure(void)
+{
+    qint64 bytes = pending();
+
+    if((!congested) && (bytes > high_water_mark)){
+        congested = true;
+        emit backpressure(congested);
+    }else if((congested) && (bytes <= high_water_mark / 2)){
+        congested = false;
+        emit backpressure(congested);
+    }
+}
+
+/**
+ * This function queues the data to be sent.
+ *
+ * The function never blocks: the data are written to the socket
+ * in the next event loop cycle, coalesced with any other data
+ * sent in the same cycle.
+ *
+ * @param data the data to be sent
+ * @return
+ * + true: the data are queued;
+ * + false: the data are discarded because the pending data exceed the overflow limit.
+ */
+bool socketTxQueue::send(const QByteArray& data)
+{
+    return send(data.constData(), data.size());
+}
+
+/**
+ * This function queues the data to be sent.
+ *
+ * @param data pointer to the data to be sent
+ * @param len number of bytes
+ * @return true if the data are queued
+ */
+bool socketTxQueue::send(const char* data, qint64 len)
+{
+    if(pending() + len > high_water_mark * OVERFLOW_FACTOR){
+        discarded += len;
+        return false;
+    }
+
+    queue.append(data, len);
+    updateBackpressure();
+
+    if(!write_scheduled){
+        write_scheduled = true;
+        QTimer::singleShot(0, this, SLOT(writePending()));
+    }
+    return true;
+}
+
+/**
+ * This function writes the queued data to the socket.
+ *
+ * The data are written only if the socket buffer is below
+ * socketTxQueue::TX_CHUNK_SIZE: otherwise the data will be written
+ * with the next bytesWritten() socket signal.
+ */
+void socketTxQueue::writePending(void)
+{
+    write_scheduled = false;
+    if(!queue.size()) return;
+    if(socket->state() != QAbstractSocket::ConnectedState) return;
+    if(socket->bytesToWrite() >= TX_CHUNK_SIZE) return;
+
+    socket->write(queue);
+    queue.resize(0);
+}
+
+/**
+ * This is the socket bytesWritten() callback.
+ *
+ * The remaining queued data are written and the backpressure status is updated.
+ */
+void socketTxQueue::socketBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+    writePending();
+    updateBackpressure();
+}
+
+/**
+ * This function discards the queued data.
+ *
+ * It should be used when the connection is lost,
+ * in order to not send old data to a new connection.
+ */
+void socketTxQueue::clear(void)
+{
+    queue.resize(0);
+    updateBackpressure();
+}
+
+/**
+ * This function waits for all the pending data to be written.
+ *
+ * This is the only blocking method of the class.
+ *
+ * @param timeout the maximum waiting time in ms
+ * @return true if all the pending data have been written
+ */
+bool socketTxQueue::flush(int timeout)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    if(socket->state() != QAbstractSocket::ConnectedState) return false;
+
+    if(queue.size()){
+        socket->write(queue);
+        queue.resize(0);
+    }
+
+    while(socket->bytesToWrite()){
+        qint64 remaining = timeout - elapsed.elapsed();
+        if(remaining <= 0) break;
+        if(!socket->waitForBytesWritten(remaining)) break;
+    }
+
+    updateBackpressure();
+    return (socket->bytesToWrite() == 0);
+}
@@ -0,0 +1,88 @@
+#ifndef SOCKETTXQUEUE_H
+#define SOCKETTXQUEUE_H
+
+#include <QObject>
+#include <QTcpSocket>
+
+/**
+ * @brief This class implements a non blocking outbound queue for a TcpIp socket
+ *
+ * The socket senders shall not wait for the data to be written:
+ * a waitForBytesWritten() stalls the whole event loop when the peer is slow.
+ *
+ * The class collects the data to be sent and writes them to the socket
+ * with the following rules:
+ * + the data sent in the same event loop cycle are coalesced in a single socket write;
+ * + the data are written only when the socket buffer is below socketTxQueue::TX_CHUNK_SIZE bytes,
+ *   the remaining data are flushed on the socket bytesWritten() signal;
+ * + when the pending data (queued + socket buffer) exceed the high-water mark
+ *   the backpressure(true) signal is emitted;
+ * + when the pending data fall below the half of the high-water mark
+ *   the backpressure(false) signal is emitted;
+ * + when the pending data exceed the overflow limit the new data are discarded.
+ *
+ * Only the socketTxQueue::flush() method blocks the caller,
+ * waiting for all the pending data to be written.
+ *
+ * # INTERFACE METHODS
+ * + socketTxQueue::send(): queues the data to be sent;
+ * + socketTxQueue::flush(): synchronous flush of the pending data;
+ * + socketTxQueue::clear(): discards the queued data (for example on a disconnection);
+ * + socketTxQueue::pending(): returns the number of bytes not yet written;
+ * + socketTxQueue::isCongested(): returns the current backpressure status;
+ *
+ * # USAGE
+ * \verbatim
+    The queue is child of the socket, so it is destroyed with the socket:
+    txQueue = new socketTxQueue(socket);
+
+    Optionally connect the backpressure signal:
+    connect(txQueue,SIGNAL(backpressure(bool)),this,SLOT(txBackpressure(bool)),Qt::UniqueConnection);
+
+    Send the data:
+    txQueue->send(data);
+   \endverbatim
+ *
+ */
+class socketTxQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit socketTxQueue(QTcpSocket* socket, qint64 high_water = socketTxQueue::DEFAULT_HIGH_WATER);
+    ~socketTxQueue(){};
+
+    static const qint64 DEFAULT_HIGH_WATER = 64 * 1024;   //!< Default high-water mark in bytes
+    static const qint64 OVERFLOW_FACTOR = 16;             //!< The data are discarded above OVERFLOW_FACTOR * high-water mark
+    static const qint64 TX_CHUNK_SIZE = 16 * 1024;        //!< Maximum bytes in the socket buffer before a new write
+
+    bool   send(const QByteArray& data);    //!< Queues the data to be sent
+    bool   send(const char* data, qint64 len); //!< Queues the data to be sent
+    bool   flush(int timeout);              //!< Synchronous flush: waits for all pending data to be written
+    void   clear(void);                     //!< Discards the queued data
+
+    qint64 pending(void);                   //!< Returns the number of bytes not yet written
+    _inline bool   isCongested(void) {return congested;}    //!< Returns the backpressure status
+    _inline qint64 getHighWaterMark(void) {return high_water_mark;} //!< Returns the high-water mark
+    void   setHighWaterMark(qint64 high_water); //!< Changes the high-water mark
+    _inline ulong  getDiscardedBytes(void) {return discarded;} //!< Returns the number of discarded bytes
+
+signals:
+    void backpressure(bool congested);      //!< Emitted when the high-water mark is crossed in both directions
+
+private slots:
+    void writePending(void);                //!< Writes the queued data to the socket
+    void socketBytesWritten(qint64 bytes);  //!< Socket bytesWritten() callback
+
+private:
+    QTcpSocket* socket;         //!< Target socket
+    QByteArray  queue;          //!< Queued data not yet written to the socket
+    bool        write_scheduled;//!< A writePending() is already scheduled in the event loop
+    bool        congested;      //!< Current backpressure status
+    qint64      high_water_mark;//!< High-water mark in bytes
+    ulong       discarded;      //!< Number of discarded bytes
+
+    void updateBackpressure(void);
+};
+
+#endif // SOCKETTXQUEUE_H
@@ -5,6 +5,7 @@
 TcpIpServer::TcpIpServer(QHostAddress ipaddress, int port):QTcpServer()
 {
     socket = nullptr;
+    txQueue = nullptr;
     connection_status = false;
     localip = ipaddress;
     localport = port;
@@ -53,6 +54,9 @@ void TcpIpServer::incomingConnection(qintptr socketDescriptor)
     }
     socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
 
+    // Non blocking transmission queue (child of the socket)
+    txQueue = new socketTxQueue(socket);
+    connect(txQueue,SIGNAL(backpressure(bool)),this,SIGNAL(txBackpressure(bool)),Qt::UniqueConnection);
 
     // Interface signal connection
     connect(socket,SIGNAL(errorOccurred(QAbstractSocket::SocketError)),this,SLOT(socketError(QAbstractSocket::SocketError)),Qt::UniqueConnection);
@@ -75,6 +79,7 @@ void TcpIpServer::disconnected()
     socket->close();
     socket->deleteLater();
     socket = nullptr; // Consente di poter accettare un nuovo client
+    txQueue = nullptr;
 }
 
 
@@ -97,12 +102,20 @@ void TcpIpServer::socketRxData()
 }
 
 
-void TcpIpServer::txData(QByteArray data, long timeout)
+bool TcpIpServer::txData(QByteArray data, long timeout)
 {
-    if( connection_status == false) return;
-    if( socket == nullptr) return;
-    socket->write(data);
-    socket->waitForBytesWritten(timeout);
+    Q_UNUSED(timeout);
+    if( connection_status == false) return false;
+    if( socket == nullptr) return false;
+    return txQueue->send(data);
+}
+
+
+bool TcpIpServer::txFlush(long timeout)
+{
+    if( connection_status == false) return false;
+    if( socket == nullptr) return false;
+    return txQueue->flush(timeout);
 }
 
 
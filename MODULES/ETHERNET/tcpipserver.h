@@ -5,6 +5,7 @@
 #include <QTcpSocket>
 #include <QHostAddress>
 #include <QNetworkInterface>
+#include "sockettxqueue.h"
 
 /**
  * @brief This class handles Tcp Ip server connections
@@ -19,7 +20,8 @@
  *
  * # INTERFACE METHODS
  * The class implements the following methods to operate:
- * + TcpIpServer::txData(): sends data to the client;
+ * + TcpIpServer::txData(): sends data to the client (non blocking);
+ * + TcpIpServer::txFlush(): waits for the pending tx data to be written;
  * + TcpIpServer::rxData() signal: reception data signal;
  * + TcpIpServer::localPort() : returns the port binded;
  * + TcpIpServer::localAddress() : returns the IP address of the used network;
@@ -76,17 +78,24 @@ public:
     int _inline localPort(){return localport;} //!< Returns the port binded
     QHostAddress _inline localAddress(){return localip;} //!< returns the IP Address binded
     bool _inline isConnected(void) {return connection_status;} //!< Returns the crrent connction status
+    bool txFlush(long timeout = TcpIpServer::_DEFAULT_TX_TIMEOUT); //!< Synchronous flush of the pending tx data
 
 public slots:
     /**
      * @brief Tx Data sending method
+     *
+     * The data are queued in a non blocking socketTxQueue:
+     * use TcpIpServer::txFlush() to wait for the data to be written.
+     *
      * @param data
      * QByteArray data to be sent
      * @param timeout
-     * (optionnal) is the tx waiting time in ms.
-     * The default is TcpIpServer::_DEFAULT_TX_TIMEOUT
+     * (optionnal) deprecated and not used: kept for compatibility.
+     * @return
+     * + true: the data are queued;
+     * + false: the client is not connected or the data are discarded (tx queue overflow).
      */
-    void txData(QByteArray data, long timeout = TcpIpServer::_DEFAULT_TX_TIMEOUT);
+    bool txData(QByteArray data, long timeout = TcpIpServer::_DEFAULT_TX_TIMEOUT);
 
 
 protected:
@@ -94,6 +103,7 @@ protected:
 
 signals:
     void serverConnection(bool status);//!< signal for connection change state
+    void txBackpressure(bool congested); //!< signals the tx queue crossing the high-water mark
     void rxData(QByteArray data); //!< signals for reception data handling
 
 private slots:
@@ -105,6 +115,7 @@ private slots:
 private:
     bool connection_status;     //!< Connection status
     QTcpSocket*  socket;        //!< Socket pointer
+    socketTxQueue* txQueue;     //!< Non blocking transmission queue
     QHostAddress localip;       //!< Address of the local server
     quint16      localport;     //!< Port of the local server
 };
@@ -1,6 +1,4 @@
 #include "device.h"
-#include <QTimer>
-#include <QTimerEvent>
 
 Device::Device(ushort canAddr, QString IP, uint port)
 {
@@ -14,6 +12,7 @@ Device::Device(ushort canAddr, QString IP, uint port)
     connect(socket,SIGNAL(errorOccurred(QAbstractSocket::SocketError)),this,SLOT(socketError(QAbstractSocket::SocketError)),Qt::UniqueConnection);
     connect(socket,SIGNAL(readyRead()), this,SLOT(socketRxData()),Qt::UniqueConnection);
     connect(socket,SIGNAL(disconnected()),this,SLOT(socketDisconnected()),Qt::UniqueConnection);
+    txQueue = new socketTxQueue(socket);
 
     this->canId = canAddr;
     configuredCanId = 0;
@@ -32,12 +31,30 @@ Device::Device(ushort canAddr, QString IP, uint port)
     // Data registers instance
     dataRegisters.append(canRegister(_D_RESERVED));
 
-    txCanTimeout = 0;
-    tx_pending = false;
     rx_err_cnt = 0;
 
+    // Streaming decoder of the legacy framing
+    rxParser.setLegacyFraming(true);
+
+    // Pipelined transactions
+    pipelineWindow = DEVICE_DEFAULT_WINDOW;
+    sequence = 0;
+    for(int i=0; i<256; i++){
+        transactions[i].status = TRANSACTION_FREE;
+        transactions[i].poll = -1;
+        transactions[i].caller_seq = 0;
+    }
+    clock.start();
+    rxTmo.setSingleShot(true);
+    connect(&rxTmo, SIGNAL(timeout()), this, SLOT(rxTmoEvent()), Qt::UniqueConnection);
+
+    // Status polling
+    for(int i=0; i<statusRegisters.size(); i++) pollPending.append(false);
+    connect(&pollTmo, SIGNAL(timeout()), this, SLOT(pollTmoEvent()), Qt::UniqueConnection);
+
     deviceConnected = false;
-    heartbeatTimer = 0;
+    heartbeatTmo.setSingleShot(true);
+    connect(&heartbeatTmo, SIGNAL(timeout()), this, SLOT(heartbeatTmoEvent()), Qt::UniqueConnection);
 }
 
 Device::~Device()
@@ -88,6 +105,8 @@ void Device::socketConnected()
     // Connessione avvenuta
     connectionStatus=true;
     socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+    txQueue->clear();
+    rxParser.reset();
 
     // Send the configuration command
     configClient(canId);
@@ -103,7 +122,8 @@ void Device::verifyRevisionCommand(void){
        qDebug() << "DEVICE CONNECTED: " << maj << min << sub;
 
     }else {
-        readDeviceRevision();
+        // A new request only when the previous one is completed
+        if(!getPendingTransactions()) readDeviceRevision();
         QTimer::singleShot(20,this,SLOT(verifyRevisionCommand()));
     }
 }
@@ -123,6 +143,7 @@ void Device::verifyClientConfiguration(void){
 void Device::socketDisconnected()
 {
     connectionStatus=false;
+    abortTransactions();
     canDriverReady(false);
     socket->connectToHost(serverip, serverport);
 }
@@ -134,6 +155,7 @@ void Device::socketError(QAbstractSocket::SocketError error)
     if(connectionStatus==true)
     {
         connectionStatus=false;
+        abortTransactions();
         canDriverReady(false);
     }
 
@@ -151,57 +173,100 @@ void Device::socketError(QAbstractSocket::SocketError error)
     return;
 }
 
+/**
+ * This is the reception slot of the socket.
+ *
+ * The socket data are read directly into the ring buffer of the canFrameParser:
+ * a reception can contain many frames or a part of a frame.
+ */
 void Device::socketRxData()
 {
-    if(connectionStatus ==false) return;
-    if(socket->bytesAvailable()==0)
-    {
-        return;
-    }
+    canFrameParser::CAN_RX_FRAME_t batch[canFrameParser::RX_BATCH_SIZE];
+    int free;
+    int n;
 
-    rxcanframe = socket->readAll();
-    if(rxcanframe.size()==0)
-    {
+    if(connectionStatus ==false){
+        socket->readAll();
         return;
     }
 
-    // Check the data protocol
-    if(rxcanframe.size() < 3) return;
-    if(rxcanframe.at(0)!='<') return;
-    if(rxcanframe.at(2)!='>') return;
+    while(socket->bytesAvailable()){
+        char* ptr = rxParser.writePointer(&free);
+        if(free) rxParser.commit(socket->read(ptr, free));
+
+        do{
+            n = rxParser.decode(batch, canFrameParser::RX_BATCH_SIZE);
+            for(int i=0; i<n; i++){
+                switch(batch[i].type){
+                case canFrameParser::FRAME_FILTER:
+                    // Configuration
+                    configuredCanId = batch[i].canId;
+                    break;
+                case canFrameParser::FRAME_DATA:
+                    handleRxFrame(batch[i].d);
+                    break;
+                default:
+                    // Heartbeat Packet
+                    break;
+                }
+            }
+        }while(n == canFrameParser::RX_BATCH_SIZE);
+    }
 
-    // Heartbeat Packet
-    if(rxcanframe.at(1) == 'H'){
+    pipelinePump();
+}
 
+/**
+ * This function handles a received protocol frame.
+ *
+ * The frame is matched with the transaction waiting for the answer
+ * with the same sequence number: frames with a wrong CRC or without
+ * a matching transaction are discarded.
+ *
+ * The answer shall have the frame code and the address of the request frame:
+ * otherwise the transaction is completed with _CAN_ERROR_FRAME.
+ *
+ * @param frame the 8 bytes of the protocol frame: SEQ, CODE, ADDRESS, D0..D3, CRC
+ */
+void Device::handleRxFrame(const uchar* frame){
+    uchar crc = 0;
+    for(int i=0; i<8; i++) crc ^= frame[i];
+    if(crc){
+        rx_err_cnt++;    // Wrong CRC
         return;
     }
 
-    // Configuration
-    if(rxcanframe.at(1) == 'C'){
-
-        if(rxcanframe.size() < 5) return;
-        configuredCanId = (rxcanframe.at(3) + 256 * rxcanframe.at(4)) & 0x7FF;
+    uchar seq = frame[0];
+    if(transactions[seq].status != TRANSACTION_SENT){
+        rx_err_cnt++;    // Unexpected sequence
         return;
     }
 
+    // The answer shall match the frame code and the address of the request
+    const QByteArray& request = transactions[seq].frame;
+    if((frame[1] != (uchar) request.at(1)) || (frame[2] != (uchar) request.at(2))){
+        rx_err_cnt++;
+        transactionCompleted(seq, _CAN_ERROR_FRAME);
+        return;
+    }
 
     bool evaluation = false;
 
-    switch(decodeFrame()){
+    switch(frame[1]){
     case _PROTO_READ_STATUS:
-        evaluation = evaluateReadStatusFrame();
+        evaluation = evaluateReadStatusFrame(frame);
         break;
     case _PROTO_WRITE_PARAM:
-        evaluation = evaluateWriteParamFrame();
+        evaluation = evaluateWriteParamFrame(frame);
         break;
     case _PROTO_WRITE_DATA:
-        evaluation = evaluateWriteDataFrame();
+        evaluation = evaluateWriteDataFrame(frame);
         break;
     case _PROTO_STORE_PARAMS:
-        evaluation = evaluateStoreFrame();
+        evaluation = evaluateStoreFrame(frame);
         break;
     case _PROTO_COMMAND_EXEC:
-        evaluation = evaluateCommandFrame();
+        evaluation = evaluateCommandFrame(frame);
         break;
 
     default:
@@ -210,129 +275,264 @@ void Device::socketRxData()
 
     }
 
-    killTimer(txCanTimeout);
-    txCanTimeout = 0;
-    tx_pending = false;
-
     if(evaluation){
-
         // Reset Heartbeat
-        if(heartbeatTimer) killTimer(heartbeatTimer);
-        heartbeatTimer = startTimer(5000);
-
-        tx_error = _CAN_NO_ERROR;
-        canTxRxCompleted(current_sequence, tx_error);
-
+        heartbeatTmo.start(DEVICE_HEARTBEAT_TMO);
+        transactionCompleted(seq, _CAN_NO_ERROR);
     }else{
-        tx_error = _CAN_ERROR_FRAME;
         rx_err_cnt++;
-        canTxRxCompleted(current_sequence, tx_error);
+        transactionCompleted(seq, _CAN_ERROR_FRAME);
     }
-
-    return;
-
 }
 
 QByteArray Device::formatReadStatus(uchar seq, uchar address){
-    QByteArray frame;
-    frame.append(seq);
-    frame.append((uchar) _PROTO_READ_STATUS);
-    frame.append((uchar) address);
-    frame.append((uchar) 0);
-    frame.append((uchar) 0);
-    frame.append((uchar) 0);
-    frame.append((uchar) 0);
-    frame.append((uchar)seq ^ (uchar) _PROTO_READ_STATUS ^ (uchar) address);
-    return frame;
-}
-
-Device::_CanProtocolFrameCode Device::decodeFrame(){
-    if(rxcanframe.size() < 11) return _PROTO_NOT_DEFINED;
-    if(rxcanframe.at(1) != 'D') return _PROTO_NOT_DEFINED;
-
-    uchar crc = 0;
-    for(int i=3; i<11; i++) crc ^= (uchar) rxcanframe.at(i);
-    if(crc) return _PROTO_NOT_DEFINED;     // Wrong CRC
-
-    if(current_sequence != rxcanframe.at(3)) return _PROTO_NOT_DEFINED;
-
-    return (_CanProtocolFrameCode) rxcanframe.at(4);
+    char frame[8] = {(char) seq, (char) _PROTO_READ_STATUS, (char) address, 0, 0, 0, 0,
+                     (char) (seq ^ (uchar) _PROTO_READ_STATUS ^ address)};
+    return QByteArray(frame, 8);
 }
 
-bool Device::evaluateReadStatusFrame(){
+bool Device::evaluateReadStatusFrame(const uchar* frame){
 
-    if(rxcanframe.at(5) >= statusRegisters.size()) return false;
-    statusRegisters[rxcanframe.at(5)].set(rxcanframe[6], rxcanframe[7], rxcanframe[8], rxcanframe[9]);
+    if(frame[2] >= statusRegisters.size()) return false;
+    statusRegisters[frame[2]].set(frame[3], frame[4], frame[5], frame[6]);
     return true;
 }
 
-bool Device::evaluateWriteParamFrame(){
-    if(rxcanframe.at(5) >= paramRegisters.size()) return false;
-    paramRegisters[rxcanframe.at(5)].update(rxcanframe[6], rxcanframe[7], rxcanframe[8], rxcanframe[9]);
+bool Device::evaluateWriteParamFrame(const uchar* frame){
+    if(frame[2] >= paramRegisters.size()) return false;
+    paramRegisters[frame[2]].update(frame[3], frame[4], frame[5], frame[6]);
     return true;
 }
 
-bool Device::evaluateWriteDataFrame(){
-    if(rxcanframe.at(5) >= dataRegisters.size()) return false;
-    dataRegisters[rxcanframe.at(5)].update(rxcanframe[6], rxcanframe[7], rxcanframe[8], rxcanframe[9]);
+bool Device::evaluateWriteDataFrame(const uchar* frame){
+    if(frame[2] >= dataRegisters.size()) return false;
+    dataRegisters[frame[2]].update(frame[3], frame[4], frame[5], frame[6]);
     return true;
 }
 
-bool Device::evaluateStoreFrame(){
+bool Device::evaluateStoreFrame(const uchar* frame){
     return true;
 }
 
-bool Device::evaluateCommandFrame(){
+bool Device::evaluateCommandFrame(const uchar* frame){
     return true;
 }
 
-
-void  Device::timerEvent(QTimerEvent* ev)
+/**
+ * This is the timer event of the earliest transaction deadline:
+ * all the expired transactions are completed with _CAN_ERROR_TMO.
+ */
+void Device::rxTmoEvent(void)
 {
-    if(ev->timerId() == txCanTimeout)
-    {
-        killTimer(txCanTimeout);
-        txCanTimeout = 0;
-        tx_pending = false;
-        tx_error = _CAN_ERROR_TMO;// Timeout
+    qint64 now = clock.elapsed();
+
+    for(int i=0; i<inflightSeq.size(); ){
+        uchar seq = inflightSeq.at(i);
+        if(transactions[seq].deadline > now){
+            i++;
+            continue;
+        }
         rx_err_cnt++;
-        canTxRxCompleted(current_sequence, tx_error);
+        transactionCompleted(seq, _CAN_ERROR_TMO);
     }
 
-    if(ev->timerId() == heartbeatTimer)
-    {
-        killTimer(heartbeatTimer);
-        heartbeatTimer = 0;
-        if(deviceConnected){
-            deviceConnected = false;
-            targetDeviceReady(false);
-        }
+    pipelinePump();
+}
+
+/**
+ * This is the timer event of the heartbeat:
+ * no valid answer has been received for DEVICE_HEARTBEAT_TMO ms.
+ */
+void Device::heartbeatTmoEvent(void)
+{
+    if(deviceConnected){
+        deviceConnected = false;
+        targetDeviceReady(false);
     }
+}
 
+/**
+ * This function sets the number of transactions waiting for the answer.
+ *
+ * @param window 1 to DEVICE_MAX_WINDOW (1 = one transaction at a time)
+ */
+void Device::setPipelineWindow(int window)
+{
+    if(window < 1) window = 1;
+    if(window > DEVICE_MAX_WINDOW) window = DEVICE_MAX_WINDOW;
+    pipelineWindow = window;
+    pipelinePump();
 }
 
+/**
+ * This function activates the periodic reading of all the STATUS registers.
+ *
+ * Every poll period a read transaction is queued for every STATUS register
+ * whose previous polling read is completed: the reads are pipelined,
+ * so all the registers can be read in the same period.
+ *
+ * @param period the poll period in ms (0 = polling disabled)
+ */
+void Device::setStatusPolling(int period)
+{
+    if(period <= 0){
+        pollTmo.stop();
+        return;
+    }
+
+    pollTmo.start(period);
+}
+
+void Device::pollTmoEvent(void)
+{
+    if(!connectionStatus) return;
+
+    for(int i=_S_REVISION; i<statusRegisters.size(); i++){
+        if(pollPending.at(i)) continue;
+
+        uchar seq = queueCanData(formatReadStatus(0, i));
+        if(!seq) return;
+        transactions[seq].poll = i;
+        pollPending[i] = true;
+    }
+}
+
+/**
+ * This function assignes a free sequence number.
+ *
+ * The sequence 0 is never assigned.
+ *
+ * @return the sequence number or 0 if all the sequence numbers are used
+ */
+uchar Device::nextSequence(void)
+{
+    for(int i=0; i<255; i++){
+        sequence++;
+        if(!sequence) sequence = 1;
+        if(transactions[sequence].status == TRANSACTION_FREE) return sequence;
+    }
+    return 0;
+}
+
+/**
+ * This function queues a transaction.
+ *
+ * The sequence number of the frame is replaced on the wire with a free sequence number
+ * (the CRC is updated): the transaction is completed with canTxRxCompleted()
+ * with the original sequence number of the frame.
+ *
+ * @param frame the 8 bytes protocol frame (without the <D> header)
+ * @return the internal sequence number of the transaction or 0 if the transaction is refused
+ */
+uchar Device::queueCanData(QByteArray frame)
+{
+    if(frame.size() < 8) return 0;
+    if(!socket) return 0;
+    if(!connectionStatus) return 0;
+    if(getPendingTransactions() >= DEVICE_MAX_QUEUE) return 0;
+
+    uchar seq = nextSequence();
+    if(!seq) return 0;
+
+    uchar caller_seq = (uchar) frame.at(0);
+    frame.truncate(8);
+    frame[7] = (char) ((uchar) frame.at(7) ^ caller_seq ^ seq);
+    frame[0] = (char) seq;
+
+    transactions[seq].status = TRANSACTION_QUEUED;
+    transactions[seq].poll = -1;
+    transactions[seq].caller_seq = caller_seq;
+    transactions[seq].frame = frame;
+    requestQueue.append(seq);
+
+    pipelinePump();
+    return seq;
+}
+
+/**
+ * This function queues a transaction.
+ *
+ * See Device::queueCanData().
+ *
+ * @param frame the 8 bytes protocol frame (without the <D> header)
+ * @return true if the transaction has been queued
+ */
 bool Device::txCanData(QByteArray frame)
 {
-    if(tx_pending) return false;
-    if(frame.size() < 8) return false;
-    if(!socket) return false;
-    if(!connectionStatus) return false;
+    return (queueCanData(frame) != 0);
+}
 
-    QByteArray data;
-    data.append('<');
-    data.append('D');
-    data.append('>');
-    data.append(frame);
+/**
+ * This function sends the queued transactions up to the pipeline window.
+ */
+void Device::pipelinePump(void)
+{
+    while((inflightSeq.size() < pipelineWindow) && (requestQueue.size())){
+        uchar seq = requestQueue.takeFirst();
+
+        QByteArray data;
+        data.reserve(11);
+        data.append('<');
+        data.append('D');
+        data.append('>');
+        data.append(transactions[seq].frame);
+
+        transactions[seq].status = TRANSACTION_SENT;
+        transactions[seq].deadline = clock.elapsed() + DEVICE_RX_TMO;
+        inflightSeq.append(seq);
+        txQueue->send(data);
+    }
 
-    tx_pending = true;
-    tx_error = _CAN_NO_ERROR;
-    current_sequence = frame.at(0);
+    pipelineArmTimer();
+}
 
-    txCanTimeout = startTimer(50); // Start the timeout timer
-    socket->write(data);
-    socket->waitForBytesWritten(100);
+/**
+ * This function arms the timer to the earliest transaction deadline.
+ */
+void Device::pipelineArmTimer(void)
+{
+    if(!inflightSeq.size()){
+        rxTmo.stop();
+        return;
+    }
 
-    return true;
+    // The transactions are sent in deadline order
+    qint64 wait = transactions[inflightSeq.first()].deadline - clock.elapsed();
+    if(wait < 0) wait = 0;
+    rxTmo.start(wait);
+}
+
+/**
+ * This function completes a transaction and releases its sequence number.
+ *
+ * The canTxRxCompleted() reports the sequence number of the caller frame.
+ *
+ * @param seq the internal sequence number of the transaction
+ * @param error the transaction result
+ */
+void Device::transactionCompleted(uchar seq, _CanTxErrors error)
+{
+    if(transactions[seq].status == TRANSACTION_SENT) inflightSeq.removeOne(seq);
+    else if(transactions[seq].status == TRANSACTION_QUEUED) requestQueue.removeOne(seq);
+    else return;
+
+    if(transactions[seq].poll >= 0) pollPending[transactions[seq].poll] = false;
+    transactions[seq].status = TRANSACTION_FREE;
+    transactions[seq].poll = -1;
+    transactions[seq].frame.clear();
+
+    canTxRxCompleted(transactions[seq].caller_seq, error);
+}
+
+/**
+ * This function completes all the transactions with _CAN_ERROR_NET
+ * when the connection is lost.
+ */
+void Device::abortTransactions(void)
+{
+    while(inflightSeq.size()) transactionCompleted(inflightSeq.first(), _CAN_ERROR_NET);
+    while(requestQueue.size()) transactionCompleted(requestQueue.first(), _CAN_ERROR_NET);
+    rxTmo.stop();
 }
 
 void Device::configClient(ushort canId)
@@ -349,8 +549,7 @@ void Device::configClient(ushort canId)
     data.append((uchar) (canId>>8));
 
 
-    socket->write(data);
-    socket->waitForBytesWritten(100);
+    txQueue->send(data);
 
 }
 
@@ -360,12 +559,7 @@ void Device::readDeviceRevision(void)
     if(!socket) return;
     if(!connectionStatus) return;
 
-    QByteArray data;
-    data.append('<');
-    data.append('D');
-    data.append('>');
-    data.append(formatReadStatus(0, _S_REVISION));
-    txCanData(data);
+    txCanData(formatReadStatus(0, _S_REVISION));
 }
 
 void Device::setDeviceConnection(bool stat)
@@ -373,12 +567,7 @@ void Device::setDeviceConnection(bool stat)
     if(deviceConnected == stat) return;
     deviceConnected = stat;
 
-    if(stat){
-        if(heartbeatTimer) killTimer(heartbeatTimer);
-        heartbeatTimer = startTimer(5000);
-    }else{
-        if(heartbeatTimer) killTimer(heartbeatTimer);
-        heartbeatTimer = 0;
-    }
+    if(stat) heartbeatTmo.start(DEVICE_HEARTBEAT_TMO);
+    else heartbeatTmo.stop();
 }
 
@@ -8,6 +8,10 @@
 #include <QAbstractSocket>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "sockettxqueue.h"
+#include "canframeparser.h"
 
 class canRegister{
 
@@ -66,6 +70,26 @@ public:
 };
 
 
+/**
+ * @brief This class implements the legacy Device connection
+ *
+ * The Device frames are exchanged with the legacy framing
+ * (see the LEGACY FRAMING section of the canFrameParserModule):
+ * + the received stream is decoded by the canFrameParser, so many frames
+ *   in a single reception and frames split between receptions are handled;
+ * + the transactions are pipelined: up to Device::setPipelineWindow() frames
+ *   are sent without waiting for the previous answers and every answer is matched
+ *   with its transaction by the sequence number;
+ * + every transaction has its own deadline (Device::DEVICE_RX_TMO): a single timer
+ *   is armed to the earliest deadline;
+ * + the canTxRxCompleted() is called once for every transaction,
+ *   with the sequence number of the frame passed to Device::queueCanData():
+ *   the sequence number sent to the device is assigned internally;
+ * + the Device::setStatusPolling() reads all the STATUS registers every poll period.
+ *
+ * The target device is considered disconnected if no valid answer is received
+ * for Device::DEVICE_HEARTBEAT_TMO ms.
+ */
 class Device: public QObject
 {
     Q_OBJECT
@@ -74,6 +98,12 @@ public:
     explicit Device(ushort CanId, QString IP, uint port);
     ~Device();
 
+    static const int DEVICE_RX_TMO = 50;                //!< Answer deadline of a transaction in ms
+    static const int DEVICE_DEFAULT_WINDOW = 8;         //!< Default number of transactions waiting for the answer
+    static const int DEVICE_MAX_WINDOW = 32;            //!< Maximum number of transactions waiting for the answer
+    static const int DEVICE_MAX_QUEUE = 128;            //!< Maximum number of queued transactions
+    static const int DEVICE_HEARTBEAT_TMO = 5000;       //!< Maximum time without valid answers in ms
+
     // protocol Implementation
     typedef enum{
         _PROTO_NOT_DEFINED  = 0,
@@ -127,6 +157,11 @@ public:
     int Disconnect(void);
     int Reconnect(void);
 
+    void setPipelineWindow(int window);
+    void setStatusPolling(int period);
+    _inline int  getPendingTransactions(void) {return requestQueue.size() + inflightSeq.size();} //!< Number of transactions not yet completed
+    _inline uint getRxErrors(void) {return rx_err_cnt;} //!< Number of failed transactions and discarded frames
+
 protected:
     ushort canId;
     QList<canRegister> statusRegisters;
@@ -141,10 +176,14 @@ private slots:
     void socketDisconnected(); // IL server ha chiiuso la connessione
     void verifyClientConfiguration(void);
     void verifyRevisionCommand(void);
+    void rxTmoEvent(void);          //!< Deadline of the earliest transaction
+    void heartbeatTmoEvent(void);   //!< No valid answer for DEVICE_HEARTBEAT_TMO ms
+    void pollTmoEvent(void);        //!< Status polling period
 
 protected:
     QByteArray formatReadStatus(uchar seq, uchar address);
     bool txCanData(QByteArray);
+    uchar queueCanData(QByteArray frame);
 
     void setDeviceConnection(bool stat);
 
@@ -154,13 +193,8 @@ protected:
     uchar sub;
 
 private:
-    int heartbeatTimer;
+    QTimer heartbeatTmo;
     bool deviceConnected;
-
-    void  timerEvent(QTimerEvent* ev);
-    int   txCanTimeout;
-    bool  tx_pending;
-    _CanTxErrors tx_error;
     uint rx_err_cnt;
 
 
@@ -168,6 +202,7 @@ private:
     QHostAddress serverip;      // Addrees of the remote server
     quint16      serverport;    // Port of the remote server
     QTcpSocket*  socket;        // Socket for  the ethernet client connection to the can Driver
+    socketTxQueue* txQueue;     // Non blocking transmission queue of the socket
     void clientConnect();       // Try to connect the canDriver
     bool connectionStatus;
 
@@ -179,18 +214,48 @@ private:
     void readDeviceRevision(void);
 
     // Can Protocol Handling
-    QByteArray rxcanframe;
-    QByteArray txcanframe;
-
-
-    _CanProtocolFrameCode decodeFrame(void);
-    bool evaluateReadStatusFrame(void);
-    bool evaluateWriteParamFrame(void);
-    bool evaluateWriteDataFrame(void);
-    bool evaluateStoreFrame(void);
-    bool evaluateCommandFrame(void);
-
-    uchar current_sequence;
+    canFrameParser rxParser;        // Streaming decoder of the received data
+
+    void handleRxFrame(const uchar* frame);
+    bool evaluateReadStatusFrame(const uchar* frame);
+    bool evaluateWriteParamFrame(const uchar* frame);
+    bool evaluateWriteDataFrame(const uchar* frame);
+    bool evaluateStoreFrame(const uchar* frame);
+    bool evaluateCommandFrame(const uchar* frame);
+
+    /**
+     *  This is a transaction
+     */
+    typedef enum{
+        TRANSACTION_FREE = 0,   //!< The sequence number is not used
+        TRANSACTION_QUEUED,     //!< The frame is waiting to be sent
+        TRANSACTION_SENT,       //!< The frame is waiting for the answer
+    }TRANSACTION_STATUS_t;
+
+    typedef struct{
+        TRANSACTION_STATUS_t status; //!< Transaction status
+        qint64     deadline;    //!< Answer deadline (clock ms)
+        short      poll;        //!< Polled STATUS register (-1 if not a polling transaction)
+        uchar      caller_seq;  //!< Sequence number of the caller frame (reported by canTxRxCompleted())
+        QByteArray frame;       //!< Protocol frame (without the <D> header)
+    }TRANSACTION_t;
+
+    TRANSACTION_t transactions[256];    //!< Transactions indexed by sequence number
+    QList<uchar>  requestQueue;         //!< Sequence numbers of the transactions waiting to be sent
+    QList<uchar>  inflightSeq;          //!< Sequence numbers of the transactions waiting for the answer
+    int           pipelineWindow;       //!< Maximum number of transactions waiting for the answer
+    uchar         sequence;             //!< Sequence number iterator
+    QElapsedTimer clock;                //!< Time base of the transaction deadlines
+    QTimer        rxTmo;                //!< Timer of the earliest transaction deadline
+
+    QTimer        pollTmo;              //!< Status polling timer
+    QList<bool>   pollPending;          //!< A polling read of the STATUS register is not yet completed
+
+    uchar nextSequence(void);
+    void  pipelinePump(void);
+    void  pipelineArmTimer(void);
+    void  transactionCompleted(uchar seq, _CanTxErrors error);
+    void  abortTransactions(void);
 };
 
 #endif // DEVICE_H
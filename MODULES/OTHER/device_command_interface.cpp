@@ -48,6 +48,7 @@ void deviceCommandInterface::incomingConnection(qintptr socketDescriptor)
     }
 
     item->socket->setSocketOption(QAbstractSocket::LowDelayOption,1);
+    item->txQueue = new socketTxQueue(item->socket);
     socketList.append(item);
 
 
@@ -127,8 +128,7 @@ void SocketItem::socketTxData(uchar socket_id, QList<QByteArray>  command)
     }
     frame.append(">\n\r");
 
-    this->socket->write(frame);
-    this->socket->waitForBytesWritten(100);
+    this->txQueue->send(frame);
     return;
 
 }
@@ -6,6 +6,7 @@
 #include <QTcpSocket>
 #include <QHostAddress>
 #include <QNetworkInterface>
+#include "sockettxqueue.h"
 
 
 class SocketItem: public QObject
@@ -36,6 +37,7 @@ public slots:
 
 public:
     QTcpSocket* socket;
+    socketTxQueue* txQueue;
     uchar id;
     static uchar idcount;
 